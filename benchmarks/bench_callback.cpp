@@ -0,0 +1,186 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Microbenchmark of the CUPTI callback of the injection part on top of
+// the stub CUPTI library, in nanoseconds per callback:
+// * "outside": a thread outside any region while another thread is in
+//   one, i.e. the early exit taken by threads which are not profiled;
+// * "lookup": the part ID string building and map lookup which every
+//   callback did before the thread state was cached, for comparison;
+// * "inside": a thread in a region, with the events sent by
+//   the flusher running alongside, in the text and binary protocols.
+//
+// Sent messages are discarded.
+
+#include <adaptyst/hw_inject.h>
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <unordered_map>
+#include <cstdlib>
+#include <unistd.h>
+#include "inject_host.hpp"
+#include "stub_cupti.hpp"
+#include "message.hpp"
+#include "microbench.hpp"
+
+extern "C" {
+  int adaptyst_init(amod_t module_id);
+  int adaptyst_region_start(amod_t module_id, const char *part_id,
+                            const char *name, const char *timestamp_str);
+  int adaptyst_region_end(amod_t module_id, const char *part_id,
+                          const char *name, const char *timestamp_str);
+  void adaptyst_close(amod_t module_id);
+}
+
+static const amod_t MODULE_ID{};
+
+static std::string this_part_id() {
+  return std::to_string(getpid()) + "_" + std::to_string(gettid());
+}
+
+// Makes "calls" calls of cudaMemcpy, i.e. twice as many callbacks.
+static void memcpy_calls(std::size_t calls) {
+  for (std::size_t i = 0; i < calls; i++) {
+    for (auto site : { CUPTI_API_ENTER, CUPTI_API_EXIT }) {
+      stub_cupti::api_call(CUPTI_CB_DOMAIN_RUNTIME_API,
+                           CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020, site);
+    }
+  }
+}
+
+static bool init(const std::string &protocol) {
+  inject_host::reset();
+  stub_cupti::reset();
+  inject_host::set_transport([](std::string_view message) {
+    keep(message);
+    return true;
+  }, [protocol](std::string &reply) {
+    reply = "runtime " + protocol;
+    return true;
+  });
+
+  if (adaptyst_init(MODULE_ID) != ADAPTYST_MODULE_OK) {
+    std::cerr << "adaptyst_init() failed: " << inject_host::error()
+              << std::endl;
+    adaptyst_close(MODULE_ID);
+    return false;
+  }
+
+  return true;
+}
+
+// Times the callbacks of a thread outside any region. The callbacks
+// are enabled only while a thread is in a region, so another thread
+// stays in one meanwhile.
+static double outside(std::size_t calls) {
+  if (!init("text")) {
+    return -1;
+  }
+
+  std::atomic<bool> started{false}, done{false};
+
+  std::thread holder([&]() {
+    std::string part_id = this_part_id();
+    adaptyst_region_start(MODULE_ID, part_id.c_str(), "region", "0");
+    started = true;
+
+    while (!done) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    adaptyst_region_end(MODULE_ID, part_id.c_str(), "region", "0");
+  });
+
+  while (!started) {
+    std::this_thread::yield();
+  }
+
+  double ns = -1;
+
+  std::thread([&]() {
+    ns = ns_per_operation(2 * calls, [&]() { memcpy_calls(calls); });
+  }).join();
+
+  done = true;
+  holder.join();
+  adaptyst_close(MODULE_ID);
+  return ns;
+}
+
+// Times what every callback did before this early exit, with
+// "threads" threads in regions.
+static double lookup(std::size_t calls, unsigned int threads) {
+  std::unordered_map<std::string, unsigned int> active_threads;
+
+  for (unsigned int i = 0; i < threads; i++) {
+    active_threads[std::to_string(getpid()) + "_" +
+                   std::to_string(gettid() + 1 + i)] = 1;
+  }
+
+  return ns_per_operation(2 * calls, [&]() {
+    std::size_t found = 0;
+
+    for (std::size_t i = 0; i < 2 * calls; i++) {
+      std::string part_id = std::to_string(getpid()) + "_" +
+        std::to_string(gettid());
+      found += active_threads.find(part_id) != active_threads.end();
+    }
+
+    keep(found);
+  });
+}
+
+// Times the callbacks of a thread in a region, including the time
+// taken by the flusher.
+static double inside(std::size_t calls, const std::string &protocol) {
+  if (!init(protocol)) {
+    return -1;
+  }
+
+  double ns = -1;
+
+  std::thread([&]() {
+    std::string part_id = this_part_id();
+    adaptyst_region_start(MODULE_ID, part_id.c_str(), "region", "0");
+    ns = ns_per_operation(2 * calls, [&]() { memcpy_calls(calls); });
+    adaptyst_region_end(MODULE_ID, part_id.c_str(), "region", "0");
+  }).join();
+
+  adaptyst_close(MODULE_ID);
+  return ns;
+}
+
+int main(int argc, char **argv) {
+  std::size_t calls = argc > 1 ? std::atoll(argv[1]) : 1000000;
+
+  if (calls == 0) {
+    std::cerr << "Usage: " << argv[0] << " [calls (default: 1000000)]"
+              << std::endl;
+    return 2;
+  }
+
+  double results[] = {
+    outside(calls), lookup(calls, 16), inside(calls, "text"),
+    inside(calls, NVGPU_BINARY_PROTOCOL)
+  };
+  const char *names[] = {
+    "outside", "lookup", "inside_text", "inside_binary"
+  };
+
+  std::cout << "callback\tns_per_callback" << std::endl << std::fixed
+            << std::setprecision(1);
+
+  for (std::size_t i = 0; i < 4; i++) {
+    if (results[i] < 0) {
+      return 1;
+    }
+
+    std::cout << names[i] << '\t' << results[i] << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,249 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Benchmark of nvgpu-merge on regions.json files written as by
+// the module with per_process and per_thread set, e.g. by the ranks of
+// an MPI job on different nodes. It prints the time taken by merging
+// all files with 1 thread and with all hardware threads.
+//
+// Every file has 3 regions with a call tree, a summary and a tree of
+// every process and thread, the call trees being random subtrees of
+// a tree of about 2000 call paths. The merged summaries are checked to
+// have all processes.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <thread>
+#include <filesystem>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <nlohmann/json.hpp>
+#include "call_tree.hpp"
+#include "process_summary.hpp"
+
+namespace fs = std::filesystem;
+
+static const char *FUNCTIONS[] = {
+  "cudaLaunchKernel k0", "cudaLaunchKernel k1", "cudaLaunchKernel k2",
+  "cudaMemcpy", "cudaMemcpyAsync", "cudaDeviceSynchronize",
+  "cudaStreamSynchronize", "cudaMalloc", "cudaFree", "cuLaunchKernel",
+  "cuMemcpyHtoD", "cuMemcpyDtoH", "cuCtxSynchronize"
+};
+
+static const std::size_t FUNCTION_COUNT =
+  sizeof(FUNCTIONS) / sizeof(FUNCTIONS[0]);
+
+// Adds the calls made by a process to its tree, with up to 3 levels of
+// nesting and the first 5 functions making nested calls.
+static void add_calls(std::mt19937 &random, CallTree &tree, NameTable &names,
+                      uint32_t parent, int depth) {
+  for (std::size_t i = 0; i < FUNCTION_COUNT; i++) {
+    if (random() % 3 != 0) {
+      continue;
+    }
+
+    uint32_t node = tree.child(parent, names.intern(FUNCTIONS[i]));
+    unsigned long long calls = 1 + random() % 100;
+
+    for (unsigned long long j = 0; j < calls; j++) {
+      tree.add_call(node, 1000 + random() % 100000);
+    }
+
+    if (depth < 3 && i < 5) {
+      add_calls(random, tree, names, node, depth + 1);
+    }
+  }
+}
+
+// Writes a regions.json file of "processes" processes with "threads"
+// threads each, whose PIDs start at "first_pid".
+static bool write_file(const fs::path &path, std::mt19937 &random,
+                       unsigned int processes, unsigned int threads,
+                       unsigned int first_pid) {
+  std::ofstream stream(path);
+  stream << '{';
+
+  for (int region = 0; region < 3; region++) {
+    NameTable names;
+    CallTree total;
+    ProcessSummary summary;
+    std::ostringstream process_trees, thread_trees;
+
+    for (unsigned int i = 0; i < processes; i++) {
+      std::string pid = std::to_string(first_pid + i);
+      CallTree process;
+
+      for (unsigned int j = 0; j < threads; j++) {
+        CallTree thread;
+        add_calls(random, thread, names, CallTree::ROOT, 0);
+
+        std::vector<uint32_t> name_map(names.size());
+
+        for (uint32_t k = 0; k < names.size(); k++) {
+          name_map[k] = k;
+        }
+
+        process.merge(thread, name_map);
+        total.merge(thread, name_map);
+        thread_trees << (i == 0 && j == 0 ? "" : ",") << '"' << pid << '_'
+                     << j + 1 << "\":";
+        thread.write_json(thread_trees, names);
+      }
+
+      std::vector<uint32_t> name_map(names.size());
+
+      for (uint32_t k = 0; k < names.size(); k++) {
+        name_map[k] = k;
+      }
+
+      summary.merge(ProcessSummary(process), name_map);
+      process_trees << (i == 0 ? "" : ",") << '"' << pid << "\":";
+      process.write_json(process_trees, names);
+    }
+
+    stream << (region == 0 ? "" : ",") << "\"region_" << region
+           << "\":{\"data\":";
+    total.write_json(stream, names);
+    stream << ",\"length\":1000000,\"processes\":{" << process_trees.str()
+           << "},\"start\":" << 1000000 * (region + 1) << ",\"summary\":";
+    summary.write_json(stream, names);
+    stream << ",\"threads\":{" << thread_trees.str() << "}}";
+  }
+
+  stream << '}' << std::endl;
+  return (bool)stream;
+}
+
+// Runs nvgpu-merge on "files" with "threads" threads and returns
+// the time taken in seconds, or a negative number if it has failed.
+static double merge(const std::vector<std::string> &files,
+                    unsigned int threads, const fs::path &output) {
+  std::string threads_str = std::to_string(threads);
+  std::string output_str = output.string();
+  std::vector<char *> args = {
+    (char *)NVGPU_MERGE_PATH, (char *)"-j", threads_str.data(),
+    (char *)"-o", output_str.data()
+  };
+
+  for (auto &file : files) {
+    args.push_back((char *)file.c_str());
+  }
+
+  args.push_back(nullptr);
+
+  auto start = std::chrono::steady_clock::now();
+  pid_t pid = fork();
+
+  if (pid == -1) {
+    std::cerr << "Could not fork" << std::endl;
+    return -1;
+  } else if (pid == 0) {
+    execv(NVGPU_MERGE_PATH, args.data());
+    std::cerr << "Could not run " NVGPU_MERGE_PATH ": "
+              << std::strerror(errno) << std::endl;
+    _exit(127);
+  }
+
+  int status;
+
+  if (waitpid(pid, &status, 0) != pid || !WIFEXITED(status) ||
+      WEXITSTATUS(status) != 0) {
+    return -1;
+  }
+
+  return std::chrono::duration<double>(
+    std::chrono::steady_clock::now() - start).count();
+}
+
+int main(int argc, char **argv) {
+  std::size_t file_count = argc > 1 ? std::atoll(argv[1]) : 1000;
+  unsigned int processes = argc > 2 ? std::atoi(argv[2]) : 8;
+  unsigned int threads = argc > 3 ? std::atoi(argv[3]) : 2;
+
+  if (argc > 4 || file_count == 0 || processes == 0 || threads == 0) {
+    std::cerr << "Usage: " << argv[0] << " [files (default: 1000)] "
+              << "[processes per file (default: 8)] "
+              << "[threads per process (default: 2)]" << std::endl;
+    return 2;
+  }
+
+  char temp[] = "/tmp/nvgpu-bench-merge-XXXXXX";
+
+  if (!mkdtemp(temp)) {
+    std::cerr << "Could not create a temporary directory" << std::endl;
+    return 1;
+  }
+
+  fs::path dir = temp;
+  std::mt19937 random(1);
+  std::vector<std::string> files;
+  std::uintmax_t bytes = 0;
+
+  for (std::size_t i = 0; i < file_count; i++) {
+    fs::path path = dir / ("regions." + std::to_string(i) + ".json");
+
+    if (!write_file(path, random, processes, threads,
+                    1000 + i * processes)) {
+      std::cerr << "Could not write " << path << std::endl;
+      fs::remove_all(dir);
+      return 1;
+    }
+
+    files.push_back(path.string());
+    bytes += fs::file_size(path);
+  }
+
+  std::cout << "files\tprocesses\tmegabytes\tthreads\tseconds\tfiles_per_s"
+            << std::endl << std::fixed;
+
+  std::vector<unsigned int> merge_threads = { 1 };
+
+  if (std::thread::hardware_concurrency() > 1) {
+    merge_threads.push_back(std::thread::hardware_concurrency());
+  }
+
+  int result = 0;
+
+  for (unsigned int merge_thread_count : merge_threads) {
+    double seconds = merge(files, merge_thread_count, dir / "merged.json");
+
+    if (seconds < 0) {
+      std::cerr << "nvgpu-merge has failed" << std::endl;
+      result = 1;
+      break;
+    }
+
+    std::ifstream stream(dir / "merged.json");
+    nlohmann::json merged = nlohmann::json::parse(stream, nullptr, false);
+
+    for (auto &[name, region] : merged.items()) {
+      if (region["summary"]["processes"] != file_count * processes) {
+        std::cerr << "Wrong number of processes in " << name << std::endl;
+        result = 1;
+      }
+    }
+
+    if (merged.size() != 3) {
+      std::cerr << "Wrong number of regions" << std::endl;
+      result = 1;
+    }
+
+    std::cout << file_count << '\t' << file_count * processes << '\t'
+              << std::setprecision(1) << bytes / 1e6 << '\t'
+              << merge_thread_count << '\t' << std::setprecision(2)
+              << seconds << '\t' << std::setprecision(1)
+              << file_count / seconds << std::endl;
+  }
+
+  fs::remove_all(dir);
+  return result;
+}
@@ -0,0 +1,281 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Benchmark of the whole path of an event: the injection part traces
+// synthetic calls fired through the stub CUPTI library in a workflow
+// process (bench_workflow.cpp), sends them over a pipe, and the module
+// aggregates them in this process until regions.json is written.
+// The module runs on the fake Adaptyst of module_host.hpp, with its
+// queue bounded as a socket would be.
+//
+// Reports the number of events, the throughput from the start of
+// the workflow until regions.json is written, percentiles of the time
+// spent in a callback, and the peak memory of both processes.
+
+#include <iostream>
+#include <iomanip>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <chrono>
+#include <filesystem>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <sys/resource.h>
+#include "module_host.hpp"
+#include "trace_generator.hpp"
+#include "frames.hpp"
+
+namespace fs = std::filesystem;
+
+static void usage(const char *program) {
+  std::cerr << "Usage: " << program << " [options]" << std::endl
+            << "Module options:" << std::endl
+            << "  --workers <n>   aggregation threads (default: 1)"
+            << std::endl
+            << "  --protocol <p>  binary or text (default: binary)"
+            << std::endl
+            << "  --policy <p>    queue policy: block, drop, or sample "
+            << "(default: block)" << std::endl
+            << "  --api <type>    runtime, driver, or both (default: both)"
+            << std::endl
+            << "  --fast-clock    timestamp events with the fast clock"
+            << std::endl
+            << "  --queue <n>     messages the fake Adaptyst queues before "
+            << "blocking (default: 64)" << std::endl
+            << "  --output <dir>  keep the output in <dir> instead of "
+            << "a temporary directory" << std::endl
+            << "  --tsv           print the results as a TSV row with "
+            << "a header" << std::endl
+            << "Workflow options:" << std::endl
+            << trace_options_usage();
+}
+
+static double seconds(unsigned long long ns) {
+  return ns / 1e9;
+}
+
+static unsigned long long now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+int main(int argc, char **argv) {
+  std::vector<std::string> workflow_args;
+  TraceOptions trace = default_trace_options();
+  unsigned int workers = 1;
+  std::size_t queue_limit = 64;
+  std::string output;
+  bool tsv = false;
+
+  module_host::set_option("cuda_api_type", "both");
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+    std::string value = i + 1 < argc ? argv[i + 1] : "";
+
+    if (arg == "--fast-clock") {
+      module_host::set_option("fast_clock", true);
+    } else if (arg == "--tsv") {
+      tsv = true;
+    } else if (i + 1 >= argc) {
+      usage(argv[0]);
+      return 2;
+    } else if (arg == "--workers" && std::atoi(value.c_str()) > 0) {
+      workers = std::atoi(value.c_str());
+      i++;
+    } else if (arg == "--protocol") {
+      module_host::set_option("wire_protocol", value);
+      i++;
+    } else if (arg == "--policy") {
+      module_host::set_option("queue_policy", value);
+      i++;
+    } else if (arg == "--api") {
+      module_host::set_option("cuda_api_type", value);
+      i++;
+    } else if (arg == "--queue") {
+      queue_limit = std::atoll(value.c_str());
+      i++;
+    } else if (arg == "--output") {
+      output = value;
+      i++;
+    } else if (arg.substr(0, 2) == "--" &&
+               set_trace_option(trace, arg.substr(2), value)) {
+      workflow_args.push_back(arg);
+      workflow_args.push_back(value);
+      i++;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  module_host::set_option("aggregation_threads", workers);
+  module_host::set_option("nvtx", trace.ranges > 0);
+  module_host::set_queue_limit(queue_limit);
+
+  fs::path dir = output;
+
+  if (output.empty()) {
+    char temp[] = "/tmp/nvgpu-bench-XXXXXX";
+
+    if (!mkdtemp(temp)) {
+      std::cerr << "Could not create a temporary directory" << std::endl;
+      return 1;
+    }
+
+    dir = temp;
+  } else {
+    fs::create_directories(dir);
+  }
+
+  module_host::set_module_dir(dir.string());
+
+  int to_module[2];
+  int from_module[2];
+
+  if (pipe(to_module) != 0 || pipe(from_module) != 0) {
+    std::cerr << "Could not create pipes" << std::endl;
+    return 1;
+  }
+
+  fs::path workflow = fs::read_symlink("/proc/self/exe").parent_path() /
+    "nvgpu-bench-workflow";
+  unsigned long long start = now();
+  pid_t pid = fork();
+
+  if (pid == -1) {
+    std::cerr << "Could not fork" << std::endl;
+    return 1;
+  } else if (pid == 0) {
+    dup2(to_module[1], 3);
+    dup2(from_module[0], 4);
+
+    for (int fd : { to_module[0], to_module[1], from_module[0],
+                    from_module[1] }) {
+      if (fd > 4) {
+        close(fd);
+      }
+    }
+
+    std::vector<char *> args = { (char *)workflow.c_str() };
+
+    for (auto &arg : workflow_args) {
+      args.push_back(arg.data());
+    }
+
+    args.push_back(nullptr);
+    execv(workflow.c_str(), args.data());
+    std::cerr << "Could not run " << workflow << ": " << std::strerror(errno)
+              << std::endl;
+    _exit(127);
+  }
+
+  close(to_module[1]);
+  close(from_module[0]);
+
+  module_host::set_workflow_times(start, 0);
+  module_host::set_reply_sink([&](const std::string &reply) {
+    write_frame(from_module[1], FRAME_MESSAGE, reply);
+  });
+
+  std::string stats;
+  int workflow_status = 0;
+
+  // Plays the part of Adaptyst between the two processes.
+  std::thread reader([&]() {
+    char type;
+    std::string payload;
+
+    while (read_frame(to_module[0], type, payload)) {
+      if (type == FRAME_MESSAGE) {
+        module_host::push(std::move(payload));
+      } else if (type == FRAME_REGION_START) {
+        module_host::push("!R " + payload);
+      } else if (type == FRAME_REGION_END) {
+        module_host::push("!E " + payload);
+      } else if (type == FRAME_STATS) {
+        stats = payload;
+      }
+    }
+
+    waitpid(pid, &workflow_status, 0);
+    module_host::set_workflow_times(start, now());
+    module_host::finish();
+  });
+
+  bool success = module_host::run();
+  unsigned long long end = now();
+  reader.join();
+  close(to_module[0]);
+  close(from_module[1]);
+
+  if (!success) {
+    std::cerr << "The module has failed: " << module_host::error()
+              << std::endl;
+    return 1;
+  } else if (!WIFEXITED(workflow_status) ||
+             WEXITSTATUS(workflow_status) != 0 || stats.empty()) {
+    std::cerr << "The workflow process has failed" << std::endl;
+    return 1;
+  }
+
+  std::map<std::string, unsigned long long> values;
+  std::istringstream stream(stats);
+  std::string item;
+
+  while (stream >> item) {
+    std::string::size_type pos = item.find('=');
+    values[item.substr(0, pos)] = std::stoull(item.substr(pos + 1));
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  unsigned long long module_rss = usage.ru_maxrss;
+  unsigned long long output_size = fs::exists(dir / "regions.json") ?
+    fs::file_size(dir / "regions.json") : 0;
+  unsigned long long events = values["events"];
+  double elapsed = seconds(end - start);
+
+  if (output.empty()) {
+    fs::remove_all(dir);
+  }
+
+  if (tsv) {
+    std::cout << "workers\tthreads\tevents\tseconds\tevents_per_s\t"
+              << "p50_ns\tp90_ns\tp99_ns\tp999_ns\tmodule_rss_kb\t"
+              << "workflow_rss_kb" << std::endl
+              << workers << '\t' << trace.threads << '\t' << events << '\t'
+              << std::fixed << std::setprecision(3) << elapsed << '\t'
+              << std::setprecision(0) << events / elapsed << '\t'
+              << values["p50"] << '\t' << values["p90"] << '\t'
+              << values["p99"] << '\t' << values["p999"] << '\t'
+              << module_rss << '\t' << values["max_rss"] << std::endl;
+    return 0;
+  }
+
+  std::cout << std::fixed << std::setprecision(2)
+            << "events            " << events << " (" << trace.threads
+            << " threads, " << trace.regions << " regions, "
+            << workers << " aggregation threads)" << std::endl
+            << "workflow          " << seconds(values["calls_time"])
+            << " s of calls, " << seconds(values["close_time"])
+            << " s to flush at the end" << std::endl
+            << "end to end        " << elapsed
+            << " s until regions.json is written" << std::endl
+            << "throughput        " << events / elapsed / 1e6
+            << " M events/s" << std::endl
+            << "callback latency  p50 " << values["p50"] << " ns, p90 "
+            << values["p90"] << " ns, p99 " << values["p99"]
+            << " ns, p99.9 " << values["p999"] << " ns" << std::endl
+            << "peak memory       module " << module_rss / 1024.0
+            << " MiB, workflow " << values["max_rss"] / 1024.0 << " MiB"
+            << std::endl
+            << "regions.json      " << output_size / 1024.0 << " KiB"
+            << std::endl;
+  return 0;
+}
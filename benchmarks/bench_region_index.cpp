@@ -0,0 +1,78 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Microbenchmark of finding the regions of a part containing
+// the timestamp of an event with RegionIndex, against scanning all of
+// them, for 1 to 1000 regions.
+//
+// Regions follow each other as the regions of a thread usually do,
+// with every tenth one spanning the next few. Timestamps are random
+// within the regions.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <random>
+#include <cstdlib>
+#include "region_index.hpp"
+#include "microbench.hpp"
+
+int main(int argc, char **argv) {
+  std::size_t queries = argc > 1 ? std::atoll(argv[1]) : 100000;
+
+  if (queries == 0) {
+    std::cerr << "Usage: " << argv[0] << " [queries (default: 100000)]"
+              << std::endl;
+    return 2;
+  }
+
+  std::cout << "regions\tindex_ns\tscan_ns" << std::endl;
+
+  for (std::size_t count : { 1, 3, 10, 30, 100, 300, 1000 }) {
+    std::vector<RegionIndex::Interval> intervals;
+
+    for (std::size_t i = 0; i < count; i++) {
+      unsigned long long start = i * 1000;
+      unsigned long long end = start + (i % 10 == 0 ? 3500 : 900);
+      intervals.push_back({ start, end, "region_" + std::to_string(i) });
+    }
+
+    RegionIndex index(intervals);
+    std::mt19937_64 random(1);
+    std::vector<unsigned long long> timestamps(queries);
+
+    for (auto &timestamp : timestamps) {
+      timestamp = random() % (count * 1000);
+    }
+
+    double index_ns = ns_per_operation(queries, [&]() {
+      std::size_t found = 0;
+
+      for (unsigned long long timestamp : timestamps) {
+        index.stab(timestamp, [&](const std::string &) { found++; });
+      }
+
+      keep(found);
+    });
+
+    double scan_ns = ns_per_operation(queries, [&]() {
+      std::size_t found = 0;
+
+      for (unsigned long long timestamp : timestamps) {
+        for (auto &interval : intervals) {
+          if (interval.start <= timestamp && timestamp <= interval.end) {
+            found++;
+          }
+        }
+      }
+
+      keep(found);
+    });
+
+    std::cout << count << '\t' << std::fixed << std::setprecision(1)
+              << index_ns << '\t' << scan_ns << std::endl;
+  }
+
+  return 0;
+}
@@ -0,0 +1,305 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Benchmark of how the aggregation in the module scales with
+// the number of aggregation threads. Synthetic binary events of many
+// profiled threads, batched into messages as by the flusher of
+// the injection part, are replayed into the module on the fake
+// Adaptyst of module_host, once per number of aggregation threads and
+// each time in a new process.
+//
+// Prints a TSV row per number of threads with the events handled per
+// second and the speedup over the first number. The regions.json
+// files written in every run must be the same.
+
+#include <iostream>
+#include <iomanip>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <filesystem>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "module_host.hpp"
+#include "message.hpp"
+
+namespace fs = std::filesystem;
+
+static const uint32_t PID = 48213;
+static const uint8_t DOMAIN = 2;
+static const uint16_t LAUNCH_CBID = 211;
+static const uint16_t SYNC_CBID = 165;
+static const int KERNELS = 16;
+
+// Calls of a thread put in a message at a time, so that messages mix
+// the events of many threads as the flusher of the injection part does.
+static const int CALLS_PER_CHUNK = 32;
+static const std::size_t MESSAGE_SIZE = 60000;
+
+static unsigned long long now() {
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+    std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+static void add_event(std::string &message, unsigned long long timestamp,
+                      uint32_t tid, bool enter, uint16_t cbid,
+                      uint32_t symbol) {
+  BinaryHeader header = { timestamp, PID, tid, (uint8_t)(enter ? 0 : 1),
+                          DOMAIN, cbid, symbol };
+  char record[BINARY_RECORD_LENGTH + 1];
+  encode_binary_header(header, record);
+
+  if (!message.empty()) {
+    message += '\n';
+  }
+
+  message.append(record, BINARY_RECORD_LENGTH);
+}
+
+// Returns the messages of "threads" threads making "calls" kernel
+// launches each, with every eighth of them in a device
+// synchronisation. Sets "events" to the number of events and "end" to
+// a timestamp after all of them.
+static std::vector<std::string> make_messages(unsigned int threads,
+                                              unsigned int calls,
+                                              unsigned long long &events,
+                                              unsigned long long &end) {
+  std::vector<std::string> messages = {
+    "cuda_api_type text " NVGPU_BINARY_PROTOCOL
+  };
+  std::string definitions =
+    "@F" + std::to_string(DOMAIN) + " " + std::to_string(LAUNCH_CBID) +
+    " cudaLaunchKernel\n@F" + std::to_string(DOMAIN) + " " +
+    std::to_string(SYNC_CBID) + " cudaDeviceSynchronize";
+
+  for (int i = 1; i <= KERNELS; i++) {
+    definitions += "\n@S" + std::to_string(PID) + " " + std::to_string(i) +
+      " kernel_" + std::to_string(i) + "(float*, int)";
+  }
+
+  messages.push_back(definitions);
+
+  for (unsigned int t = 0; t < threads; t++) {
+    messages.push_back("!R region " + std::to_string(PID) + "_" +
+                       std::to_string(1000 + t) + " 0");
+  }
+
+  std::vector<unsigned int> made(threads, 0);
+  std::vector<unsigned long long> timestamps(threads, 1000);
+  std::string message;
+  unsigned int done = 0;
+  events = 0;
+
+  while (done < threads) {
+    for (unsigned int t = 0; t < threads; t++) {
+      if (made[t] == calls) {
+        continue;
+      }
+
+      uint32_t tid = 1000 + t;
+      unsigned long long &timestamp = timestamps[t];
+
+      for (int i = 0; i < CALLS_PER_CHUNK && made[t] < calls; i++) {
+        uint32_t symbol = 1 + made[t] % KERNELS;
+        bool sync = made[t] % 8 == 7;
+
+        if (sync) {
+          add_event(message, timestamp += 50, tid, true, SYNC_CBID, 0);
+        }
+
+        add_event(message, timestamp += 50, tid, true, LAUNCH_CBID, symbol);
+        add_event(message, timestamp += 50, tid, false, LAUNCH_CBID,
+                  symbol);
+
+        if (sync) {
+          add_event(message, timestamp += 50, tid, false, SYNC_CBID, 0);
+        }
+
+        events += sync ? 4 : 2;
+        made[t]++;
+      }
+
+      if (made[t] == calls) {
+        done++;
+      }
+
+      if (message.size() >= MESSAGE_SIZE) {
+        messages.push_back(std::move(message));
+        message.clear();
+      }
+    }
+  }
+
+  if (!message.empty()) {
+    messages.push_back(std::move(message));
+  }
+
+  end = 0;
+
+  for (unsigned int t = 0; t < threads; t++) {
+    end = std::max(end, timestamps[t] + 1);
+  }
+
+  for (unsigned int t = 0; t < threads; t++) {
+    messages.push_back("!E region " + std::to_string(PID) + "_" +
+                       std::to_string(1000 + t) + " " + std::to_string(end));
+  }
+
+  return messages;
+}
+
+// Runs the module on "messages" with "workers" aggregation threads in
+// a new process, writing its output to "dir". Returns the time taken
+// by the module in nanoseconds, or 0 if it has failed.
+static unsigned long long replay(const std::vector<std::string> &messages,
+                                 unsigned int workers, unsigned long long end,
+                                 const fs::path &dir) {
+  int result[2];
+
+  if (pipe(result) != 0) {
+    return 0;
+  }
+
+  pid_t pid = fork();
+
+  if (pid == -1) {
+    close(result[0]);
+    close(result[1]);
+    return 0;
+  } else if (pid == 0) {
+    close(result[0]);
+    module_host::reset();
+    module_host::set_module_dir(dir.string());
+    module_host::set_workflow_times(0, end);
+    module_host::set_option("aggregation_threads", workers);
+
+    for (auto &message : messages) {
+      module_host::push(message);
+    }
+
+    module_host::finish();
+
+    unsigned long long start = now();
+    bool success = module_host::run();
+    unsigned long long elapsed = success ? now() - start : 0;
+
+    if (!success) {
+      std::cerr << module_host::error() << std::endl;
+    }
+
+    bool written = write(result[1], &elapsed, sizeof(elapsed)) ==
+      sizeof(elapsed);
+    _exit(written ? 0 : 1);
+  }
+
+  close(result[1]);
+
+  unsigned long long elapsed = 0;
+
+  if (read(result[0], &elapsed, sizeof(elapsed)) != sizeof(elapsed)) {
+    elapsed = 0;
+  }
+
+  close(result[0]);
+
+  int status;
+  waitpid(pid, &status, 0);
+  return WIFEXITED(status) && WEXITSTATUS(status) == 0 ? elapsed : 0;
+}
+
+static std::string read_file(const fs::path &path) {
+  std::ifstream stream(path, std::ios::binary);
+  std::ostringstream contents;
+  contents << stream.rdbuf();
+  return contents.str();
+}
+
+// Parses a comma-separated list of positive numbers, returning false
+// if "list" is not one.
+static bool parse_counts(const std::string &list,
+                         std::vector<unsigned int> &counts) {
+  std::istringstream stream(list);
+  std::string item;
+
+  while (std::getline(stream, item, ',')) {
+    if (item.empty() || item.find_first_not_of("0123456789") !=
+        std::string::npos || std::atoi(item.c_str()) <= 0) {
+      return false;
+    }
+
+    counts.push_back(std::atoi(item.c_str()));
+  }
+
+  return !counts.empty();
+}
+
+int main(int argc, char **argv) {
+  unsigned int threads = argc > 1 ? std::atoi(argv[1]) : 32;
+  unsigned int calls = argc > 2 ? std::atoi(argv[2]) : 50000;
+  std::vector<unsigned int> workers;
+
+  if (argc > 4 || threads == 0 || calls == 0 ||
+      !parse_counts(argc > 3 ? argv[3] : "1,2,4,8,16,32", workers)) {
+    std::cerr << "Usage: " << argv[0] << " [threads (default: 32)] "
+              << "[calls per thread (default: 50000)] "
+              << "[aggregation threads (default: 1,2,4,8,16,32)]"
+              << std::endl;
+    return 2;
+  }
+
+  unsigned long long events, end;
+  std::vector<std::string> messages = make_messages(threads, calls, events,
+                                                    end);
+
+  char dir_template[] = "/tmp/nvgpu-bench-scaling-XXXXXX";
+
+  if (!mkdtemp(dir_template)) {
+    std::cerr << "Could not create a temporary directory" << std::endl;
+    return 1;
+  }
+
+  fs::path dir = dir_template;
+  std::string first_output;
+  unsigned long long first = 0;
+  int status = 0;
+
+  std::cout << "workers\tevents\tseconds\tevents_per_s\tspeedup"
+            << std::endl;
+
+  for (unsigned int count : workers) {
+    fs::path run_dir = dir / std::to_string(count);
+    fs::create_directories(run_dir);
+    unsigned long long time = replay(messages, count, end, run_dir);
+
+    if (time == 0) {
+      std::cerr << "The module has failed with " << count
+                << " aggregation threads" << std::endl;
+      status = 1;
+      break;
+    }
+
+    std::string output = read_file(run_dir / "regions.json");
+
+    if (first == 0) {
+      first = time;
+      first_output = output;
+    } else if (output != first_output) {
+      std::cerr << "regions.json differs with " << count
+                << " aggregation threads" << std::endl;
+      status = 1;
+    }
+
+    double seconds = time / 1e9;
+    std::cout << count << '\t' << events << '\t' << std::fixed
+              << std::setprecision(3) << seconds << '\t'
+              << std::setprecision(0) << events / seconds << '\t'
+              << std::setprecision(2) << (double)first / time << std::endl;
+  }
+
+  fs::remove_all(dir);
+  return status;
+}
@@ -0,0 +1,171 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Microbenchmark of parsing the events of a synthetic trace, in
+// messages per second: with the std::regex the module used before
+// parse_message(), built for every message as it was, and with
+// the tokenizer through MessageDecoder in the text and binary
+// protocols.
+//
+// The trace is made of kernel launches with symbols and of memcpys of
+// 8 threads, with increasing timestamps.
+
+#include <iostream>
+#include <iomanip>
+#include <string>
+#include <vector>
+#include <regex>
+#include <utility>
+#include <algorithm>
+#include <cstdlib>
+#include "message.hpp"
+#include "microbench.hpp"
+
+typedef struct Event {
+  unsigned long long timestamp;
+  uint32_t tid;
+  bool enter;
+  bool launch;
+  uint32_t kernel;
+} Event;
+
+static const uint32_t PID = 48213;
+static const uint16_t LAUNCH_CBID = 211;
+static const uint16_t MEMCPY_CBID = 31;
+
+static std::vector<Event> make_events(std::size_t count) {
+  std::vector<Event> events;
+  unsigned long long timestamp = 1700000000000000000ULL;
+
+  for (std::size_t i = 0; events.size() < count; i++) {
+    Event event = { timestamp, PID + 1 + (uint32_t)(i % 8), true,
+                    i % 3 != 0, (uint32_t)(i % 16) };
+    events.push_back(event);
+    event.timestamp += 1500;
+    event.enter = false;
+    events.push_back(event);
+    timestamp += 2000;
+  }
+
+  events.resize(count);
+  return events;
+}
+
+static std::string kernel_name(uint32_t kernel) {
+  return "void kernel_" + std::to_string(kernel) +
+    "<float>(float const*, float*, int)";
+}
+
+static std::string text_line(const Event &event) {
+  std::string line = std::to_string(event.timestamp) + " " +
+    std::to_string(PID) + "_" + std::to_string(event.tid) +
+    (event.enter ? " enter " : " exit ");
+
+  if (event.launch) {
+    return line + "cudaLaunchKernel " + kernel_name(event.kernel);
+  }
+
+  return line + "cudaMemcpy";
+}
+
+static std::string binary_line(const Event &event) {
+  BinaryHeader header;
+  header.timestamp = event.timestamp;
+  header.pid = PID;
+  header.tid = event.tid;
+  header.site = event.enter ? 0 : 1;
+  header.domain = 1;
+  header.cbid = event.launch ? LAUNCH_CBID : MEMCPY_CBID;
+  header.symbol = event.launch ? event.kernel + 1 : 0;
+
+  char record[BINARY_RECORD_LENGTH + 1];
+  encode_binary_header(header, record);
+  return std::string(record, BINARY_RECORD_LENGTH);
+}
+
+int main(int argc, char **argv) {
+  std::size_t count = argc > 1 ? std::atoll(argv[1]) : 200000;
+
+  if (count == 0) {
+    std::cerr << "Usage: " << argv[0] << " [messages (default: 200000)]"
+              << std::endl;
+    return 2;
+  }
+
+  std::vector<Event> events = make_events(count);
+  std::vector<std::string> text, binary;
+
+  for (auto &event : events) {
+    text.push_back(text_line(event));
+    binary.push_back(binary_line(event));
+  }
+
+  std::vector<std::string> definitions = {
+    "@F1 " + std::to_string(LAUNCH_CBID) + " cudaLaunchKernel",
+    "@F1 " + std::to_string(MEMCPY_CBID) + " cudaMemcpy"
+  };
+
+  for (uint32_t kernel = 0; kernel < 16; kernel++) {
+    definitions.push_back("@S" + std::to_string(PID) + " " +
+                          std::to_string(kernel + 1) + " " +
+                          kernel_name(kernel));
+  }
+
+  // The regex is slow enough for a fraction of the trace to do.
+  std::size_t regex_count = std::min<std::size_t>(count, 5000);
+
+  double regex_ns = ns_per_operation(regex_count, [&]() {
+    unsigned long long sum = 0;
+
+    for (std::size_t i = 0; i < regex_count; i++) {
+      std::smatch match;
+      std::string msg_str(text[i]);
+
+      if (std::regex_match(msg_str, match,
+                           std::regex("^(-?\\d+) (.+) (enter|exit) (.+)$"))) {
+        std::string part_id = match[2].str();
+        std::string state = match[3].str();
+        std::string func_name = match[4].str();
+        sum += std::stoull(match[1].str()) + part_id.size() +
+          state.size() + func_name.size();
+      }
+    }
+
+    keep(sum);
+  });
+
+  auto decode = [&](const std::vector<std::string> &lines) {
+    return ns_per_operation(lines.size(), [&]() {
+      MessageDecoder decoder;
+      Message message;
+      unsigned long long sum = 0;
+
+      for (auto &definition : definitions) {
+        decoder.decode(definition, message);
+      }
+
+      for (auto &line : lines) {
+        if (decoder.decode(line, message) == MessageDecoder::EVENT) {
+          sum += message.timestamp + message.part_id.size() +
+            message.func_name.size();
+        }
+      }
+
+      keep(sum);
+    });
+  };
+
+  double text_ns = decode(text);
+  double binary_ns = decode(binary);
+
+  std::cout << "parser\tns_per_message\tmessages_per_s" << std::endl
+            << std::fixed;
+
+  for (auto [name, ns] : { std::pair<const char *, double>{ "regex", regex_ns },
+                           { "text", text_ns }, { "binary", binary_ns } }) {
+    std::cout << name << '\t' << std::setprecision(1) << ns << '\t'
+              << std::setprecision(0) << 1e9 / ns << std::endl;
+  }
+
+  return 0;
+}
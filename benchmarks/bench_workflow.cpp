@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Workflow process of the pipeline benchmark (see bench_pipeline.cpp):
+// runs the injection part on top of the stub CUPTI library, makes
+// synthetic calls on several threads, and sends everything to
+// the module process through the pipes at WORKFLOW_OUTPUT_FD and
+// WORKFLOW_INPUT_FD.
+
+#include <adaptyst/hw_inject.h>
+#include <iostream>
+#include <thread>
+#include <mutex>
+#include <vector>
+#include <string>
+#include <sys/resource.h>
+#include "inject_host.hpp"
+#include "trace_generator.hpp"
+#include "frames.hpp"
+
+extern "C" {
+  int adaptyst_init(amod_t module_id);
+  int adaptyst_region_start(amod_t module_id, const char *part_id,
+                            const char *name, const char *timestamp_str);
+  int adaptyst_region_end(amod_t module_id, const char *part_id,
+                          const char *name, const char *timestamp_str);
+  void adaptyst_close(amod_t module_id);
+}
+
+constexpr int WORKFLOW_OUTPUT_FD = 3;
+constexpr int WORKFLOW_INPUT_FD = 4;
+
+static std::mutex output_lock;
+
+static bool send_frame(char type, std::string_view payload) {
+  std::unique_lock lock(output_lock);
+  return write_frame(WORKFLOW_OUTPUT_FD, type, payload);
+}
+
+static std::string percentile(const LatencyHistogram &histogram,
+                              double percent, unsigned long long count) {
+  return std::to_string(count == 0 ? 0 : histogram.percentile(percent, count));
+}
+
+int main(int argc, char **argv) {
+  TraceOptions options = default_trace_options();
+
+  for (int i = 1; i + 1 < argc; i += 2) {
+    std::string name = argv[i];
+
+    if (name.size() < 3 || name.substr(0, 2) != "--" ||
+        !set_trace_option(options, name.substr(2), argv[i + 1])) {
+      std::cerr << "Invalid option: " << name << std::endl;
+      return 2;
+    }
+  }
+
+  inject_host::set_transport([](std::string_view message) {
+    return send_frame(FRAME_MESSAGE, message);
+  }, [](std::string &message) {
+    char type;
+    return read_frame(WORKFLOW_INPUT_FD, type, message);
+  });
+
+  const amod_t module_id{};
+
+  if (adaptyst_init(module_id) != ADAPTYST_MODULE_OK) {
+    std::cerr << "adaptyst_init() failed: " << inject_host::error()
+              << std::endl;
+    return 1;
+  }
+
+  std::vector<LatencyHistogram> latencies(options.threads);
+  std::vector<unsigned long long> events(options.threads, 0);
+  std::vector<std::thread> threads;
+  unsigned long long start = inject_host::steady_timestamp();
+
+  for (unsigned int i = 0; i < options.threads; i++) {
+    threads.emplace_back([&, i]() {
+      TraceGenerator generator(options, i);
+      std::string part_id = std::to_string(getpid()) + "_" +
+        std::to_string(gettid());
+
+      for (unsigned int j = 0; j < options.regions; j++) {
+        std::string region = "region_" + std::to_string(j);
+        std::string timestamp =
+          std::to_string(inject_host::steady_timestamp());
+
+        // Adaptyst tells the module about a region before the workflow
+        // makes any call in it.
+        send_frame(FRAME_REGION_START, region + " " + part_id + " " + timestamp);
+        adaptyst_region_start(module_id, part_id.c_str(), region.c_str(),
+                              timestamp.c_str());
+
+        generator.run_region(latencies[i], events[i]);
+
+        timestamp = std::to_string(inject_host::steady_timestamp());
+        adaptyst_region_end(module_id, part_id.c_str(), region.c_str(),
+                            timestamp.c_str());
+        send_frame(FRAME_REGION_END, region + " " + part_id + " " + timestamp);
+      }
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  unsigned long long calls_end = inject_host::steady_timestamp();
+
+  // Sends everything still buffered.
+  adaptyst_close(module_id);
+
+  unsigned long long end = inject_host::steady_timestamp();
+  LatencyHistogram total;
+  unsigned long long count = 0;
+
+  for (unsigned int i = 0; i < options.threads; i++) {
+    total.merge(latencies[i]);
+    count += events[i];
+  }
+
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+
+  std::string stats = "events=" + std::to_string(count) +
+    " calls_time=" + std::to_string(calls_end - start) +
+    " close_time=" + std::to_string(end - calls_end) +
+    " p50=" + percentile(total, 50, count) +
+    " p90=" + percentile(total, 90, count) +
+    " p99=" + percentile(total, 99, count) +
+    " p999=" + percentile(total, 99.9, count) +
+    " max_rss=" + std::to_string(usage.ru_maxrss);
+
+  return send_frame(FRAME_STATS, stats) ? 0 : 1;
+}
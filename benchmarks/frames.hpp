@@ -0,0 +1,93 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Framing of what the two processes of the pipeline benchmark exchange
+// over pipes: a type byte, a 32-bit length, and the payload.
+
+#ifndef NVGPU_BENCHMARKS_FRAMES_HPP
+#define NVGPU_BENCHMARKS_FRAMES_HPP
+
+#include <string>
+#include <string_view>
+#include <cstdint>
+#include <cerrno>
+#include <unistd.h>
+
+// A string sent to the module.
+constexpr char FRAME_MESSAGE = 'M';
+
+// Start and end of a region, with "<region> <part ID> <timestamp>".
+constexpr char FRAME_REGION_START = 'R';
+constexpr char FRAME_REGION_END = 'E';
+
+// Statistics of the workflow process, sent last, as
+// "<name>=<value> ...".
+constexpr char FRAME_STATS = 'S';
+
+inline bool write_all(int fd, const char *data, std::size_t size) {
+  while (size > 0) {
+    ssize_t written = write(fd, data, size);
+
+    if (written == -1 && errno == EINTR) {
+      continue;
+    } else if (written <= 0) {
+      return false;
+    }
+
+    data += written;
+    size -= written;
+  }
+
+  return true;
+}
+
+inline bool read_all(int fd, char *data, std::size_t size) {
+  while (size > 0) {
+    ssize_t count = read(fd, data, size);
+
+    if (count == -1 && errno == EINTR) {
+      continue;
+    } else if (count <= 0) {
+      return false;
+    }
+
+    data += count;
+    size -= count;
+  }
+
+  return true;
+}
+
+inline bool write_frame(int fd, char type, std::string_view payload) {
+  char header[5];
+  uint32_t size = payload.size();
+  header[0] = type;
+
+  for (int i = 0; i < 4; i++) {
+    header[1 + i] = (char)(size >> (8 * i));
+  }
+
+  return write_all(fd, header, sizeof(header)) &&
+    write_all(fd, payload.data(), payload.size());
+}
+
+// Returns false at the end of the pipe or on an error.
+inline bool read_frame(int fd, char &type, std::string &payload) {
+  char header[5];
+
+  if (!read_all(fd, header, sizeof(header))) {
+    return false;
+  }
+
+  uint32_t size = 0;
+
+  for (int i = 0; i < 4; i++) {
+    size |= (uint32_t)(unsigned char)header[1 + i] << (8 * i);
+  }
+
+  type = header[0];
+  payload.resize(size);
+  return read_all(fd, payload.data(), size);
+}
+
+#endif
@@ -0,0 +1,44 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Timing of the microbenchmarks, which measure single operations of
+// the module or the injection part in a loop.
+
+#ifndef NVGPU_BENCHMARKS_MICROBENCH_HPP
+#define NVGPU_BENCHMARKS_MICROBENCH_HPP
+
+#include <chrono>
+#include <algorithm>
+#include <cstddef>
+
+// Calls "run", which makes "operations" operations, until at least
+// 0.2 s and 3 calls have passed, and returns the nanoseconds per
+// operation of the fastest call.
+template<typename F>
+double ns_per_operation(std::size_t operations, F run) {
+  using clock = std::chrono::steady_clock;
+  double best = -1;
+  clock::time_point end = clock::now() + std::chrono::milliseconds(200);
+
+  for (int calls = 0; calls < 3 || clock::now() < end; calls++) {
+    clock::time_point start = clock::now();
+    run();
+    double ns = std::chrono::duration<double, std::nano>(
+      clock::now() - start).count() / std::max<std::size_t>(operations, 1);
+
+    if (best < 0 || ns < best) {
+      best = ns;
+    }
+  }
+
+  return best;
+}
+
+// Keeps the compiler from removing a computation whose result is
+// otherwise unused.
+template<typename T>
+void keep(const T &value) {
+  asm volatile("" : : "g"(&value) : "memory");
+}
+
+#endif
@@ -0,0 +1,270 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cupti.h>
+#include <cupti_nvtx_cbid.h>
+#include <generated_cuda_runtime_api_meta.h>
+#include <generated_cuda_meta.h>
+#include <generated_nvtx_meta.h>
+#include <chrono>
+#include <sstream>
+#include "stub_cupti.hpp"
+#include "trace_generator.hpp"
+
+namespace {
+  constexpr unsigned long long CALLS_PER_RANGE = 32;
+
+  enum Category { LAUNCH, MEMCPY, MEMSET, SYNC, OTHER };
+
+  // Parameters of the calls, read by the injection part.
+  const cudaMemcpy_v3020_params MEMCPY_PARAMS = {
+    nullptr, nullptr, 1 << 20, cudaMemcpyHostToDevice, nullptr
+  };
+
+  const cuMemcpyHtoD_v2_params CU_MEMCPY_PARAMS = {
+    0, nullptr, 1 << 20, nullptr
+  };
+
+  const cudaMemset_v3020_params MEMSET_PARAMS = { nullptr, 0, 4096, nullptr };
+  const cuMemsetD8_v2_params CU_MEMSET_PARAMS = { 0, 0, 4096, nullptr };
+
+  unsigned long long now() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+}
+
+TraceOptions default_trace_options() {
+  TraceOptions options;
+  options.threads = 4;
+  options.regions = 2;
+  options.calls = 100000;
+  options.depth = 2;
+  options.launch_weight = 4;
+  options.memcpy_weight = 2;
+  options.memset_weight = 1;
+  options.sync_weight = 1;
+  options.other_weight = 2;
+  options.kernels = 16;
+  options.ranges = 0;
+  options.seed = 1;
+  return options;
+}
+
+bool set_trace_option(TraceOptions &options, const std::string &name,
+                      const std::string &value) {
+  unsigned long long number;
+  std::istringstream stream(value);
+
+  if (name == "mix") {
+    std::string item;
+
+    while (std::getline(stream, item, ',')) {
+      std::string::size_type pos = item.find('=');
+
+      if (pos == std::string::npos) {
+        return false;
+      }
+
+      std::string category = item.substr(0, pos);
+      unsigned int weight = std::stoul(item.substr(pos + 1));
+
+      if (category == "launch") {
+        options.launch_weight = weight;
+      } else if (category == "memcpy") {
+        options.memcpy_weight = weight;
+      } else if (category == "memset") {
+        options.memset_weight = weight;
+      } else if (category == "sync") {
+        options.sync_weight = weight;
+      } else if (category == "other") {
+        options.other_weight = weight;
+      } else {
+        return false;
+      }
+    }
+
+    return options.launch_weight + options.memcpy_weight +
+      options.memset_weight + options.sync_weight + options.other_weight > 0;
+  }
+
+  if (!(stream >> number)) {
+    return false;
+  }
+
+  if (name == "threads" && number > 0) {
+    options.threads = number;
+  } else if (name == "regions" && number > 0) {
+    options.regions = number;
+  } else if (name == "calls") {
+    options.calls = number;
+  } else if (name == "depth" && number > 0) {
+    options.depth = number;
+  } else if (name == "kernels" && number > 0) {
+    options.kernels = number;
+  } else if (name == "ranges") {
+    options.ranges = number;
+  } else if (name == "seed") {
+    options.seed = number;
+  } else {
+    return false;
+  }
+
+  return true;
+}
+
+std::string trace_options_usage() {
+  return
+    "  --threads <n>   threads making calls (default: 4)\n"
+    "  --regions <n>   regions every thread goes through (default: 2)\n"
+    "  --calls <n>     top-level calls per thread and region "
+    "(default: 100000)\n"
+    "  --depth <n>     nesting depth of a top-level call, 2 for a driver "
+    "call\n"
+    "                  inside every runtime call (default: 2)\n"
+    "  --mix <list>    weights of launch, memcpy, memset, sync, and other\n"
+    "                  calls (default: launch=4,memcpy=2,memset=1,sync=1,"
+    "other=2)\n"
+    "  --kernels <n>   distinct kernel names (default: 16)\n"
+    "  --ranges <n>    distinct NVTX range names, 0 for no ranges "
+    "(default: 0)\n"
+    "  --seed <n>      random seed (default: 1)\n";
+}
+
+TraceGenerator::TraceGenerator(const TraceOptions &options,
+                               unsigned int thread) : options(options) {
+  this->random.seed(options.seed * 1000003 + thread);
+  this->categories = std::discrete_distribution<int>({
+    (double)options.launch_weight, (double)options.memcpy_weight,
+    (double)options.memset_weight, (double)options.sync_weight,
+    (double)options.other_weight
+  });
+
+  for (unsigned int i = 0; i < options.kernels; i++) {
+    this->kernel_names.push_back("kernel_" + std::to_string(i) +
+                                 "(float*, int)");
+  }
+
+  for (unsigned int i = 0; i < options.ranges; i++) {
+    this->range_names.push_back("range_" + std::to_string(i));
+  }
+}
+
+void TraceGenerator::run_region(LatencyHistogram &latencies,
+                                unsigned long long &events) {
+  nvtxRangePushA_params push = { nullptr };
+
+  for (unsigned long long i = 0; i < this->options.calls; i++) {
+    bool ranged = !this->range_names.empty();
+
+    if (ranged && i % CALLS_PER_RANGE == 0) {
+      push.message =
+        this->range_names[this->random() % this->range_names.size()].c_str();
+      this->fire({ CUPTI_CB_DOMAIN_NVTX, CUPTI_CBID_NVTX_nvtxRangePushA,
+                   &push, nullptr }, true, latencies, events);
+    }
+
+    this->call(1, this->categories(this->random),
+               this->random() % this->kernel_names.size(), latencies, events);
+
+    if (ranged && (i % CALLS_PER_RANGE == CALLS_PER_RANGE - 1 ||
+                   i + 1 == this->options.calls)) {
+      this->fire({ CUPTI_CB_DOMAIN_NVTX, CUPTI_CBID_NVTX_nvtxRangePop,
+                   nullptr, nullptr }, true, latencies, events);
+    }
+  }
+}
+
+void TraceGenerator::call(unsigned int depth, int category,
+                          unsigned int kernel, LatencyHistogram &latencies,
+                          unsigned long long &events) {
+  const char *kernel_name = this->kernel_names[kernel].c_str();
+
+  // Launches of a kernel always have the same configuration.
+  unsigned int grid = 32 * (1 + kernel % 8);
+  cudaLaunchKernel_v7000_params launch = {
+    nullptr, { grid, 1, 1 }, { 256, 1, 1 }, nullptr, 0, nullptr
+  };
+  cuLaunchKernel_params cu_launch = {
+    nullptr, grid, 1, 1, 256, 1, 1, 0, nullptr, nullptr, nullptr
+  };
+
+  // The outermost call is a runtime API call, with driver API calls of
+  // the same kind inside it.
+  bool runtime = depth == 1;
+  Call call;
+
+  switch ((Category)category) {
+  case LAUNCH:
+    call = runtime ?
+      Call{ CUPTI_CB_DOMAIN_RUNTIME_API,
+            CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, &launch,
+            kernel_name } :
+      Call{ CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel,
+            &cu_launch, kernel_name };
+    break;
+  case MEMCPY:
+    call = runtime ?
+      Call{ CUPTI_CB_DOMAIN_RUNTIME_API,
+            CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020, &MEMCPY_PARAMS,
+            nullptr } :
+      Call{ CUPTI_CB_DOMAIN_DRIVER_API,
+            CUPTI_DRIVER_TRACE_CBID_cuMemcpyHtoD_v2, &CU_MEMCPY_PARAMS,
+            nullptr };
+    break;
+  case MEMSET:
+    call = runtime ?
+      Call{ CUPTI_CB_DOMAIN_RUNTIME_API,
+            CUPTI_RUNTIME_TRACE_CBID_cudaMemset_v3020, &MEMSET_PARAMS,
+            nullptr } :
+      Call{ CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuMemsetD8_v2,
+            &CU_MEMSET_PARAMS, nullptr };
+    break;
+  case SYNC:
+    call = runtime ?
+      Call{ CUPTI_CB_DOMAIN_RUNTIME_API,
+            CUPTI_RUNTIME_TRACE_CBID_cudaDeviceSynchronize_v3020, nullptr,
+            nullptr } :
+      Call{ CUPTI_CB_DOMAIN_DRIVER_API,
+            CUPTI_DRIVER_TRACE_CBID_cuCtxSynchronize, nullptr, nullptr };
+    break;
+  default:
+    call = runtime ?
+      Call{ CUPTI_CB_DOMAIN_RUNTIME_API,
+            CUPTI_RUNTIME_TRACE_CBID_cudaStreamQuery_v3020, nullptr,
+            nullptr } :
+      Call{ CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuStreamQuery,
+            nullptr, nullptr };
+    break;
+  }
+
+  this->fire(call, true, latencies, events);
+
+  if (depth < this->options.depth) {
+    this->call(depth + 1, category, kernel, latencies, events);
+  }
+
+  this->fire(call, false, latencies, events);
+}
+
+bool TraceGenerator::fire(const Call &call, bool enter,
+                          LatencyHistogram &latencies,
+                          unsigned long long &events) {
+  unsigned long long start = now();
+  bool fired;
+
+  if (call.domain == CUPTI_CB_DOMAIN_NVTX) {
+    fired = stub_cupti::nvtx_call(call.cbid, call.params);
+  } else {
+    fired = stub_cupti::api_call((CUpti_CallbackDomain)call.domain, call.cbid,
+                                 enter ? CUPTI_API_ENTER : CUPTI_API_EXIT,
+                                 call.params, call.symbol);
+  }
+
+  if (fired) {
+    latencies.add(now() - start);
+    events++;
+  }
+
+  return fired;
+}
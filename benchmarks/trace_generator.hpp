@@ -0,0 +1,84 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Synthetic CUDA API traces fired through the stub CUPTI library, as if
+// a workflow made the calls.
+
+#ifndef NVGPU_BENCHMARKS_TRACE_GENERATOR_HPP
+#define NVGPU_BENCHMARKS_TRACE_GENERATOR_HPP
+
+#include <string>
+#include <vector>
+#include <random>
+#include "histogram.hpp"
+
+typedef struct TraceOptions {
+  // Threads making calls, each going through all regions in turn.
+  unsigned int threads;
+  unsigned int regions;
+
+  // Top-level calls per thread and region.
+  unsigned long long calls;
+
+  // Nesting depth of a top-level call: 1 is a runtime API call alone,
+  // 2 adds a driver API call inside it, and so on.
+  unsigned int depth;
+
+  // Relative weights of kernel launches, memcpys, memsets,
+  // synchronisations, and other functions.
+  unsigned int launch_weight;
+  unsigned int memcpy_weight;
+  unsigned int memset_weight;
+  unsigned int sync_weight;
+  unsigned int other_weight;
+
+  // Distinct kernel names of launches.
+  unsigned int kernels;
+
+  // Distinct NVTX range names, with a range pushed every
+  // CALLS_PER_RANGE top-level calls, or 0 for no ranges.
+  unsigned int ranges;
+
+  unsigned long long seed;
+} TraceOptions;
+
+TraceOptions default_trace_options();
+
+// Sets an option from "--<name> <value>" (e.g. "--mix" with
+// "launch=4,memcpy=2"). Returns false if there is no such option or
+// the value is invalid.
+bool set_trace_option(TraceOptions &options, const std::string &name,
+                      const std::string &value);
+
+// Usage text of the options.
+std::string trace_options_usage();
+
+// Fires the calls of one region of one thread. The time of every fired
+// callback is added to "latencies", in nanoseconds.
+class TraceGenerator {
+public:
+  TraceGenerator(const TraceOptions &options, unsigned int thread);
+
+  void run_region(LatencyHistogram &latencies, unsigned long long &events);
+
+private:
+  typedef struct Call {
+    int domain;
+    unsigned int cbid;
+    const void *params;
+    const char *symbol;
+  } Call;
+
+  void call(unsigned int depth, int category, unsigned int kernel,
+            LatencyHistogram &latencies, unsigned long long &events);
+  bool fire(const Call &call, bool enter, LatencyHistogram &latencies,
+            unsigned long long &events);
+
+  const TraceOptions &options;
+  std::mt19937_64 random;
+  std::discrete_distribution<int> categories;
+  std::vector<std::string> kernel_names;
+  std::vector<std::string> range_names;
+};
+
+#endif
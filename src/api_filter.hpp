@@ -0,0 +1,172 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_API_FILTER_HPP
+#define NVGPU_API_FILTER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <algorithm>
+#include <cctype>
+#include "message.hpp"
+
+// Advertised by the injection part in the "cuda_api_type" request if it
+// accepts a filter in the reply, which is then followed by
+// "<name> <include list> <exclude list>" (see ApiFilter::join_list()).
+#define NVGPU_FILTER_CAPABILITY "filter1"
+
+// Selection of CUDA API functions to trace, made of an include list and
+// an exclude list. Every item is either a function name (e.g.
+// "cudaMemcpy") or a category of api_category_name(), which matches
+// the functions api_category() puts in it. A function is traced if
+// the include list is empty or matches it, and the exclude list does
+// not match it.
+//
+// Function names are compared without the "_v<number>", "_ptsz", and
+// "_ptds" suffixes, so "cudaLaunchKernel" matches
+// "cudaLaunchKernel_ptsz_v7000" as well.
+class ApiFilter {
+public:
+  ApiFilter() { }
+
+  ApiFilter(std::vector<std::string> include,
+            std::vector<std::string> exclude) {
+    this->include = std::move(include);
+    this->exclude = std::move(exclude);
+  }
+
+  // Returns true if every function is traced.
+  bool empty() const {
+    return this->include.empty() && this->exclude.empty();
+  }
+
+  bool matches(std::string_view name, ApiCategory category) const {
+    std::string_view base = base_name(name);
+
+    if (!this->include.empty() &&
+        !matches_any(this->include, name, base, category)) {
+      return false;
+    }
+
+    return !matches_any(this->exclude, name, base, category);
+  }
+
+  // Splits a comma-separated list, ignoring whitespace around items
+  // and empty items. "-" is an empty list.
+  static std::vector<std::string> parse_list(std::string_view list) {
+    std::vector<std::string> result;
+
+    if (list == "-") {
+      return result;
+    }
+
+    while (true) {
+      std::string_view::size_type pos = list.find(',');
+      std::string_view item = list.substr(0, pos);
+
+      while (!item.empty() && std::isspace((unsigned char)item.front())) {
+        item.remove_prefix(1);
+      }
+
+      while (!item.empty() && std::isspace((unsigned char)item.back())) {
+        item.remove_suffix(1);
+      }
+
+      if (!item.empty()) {
+        result.emplace_back(item);
+      }
+
+      if (pos == std::string_view::npos) {
+        break;
+      }
+
+      list.remove_prefix(pos + 1);
+    }
+
+    return result;
+  }
+
+  // The inverse of parse_list(), producing a list without whitespace
+  // which can be sent as a single token.
+  static std::string join_list(const std::vector<std::string> &items) {
+    if (items.empty()) {
+      return "-";
+    }
+
+    std::string result;
+
+    for (auto &item : items) {
+      if (!result.empty()) {
+        result += ',';
+      }
+
+      result += item;
+    }
+
+    return result;
+  }
+
+  // Returns false if an item cannot be a function name or a category.
+  static bool valid_item(std::string_view item) {
+    return item != "-" && std::all_of(item.begin(), item.end(), [](char c) {
+      return std::isalnum((unsigned char)c) || c == '_';
+    });
+  }
+
+private:
+  static std::string_view base_name(std::string_view name) {
+    bool stripped;
+
+    do {
+      stripped = false;
+
+      for (std::string_view suffix : { "_ptsz", "_ptds" }) {
+        if (name.ends_with(suffix)) {
+          name.remove_suffix(suffix.size());
+          stripped = true;
+        }
+      }
+
+      std::string_view::size_type pos = name.rfind("_v");
+
+      if (pos != std::string_view::npos && pos + 2 < name.size() &&
+          std::all_of(name.begin() + pos + 2, name.end(), [](char c) {
+            return std::isdigit((unsigned char)c);
+          })) {
+        name = name.substr(0, pos);
+        stripped = true;
+      }
+    } while (stripped);
+
+    return name;
+  }
+
+  static bool matches_item(std::string_view item, std::string_view name,
+                           std::string_view base, ApiCategory category) {
+    int item_category = parse_api_category(item);
+
+    if (item_category != -1) {
+      return item_category == category;
+    }
+
+    return item == name || item == base;
+  }
+
+  static bool matches_any(const std::vector<std::string> &items,
+                          std::string_view name, std::string_view base,
+                          ApiCategory category) {
+    for (auto &item : items) {
+      if (matches_item(item, name, base, category)) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+  std::vector<std::string> include;
+  std::vector<std::string> exclude;
+};
+
+#endif
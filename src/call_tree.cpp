@@ -0,0 +1,641 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "call_tree.hpp"
+#include <algorithm>
+
+uint32_t NameTable::intern(std::string_view name) {
+  auto found = this->ids.find(name);
+
+  if (found != this->ids.end()) {
+    return found->second;
+  }
+
+  uint32_t id = this->names.size();
+  this->names.emplace_back(name);
+  this->ids[this->names.back()] = id;
+  return id;
+}
+
+bool NameTable::find(std::string_view name, uint32_t &id) const {
+  auto found = this->ids.find(name);
+
+  if (found == this->ids.end()) {
+    return false;
+  }
+
+  id = found->second;
+  return true;
+}
+
+CallTree::CallTree() {
+  this->nodes.push_back({ NONE, NONE, NONE, NONE, 0, 0, 0, 0, 0 });
+  this->histograms.emplace_back();
+  this->incomplete_nodes.push_back(false);
+  this->limit = 0;
+  this->error_threshold = 0;
+}
+
+uint32_t CallTree::append(uint32_t parent, uint32_t name) {
+  // With a limit, the arena grows up to it instead of doubling past it,
+  // in one step rather than a small one near the limit which would copy
+  // the whole arena again.
+  if (this->limit != 0 && this->nodes.size() == this->nodes.capacity()) {
+    std::size_t capacity = this->nodes.size() * 2;
+
+    if (capacity >= this->limit) {
+      capacity = std::max(this->nodes.size() + 1, this->limit + LIMIT_SLACK);
+    }
+
+    this->nodes.reserve(capacity);
+    this->histograms.reserve(capacity);
+  }
+
+  uint32_t index = this->nodes.size();
+  this->nodes.push_back({ name, parent, NONE, this->nodes[parent].first_child,
+                          0, 0, 0, 0, 0 });
+  this->histograms.emplace_back();
+  this->incomplete_nodes.push_back(false);
+  this->nodes[parent].first_child = index;
+  return index;
+}
+
+uint32_t CallTree::child(uint32_t parent, uint32_t name) {
+  auto found = this->children.find(child_key(parent, name));
+
+  if (found != this->children.end()) {
+    return found->second;
+  }
+
+  uint32_t index = this->append(parent, name);
+  this->children.emplace(child_key(parent, name), index);
+  return index;
+}
+
+void CallTree::merge(const CallTree &other,
+                     const std::vector<uint32_t> &names) {
+  // Pairs of a node of "other" and the corresponding node here.
+  std::vector<std::pair<uint32_t, uint32_t> > pending;
+  pending.push_back({ ROOT, ROOT });
+
+  if (other.incomplete_nodes[ROOT]) {
+    this->incomplete_nodes[ROOT] = true;
+  }
+
+  while (!pending.empty()) {
+    auto [from, to] = pending.back();
+    pending.pop_back();
+
+    for (uint32_t i = other.nodes[from].first_child; i != NONE;
+         i = other.nodes[i].next_sibling) {
+      const Node &source = other.nodes[i];
+      uint32_t index = this->child(to, names[source.name]);
+      Node &target = this->nodes[index];
+
+      if (source.count > 0) {
+        if (target.count == 0 || source.min < target.min) {
+          target.min = source.min;
+        }
+
+        if (source.max > target.max) {
+          target.max = source.max;
+        }
+      }
+
+      target.length += source.length;
+      target.time += source.time;
+      target.count += source.count;
+      this->histograms[index].merge(other.histograms[i]);
+
+      if (other.incomplete_nodes[i]) {
+        this->incomplete_nodes[index] = true;
+      }
+
+      if (const Transfers *transfers = other.node_transfers(i)) {
+        Transfers &target_transfers = this->transfers[index];
+
+        for (int j = 0; j < TRANSFER_DIRECTIONS; j++) {
+          target_transfers[j].count += (*transfers)[j].count;
+          target_transfers[j].bytes += (*transfers)[j].bytes;
+          target_transfers[j].time += (*transfers)[j].time;
+        }
+      }
+
+      if (const std::vector<Launch> *launches = other.node_launches(i)) {
+        std::vector<Launch> &target_launches = this->launches[index];
+
+        for (Launch launch : *launches) {
+          launch.config = names[launch.config];
+          add_launches(target_launches, launch);
+        }
+      }
+
+      pending.push_back({ i, index });
+    }
+  }
+}
+
+void CallTree::merge_json(const nlohmann::json &json, NameTable &names) {
+  // Pairs of a "children" object and the node they belong to here.
+  std::vector<std::pair<const nlohmann::json *, uint32_t> > pending;
+  pending.push_back({ &json, ROOT });
+
+  while (!pending.empty()) {
+    auto [children, parent] = pending.back();
+    pending.pop_back();
+
+    for (auto &[name, source] : children->items()) {
+      uint32_t index = this->child(parent, names.intern(name));
+      Node &target = this->nodes[index];
+      const nlohmann::json &stats = source.at("stats");
+      unsigned long long count = stats.at("count");
+
+      if (count > 0) {
+        unsigned long long min = stats.at("min");
+        unsigned long long max = stats.at("max");
+
+        if (target.count == 0 || min < target.min) {
+          target.min = min;
+        }
+
+        if (max > target.max) {
+          target.max = max;
+        }
+      }
+
+      target.length += source.at("length").get<unsigned long long>();
+      target.time += stats.at("time").get<unsigned long long>();
+      target.count += count;
+
+      if (source.contains("histogram")) {
+        const nlohmann::json &histogram = source["histogram"];
+
+        for (std::size_t i = 0; i + 1 < histogram.size(); i += 2) {
+          int bucket = histogram[i];
+
+          if (bucket < 0 || bucket >= LatencyHistogram::BUCKETS) {
+            throw nlohmann::json::other_error::create(
+              501, "histogram bucket out of range", &histogram);
+          }
+
+          this->histograms[index].add_to_bucket(bucket, histogram[i + 1]);
+        }
+      } else if (count > 0) {
+        // Only the percentiles are known: the calls below the rank of
+        // p99 are taken to be as long as p50 and the rest as long as
+        // p99, which gives back both of them.
+        unsigned long long fast = LatencyHistogram::rank(99, count) - 1;
+
+        if (fast < LatencyHistogram::rank(50, count)) {
+          // p50 and p99 are the same call.
+          fast = count;
+        }
+
+        this->histograms[index].add(stats.at("p50"), fast);
+        this->histograms[index].add(stats.at("p99"), count - fast);
+      }
+
+      if (source.value("incomplete", false)) {
+        this->incomplete_nodes[index] = true;
+      }
+
+      if (source.contains("transfers")) {
+        for (auto &[direction_name, transfer] : source["transfers"].items()) {
+          int direction = parse_transfer_direction(direction_name);
+
+          if (direction == -1) {
+            throw nlohmann::json::other_error::create(
+              501, "unknown transfer direction", &transfer);
+          }
+
+          Transfer &target_transfer = this->transfers[index][direction];
+          target_transfer.count += transfer.at("count").get<unsigned long long>();
+          target_transfer.bytes += transfer.at("bytes").get<unsigned long long>();
+          target_transfer.time += transfer.at("time").get<unsigned long long>();
+        }
+      }
+
+      if (source.contains("launches")) {
+        std::vector<Launch> &target_launches = this->launches[index];
+
+        for (auto &[config, launch] : source["launches"].items()) {
+          add_launches(target_launches, {
+              names.intern(config),
+              launch.at("count").get<unsigned long long>(),
+              launch.at("max").get<unsigned long long>(),
+              launch.at("time").get<unsigned long long>() });
+        }
+      }
+
+      pending.push_back({ &source.at("children"), index });
+    }
+  }
+}
+
+void CallTree::subtract_overhead(double per_callback) {
+  // Children always come after their parents in the arena, so going
+  // backwards visits every node after all nodes below it.
+  std::vector<unsigned long long> calls_below(this->nodes.size(), 0);
+  std::vector<unsigned long long> calls_below_sum(this->nodes.size(), 0);
+
+  for (uint32_t i = this->nodes.size() - 1; i > ROOT; i--) {
+    uint32_t parent = this->nodes[i].parent;
+    calls_below[parent] += this->nodes[i].count + calls_below[i];
+  }
+
+  for (uint32_t i = this->nodes.size() - 1; i > ROOT; i--) {
+    // The length of a node is the sum of the times of all nodes in its
+    // subtree, so it loses the overhead of every one of them.
+    calls_below_sum[i] += calls_below[i];
+    calls_below_sum[this->nodes[i].parent] += calls_below_sum[i];
+
+    auto subtract = [per_callback](unsigned long long &value,
+                                   unsigned long long calls) {
+      unsigned long long overhead = 2 * per_callback * calls;
+      value = value > overhead ? value - overhead : 0;
+    };
+
+    subtract(this->nodes[i].time, calls_below[i]);
+    subtract(this->nodes[i].length, calls_below_sum[i]);
+  }
+}
+
+std::vector<uint32_t> CallTree::prune(uint32_t other_name,
+                                      const std::vector<uint32_t> &pinned) {
+  std::size_t size = this->nodes.size();
+  std::vector<uint32_t> new_index(size);
+
+  if (this->limit == 0 || size <= this->limit / 2) {
+    for (uint32_t i = 0; i < size; i++) {
+      new_index[i] = i;
+    }
+
+    return new_index;
+  }
+
+  // Half of the nodes left are for the "[other]" nodes, at most one
+  // per kept node.
+  std::size_t budget = std::max<std::size_t>(this->limit / 4, 1);
+  std::vector<bool> kept(size, false);
+  std::size_t kept_count = 0;
+
+  auto keep = [&](uint32_t index) {
+    for (uint32_t i = index; i != NONE && !kept[i]; i = this->nodes[i].parent) {
+      kept[i] = true;
+      kept_count++;
+    }
+  };
+
+  keep(ROOT);
+
+  for (uint32_t index : pinned) {
+    keep(index);
+  }
+
+  std::vector<uint32_t> order;
+  order.reserve(size - 1);
+
+  for (uint32_t i = ROOT + 1; i < size; i++) {
+    order.push_back(i);
+  }
+
+  std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) {
+    unsigned long long weight_a = this->weight(a);
+    unsigned long long weight_b = this->weight(b);
+    return weight_a > weight_b || (weight_a == weight_b && a < b);
+  });
+
+  unsigned long long threshold = this->error_threshold;
+
+  for (uint32_t index : order) {
+    if (kept_count >= budget) {
+      break;
+    }
+
+    if (!kept[index]) {
+      keep(index);
+      threshold = this->weight(index);
+    }
+  }
+
+  // Kept nodes stay in the same order, so parents still come before
+  // their children.
+  CallTree result;
+  result.nodes.clear();
+  result.histograms.clear();
+  result.incomplete_nodes.clear();
+  result.limit = this->limit;
+  result.error_threshold = threshold;
+
+  // Room for an "[other]" node per kept node, the tree then grows
+  // up to the limit as usual.
+  std::size_t capacity = std::min(2 * kept_count, this->limit + LIMIT_SLACK);
+  result.nodes.reserve(capacity);
+  result.histograms.reserve(capacity);
+  result.children.reserve(capacity);
+
+  for (uint32_t i = 0; i < size; i++) {
+    if (!kept[i]) {
+      new_index[i] = NONE;
+      continue;
+    }
+
+    Node node = this->nodes[i];
+    new_index[i] = result.nodes.size();
+    node.first_child = NONE;
+    node.next_sibling = NONE;
+
+    if (i != ROOT) {
+      node.parent = new_index[node.parent];
+      node.next_sibling = result.nodes[node.parent].first_child;
+      result.nodes[node.parent].first_child = new_index[i];
+      result.children[child_key(node.parent, node.name)] = new_index[i];
+    }
+
+    result.nodes.push_back(node);
+    result.histograms.push_back(this->histograms[i]);
+    result.incomplete_nodes.push_back(this->incomplete_nodes[i]);
+    result.errors.push_back(this->weight(i) - node.length);
+
+    if (const Transfers *transfers = this->node_transfers(i)) {
+      result.transfers[new_index[i]] = *transfers;
+    }
+
+    if (const std::vector<Launch> *launches = this->node_launches(i)) {
+      result.launches[new_index[i]] = *launches;
+    }
+  }
+
+  // The "[other]" node of the closest kept ancestor of every folded
+  // node.
+  std::vector<uint32_t> targets(size, NONE);
+
+  for (uint32_t i = ROOT + 1; i < size; i++) {
+    if (kept[i]) {
+      continue;
+    }
+
+    const Node &source = this->nodes[i];
+    uint32_t target;
+
+    if (kept[source.parent]) {
+      target = result.child(new_index[source.parent], other_name);
+
+      if (target == result.errors.size()) {
+        result.errors.push_back(0);
+      }
+
+      Node &other = result.nodes[target];
+
+      if (source.count > 0) {
+        if (other.count == 0 || source.min < other.min) {
+          other.min = source.min;
+        }
+
+        if (source.max > other.max) {
+          other.max = source.max;
+        }
+      }
+
+      other.count += source.count;
+      other.time += source.time;
+      other.length += source.length;
+      result.histograms[target].merge(this->histograms[i]);
+    } else {
+      target = targets[source.parent];
+    }
+
+    targets[i] = target;
+
+    if (this->incomplete_nodes[i]) {
+      result.incomplete_nodes[target] = true;
+    }
+
+    if (const Transfers *transfers = this->node_transfers(i)) {
+      Transfers &target_transfers = result.transfers[target];
+
+      for (int j = 0; j < TRANSFER_DIRECTIONS; j++) {
+        target_transfers[j].count += (*transfers)[j].count;
+        target_transfers[j].bytes += (*transfers)[j].bytes;
+        target_transfers[j].time += (*transfers)[j].time;
+      }
+    }
+
+    if (const std::vector<Launch> *launches = this->node_launches(i)) {
+      std::vector<Launch> &target_launches = result.launches[target];
+
+      for (const Launch &launch : *launches) {
+        add_launches(target_launches, launch);
+      }
+    }
+  }
+
+  *this = std::move(result);
+  return new_index;
+}
+
+unsigned long long CallTree::self_time(uint32_t index) const {
+  unsigned long long children_time = 0;
+
+  for (uint32_t i = this->nodes[index].first_child; i != NONE;
+       i = this->nodes[i].next_sibling) {
+    children_time += this->nodes[i].time;
+  }
+
+  // Children can have more time than the node itself if some calls
+  // of the node have not finished.
+  return this->nodes[index].time > children_time ?
+    this->nodes[index].time - children_time : 0;
+}
+
+void CallTree::write_stats(std::ostream &stream, uint32_t index) const {
+  const Node &node = this->nodes[index];
+  stream << "\"stats\":{\"count\":" << node.count
+         << ",\"max\":" << node.max
+         << ",\"min\":" << node.min
+         << ",\"p50\":" << this->percentile(index, 50)
+         << ",\"p99\":" << this->percentile(index, 99)
+         << ",\"self\":" << this->self_time(index)
+         << ",\"time\":" << node.time << '}';
+}
+
+CallTree::Transfer CallTree::total_transfer(uint32_t index) const {
+  Transfer total = { 0, 0, 0 };
+
+  if (const Transfers *transfers = this->node_transfers(index)) {
+    for (auto &transfer : *transfers) {
+      total.count += transfer.count;
+      total.bytes += transfer.bytes;
+      total.time += transfer.time;
+    }
+  }
+
+  return total;
+}
+
+void CallTree::write_transfers(std::ostream &stream,
+                               const Transfers &transfers) const {
+  // In the order of keys in nlohmann::json objects.
+  static const std::array<int, TRANSFER_DIRECTIONS> order = []() {
+    std::array<int, TRANSFER_DIRECTIONS> result;
+
+    for (int i = 0; i < TRANSFER_DIRECTIONS; i++) {
+      result[i] = i;
+    }
+
+    std::sort(result.begin(), result.end(), [](int a, int b) {
+      return std::string_view(transfer_direction_name(a)) <
+        transfer_direction_name(b);
+    });
+
+    return result;
+  }();
+
+  stream << "\"transfers\":{";
+  bool first = true;
+
+  for (int direction : order) {
+    const Transfer &transfer = transfers[direction];
+
+    if (transfer.count == 0) {
+      continue;
+    }
+
+    stream << (first ? "" : ",") << '"' << transfer_direction_name(direction)
+           << "\":{\"bandwidth\":" << bandwidth(transfer)
+           << ",\"bytes\":" << transfer.bytes
+           << ",\"count\":" << transfer.count
+           << ",\"time\":" << transfer.time << '}';
+    first = false;
+  }
+
+  stream << '}';
+}
+
+void CallTree::write_launches(std::ostream &stream, const NameTable &names,
+                              const std::vector<Launch> &launches) const {
+  std::vector<const Launch *> order;
+
+  for (const Launch &launch : launches) {
+    order.push_back(&launch);
+  }
+
+  std::sort(order.begin(), order.end(), [&](const Launch *a, const Launch *b) {
+    return names.name(a->config) < names.name(b->config);
+  });
+
+  stream << "\"launches\":{";
+
+  for (std::size_t i = 0; i < order.size(); i++) {
+    if (i > 0) {
+      stream << ',';
+    }
+
+    write_json_string(stream, names.name(order[i]->config));
+    stream << ":{\"count\":" << order[i]->count
+           << ",\"max\":" << order[i]->max
+           << ",\"time\":" << order[i]->time << '}';
+  }
+
+  stream << "},";
+}
+
+std::vector<uint32_t> CallTree::sorted_children(const NameTable &names,
+                                                uint32_t parent) const {
+  std::vector<uint32_t> result;
+
+  for (uint32_t i = this->nodes[parent].first_child; i != NONE;
+       i = this->nodes[i].next_sibling) {
+    result.push_back(i);
+  }
+
+  std::sort(result.begin(), result.end(), [&](uint32_t a, uint32_t b) {
+    return names.name(this->nodes[a].name) < names.name(this->nodes[b].name);
+  });
+
+  return result;
+}
+
+void CallTree::write_json(std::ostream &stream, const NameTable &names,
+                          bool histograms) const {
+  // The walk is iterative, so deep call paths cannot overflow
+  // the stack.
+  typedef struct Level {
+    std::vector<uint32_t> children;
+    std::size_t next;
+  } Level;
+
+  std::vector<Level> levels;
+  levels.push_back({ this->sorted_children(names, ROOT), 0 });
+  stream << '{';
+
+  while (!levels.empty()) {
+    Level &level = levels.back();
+
+    if (level.next == level.children.size()) {
+      levels.pop_back();
+      stream << '}';
+
+      if (!levels.empty()) {
+        Level &parent = levels.back();
+        uint32_t index = parent.children[parent.next - 1];
+
+        if (histograms) {
+          stream << ",\"histogram\":[";
+          bool first = true;
+
+          for (int i = 0; i < LatencyHistogram::BUCKETS; i++) {
+            uint32_t count = this->histograms[index].bucket_count(i);
+
+            if (count > 0) {
+              stream << (first ? "" : ",") << i << ',' << count;
+              first = false;
+            }
+          }
+
+          stream << ']';
+        }
+
+        if (this->incomplete_nodes[index]) {
+          stream << ",\"incomplete\":true";
+        }
+
+        stream << ',';
+
+        if (const std::vector<Launch> *launches = this->node_launches(index)) {
+          this->write_launches(stream, names, *launches);
+        }
+
+        stream << "\"length\":" << this->nodes[index].length << ',';
+        this->write_stats(stream, index);
+
+        if (const Transfers *transfers = this->node_transfers(index)) {
+          stream << ',';
+          this->write_transfers(stream, *transfers);
+        }
+
+        stream << '}';
+      }
+
+      continue;
+    }
+
+    uint32_t index = level.children[level.next++];
+
+    if (level.next > 1) {
+      stream << ',';
+    }
+
+    write_json_string(stream, names.name(this->nodes[index].name));
+    stream << ":{";
+
+    if (this->node_transfers(index)) {
+      Transfer total = this->total_transfer(index);
+      stream << "\"bandwidth\":" << bandwidth(total) << ",\"bytes\":"
+             << total.bytes << ',';
+    }
+
+    stream << "\"children\":{";
+    levels.push_back({ this->sorted_children(names, index), 0 });
+  }
+}
@@ -0,0 +1,352 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_CALL_TREE_HPP
+#define NVGPU_CALL_TREE_HPP
+
+#include <string>
+#include <string_view>
+#include <deque>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <ostream>
+#include <algorithm>
+#include <array>
+#include <nlohmann/json.hpp>
+#include "histogram.hpp"
+#include "message.hpp"
+
+// Assigns consecutive integer IDs to strings, so that call trees can
+// store and compare names as integers. Names are never removed, as
+// trees pruned into "[other]" nodes may still be merged with trees
+// using them, so they are outside the memory budget of the trees.
+class NameTable {
+public:
+  uint32_t intern(std::string_view name);
+
+  // Returns false if "name" has not been interned.
+  bool find(std::string_view name, uint32_t &id) const;
+
+  const std::string &name(uint32_t id) const {
+    return this->names[id];
+  }
+
+  std::size_t size() const {
+    return this->names.size();
+  }
+
+private:
+  // A deque never moves its elements, so the keys of this->ids
+  // can point to them.
+  std::deque<std::string> names;
+  std::unordered_map<std::string_view, uint32_t> ids;
+};
+
+// Call tree of a region with lengths summed per call path. Nodes live
+// in a single arena and refer to each other by index, with children
+// of a node chained through next_sibling. Every node also has
+// statistics of the individual calls it stands for, which take
+// a fixed amount of memory per node.
+class CallTree {
+public:
+  static constexpr uint32_t NONE = (uint32_t)-1;
+  static constexpr uint32_t ROOT = 0;
+
+  typedef struct Node {
+    uint32_t name;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+
+    // Sum of the lengths of the calls of this node and of all calls
+    // made during them (the "length" of regions.json).
+    unsigned long long length;
+
+    // Statistics of the calls of this node alone, set by add_call().
+    unsigned long long time;
+    unsigned long long count;
+    unsigned long long min;
+    unsigned long long max;
+  } Node;
+
+  // Memory transfers made by the calls of a node in one direction.
+  typedef struct Transfer {
+    unsigned long long count;
+    unsigned long long bytes;
+
+    // Sum of the lengths of the calls.
+    unsigned long long time;
+  } Transfer;
+
+  typedef std::array<Transfer, TRANSFER_DIRECTIONS> Transfers;
+
+  // Kernel launches made by the calls of a node with one launch
+  // configuration, whose name ID is "config" (see
+  // NVGPU_LAUNCH_CAPABILITY).
+  typedef struct Launch {
+    uint32_t config;
+    unsigned long long count;
+    unsigned long long max;
+
+    // Sum of the lengths of the calls.
+    unsigned long long time;
+  } Launch;
+
+  // Name of the nodes into which prune() folds the children it removes.
+  static constexpr const char *OTHER_NAME = "[other]";
+
+  // Approximate memory taken by a node, for turning a memory budget
+  // into a node limit (see node_limit()).
+  static constexpr std::size_t NODE_MEMORY = sizeof(Node) +
+    sizeof(LatencyHistogram) + sizeof(unsigned long long) + 48;
+
+  CallTree();
+
+  // Returns the child of "parent" called "name", creating it if needed.
+  uint32_t child(uint32_t parent, uint32_t name);
+
+  // Returns the largest node limit of a tree fitting in "memory" bytes.
+  // Growing the arena and pruning both hold two copies of the tree for
+  // a moment, so a tree gets half of the memory, including the slack
+  // past the limit.
+  static std::size_t node_limit(std::size_t memory) {
+    std::size_t nodes = memory / (2 * NODE_MEMORY);
+    return std::max<std::size_t>(nodes > LIMIT_SLACK ?
+                                 nodes - LIMIT_SLACK : 0, 2);
+  }
+
+  // Sets the number of nodes past which over_limit() is true, or 0 for
+  // no limit. The arena then never grows much beyond the limit.
+  void set_node_limit(std::size_t limit) {
+    this->limit = limit;
+  }
+
+  bool over_limit() const {
+    return this->limit != 0 && this->nodes.size() > this->limit;
+  }
+
+  // Shrinks the tree to at most half of its node limit, keeping
+  // the heaviest call paths exactly and folding the other children of
+  // every kept node into its "[other]" child (named "other_name").
+  // Nodes in "pinned" and their ancestors are always kept. Returns
+  // the new index of every node, or NONE for folded nodes.
+  //
+  // Nodes are chosen as in the Space-Saving heavy-hitter algorithm,
+  // with evictions done in batches: the weight of a node is its length
+  // plus an error, which for nodes created after a pruning is the
+  // lowest weight kept by it. A call path taking more than about
+  // 1 / (limit / 2) of the time of the tree is thus never folded.
+  //
+  // An "[other]" node has the count, time and statistics of
+  // the calls folded into it, and its length and transfers include
+  // everything made during them, so the totals of every kept node
+  // and its children do not change.
+  std::vector<uint32_t> prune(uint32_t other_name,
+                              const std::vector<uint32_t> &pinned);
+
+  Node &node(uint32_t index) {
+    return this->nodes[index];
+  }
+
+  const Node &node(uint32_t index) const {
+    return this->nodes[index];
+  }
+
+  // Marks a node as having lost some of its calls or of the calls
+  // made during them, so that its statistics and those of the nodes
+  // below it are lower bounds.
+  void mark_incomplete(uint32_t index) {
+    this->incomplete_nodes[index] = true;
+  }
+
+  bool incomplete(uint32_t index) const {
+    return this->incomplete_nodes[index];
+  }
+
+  // Records a finished call of a node.
+  void add_call(uint32_t index, unsigned long long length) {
+    Node &node = this->nodes[index];
+
+    if (node.count == 0 || length < node.min) {
+      node.min = length;
+    }
+
+    if (length > node.max) {
+      node.max = length;
+    }
+
+    node.count++;
+    node.time += length;
+    this->histograms[index].add(length);
+  }
+
+  // Records the size of the transfer made by a finished call of
+  // a node, in addition to add_call().
+  void add_transfer(uint32_t index, int direction, unsigned long long bytes,
+                    unsigned long long length) {
+    Transfer &transfer = this->transfers[index][direction];
+    transfer.count++;
+    transfer.bytes += bytes;
+    transfer.time += length;
+  }
+
+  // Returns the transfers of a node per TransferDirection, or null if
+  // its calls have made none.
+  const Transfers *node_transfers(uint32_t index) const {
+    auto found = this->transfers.find(index);
+    return found == this->transfers.end() ? nullptr : &found->second;
+  }
+
+  // Sums the transfers of a node over all directions.
+  Transfer total_transfer(uint32_t index) const;
+
+  // Records the launch configuration of a finished call of a node,
+  // in addition to add_call().
+  void add_launch(uint32_t index, uint32_t config, unsigned long long length) {
+    add_launches(this->launches[index], { config, 1, length, length });
+  }
+
+  // Returns the launches of a node per configuration, or null if its
+  // calls have launched no kernel with a known configuration.
+  const std::vector<Launch> *node_launches(uint32_t index) const {
+    auto found = this->launches.find(index);
+    return found == this->launches.end() ? nullptr : &found->second;
+  }
+
+  // Adds all nodes of "other" to this tree, with names[i] being
+  // the name in this tree of name i of "other".
+  void merge(const CallTree &other, const std::vector<uint32_t> &names);
+
+  // Removes the cost of profiling nested calls from the lengths and
+  // times, assuming that every call made during a call of a node adds
+  // two callbacks of "per_callback" nanoseconds to it. Call statistics
+  // other than the total time are left as they are.
+  void subtract_overhead(double per_callback);
+
+  // Time spent in the calls of a node outside the calls of its
+  // children, i.e. the node's time minus the time of its children.
+  unsigned long long self_time(uint32_t index) const;
+
+  // Returns the approximate length of the call at the given
+  // percentile (0-100) of a node, see LatencyHistogram.
+  unsigned long long percentile(uint32_t index, double percent) const {
+    const Node &node = this->nodes[index];
+    unsigned long long value =
+      this->histograms[index].percentile(percent, node.count);
+    return std::clamp(value, node.min, node.max);
+  }
+
+  // Number of nodes, including the root.
+  std::size_t size() const {
+    return this->nodes.size();
+  }
+
+  // Writes the children of the root in the regions.json format, i.e.
+  // an object mapping names to objects with "children", "length", and
+  // "stats" (see write_stats()), and "incomplete" set to true for
+  // incomplete nodes. Nodes with transfers also get the total "bytes"
+  // and "bandwidth" (in bytes per second of the time of their calls),
+  // and "transfers" with "bandwidth", "bytes", "count", and "time" per
+  // direction. Nodes of kernel launches get "launches", mapping launch
+  // configurations to "count", "max", and "time" of their calls. If
+  // "histograms" is true, every node also gets "histogram", a flat
+  // array of bucket index and count pairs of its non-empty buckets, so
+  // that the tree can be read back with merge_json() without losing
+  // anything.
+  // The output is the same as of nlohmann::json::dump(), but it is
+  // streamed while walking the tree instead of built in memory first.
+  void write_json(std::ostream &stream, const NameTable &names,
+                  bool histograms = false) const;
+
+  // Adds all nodes of a tree written by write_json() to this tree,
+  // interning their names in "names". Trees written without histograms
+  // are read too, with the histograms approximated from p50 and p99.
+  // Throws nlohmann::json::exception if "json" is not such a tree.
+  void merge_json(const nlohmann::json &json, NameTable &names);
+
+private:
+  // Writes the "stats" object of a node: "count", "max", "min", "p50",
+  // "p99", "self", and "time", with the last two as in Node and
+  // self_time().
+  void write_stats(std::ostream &stream, uint32_t index) const;
+
+  // Writes the "transfers" object of a node, see write_json().
+  void write_transfers(std::ostream &stream, const Transfers &transfers) const;
+
+  // Writes the "launches" object of a node, see write_json().
+  void write_launches(std::ostream &stream, const NameTable &names,
+                      const std::vector<Launch> &launches) const;
+
+  // Adds "launch" to the launches of a node with the same
+  // configuration, if any. Nodes have few configurations, so they are
+  // searched linearly.
+  static void add_launches(std::vector<Launch> &target, const Launch &launch) {
+    for (Launch &existing : target) {
+      if (existing.config == launch.config) {
+        existing.count += launch.count;
+        existing.max = std::max(existing.max, launch.max);
+        existing.time += launch.time;
+        return;
+      }
+    }
+
+    target.push_back(launch);
+  }
+
+  static unsigned long long bandwidth(const Transfer &transfer) {
+    return transfer.time == 0 ? 0 :
+      (unsigned long long)((double)transfer.bytes * 1000000000 / transfer.time);
+  }
+
+  // Returns the children of a node sorted by name, which is the order
+  // of keys in nlohmann::json objects.
+  std::vector<uint32_t> sorted_children(const NameTable &names,
+                                        uint32_t parent) const;
+
+  static uint64_t child_key(uint32_t parent, uint32_t name) {
+    return ((uint64_t)parent << 32) | name;
+  }
+
+  // Appends a node without looking it up in this->children.
+  uint32_t append(uint32_t parent, uint32_t name);
+
+  // Space-Saving weight of a node, see prune().
+  unsigned long long weight(uint32_t index) const {
+    return this->nodes[index].length + (index < this->errors.size() ?
+                                        this->errors[index] :
+                                        this->error_threshold);
+  }
+
+  // Room for the nodes created past the node limit before the tree
+  // is pruned, e.g. for a whole call path looked up at once.
+  static constexpr std::size_t LIMIT_SLACK = 64;
+
+  std::vector<Node> nodes;
+
+  // Kept apart from the nodes since they are much larger and needed
+  // only for percentiles.
+  std::vector<LatencyHistogram> histograms;
+  std::vector<bool> incomplete_nodes;
+
+  // Only nodes of memcpy and memset functions have transfers.
+  std::unordered_map<uint32_t, Transfers> transfers;
+
+  // Only nodes of kernel launch functions have launches.
+  std::unordered_map<uint32_t, std::vector<Launch> > launches;
+  std::unordered_map<uint64_t, uint32_t> children;
+
+  // Set by prune(): the errors of the nodes it has kept, and the error
+  // of nodes created afterwards.
+  std::size_t limit;
+  std::vector<unsigned long long> errors;
+  unsigned long long error_threshold;
+};
+
+// Writes a string as a JSON string literal, escaped in the same way
+// as by nlohmann::json::dump().
+inline void write_json_string(std::ostream &stream, const std::string &str) {
+  stream << nlohmann::json(str).dump();
+}
+
+#endif
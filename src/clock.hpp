@@ -0,0 +1,112 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_CLOCK_HPP
+#define NVGPU_CLOCK_HPP
+
+#include <cstdint>
+#include <ctime>
+
+#if defined(__x86_64__)
+#include <x86intrin.h>
+#include <cpuid.h>
+#endif
+
+// Cheaper source of event timestamps than adaptyst_get_timestamp(): the
+// time stamp counter on x86-64 CPUs where it runs at a constant rate,
+// and CLOCK_MONOTONIC_RAW elsewhere. Its ticks are mapped to Adaptyst
+// timestamps with calibration points taken by calibrate(), see
+// ClockConversion.
+class FastClock {
+public:
+  // A tick count and the Adaptyst timestamp read at the same time.
+  typedef struct Point {
+    uint64_t ticks;
+    unsigned long long timestamp;
+  } Point;
+
+  FastClock() {
+    this->tsc = false;
+
+#if defined(__x86_64__)
+    unsigned int eax, ebx, ecx, edx;
+
+    // Bit 8 of EDX is the invariant TSC flag.
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) && (edx & (1 << 8))) {
+      this->tsc = true;
+    }
+#endif
+  }
+
+  uint64_t now() const {
+#if defined(__x86_64__)
+    if (this->tsc) {
+      return __rdtsc();
+    }
+#endif
+
+    timespec time;
+    clock_gettime(CLOCK_MONOTONIC_RAW, &time);
+    return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+  }
+
+  bool uses_tsc() const {
+    return this->tsc;
+  }
+
+  // Reads an Adaptyst timestamp with "timestamp" between two reads of
+  // the ticks CALIBRATION_READS times, and returns the read which took
+  // the shortest time, paired with the middle of its ticks.
+  template<typename F>
+  Point calibrate(F timestamp) const {
+    Point best = { 0, 0 };
+    uint64_t best_span = (uint64_t)-1;
+
+    for (int i = 0; i < CALIBRATION_READS; i++) {
+      uint64_t before = this->now();
+      unsigned long long value = timestamp();
+      uint64_t after = this->now();
+
+      if (after - before < best_span) {
+        best_span = after - before;
+        best = { before + best_span / 2, value };
+      }
+    }
+
+    return best;
+  }
+
+private:
+  static const int CALIBRATION_READS = 5;
+
+  bool tsc;
+};
+
+// Maps ticks of the FastClock of a process to Adaptyst timestamps from
+// the latest calibration point and the rate of the clock measured up to
+// it. Ticks before the point are mapped with the same rate, so events
+// sent a little before a new point are still converted correctly.
+class ClockConversion {
+public:
+  ClockConversion() {
+    this->point = { 0, 0 };
+    this->rate = 1;
+  }
+
+  // "rate" is in nanoseconds per tick.
+  void set(FastClock::Point point, double rate) {
+    this->point = point;
+    this->rate = rate;
+  }
+
+  unsigned long long convert(uint64_t ticks) const {
+    return this->point.timestamp +
+      (long long)((double)(int64_t)(ticks - this->point.ticks) * this->rate);
+  }
+
+private:
+  FastClock::Point point;
+  double rate;
+};
+
+#endif
@@ -0,0 +1,74 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_EVENT_BUFFER_HPP
+#define NVGPU_EVENT_BUFFER_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <atomic>
+#include <cstddef>
+
+// Lock-free single-producer single-consumer ring buffer of event lines.
+// Each profiled thread pushes to its own buffer and a single flusher
+// thread drains all of them.
+//
+// Slots are reused, so pushing does not allocate once every slot has
+// held a line at least as long as the one being pushed.
+class EventBuffer {
+public:
+  // "capacity" must be a power of two.
+  EventBuffer(std::size_t capacity) : slots(capacity) {
+    this->mask = capacity - 1;
+    this->head = 0;
+    this->tail = 0;
+  }
+
+  // Called by the producer only. Returns false if the buffer is full.
+  bool push(std::string_view line) {
+    std::size_t head = this->head.load(std::memory_order_relaxed);
+
+    if (head - this->tail.load(std::memory_order_acquire) >
+        this->mask) {
+      return false;
+    }
+
+    this->slots[head & this->mask].assign(line);
+    this->head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  // Called by the consumer only. Passes every line available at
+  // the time of the call to "consume" in order and returns how many
+  // there were.
+  template<typename F>
+  std::size_t drain(F consume) {
+    std::size_t tail = this->tail.load(std::memory_order_relaxed);
+    std::size_t head = this->head.load(std::memory_order_acquire);
+
+    for (std::size_t i = tail; i != head; i++) {
+      consume(std::string_view(this->slots[i & this->mask]));
+    }
+
+    this->tail.store(head, std::memory_order_release);
+    return head - tail;
+  }
+
+  std::size_t size() const {
+    return this->head.load(std::memory_order_acquire) -
+      this->tail.load(std::memory_order_acquire);
+  }
+
+  std::size_t capacity() const {
+    return this->mask + 1;
+  }
+
+private:
+  std::vector<std::string> slots;
+  std::size_t mask;
+  alignas(64) std::atomic<std::size_t> head;
+  alignas(64) std::atomic<std::size_t> tail;
+};
+
+#endif
@@ -0,0 +1,107 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_HISTOGRAM_HPP
+#define NVGPU_HISTOGRAM_HPP
+
+#include <array>
+#include <cstdint>
+#include <bit>
+#include <algorithm>
+
+// Fixed-size histogram of call lengths with log-linear buckets, in
+// the spirit of HdrHistogram: every power of two is split into
+// SUB_BUCKETS equal buckets, so a percentile is off by at most 1/8 of
+// its value. Lengths of 2^MAX_EXPONENT and more share the last bucket.
+class LatencyHistogram {
+public:
+  static const int SUB_BUCKETS = 4;
+  static const int MAX_EXPONENT = 40;
+  static const int BUCKETS = SUB_BUCKETS +
+    (MAX_EXPONENT - 2) * SUB_BUCKETS;
+
+  LatencyHistogram() {
+    this->counts.fill(0);
+  }
+
+  void add(unsigned long long value) {
+    this->counts[bucket(value)]++;
+  }
+
+  void add(unsigned long long value, uint32_t count) {
+    this->counts[bucket(value)] += count;
+  }
+
+  void merge(const LatencyHistogram &other) {
+    for (int i = 0; i < BUCKETS; i++) {
+      this->counts[i] += other.counts[i];
+    }
+  }
+
+  // Returns the middle of the bucket containing the value at
+  // the given percentile (0-100) of "count" values added.
+  unsigned long long percentile(double percent,
+                                unsigned long long count) const {
+    unsigned long long target = rank(percent, count);
+    unsigned long long seen = 0;
+
+    for (int i = 0; i < BUCKETS; i++) {
+      seen += this->counts[i];
+
+      if (seen >= target) {
+        return lower_bound(i) + width(i) / 2;
+      }
+    }
+
+    return 0;
+  }
+
+  // Returns the 1-based rank of the value at the given percentile
+  // (0-100) of "count" values.
+  static unsigned long long rank(double percent, unsigned long long count) {
+    return std::max((unsigned long long)(percent / 100 * count), 1ULL);
+  }
+
+  // Raw access to the buckets, for saving and restoring histograms.
+  uint32_t bucket_count(int index) const {
+    return this->counts[index];
+  }
+
+  void add_to_bucket(int index, uint32_t count) {
+    this->counts[index] += count;
+  }
+
+private:
+  static int bucket(unsigned long long value) {
+    if (value < SUB_BUCKETS) {
+      return value;
+    }
+
+    int exponent = std::bit_width(value) - 1;
+    int index = SUB_BUCKETS + (exponent - 2) * SUB_BUCKETS +
+      ((value >> (exponent - 2)) & (SUB_BUCKETS - 1));
+    return index < BUCKETS ? index : BUCKETS - 1;
+  }
+
+  static unsigned long long lower_bound(int index) {
+    if (index < SUB_BUCKETS) {
+      return index;
+    }
+
+    int exponent = (index - SUB_BUCKETS) / SUB_BUCKETS + 2;
+    int sub = (index - SUB_BUCKETS) % SUB_BUCKETS;
+    return (unsigned long long)(SUB_BUCKETS + sub) << (exponent - 2);
+  }
+
+  static unsigned long long width(int index) {
+    if (index < SUB_BUCKETS) {
+      return 1;
+    }
+
+    return 1ULL << ((index - SUB_BUCKETS) / SUB_BUCKETS);
+  }
+
+  std::array<uint32_t, BUCKETS> counts;
+};
+
+#endif
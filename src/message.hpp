@@ -0,0 +1,571 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_MESSAGE_HPP
+#define NVGPU_MESSAGE_HPP
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <charconv>
+#include <cstdint>
+#include <cctype>
+
+// A single event sent by the injection part, in the form of
+// "<timestamp> <part ID> <enter|exit> <function name>[ <symbol name>]".
+//
+// All string views point to the buffer passed to parse_message(), so
+// a Message must not outlive that buffer.
+typedef struct Message {
+  typedef enum State {
+    ENTER,
+    EXIT
+  } State;
+
+  bool timestamp_known;
+  unsigned long long timestamp;
+  std::string_view part_id;
+  State state;
+  std::string_view func_name;
+} Message;
+
+// Splits off the part of "str" up to the first space and removes
+// it together with the space from "str". Returns false if there
+// is no space or the token is empty.
+inline bool next_message_token(std::string_view &str,
+                               std::string_view &token) {
+  std::string_view::size_type pos = str.find(' ');
+
+  if (pos == std::string_view::npos || pos == 0) {
+    return false;
+  }
+
+  token = str.substr(0, pos);
+  str.remove_prefix(pos + 1);
+  return true;
+}
+
+// Parses an event message without any heap allocation. Returns false
+// if the message is malformed, in which case the contents of "result"
+// are unspecified.
+inline bool parse_message(std::string_view msg, Message &result) {
+  std::string_view timestamp_str;
+
+  if (!next_message_token(msg, timestamp_str) ||
+      !next_message_token(msg, result.part_id)) {
+    return false;
+  }
+
+  std::string_view state;
+
+  if (!next_message_token(msg, state)) {
+    return false;
+  }
+
+  if (state == "enter") {
+    result.state = Message::ENTER;
+  } else if (state == "exit") {
+    result.state = Message::EXIT;
+  } else {
+    return false;
+  }
+
+  if (msg.empty()) {
+    return false;
+  }
+
+  result.func_name = msg;
+
+  if (timestamp_str == "-1") {
+    result.timestamp_known = false;
+    result.timestamp = 0;
+    return true;
+  }
+
+  const char *end = timestamp_str.data() + timestamp_str.size();
+  auto [ptr, ec] = std::from_chars(timestamp_str.data(), end,
+                                   result.timestamp);
+
+  if (ec != std::errc() || ptr != end) {
+    return false;
+  }
+
+  result.timestamp_known = true;
+  return true;
+}
+
+// Name of the binary protocol advertised by the injection part in
+// the "cuda_api_type" request and chosen by the module in the reply.
+// The number must be increased whenever the record layout changes.
+#define NVGPU_BINARY_PROTOCOL "binary1"
+
+// Advertised by the injection part in the "cuda_api_type" request if it
+// can send its overhead counters as the last message, and repeated by
+// the module in the reply if they should be sent.
+#define NVGPU_OVERHEAD_CAPABILITY "overhead1"
+
+// Advertised by the injection part in the "cuda_api_type" request if it
+// can lose events instead of waiting when the module falls behind, and
+// sent by the module in the reply followed by the queue policy ("drop"
+// or "sample") to enable it. Lost events of a thread are reported with
+// "@L <timestamp> <part ID> <count>" before its next event, with
+// the timestamp of the first of them, and per function with
+// "@A <function name>=<count> ..." when the injection part is closed.
+#define NVGPU_POLICY_CAPABILITY "policy1"
+
+// Advertised by the injection part in the "cuda_api_type" request if it
+// can timestamp events with FastClock, and repeated by the module in
+// the reply to make it do so. Every timestamp sent by the injection
+// part is then in ticks of the clock of its process, announced with
+// "@C <PID> <ticks> <timestamp> <nanoseconds per tick>" lines (see
+// ClockConversion) before the first event and regularly afterwards.
+#define NVGPU_CLOCK_CAPABILITY "clock1"
+
+// Advertised by the injection part in the "cuda_api_type" request if it
+// can report the size of memory transfers, and repeated by the module
+// in the reply to enable it. The enter event of a memcpy or memset call
+// is then preceded by "@M <part ID> <direction> <bytes>", with
+// the direction being one of transfer_direction_name().
+#define NVGPU_TRANSFER_CAPABILITY "transfer1"
+
+typedef enum TransferDirection {
+  HOST_TO_DEVICE,
+  DEVICE_TO_HOST,
+  DEVICE_TO_DEVICE,
+  HOST_TO_HOST,
+  PEER_TO_PEER,
+
+  // cudaMemcpyDefault and cuMemcpy(), where the direction is inferred
+  // by CUDA from the pointers.
+  UNKNOWN_DIRECTION,
+  MEMSET,
+  TRANSFER_DIRECTIONS
+} TransferDirection;
+
+inline const char *transfer_direction_name(int direction) {
+  static const char *names[] = { "HtoD", "DtoH", "DtoD", "HtoH", "PtoP",
+                                 "default", "memset" };
+  return names[direction];
+}
+
+// Returns -1 if "name" is not a transfer direction.
+inline int parse_transfer_direction(std::string_view name) {
+  for (int i = 0; i < TRANSFER_DIRECTIONS; i++) {
+    if (name == transfer_direction_name(i)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Advertised by the injection part in the "cuda_api_type" request if it
+// can report the configuration of kernel launches, and repeated by
+// the module in the reply to enable it. The enter event of a launch
+// call is then preceded by "@G <part ID> <configuration>", with
+// the configuration being "<grid dims> <block dims> <dynamic shared
+// memory bytes> <stream>" (see write_launch_config()).
+#define NVGPU_LAUNCH_CAPABILITY "launch1"
+
+typedef struct LaunchConfig {
+  unsigned int grid[3];
+  unsigned int block[3];
+  unsigned long long shared_memory;
+  uintptr_t stream;
+} LaunchConfig;
+
+// Enough for any configuration written by write_launch_config().
+const std::size_t LAUNCH_CONFIG_SIZE = 128;
+
+// Writes a launch configuration to "buffer", which must have
+// LAUNCH_CONFIG_SIZE characters, as e.g. "128,1,1 256,1,1 0 7f3a2c001e0",
+// with the dims separated by commas and the stream handle in hex (0 for
+// the default stream). Returns the end of the written characters.
+inline char *write_launch_config(const LaunchConfig &config, char *buffer) {
+  char *end = buffer + LAUNCH_CONFIG_SIZE;
+  char *ptr = buffer;
+
+  for (const unsigned int *dims : { config.grid, config.block }) {
+    for (int i = 0; i < 3; i++) {
+      ptr = std::to_chars(ptr, end, dims[i]).ptr;
+      *ptr++ = i < 2 ? ',' : ' ';
+    }
+  }
+
+  ptr = std::to_chars(ptr, end, config.shared_memory).ptr;
+  *ptr++ = ' ';
+  return std::to_chars(ptr, end, config.stream, 16).ptr;
+}
+
+// Returns false if "str" is not a configuration written by
+// write_launch_config().
+inline bool valid_launch_config(std::string_view str) {
+  // Fields of the configuration and the separators after them.
+  const char separators[] = { ',', ',', ' ', ',', ',', ' ', ' ', '\0' };
+  std::size_t pos = 0;
+
+  for (char separator : separators) {
+    std::size_t start = pos;
+
+    while (pos < str.size() && std::isxdigit((unsigned char)str[pos])) {
+      pos++;
+    }
+
+    if (pos == start || (separator != '\0' &&
+                         (pos == str.size() || str[pos++] != separator))) {
+      return false;
+    }
+  }
+
+  return pos == str.size();
+}
+
+// Advertised by the injection part in the "cuda_api_type" request if it
+// can classify the functions it traces, and repeated by the module in
+// the reply to enable it. The first event of a function in one of
+// the categories below is then preceded by "@K <category> <function
+// name>", with the category being one of api_category_name().
+#define NVGPU_CATEGORY_CAPABILITY "category1"
+
+typedef enum ApiCategory {
+  API_OTHER,
+  API_LAUNCH,
+  API_MEMCPY,
+  API_MEMSET,
+  API_SYNC,
+  API_ALLOC,
+
+  // Creating, destroying, querying and recording streams and events.
+  API_STREAM,
+  API_GRAPH_LAUNCH,
+  API_CATEGORIES
+} ApiCategory;
+
+inline const char *api_category_name(int category) {
+  static const char *names[] = { "other", "launch", "memcpy", "memset",
+                                 "sync", "alloc", "stream", "graph" };
+  return names[category];
+}
+
+// Returns -1 if "name" is not a category.
+inline int parse_api_category(std::string_view name) {
+  for (int i = 0; i < API_CATEGORIES; i++) {
+    if (name == api_category_name(i)) {
+      return i;
+    }
+  }
+
+  return -1;
+}
+
+// Advertised by the injection part in the "cuda_api_type" request if it
+// can trace NVTX push/pop ranges, and repeated by the module in the reply
+// to enable it. A range is sent as a call of NVTX_RANGE_FUNCTION with
+// the range name as its symbol, i.e. its enter event in the text
+// protocol is "<timestamp> <part ID> enter [nvtx] <range name>". In
+// the binary protocol, the function is defined for the NVTX domain and
+// callback ID NVTX_RANGE_CBID, and range names are interned like kernel
+// symbols.
+#define NVGPU_NVTX_CAPABILITY "nvtx1"
+#define NVTX_RANGE_FUNCTION "[nvtx]"
+
+const uint16_t NVTX_RANGE_CBID = 0;
+
+// Fixed-size header of an event in the binary protocol. The Adaptyst
+// channel carries null-terminated strings, so the header is packed into
+// BINARY_HEADER_SIZE little-endian bytes and sent in base64 after
+// a '#' character.
+//
+// Function names are not sent with events. Instead, the first event
+// with a given domain and callback ID is preceded by a definition
+// line "@F<domain> <callback ID> <name>". Kernel symbols are interned
+// in the same way with "@S<PID> <ID> <symbol>", with ID 0 meaning "no
+// symbol". Every process numbers its symbols on its own, so a symbol
+// is identified by the PID of the defining process and its ID.
+typedef struct BinaryHeader {
+  unsigned long long timestamp;
+  uint32_t pid;
+  uint32_t tid;
+  uint8_t site;
+  uint8_t domain;
+  uint16_t cbid;
+  uint32_t symbol;
+} BinaryHeader;
+
+const unsigned long long BINARY_UNKNOWN_TIMESTAMP = (unsigned long long)-1;
+const int BINARY_HEADER_SIZE = 24;
+const int BINARY_RECORD_LENGTH = 1 + BINARY_HEADER_SIZE / 3 * 4;
+
+constexpr const char *base64_chars() {
+  return "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+}
+
+// Returns the value of a base64 character, or -1 if it is not one.
+inline int base64_value(char c) {
+  static const struct Table {
+    signed char values[256];
+
+    constexpr Table() : values() {
+      for (int i = 0; i < 256; i++) {
+        this->values[i] = -1;
+      }
+
+      for (int i = 0; i < 64; i++) {
+        this->values[(unsigned char)base64_chars()[i]] = i;
+      }
+    }
+  } table;
+
+  return table.values[(unsigned char)c];
+}
+
+// Writes BINARY_RECORD_LENGTH characters followed by a null
+// terminator to "out".
+inline void encode_binary_header(const BinaryHeader &header, char *out) {
+  unsigned char bytes[BINARY_HEADER_SIZE];
+
+  for (int i = 0; i < 8; i++) {
+    bytes[i] = (header.timestamp >> (8 * i)) & 0xff;
+  }
+
+  for (int i = 0; i < 4; i++) {
+    bytes[8 + i] = (header.pid >> (8 * i)) & 0xff;
+    bytes[12 + i] = (header.tid >> (8 * i)) & 0xff;
+    bytes[20 + i] = (header.symbol >> (8 * i)) & 0xff;
+  }
+
+  bytes[16] = header.site;
+  bytes[17] = header.domain;
+  bytes[18] = header.cbid & 0xff;
+  bytes[19] = (header.cbid >> 8) & 0xff;
+
+  const char *chars = base64_chars();
+  *out++ = '#';
+
+  for (int i = 0; i < BINARY_HEADER_SIZE; i += 3) {
+    uint32_t group = (bytes[i] << 16) | (bytes[i + 1] << 8) | bytes[i + 2];
+    *out++ = chars[(group >> 18) & 0x3f];
+    *out++ = chars[(group >> 12) & 0x3f];
+    *out++ = chars[(group >> 6) & 0x3f];
+    *out++ = chars[group & 0x3f];
+  }
+
+  *out = '\0';
+}
+
+// Decodes a '#'-prefixed binary event. Returns false if "str" is
+// not a valid one.
+inline bool decode_binary_header(std::string_view str, BinaryHeader &header) {
+  if (str.size() != BINARY_RECORD_LENGTH || str[0] != '#') {
+    return false;
+  }
+
+  unsigned char bytes[BINARY_HEADER_SIZE];
+
+  for (int i = 0; i < BINARY_HEADER_SIZE / 3; i++) {
+    uint32_t group = 0;
+
+    for (int j = 0; j < 4; j++) {
+      int value = base64_value(str[1 + 4 * i + j]);
+
+      if (value == -1) {
+        return false;
+      }
+
+      group = (group << 6) | value;
+    }
+
+    bytes[3 * i] = (group >> 16) & 0xff;
+    bytes[3 * i + 1] = (group >> 8) & 0xff;
+    bytes[3 * i + 2] = group & 0xff;
+  }
+
+  header.timestamp = 0;
+  header.pid = 0;
+  header.tid = 0;
+  header.symbol = 0;
+
+  for (int i = 0; i < 8; i++) {
+    header.timestamp |= (unsigned long long)bytes[i] << (8 * i);
+  }
+
+  for (int i = 0; i < 4; i++) {
+    header.pid |= (uint32_t)bytes[8 + i] << (8 * i);
+    header.tid |= (uint32_t)bytes[12 + i] << (8 * i);
+    header.symbol |= (uint32_t)bytes[20 + i] << (8 * i);
+  }
+
+  header.site = bytes[16];
+  header.domain = bytes[17];
+  header.cbid = bytes[18] | (bytes[19] << 8);
+
+  return true;
+}
+
+// Enough for the part ID of a binary event, "<PID>_<TID>".
+const std::size_t BINARY_PART_ID_SIZE = 32;
+
+// Writes the part ID of a binary event to "buffer", which must have
+// BINARY_PART_ID_SIZE characters, in the same form as in the text
+// protocol.
+inline std::string_view binary_part_id(const BinaryHeader &header,
+                                       char *buffer) {
+  char *end = buffer + BINARY_PART_ID_SIZE;
+  char *ptr = std::to_chars(buffer, end, header.pid).ptr;
+  *ptr++ = '_';
+  ptr = std::to_chars(ptr, end, header.tid).ptr;
+  return std::string_view(buffer, ptr - buffer);
+}
+
+// Turns lines sent by the injection part, either in the text or
+// the binary protocol, into Messages. Definitions of function and
+// symbol names are remembered for decoding subsequent binary events.
+//
+// The part ID in a decoded Message may point to an internal buffer
+// of the decoder, so it is valid only until the next call to decode().
+class MessageDecoder {
+public:
+  typedef enum Result {
+    INVALID,
+    EVENT,
+    DEFINITION
+  } Result;
+
+  Result decode(std::string_view line, Message &result) {
+    if (line.empty()) {
+      return INVALID;
+    }
+
+    if (line[0] == '@') {
+      return this->define(line.substr(1)) ? DEFINITION : INVALID;
+    }
+
+    if (line[0] != '#') {
+      return parse_message(line, result) ? EVENT : INVALID;
+    }
+
+    BinaryHeader header;
+
+    if (!decode_binary_header(line, header)) {
+      return INVALID;
+    }
+
+    uint32_t function_id = function_key(header.domain, header.cbid);
+    auto function = this->functions.find(function_id);
+
+    if (function == this->functions.end()) {
+      return INVALID;
+    }
+
+    const std::string *name = &function->second;
+
+    if (header.symbol != 0) {
+      auto symbol = this->symbols.find(symbol_key(header.pid, header.symbol));
+
+      if (symbol == this->symbols.end()) {
+        return INVALID;
+      }
+
+      // Full names are built once per function and symbol pair.
+      auto full_name = symbol->second.full_names.find(function_id);
+
+      if (full_name == symbol->second.full_names.end()) {
+        full_name = symbol->second.full_names.emplace(
+          function_id, function->second + " " + symbol->second.name).first;
+      }
+
+      name = &full_name->second;
+    }
+
+    result.timestamp_known = header.timestamp != BINARY_UNKNOWN_TIMESTAMP;
+    result.timestamp = result.timestamp_known ? header.timestamp : 0;
+    result.part_id = binary_part_id(header, this->part_id);
+    result.func_name = *name;
+
+    if (header.site == 0) {
+      result.state = Message::ENTER;
+    } else if (header.site == 1) {
+      result.state = Message::EXIT;
+    } else {
+      return INVALID;
+    }
+
+    return EVENT;
+  }
+
+  static uint32_t function_key(uint8_t domain, uint16_t cbid) {
+    return ((uint32_t)domain << 16) | cbid;
+  }
+
+  static uint64_t symbol_key(uint32_t pid, uint32_t id) {
+    return ((uint64_t)pid << 32) | id;
+  }
+
+private:
+  typedef struct Symbol {
+    std::string name;
+
+    // "<function name> <symbol name>" by function key.
+    std::unordered_map<uint32_t, std::string> full_names;
+  } Symbol;
+
+  bool define(std::string_view definition) {
+    if (definition.empty()) {
+      return false;
+    }
+
+    char type = definition[0];
+    definition.remove_prefix(1);
+
+    std::string_view first;
+    uint32_t owner = 0, id = 0;
+
+    // The domain of a function or the PID of a symbol.
+    if (!next_message_token(definition, first) ||
+        !parse_number(first, owner)) {
+      return false;
+    }
+
+    if (!next_message_token(definition, first) || !parse_number(first, id) ||
+        definition.empty()) {
+      return false;
+    }
+
+    if (type == 'F') {
+      if (owner > 0xff || id > 0xffff) {
+        return false;
+      }
+
+      uint32_t key = function_key(owner, id);
+      std::string &name = this->functions[key];
+
+      // Full names built with the previous name are stale.
+      if (!name.empty() && name != definition) {
+        for (auto &symbol : this->symbols) {
+          symbol.second.full_names.erase(key);
+        }
+      }
+
+      name = definition;
+    } else if (type == 'S' && id != 0) {
+      // A new definition of a symbol replaces its full names too.
+      this->symbols[symbol_key(owner, id)] = { std::string(definition), {} };
+    } else {
+      return false;
+    }
+
+    return true;
+  }
+
+  static bool parse_number(std::string_view str, uint32_t &result) {
+    const char *end = str.data() + str.size();
+    auto [ptr, ec] = std::from_chars(str.data(), end, result);
+    return ec == std::errc() && ptr == end;
+  }
+
+  std::unordered_map<uint32_t, std::string> functions;
+  std::unordered_map<uint64_t, Symbol> symbols;
+  char part_id[BINARY_PART_ID_SIZE];
+};
+
+#endif
@@ -5,18 +5,42 @@
 #include <adaptyst/hw.h>
 
 #include <string>
+#include <string_view>
 #include <unordered_map>
 #include <vector>
-#include <regex>
 #include <mutex>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <deque>
+#include <chrono>
 #include <nlohmann/json.hpp>
 #include <filesystem>
 #include <fstream>
+#include <map>
+#include <cstring>
+#include <algorithm>
+#include <set>
+#include "message.hpp"
+#include "region_index.hpp"
+#include "call_tree.hpp"
+#include "process_summary.hpp"
+#include "api_filter.hpp"
+#include "timeline.hpp"
+#include "clock.hpp"
 
 volatile const char *name = "nvgpu";
 volatile const char *version = "0.1.0-dev.2026.03a";
 volatile const int version_nums[] = {0, 1, 0, 2, -1};
-volatile const char *options[] = { "cuda_api_type", NULL };
+volatile const char *options[] = { "cuda_api_type", "cuda_api_include",
+                                   "cuda_api_exclude", "wire_protocol",
+                                   "extra_output", "timeline", "per_thread",
+                                   "aggregation_threads", "overhead_correction",
+                                   "queue_policy", "checkpoint_interval",
+                                   "checkpoint_size", "fast_clock", "nvtx",
+                                   "tree_memory_limit", "per_process",
+                                   NULL };
 volatile const char *tags[] = { NULL };
 volatile const char *log_types[] = { NULL };
 volatile const unsigned int max_count_per_entity = 1;
@@ -26,32 +50,2054 @@ volatile const char *cuda_api_type_help = "CUDA API calls to trace "
 volatile const option_type cuda_api_type_type = STRING;
 volatile const char *cuda_api_type_default = "both";
 
+volatile const char *cuda_api_include_help = "Comma-separated list of "
+  "CUDA API functions to trace among those selected by cuda_api_type, "
+  "where an item is a function name (e.g. \"cudaMemcpy\") or one of "
+  "the categories \"launch\", \"memcpy\", \"memset\", \"sync\", "
+  "\"alloc\", \"stream\", \"graph\", and \"other\" (functions in "
+  "none of the others) (default: empty, i.e. all functions)";
+volatile const option_type cuda_api_include_type = STRING;
+volatile const char *cuda_api_include_default = "";
+
+volatile const char *cuda_api_exclude_help = "Comma-separated list of "
+  "CUDA API functions not to trace, in the same format as for "
+  "cuda_api_include (default: empty)";
+volatile const option_type cuda_api_exclude_type = STRING;
+volatile const char *cuda_api_exclude_default = "";
+
+volatile const char *wire_protocol_help = "Format of events sent from "
+  "the profiled program to the module (\"binary\" or \"text\", "
+  "default: \"binary\"), \"text\" is used regardless if the other "
+  "side does not support \"binary\"";
+volatile const option_type wire_protocol_type = STRING;
+volatile const char *wire_protocol_default = "binary";
+
+volatile const char *extra_output_help = "Additional output written "
+  "next to regions.json (\"none\" or \"table\" for regions.bin, "
+  "a flat table of call tree nodes which can be memory-mapped, "
+  "default: \"none\")";
+volatile const option_type extra_output_type = STRING;
+volatile const char *extra_output_default = "none";
+
+volatile const char *timeline_help = "Whether to record every finished "
+  "call in a region with its start and end (\"none\" or \"chrome\" for "
+  "timeline.json in the Chrome trace event format, default: \"none\"), "
+  "calls are spilled to a memory-mapped file during profiling and "
+  "converted at the end";
+volatile const option_type timeline_type = STRING;
+volatile const char *timeline_default = "none";
+
+volatile const char *per_thread_help = "Whether to also write the call "
+  "tree of every thread (part ID) of each region to regions.json, "
+  "under \"threads\" next to \"data\" (default: false)";
+volatile const option_type per_thread_type = BOOL;
+volatile const bool per_thread_default = false;
+
+volatile const char *aggregation_threads_help = "Number of threads "
+  "aggregating events, with events of each thread of the profiled "
+  "program always handled by the same aggregation thread (default: 1, "
+  "i.e. events are aggregated by the thread receiving them)";
+volatile const option_type aggregation_threads_type = UNSIGNED_INT;
+volatile const unsigned int aggregation_threads_default = 1;
+
+volatile const char *overhead_correction_help = "Whether to subtract "
+  "the estimated time spent in the callbacks of nested calls from "
+  "the lengths and times in regions.json, based on the average "
+  "callback time in overhead.json (default: false)";
+volatile const option_type overhead_correction_type = BOOL;
+volatile const bool overhead_correction_default = false;
+
+volatile const char *queue_policy_help = "What the profiled program "
+  "does when the module falls behind and its event buffers fill up "
+  "(\"block\" to wait, \"drop\" to lose new events, or \"sample\" to "
+  "also trace only some of the calls once the buffers are mostly full, "
+  "default: \"block\"), lost events are counted in overhead.json and "
+  "call tree nodes which may be missing some calls are marked as "
+  "incomplete";
+volatile const option_type queue_policy_type = STRING;
+volatile const char *queue_policy_default = "block";
+
+volatile const char *checkpoint_interval_help = "Number of seconds "
+  "between checkpoints, at which the call trees of regions which have "
+  "ended with no calls left unfinished are written to "
+  "checkpoint.<number>.json and removed from memory, to be merged into "
+  "regions.json at the end (default: 0, i.e. no checkpoints based on "
+  "time), checkpoint files are in the regions.json format with "
+  "\"histogram\" added to every node and are left behind if profiling "
+  "does not finish";
+volatile const option_type checkpoint_interval_type = UNSIGNED_INT;
+volatile const unsigned int checkpoint_interval_default = 0;
+
+volatile const char *checkpoint_size_help = "Number of MiB of events "
+  "received between checkpoints, see checkpoint_interval (default: 0, "
+  "i.e. no checkpoints based on size)";
+volatile const option_type checkpoint_size_type = UNSIGNED_INT;
+volatile const unsigned int checkpoint_size_default = 0;
+
+volatile const char *fast_clock_help = "Whether the profiled program "
+  "should timestamp events with the time stamp counter or "
+  "CLOCK_MONOTONIC_RAW instead of the Adaptyst clock, converting them "
+  "with calibration points taken regularly (default: false), the largest "
+  "drift of the clock between two points is in overhead.json";
+volatile const option_type fast_clock_type = BOOL;
+volatile const bool fast_clock_default = false;
+
+volatile const char *nvtx_help = "Whether to also trace NVTX push/pop "
+  "ranges of the profiled program, each becoming a call tree node named "
+  "\"[nvtx] <range name>\" with the calls made in the range as its "
+  "children (default: false), NVTX_INJECTION64_PATH must point to "
+  "the CUPTI library for the ranges to be seen";
+volatile const option_type nvtx_type = BOOL;
+volatile const bool nvtx_default = false;
+
+volatile const char *tree_memory_limit_help = "Number of MiB the call "
+  "tree of a thread in a region may take, past which the tree keeps only "
+  "its heaviest call paths and folds the other calls into \"[other]\" "
+  "nodes with the same totals (default: 0, i.e. no limit), the number of "
+  "folded nodes is in overhead.json; names of functions and kernels are "
+  "not covered by the limit and are kept until the end, taking about "
+  "0.5 KiB per kernel in every aggregation thread handling its calls";
+volatile const option_type tree_memory_limit_type = UNSIGNED_INT;
+volatile const unsigned int tree_memory_limit_default = 0;
+
+volatile const char *per_process_help = "Whether to also write the call "
+  "tree of every process (PID in the part ID) of each region to "
+  "regions.json under \"processes\", together with the minimum, maximum, "
+  "mean, and imbalance of the length of every call path across "
+  "the processes under \"summary\", with processes not making the calls "
+  "of a path counting as 0 (default: false)";
+volatile const option_type per_process_type = BOOL;
+volatile const bool per_process_default = false;
+
 namespace fs = std::filesystem;
 
-class NvgpuModule {
-private:
-  typedef struct Region {
-    bool start_defined;
-    unsigned long long start;
-    bool end_defined;
-    unsigned long long end;
-  } Region;
+class NvgpuModule {
+private:
+  typedef struct Region {
+    bool start_defined;
+    unsigned long long start;
+    bool end_defined;
+    unsigned long long end;
+
+    // When region_end() was called, for checkpoints.
+    std::chrono::steady_clock::time_point end_received;
+  } Region;
+
+  // Allows looking up std::string keys by std::string_view without
+  // constructing a temporary std::string.
+  typedef struct StringHash {
+    using is_transparent = void;
+
+    std::size_t operator()(std::string_view str) const {
+      return std::hash<std::string_view>()(str);
+    }
+  } StringHash;
+
+  template<typename T>
+  using StringMap = std::unordered_map<std::string, T, StringHash,
+                                       std::equal_to<> >;
+
+  typedef StringMap<std::shared_ptr<const RegionIndex> > RegionSnapshot;
+
+  // Returns the PID in a part ID, which is "<PID>_<TID>".
+  static std::string_view process_id(std::string_view part_id) {
+    return part_id.substr(0, part_id.find('_'));
+  }
+
+  typedef struct Frame {
+    uint32_t name;
+    unsigned long long timestamp;
+
+    // Node of the frame in the call tree, or CallTree::NONE if it
+    // has not been looked up yet.
+    uint32_t node;
+
+    // Transfer made by the call, with direction -1 if there is none.
+    int direction;
+    unsigned long long bytes;
+
+    // Name ID of the launch configuration of the call, or
+    // CallTree::NONE if it is not a kernel launch or it is unknown.
+    uint32_t launch;
+  } Frame;
+
+  // Calls made by a single thread (part ID) within a region. Every
+  // thread has its own stack, so that calls of threads running at
+  // the same time do not interleave.
+  typedef struct PartState {
+    CallTree tree;
+    std::vector<Frame> stack;
+
+    // Name IDs of the part and the region, for the timeline.
+    uint32_t part_name;
+    uint32_t region_name;
+
+    // Set once events of the part have been lost, after which exits
+    // not matching the stack are expected (see unwind()).
+    bool lossy;
+  } PartState;
+
+  typedef struct RegionState {
+    StringMap<PartState> parts;
+
+    // Call trees of all parts merged together, set at the end of
+    // profiling if there is more than one part or the region has been
+    // restored from checkpoints.
+    CallTree tree;
+    bool restored;
+
+    // Call trees of the processes by PID, set at the end of profiling
+    // if per_process is set.
+    std::map<std::string, CallTree> processes;
+  } RegionState;
+
+  // Everything written about a region at the end of profiling.
+  typedef struct RegionOutput {
+    // Whether length and start are set.
+    bool defined;
+    unsigned long long length;
+    unsigned long long start;
+
+    // nullptr if no call has finished in the region.
+    const CallTree *tree;
+
+    // Trees of the individual parts, filled only if per_thread
+    // is set.
+    std::map<std::string, const CallTree *> threads;
+
+    // Trees of the individual processes and their summary, filled only
+    // if per_process is set. summary is nullptr in checkpoints.
+    std::map<std::string, const CallTree *> processes;
+    const ProcessSummary *summary;
+  } RegionOutput;
+
+  // Header of regions.bin, a flat table of all call tree nodes which
+  // can be memory-mapped instead of parsed. It is followed by:
+  // * name_count NameEntries, pointing into the string blob,
+  // * region_count TableRegions,
+  // * node_count TableNodes, with each region starting with
+  //   the root of its tree (named CallTree::NONE) and all indices
+  //   relative to the start of the table,
+  // * string_size bytes of names (not null-terminated).
+  // All integers are in the byte order of the machine running
+  // the module.
+  typedef struct TableHeader {
+    char magic[8];
+    uint64_t name_count;
+    uint64_t region_count;
+    uint64_t node_count;
+    uint64_t string_size;
+  } TableHeader;
+
+  typedef struct NameEntry {
+    uint64_t offset;
+    uint64_t size;
+  } NameEntry;
+
+  // A call tree node together with its statistics which are not
+  // stored in CallTree::Node. incomplete is 1 for nodes marked with
+  // CallTree::mark_incomplete() and 0 otherwise. bytes and
+  // transfer_time are the totals of CallTree::total_transfer().
+  typedef struct TableNode {
+    CallTree::Node node;
+    uint64_t self;
+    uint64_t p50;
+    uint64_t p99;
+    uint64_t incomplete;
+    uint64_t bytes;
+    uint64_t transfer_time;
+  } TableNode;
+
+  typedef struct TableRegion {
+    uint32_t name;
+
+    // Index of the root node, or CallTree::NONE if the region
+    // has no call tree.
+    uint32_t root;
+    uint64_t length;
+    uint64_t start;
+  } TableRegion;
+
+  std::string cuda_api_type;
+  std::vector<std::string> cuda_api_include;
+  std::vector<std::string> cuda_api_exclude;
+  std::string wire_protocol;
+  std::string extra_output;
+  std::string timeline;
+  bool per_thread;
+  bool per_process;
+  bool overhead_correction;
+  std::string queue_policy;
+  bool fast_clock;
+  bool nvtx;
+
+  // Whether the injection part sends timestamps in FastClock ticks.
+  bool fast_clock_used;
+
+  // Whether the injection part sends the categories of functions,
+  // which are then in this->function_categories by function name.
+  bool categories_used;
+  StringMap<int> function_categories;
+  amod_t module_id;
+  StringMap<StringMap<Region> > regions;
+  std::mutex region_lock;
+
+  // Read-only view of this->regions used for matching events. It is
+  // replaced as a whole under region_lock whenever a region starts or
+  // ends, and region_version is increased afterwards. Every shard
+  // keeps its own copy and takes the lock only when the version changes.
+  std::shared_ptr<const RegionSnapshot> region_snapshot;
+  std::atomic<unsigned long long> region_version;
+
+  // Aggregation state of events from a subset of part IDs. With more
+  // than one shard, each is updated only by its own worker thread,
+  // which gets batches of lines from the receiving thread.
+  // Counters of the cost of handling events, see overhead.json.
+  typedef struct EventCounters {
+    unsigned long long events;
+    unsigned long long invalid;
+    unsigned long long unknown_timestamp;
+    unsigned long long no_active_region;
+    unsigned long long stack_mismatch;
+    unsigned long long pruned_nodes;
+
+    // Estimated from every TIMING_INTERVAL-th event, in nanoseconds.
+    unsigned long long matching_time;
+    unsigned long long aggregation_time;
+  } EventCounters;
+
+  // Details of a call sent before its enter event, as in Frame.
+  typedef struct PendingCall {
+    int direction;
+    unsigned long long bytes;
+    uint32_t launch;
+  } PendingCall;
+
+  typedef struct Shard {
+    NameTable names;
+    StringMap<RegionState> region_states;
+    MessageDecoder decoder;
+    std::shared_ptr<const RegionSnapshot> cached_regions;
+    unsigned long long cached_region_version;
+
+    // Reused between messages so that no allocation happens here
+    // in the steady state. The views point to region names in
+    // cached_regions.
+    std::vector<std::string_view> applicable_regions;
+
+    // Lines collected by the receiving thread for the next batch.
+    std::string pending;
+
+    EventCounters counters;
+
+    // Events lost by the injection part per part ID, see handle_loss().
+    std::map<std::string, unsigned long long> lost;
+
+    // Transfers and launch configurations from "@M" and "@G" lines
+    // waiting for the enter events of their calls, per part ID, see
+    // handle_transfer() and handle_launch().
+    StringMap<PendingCall> pending_calls;
+
+    // Clocks of the injection parts per PID if their timestamps are
+    // in FastClock ticks, and the largest difference in nanoseconds
+    // between a calibration point and the timestamp predicted for it
+    // from the previous one, see handle_calibration().
+    std::unordered_map<uint32_t, ClockConversion> clocks;
+    unsigned long long clock_drift_max;
+
+    // Finished calls, if the timeline is recorded.
+    std::unique_ptr<TimelineWriter> timeline;
+    fs::path timeline_path;
+
+    std::thread worker;
+    std::mutex queue_lock;
+    std::condition_variable queue_cond;
+    std::deque<std::string> queue;
+    bool finished;
+
+    // Whether the worker thread is handling a batch.
+    bool busy;
+    std::string error;
+  } Shard;
+
+  // Maximum number of batches queued for a worker thread before
+  // the receiving thread waits.
+  static constexpr std::size_t MAX_QUEUED_BATCHES = 64;
+
+  std::vector<std::unique_ptr<Shard> > shards;
+  std::mutex print_lock;
+
+  // Only every TIMING_INTERVAL-th event is timed, so that reading
+  // the clock does not add much to the cost being measured.
+  static const unsigned long long TIMING_INTERVAL = 64;
+
+  // Timeouts of waiting for messages, in milliseconds, see
+  // receive_message(). At most MAX_MESSAGES_PER_WAKEUP messages are
+  // handled before checking whether a checkpoint is due.
+  static constexpr long MIN_RECEIVE_TIMEOUT = 1;
+  static constexpr long MAX_RECEIVE_TIMEOUT = 128;
+  static constexpr std::size_t MAX_MESSAGES_PER_WAKEUP = 64;
+
+  long receive_timeout;
+  unsigned long long messages_received;
+  unsigned long long receive_timeouts;
+
+  // Sums of the counters sent by the injection parts in "@O" lines,
+  // and the number of such lines.
+  std::map<std::string, unsigned long long> injection_counters;
+  unsigned long long injection_reports;
+
+  // Events lost by the injection parts per function, from "@A" lines.
+  std::map<std::string, unsigned long long> lost_functions;
+
+  // A region is written to a checkpoint only once it has ended
+  // CHECKPOINT_DELAY ago, by which time the injection parts should
+  // have sent all of its events.
+  static constexpr std::chrono::seconds CHECKPOINT_DELAY{1};
+
+  fs::path module_dir;
+  unsigned int checkpoint_interval;
+  unsigned long long checkpoint_size;
+
+  // Node limit of every call tree, or 0 for none, see
+  // CallTree::set_node_limit().
+  std::size_t tree_node_limit;
+  unsigned int checkpoint_count;
+  std::chrono::steady_clock::time_point last_checkpoint;
+  unsigned long long bytes_since_checkpoint;
+
+  // adaptyst_print() for messages about events, which may be printed
+  // by several worker threads.
+  void print_event_warning(const std::string &message) {
+    std::unique_lock lock(this->print_lock);
+    adaptyst_print(this->module_id, message.c_str(), true, false, "General");
+  }
+
+  // Fills shard.applicable_regions with the regions of a part active
+  // at a given time. Returns false if the part has no regions at all.
+  bool find_regions(Shard &shard, std::string_view part_id,
+                    unsigned long long timestamp) {
+    shard.applicable_regions.clear();
+
+    unsigned long long version =
+      this->region_version.load(std::memory_order_acquire);
+
+    if (version != shard.cached_region_version) {
+      std::unique_lock lock(this->region_lock);
+      shard.cached_regions = this->region_snapshot;
+      shard.cached_region_version = version;
+    }
+
+    auto part_regions = shard.cached_regions->find(part_id);
+
+    if (part_regions == shard.cached_regions->end()) {
+      return false;
+    }
+
+    part_regions->second->stab(timestamp, [&shard](const std::string &name) {
+      shard.applicable_regions.push_back(name);
+    });
+
+    return true;
+  }
+
+  // Returns the state of a part in a region, creating both if needed.
+  PartState &part_state(Shard &shard, std::string_view region_name,
+                        std::string_view part_id) {
+    auto region = shard.region_states.find(region_name);
+
+    if (region == shard.region_states.end()) {
+      region = shard.region_states.emplace(region_name, RegionState()).first;
+    }
+
+    auto part = region->second.parts.find(part_id);
+
+    if (part == region->second.parts.end()) {
+      part = region->second.parts.emplace(part_id, PartState()).first;
+      part->second.part_name = shard.names.intern(part_id);
+      part->second.region_name = shard.names.intern(region_name);
+      part->second.lossy = false;
+      part->second.tree.set_node_limit(this->tree_node_limit);
+    }
+
+    return part->second;
+  }
+
+  // Marks the nodes of the frames of a part from the first-th one up
+  // as incomplete, looking them up in the call tree if needed.
+  void mark_incomplete(PartState &part, std::size_t first) {
+    uint32_t parent = CallTree::ROOT;
+
+    for (std::size_t i = 0; i < part.stack.size(); i++) {
+      Frame &frame = part.stack[i];
+
+      if (frame.node == CallTree::NONE) {
+        frame.node = part.tree.child(parent, frame.name);
+      }
+
+      if (i >= first) {
+        part.tree.mark_incomplete(frame.node);
+      }
+
+      parent = frame.node;
+    }
+  }
+
+  // Prunes the call tree of a part (see CallTree::prune()), keeping
+  // the nodes of its stack.
+  void prune(Shard &shard, PartState &part) {
+    std::vector<uint32_t> pinned;
+
+    for (auto &frame : part.stack) {
+      if (frame.node != CallTree::NONE) {
+        pinned.push_back(frame.node);
+      }
+    }
+
+    std::size_t size = part.tree.size();
+    std::vector<uint32_t> new_index =
+      part.tree.prune(shard.names.intern(CallTree::OTHER_NAME), pinned);
+
+    for (auto &frame : part.stack) {
+      if (frame.node != CallTree::NONE) {
+        frame.node = new_index[frame.node];
+      }
+    }
+
+    shard.counters.pruned_nodes += size - part.tree.size();
+  }
+
+  // Pops the frames above the innermost one called "name" from
+  // the stack of a part which has lost events, since their exits must
+  // have been lost. The stack is left as it is if there is no such
+  // frame, i.e. if the enter of the call has been lost instead.
+  void unwind(PartState &part, uint32_t name) {
+    auto frame = std::find_if(part.stack.rbegin(), part.stack.rend(),
+                              [name](const Frame &frame) {
+                                return frame.name == name;
+                              });
+
+    if (frame == part.stack.rend() || frame == part.stack.rbegin()) {
+      return;
+    }
+
+    std::size_t size = part.stack.rend() - frame;
+    this->mark_incomplete(part, size);
+    part.stack.resize(size);
+  }
+
+  // Handles "@C <PID> <ticks> <timestamp> <nanoseconds per tick>",
+  // see NVGPU_CLOCK_CAPABILITY. Every shard gets these lines in
+  // the same order relative to the events of the process as they were
+  // sent, so it can convert the timestamps of the events itself.
+  void handle_calibration(Shard &shard, std::string_view line) {
+    std::string_view fields = line, type, pid_str, ticks_str, timestamp_str;
+    uint32_t pid;
+    FastClock::Point point;
+    double rate;
+
+    auto parse = [](std::string_view str, auto &result) {
+      const char *end = str.data() + str.size();
+      auto [ptr, ec] = std::from_chars(str.data(), end, result);
+      return ec == std::errc() && ptr == end;
+    };
+
+    if (!next_message_token(fields, type) || type != "@C" ||
+        !next_message_token(fields, pid_str) ||
+        !next_message_token(fields, ticks_str) ||
+        !next_message_token(fields, timestamp_str) ||
+        !parse(pid_str, pid) || !parse(ticks_str, point.ticks) ||
+        !parse(timestamp_str, point.timestamp) || !parse(fields, rate) ||
+        rate <= 0) {
+      shard.counters.invalid++;
+      this->print_event_warning("Invalid message from the injection part, "
+                                "ignoring: " + std::string(line));
+      return;
+    }
+
+    auto [clock, inserted] = shard.clocks.try_emplace(pid);
+
+    if (!inserted) {
+      unsigned long long predicted = clock->second.convert(point.ticks);
+      unsigned long long drift = predicted > point.timestamp ?
+        predicted - point.timestamp : point.timestamp - predicted;
+      shard.clock_drift_max = std::max(shard.clock_drift_max, drift);
+    }
+
+    clock->second.set(point, rate);
+  }
+
+  // Converts the FastClock ticks of an event of a part to an Adaptyst
+  // timestamp. Returns false if the process of the part has not sent
+  // any calibration point.
+  bool convert_timestamp(Shard &shard, std::string_view part_id,
+                         unsigned long long &timestamp) {
+    uint32_t pid;
+
+    if (std::from_chars(part_id.data(), part_id.data() + part_id.size(),
+                        pid).ec != std::errc()) {
+      return false;
+    }
+
+    auto clock = shard.clocks.find(pid);
+
+    if (clock == shard.clocks.end()) {
+      return false;
+    }
+
+    timestamp = clock->second.convert(timestamp);
+    return true;
+  }
+
+  // Handles "@L <timestamp> <part ID> <count>", see
+  // NVGPU_POLICY_CAPABILITY. In every region of the part active when
+  // the first event was lost, the region and the calls on the stack
+  // of the part are marked as incomplete, as they may have lost some
+  // of their nested calls.
+  void handle_loss(Shard &shard, std::string_view line) {
+    std::string_view fields = line, type, timestamp_str, part_id;
+    unsigned long long timestamp, count;
+
+    auto parse = [](std::string_view str, unsigned long long &result) {
+      const char *end = str.data() + str.size();
+      auto [ptr, ec] = std::from_chars(str.data(), end, result);
+      return ec == std::errc() && ptr == end;
+    };
+
+    if (!next_message_token(fields, type) || type != "@L" ||
+        !next_message_token(fields, timestamp_str) ||
+        !next_message_token(fields, part_id) ||
+        !parse(timestamp_str, timestamp) || !parse(fields, count)) {
+      shard.counters.invalid++;
+      this->print_event_warning("Invalid message from the injection part, "
+                                "ignoring: " + std::string(line));
+      return;
+    }
+
+    shard.lost[std::string(part_id)] += count;
+
+    if (this->fast_clock_used &&
+        !this->convert_timestamp(shard, part_id, timestamp)) {
+      shard.counters.unknown_timestamp++;
+      return;
+    }
+
+    if (!this->find_regions(shard, part_id, timestamp)) {
+      return;
+    }
+
+    for (auto &region_name : shard.applicable_regions) {
+      PartState &part = this->part_state(shard, region_name, part_id);
+      part.lossy = true;
+      part.tree.mark_incomplete(CallTree::ROOT);
+      this->mark_incomplete(part, 0);
+    }
+  }
+
+  // Handles "@M <part ID> <direction> <bytes>", see
+  // NVGPU_TRANSFER_CAPABILITY. The transfer is given to the call
+  // started by the next event of the part, which is dropped if it is
+  // not an enter (e.g. because the enter has been lost).
+  void handle_transfer(Shard &shard, std::string_view line) {
+    std::string_view fields = line, type, part_id, direction_str;
+    int direction = -1;
+    unsigned long long bytes;
+
+    if (next_message_token(fields, type) && type == "@M" &&
+        next_message_token(fields, part_id) &&
+        next_message_token(fields, direction_str)) {
+      direction = parse_transfer_direction(direction_str);
+    }
+
+    const char *end = fields.data() + fields.size();
+    auto [ptr, ec] = std::from_chars(fields.data(), end, bytes);
+
+    if (direction == -1 || ec != std::errc() || ptr != end) {
+      shard.counters.invalid++;
+      this->print_event_warning("Invalid message from the injection part, "
+                                "ignoring: " + std::string(line));
+      return;
+    }
+
+    shard.pending_calls[std::string(part_id)] = { direction, bytes,
+                                                  CallTree::NONE };
+  }
+
+  // Handles "@G <part ID> <configuration>", see NVGPU_LAUNCH_CAPABILITY.
+  // The configuration is given to the next event of the part in
+  // the same way as a transfer in handle_transfer().
+  void handle_launch(Shard &shard, std::string_view line) {
+    std::string_view config = line, type, part_id;
+
+    if (!next_message_token(config, type) || type != "@G" ||
+        !next_message_token(config, part_id) ||
+        !valid_launch_config(config)) {
+      shard.counters.invalid++;
+      this->print_event_warning("Invalid message from the injection part, "
+                                "ignoring: " + std::string(line));
+      return;
+    }
+
+    shard.pending_calls[std::string(part_id)] = { -1, 0,
+                                                  shard.names.intern(config) };
+  }
+
+  // Handles a single line sent by the injection part.
+  void handle_line(Shard &shard, std::string_view line) {
+    if (line.starts_with("@L")) {
+      this->handle_loss(shard, line);
+      return;
+    } else if (line.starts_with("@C")) {
+      this->handle_calibration(shard, line);
+      return;
+    } else if (line.starts_with("@M")) {
+      this->handle_transfer(shard, line);
+      return;
+    } else if (line.starts_with("@G")) {
+      this->handle_launch(shard, line);
+      return;
+    }
+
+    Message message;
+    MessageDecoder::Result result = shard.decoder.decode(line, message);
+
+    if (result == MessageDecoder::INVALID) {
+      shard.counters.invalid++;
+      this->print_event_warning("Invalid message from the injection part, "
+                                "ignoring: " + std::string(line));
+      return;
+    } else if (result == MessageDecoder::DEFINITION) {
+      return;
+    }
+
+    PendingCall call = { -1, 0, CallTree::NONE };
+
+    if (!shard.pending_calls.empty()) {
+      auto found = shard.pending_calls.find(message.part_id);
+
+      if (found != shard.pending_calls.end()) {
+        if (message.state == Message::ENTER) {
+          call = found->second;
+        }
+
+        shard.pending_calls.erase(found);
+      }
+    }
+
+    if (!message.timestamp_known ||
+        (this->fast_clock_used &&
+         !this->convert_timestamp(shard, message.part_id,
+                                  message.timestamp))) {
+      shard.counters.unknown_timestamp++;
+      this->print_event_warning("Unknown timestamp received from the "
+                                "injection part, ignoring: " +
+                                std::string(line));
+      return;
+    }
+
+    bool timed = shard.counters.events++ % TIMING_INTERVAL == 0;
+    std::chrono::steady_clock::time_point start_time, matched_time;
+
+    if (timed) {
+      start_time = std::chrono::steady_clock::now();
+    }
+
+    unsigned long long timestamp = message.timestamp;
+
+    if (!this->find_regions(shard, message.part_id, timestamp)) {
+      shard.counters.no_active_region++;
+      this->print_event_warning(std::string(message.part_id) +
+                                " doesn't seem to have any active regions, "
+                                "ignoring: " + std::string(line));
+      return;
+    }
+
+    if (timed) {
+      matched_time = std::chrono::steady_clock::now();
+      shard.counters.matching_time += TIMING_INTERVAL *
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          matched_time - start_time).count();
+    }
+
+    uint32_t func_name;
+
+    if (message.state == Message::ENTER) {
+      func_name = shard.names.intern(message.func_name);
+    } else if (!shard.names.find(message.func_name, func_name)) {
+      func_name = CallTree::NONE;
+    }
+
+    for (auto &region_name : shard.applicable_regions) {
+      if (message.state == Message::ENTER) {
+        PartState &part = this->part_state(shard, region_name,
+                                           message.part_id);
+        part.stack.push_back({ func_name, timestamp, CallTree::NONE,
+                               call.direction, call.bytes, call.launch });
+      } else if (message.state == Message::EXIT) {
+        auto region = shard.region_states.find(region_name);
+        StringMap<PartState>::iterator part;
+        bool found = region != shard.region_states.end() &&
+          (part = region->second.parts.find(message.part_id)) !=
+          region->second.parts.end();
+
+        if (found && part->second.lossy) {
+          this->unwind(part->second, func_name);
+        }
+
+        if (!found || part->second.stack.empty() ||
+            part->second.stack.back().name != func_name) {
+          shard.counters.stack_mismatch++;
+
+          // Expected after losing the enter of the call.
+          if (!found || !part->second.lossy) {
+            this->print_event_warning("Received message from the injection "
+                                      "part doesn't correspond to the current "
+                                      "stack of region \"" +
+                                      std::string(region_name) +
+                                      "\", ignoring: " + std::string(line));
+          }
+
+          continue;
+        }
+
+        auto &cur_stack = part->second.stack;
+        CallTree &tree = part->second.tree;
+
+        unsigned long long length = timestamp - cur_stack.back().timestamp;
+
+        // The length is added to every node on the current call path.
+        // Nodes are looked up only once per frame and remembered
+        // for the later exits of the frames below.
+        uint32_t parent = CallTree::ROOT;
+
+        for (auto &frame : cur_stack) {
+          if (frame.node == CallTree::NONE) {
+            frame.node = tree.child(parent, frame.name);
+          }
+
+          tree.node(frame.node).length += length;
+          parent = frame.node;
+        }
+
+        tree.add_call(cur_stack.back().node, length);
+
+        if (cur_stack.back().direction != -1) {
+          tree.add_transfer(cur_stack.back().node, cur_stack.back().direction,
+                            cur_stack.back().bytes, length);
+        }
+
+        if (cur_stack.back().launch != CallTree::NONE) {
+          tree.add_launch(cur_stack.back().node, cur_stack.back().launch,
+                          length);
+        }
+
+        if (shard.timeline &&
+            !shard.timeline->append({ cur_stack.back().timestamp, timestamp,
+                                      part->second.part_name,
+                                      part->second.region_name, func_name,
+                                      (uint32_t)cur_stack.size() - 1 })) {
+          this->print_event_warning("Stopping the timeline: " +
+                                    shard.timeline->error());
+          shard.timeline.reset();
+        }
+
+        cur_stack.pop_back();
+
+        if (tree.over_limit()) {
+          this->prune(shard, part->second);
+        }
+      }
+    }
+
+    if (timed) {
+      shard.counters.aggregation_time += TIMING_INTERVAL *
+        std::chrono::duration_cast<std::chrono::nanoseconds>(
+          std::chrono::steady_clock::now() - matched_time).count();
+    }
+  }
+
+  // Adds the counters of an "@O <name>=<value> ..." or
+  // "@A <name>=<value> ..." line to "counters".
+  static void add_counters(std::string_view line,
+                           std::map<std::string, unsigned long long> &counters) {
+    line.remove_prefix(2);
+
+    while (!line.empty()) {
+      std::string_view::size_type pos = line.find(' ');
+      std::string_view item = line.substr(0, pos);
+      std::string_view::size_type equals = item.find('=');
+      unsigned long long value;
+
+      if (equals != std::string_view::npos &&
+          std::from_chars(item.data() + equals + 1, item.data() + item.size(),
+                          value).ec == std::errc()) {
+        counters[std::string(item.substr(0, equals))] += value;
+      }
+
+      if (pos == std::string_view::npos) {
+        break;
+      }
+
+      line.remove_prefix(pos + 1);
+    }
+  }
+
+  // Average time spent in a callback of a thread in a region,
+  // in nanoseconds, or 0 if unknown.
+  double callback_overhead() {
+    unsigned long long traced = this->injection_counters["traced_callbacks"];
+
+    if (traced == 0) {
+      return 0;
+    }
+
+    return (double)this->injection_counters["callback_time"] / traced;
+  }
+
+  // Writes overhead.json.
+  bool write_overhead(std::ostream &stream) {
+    nlohmann::json module;
+    EventCounters total = { 0, 0, 0, 0, 0, 0, 0, 0 };
+    unsigned long long clock_drift_max = 0;
+
+    for (auto &shard : this->shards) {
+      total.events += shard->counters.events;
+      total.invalid += shard->counters.invalid;
+      total.unknown_timestamp += shard->counters.unknown_timestamp;
+      total.no_active_region += shard->counters.no_active_region;
+      total.stack_mismatch += shard->counters.stack_mismatch;
+      total.pruned_nodes += shard->counters.pruned_nodes;
+      total.matching_time += shard->counters.matching_time;
+      total.aggregation_time += shard->counters.aggregation_time;
+      clock_drift_max = std::max(clock_drift_max, shard->clock_drift_max);
+    }
+
+    module["messages"] = this->messages_received;
+    module["receive_timeouts"] = this->receive_timeouts;
+    module["checkpoints"] = this->checkpoint_count;
+    module["events"] = total.events;
+    module["invalid"] = total.invalid;
+    module["unknown_timestamp"] = total.unknown_timestamp;
+    module["no_active_region"] = total.no_active_region;
+    module["stack_mismatch"] = total.stack_mismatch;
+    module["pruned_nodes"] = total.pruned_nodes;
+    module["matching_time"] = total.matching_time;
+    module["aggregation_time"] = total.aggregation_time;
+
+    nlohmann::json injection = nlohmann::json::object();
+
+    for (auto &counter : this->injection_counters) {
+      injection[counter.first] = counter.second;
+    }
+
+    injection["reports"] = this->injection_reports;
+
+    nlohmann::json overhead;
+    overhead["module"] = module;
+    overhead["injection"] = injection;
+    overhead["callback_overhead"] = this->callback_overhead();
+    overhead["corrected"] = this->overhead_correction;
+
+    nlohmann::json lost_threads = nlohmann::json::object();
+    nlohmann::json lost_functions = nlohmann::json::object();
+
+    for (auto &shard : this->shards) {
+      for (auto &part : shard->lost) {
+        lost_threads[part.first] = part.second;
+      }
+    }
+
+    for (auto &function : this->lost_functions) {
+      lost_functions[function.first] = function.second;
+    }
+
+    overhead["queue_policy"] = this->queue_policy;
+    overhead["clock"] = { { "fast", this->fast_clock_used },
+                          { "drift_max", clock_drift_max } };
+    overhead["lost"] = { { "threads", lost_threads },
+                         { "functions", lost_functions } };
+
+    stream << overhead.dump() << std::endl;
+    return (bool)stream;
+  }
+
+  // Handles "@K <category> <function name>", see
+  // NVGPU_CATEGORY_CAPABILITY.
+  void handle_category(std::string_view line) {
+    std::string_view type, category_name;
+    int category;
+
+    if (!next_message_token(line, type) ||
+        !next_message_token(line, category_name) || line.empty() ||
+        (category = parse_api_category(category_name)) == -1) {
+      return;
+    }
+
+    this->function_categories[std::string(line)] = category;
+  }
+
+  // Writes the calls made directly in a region, i.e. not from within
+  // other traced calls, summed per category as "categories":{...}.
+  // These add up to the time the region spends in CUDA calls. NVTX
+  // ranges are not calls, so the calls made in them count as direct.
+  void write_categories(std::ostream &stream, const CallTree &tree,
+                        const NameTable &names) {
+    unsigned long long counts[API_CATEGORIES] = {};
+    unsigned long long times[API_CATEGORIES] = {};
+    std::vector<uint32_t> parents = { CallTree::ROOT };
+
+    while (!parents.empty()) {
+      uint32_t parent = parents.back();
+      parents.pop_back();
+
+      for (uint32_t i = tree.node(parent).first_child; i != CallTree::NONE;
+           i = tree.node(i).next_sibling) {
+        // Launches have the kernel symbol after the function name, and
+        // NVTX ranges have the range name.
+        std::string_view name = names.name(tree.node(i).name);
+        std::string_view function = name.substr(0, name.find(' '));
+
+        if (function == NVTX_RANGE_FUNCTION) {
+          parents.push_back(i);
+          continue;
+        }
+
+        auto found = this->function_categories.find(function);
+        int category = found == this->function_categories.end() ?
+          API_OTHER : found->second;
+
+        counts[category] += tree.node(i).count;
+        times[category] += tree.node(i).time;
+      }
+    }
+
+    // In the order of keys in nlohmann::json objects.
+    std::map<std::string_view, int> order;
+
+    for (int i = 0; i < API_CATEGORIES; i++) {
+      order[api_category_name(i)] = i;
+    }
+
+    stream << "\"categories\":{";
+    bool first = true;
+
+    for (auto &[name, category] : order) {
+      if (counts[category] == 0) {
+        continue;
+      }
+
+      stream << (first ? "" : ",") << '"' << name << "\":{\"count\":"
+             << counts[category] << ",\"time\":" << times[category] << '}';
+      first = false;
+    }
+
+    stream << "},";
+  }
+
+  // Returns the shard handling events of the part ID of a line, or
+  // -1 for definitions, which are needed by every shard. Binary and
+  // text events of a part (the latter being sent for functions which
+  // cannot be sent in binary) and its "@L", "@M", and "@G" lines hash
+  // the same.
+  int shard_of(std::string_view line) {
+    std::size_t hash;
+    bool call_line = line.starts_with("@M") || line.starts_with("@G");
+
+    if (line.starts_with('@') && !line.starts_with("@L") && !call_line) {
+      return -1;
+    } else if (call_line) {
+      std::string_view type, part_id;
+
+      if (!next_message_token(line, type) ||
+          !next_message_token(line, part_id)) {
+        return 0;
+      }
+
+      hash = std::hash<std::string_view>()(part_id);
+    } else if (line.starts_with('#')) {
+      BinaryHeader header;
+      char part_id[BINARY_PART_ID_SIZE];
+
+      if (!decode_binary_header(line, header)) {
+        return 0;
+      }
+
+      hash = std::hash<std::string_view>()(binary_part_id(header, part_id));
+    } else {
+      std::string_view type, timestamp, part_id;
+
+      if ((line.starts_with("@L") && !next_message_token(line, type)) ||
+          !next_message_token(line, timestamp) ||
+          !next_message_token(line, part_id)) {
+        return 0;
+      }
+
+      hash = std::hash<std::string_view>()(part_id);
+    }
+
+    return hash % this->shards.size();
+  }
+
+  // Adds a line to the next batch of its shard or, with one shard
+  // only, handles it right away.
+  void dispatch_line(std::string_view line) {
+    if (line.starts_with("@O")) {
+      add_counters(line, this->injection_counters);
+      this->injection_reports++;
+      return;
+    } else if (line.starts_with("@A")) {
+      add_counters(line, this->lost_functions);
+      return;
+    } else if (line.starts_with("@K")) {
+      this->handle_category(line);
+      return;
+    }
+
+    if (this->shards.size() == 1) {
+      this->handle_line(*this->shards[0], line);
+      return;
+    }
+
+    int index = this->shard_of(line);
+
+    for (int i = 0; i < (int)this->shards.size(); i++) {
+      if (index == -1 || index == i) {
+        std::string &pending = this->shards[i]->pending;
+
+        if (!pending.empty()) {
+          pending += '\n';
+        }
+
+        pending += line;
+      }
+    }
+  }
+
+  // Hands the collected batches over to the worker threads.
+  void send_batches() {
+    if (this->shards.size() == 1) {
+      return;
+    }
+
+    for (auto &shard : this->shards) {
+      if (shard->pending.empty()) {
+        continue;
+      }
+
+      {
+        std::unique_lock lock(shard->queue_lock);
+        shard->queue_cond.wait(lock, [&shard]() {
+          return shard->queue.size() < MAX_QUEUED_BATCHES;
+        });
+
+        shard->queue.push_back(std::move(shard->pending));
+      }
+
+      shard->queue_cond.notify_all();
+      shard->pending.clear();
+    }
+  }
+
+  void run_worker(Shard &shard) {
+    while (true) {
+      std::string batch;
+
+      {
+        std::unique_lock lock(shard.queue_lock);
+        shard.queue_cond.wait(lock, [&shard]() {
+          return shard.finished || !shard.queue.empty();
+        });
+
+        if (shard.queue.empty()) {
+          return;
+        }
+
+        batch = std::move(shard.queue.front());
+        shard.queue.pop_front();
+        shard.busy = true;
+      }
+
+      shard.queue_cond.notify_all();
+
+      try {
+        std::string_view lines(batch);
+
+        while (!lines.empty()) {
+          std::string_view::size_type pos = lines.find('\n');
+          this->handle_line(shard, lines.substr(0, pos));
+
+          if (pos == std::string_view::npos) {
+            break;
+          }
+
+          lines.remove_prefix(pos + 1);
+        }
+      } catch (std::exception &e) {
+        // Further batches are still taken off the queue so that
+        // the receiving thread does not wait forever.
+        if (shard.error.empty()) {
+          shard.error = e.what();
+        }
+      }
+
+      {
+        std::unique_lock lock(shard.queue_lock);
+        shard.busy = false;
+      }
+
+      shard.queue_cond.notify_all();
+    }
+  }
+
+  // Waits until the worker threads have handled everything queued, so
+  // that the receiving thread can access the shards until it sends
+  // more batches.
+  void wait_for_workers() {
+    if (this->shards.size() == 1) {
+      return;
+    }
+
+    for (auto &shard : this->shards) {
+      std::unique_lock lock(shard->queue_lock);
+      shard->queue_cond.wait(lock, [&shard]() {
+        return shard->queue.empty() && !shard->busy;
+      });
+    }
+  }
+
+  // Returns the regions with call trees in memory which can be written
+  // to a checkpoint: those which have ended in every part at least
+  // CHECKPOINT_DELAY ago and have no unfinished calls. The shards
+  // must not be in use by the worker threads.
+  std::set<std::string> closed_regions() {
+    std::set<std::string> open, closed;
+    auto now = std::chrono::steady_clock::now();
+
+    {
+      std::unique_lock lock(this->region_lock);
+
+      for (auto &part_id : this->regions) {
+        for (auto &region : part_id.second) {
+          if (region.second.end_defined &&
+              now - region.second.end_received >= CHECKPOINT_DELAY) {
+            closed.insert(region.first);
+          } else {
+            open.insert(region.first);
+          }
+        }
+      }
+    }
+
+    std::set<std::string> result;
+
+    for (auto &shard : this->shards) {
+      for (auto &region : shard->region_states) {
+        if (closed.find(region.first) != closed.end() &&
+            open.find(region.first) == open.end()) {
+          result.insert(region.first);
+        }
+      }
+    }
+
+    for (auto &shard : this->shards) {
+      for (auto &region : shard->region_states) {
+        for (auto &part : region.second.parts) {
+          if (!part.second.stack.empty()) {
+            result.erase(region.first);
+          }
+        }
+      }
+    }
+
+    return result;
+  }
+
+  fs::path checkpoint_path(unsigned int index) {
+    return this->module_dir / ("checkpoint." + std::to_string(index) +
+                               ".json");
+  }
+
+  // Writes the call trees of closed_regions() to the next checkpoint
+  // file and removes them from memory. The file is renamed into place
+  // once complete, so a crash never leaves a partial one. If it cannot
+  // be written, the regions stay in memory.
+  bool checkpoint() {
+    this->last_checkpoint = std::chrono::steady_clock::now();
+    this->bytes_since_checkpoint = 0;
+    this->wait_for_workers();
+
+    std::set<std::string> closed = this->closed_regions();
+
+    if (closed.empty()) {
+      return true;
+    }
+
+    NameTable names;
+    std::map<std::string, CallTree> trees;
+    std::map<std::string, std::map<std::string, CallTree> > thread_trees;
+    std::map<std::string, std::map<std::string, CallTree> > process_trees;
+
+    for (auto &shard : this->shards) {
+      std::vector<uint32_t> name_map(shard->names.size());
+
+      for (uint32_t i = 0; i < shard->names.size(); i++) {
+        name_map[i] = names.intern(shard->names.name(i));
+      }
+
+      for (auto &name : closed) {
+        auto region = shard->region_states.find(name);
+
+        if (region == shard->region_states.end()) {
+          continue;
+        }
+
+        for (auto &part : region->second.parts) {
+          trees[name].merge(part.second.tree, name_map);
+
+          if (this->per_thread) {
+            thread_trees[name][part.first].merge(part.second.tree, name_map);
+          }
+
+          if (this->per_process) {
+            std::string pid(process_id(part.first));
+            process_trees[name][pid].merge(part.second.tree, name_map);
+          }
+        }
+      }
+    }
+
+    std::map<std::string, RegionOutput> outputs;
+
+    for (auto &name : closed) {
+      RegionOutput &output = outputs[name];
+      output = { false, 0, 0, nullptr, {}, {}, nullptr };
+
+      if (trees[name].size() > 1) {
+        output.tree = &trees[name];
+      }
+
+      for (auto &thread : thread_trees[name]) {
+        if (thread.second.size() > 1) {
+          output.threads[thread.first] = &thread.second;
+        }
+      }
+
+      for (auto &process : process_trees[name]) {
+        if (process.second.size() > 1) {
+          output.processes[process.first] = &process.second;
+        }
+      }
+    }
+
+    if (!this->add_region_times(outputs, false)) {
+      return false;
+    }
+
+    fs::path path = this->checkpoint_path(this->checkpoint_count);
+    fs::path temp_path = path;
+    temp_path += ".tmp";
+
+    {
+      std::ofstream stream(temp_path);
+
+      if (!stream || !this->write_json(stream, outputs, names, true)) {
+        adaptyst_print(this->module_id, ("Could not write " +
+                                         temp_path.string() +
+                                         ", keeping regions in memory").c_str(),
+                       true, false, "General");
+        return true;
+      }
+    }
+
+    std::error_code error;
+    fs::rename(temp_path, path, error);
+
+    if (error) {
+      adaptyst_print(this->module_id, ("Could not rename " + temp_path.string() +
+                                       ": " + error.message() +
+                                       ", keeping regions in memory").c_str(),
+                     true, false, "General");
+      return true;
+    }
+
+    this->checkpoint_count++;
+
+    for (auto &shard : this->shards) {
+      for (auto &name : closed) {
+        shard->region_states.erase(name);
+      }
+    }
+
+    return true;
+  }
+
+  // Merges the regions written to checkpoints back into the first
+  // shard, after merge_other_shards().
+  bool restore_checkpoints() {
+    Shard &result = *this->shards[0];
+
+    for (unsigned int i = 0; i < this->checkpoint_count; i++) {
+      fs::path path = this->checkpoint_path(i);
+      std::ifstream stream(path);
+
+      if (!stream) {
+        adaptyst_set_error(this->module_id,
+                           ("Could not open " + path.string()).c_str());
+        return false;
+      }
+
+      try {
+        nlohmann::json checkpoint = nlohmann::json::parse(stream);
+
+        for (auto &[name, region] : checkpoint.items()) {
+          RegionState &state = result.region_states[name];
+          state.restored = true;
+          state.tree.set_node_limit(this->tree_node_limit);
+
+          if (region.value("incomplete", false)) {
+            state.tree.mark_incomplete(CallTree::ROOT);
+          }
+
+          // The trees of the parts add up to the tree of the region.
+          if (this->per_thread) {
+            for (auto &[part_id, tree] : region.at("threads").items()) {
+              CallTree &part_tree = state.parts[part_id].tree;
+              part_tree.set_node_limit(this->tree_node_limit);
+              part_tree.merge_json(tree, result.names);
+
+              if (part_tree.over_limit()) {
+                part_tree.prune(result.names.intern(CallTree::OTHER_NAME), {});
+              }
+            }
+          } else {
+            state.tree.merge_json(region.at("data"), result.names);
+
+            if (state.tree.over_limit()) {
+              state.tree.prune(result.names.intern(CallTree::OTHER_NAME), {});
+            }
+
+            // With per_thread, the trees of the processes are made from
+            // those of the parts instead.
+            if (this->per_process) {
+              for (auto &[pid, tree] : region.at("processes").items()) {
+                CallTree &process_tree = state.processes[pid];
+                process_tree.set_node_limit(this->tree_node_limit);
+                process_tree.merge_json(tree, result.names);
+
+                if (process_tree.over_limit()) {
+                  process_tree.prune(result.names.intern(CallTree::OTHER_NAME),
+                                     {});
+                }
+              }
+            }
+          }
+        }
+      } catch (nlohmann::json::exception &e) {
+        adaptyst_set_error(this->module_id, ("Could not read " + path.string() +
+                                             ": " + e.what()).c_str());
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+  // Stops the worker threads after they handle everything queued,
+  // merges all shards and checkpoints into the first shard, and merges
+  // the trees of the parts of every region there. Returns false if
+  // a worker has failed or a checkpoint cannot be read.
+  bool merge_shards() {
+    Shard &result = *this->shards[0];
+
+    if (this->shards.size() > 1 && !this->merge_other_shards()) {
+      return false;
+    }
+
+    if (!this->restore_checkpoints()) {
+      return false;
+    }
+
+    std::vector<uint32_t> name_map(result.names.size());
+
+    for (uint32_t i = 0; i < result.names.size(); i++) {
+      name_map[i] = i;
+    }
+
+    for (auto &region : result.region_states) {
+      // The trees of the parts of a process add up to its tree.
+      if (this->per_process) {
+        for (auto &part : region.second.parts) {
+          std::string pid(process_id(part.first));
+          CallTree &tree = region.second.processes[pid];
+          tree.set_node_limit(this->tree_node_limit);
+          tree.merge(part.second.tree, name_map);
+
+          if (tree.over_limit()) {
+            tree.prune(result.names.intern(CallTree::OTHER_NAME), {});
+          }
+        }
+      }
+
+      // The tree of the only part is used as it is.
+      if (region.second.parts.size() < 2 && !region.second.restored) {
+        continue;
+      }
+
+      region.second.tree.set_node_limit(this->tree_node_limit);
+
+      for (auto &part : region.second.parts) {
+        region.second.tree.merge(part.second.tree, name_map);
+
+        if (region.second.tree.over_limit()) {
+          region.second.tree.prune(result.names.intern(CallTree::OTHER_NAME),
+                                   {});
+        }
+
+        if (!this->per_thread) {
+          part.second.tree = CallTree();
+        }
+      }
+    }
+
+    return true;
+  }
+
+  // See merge_shards(). Each part ID is handled by one shard only, so
+  // part states are moved to the first shard as they are, with only
+  // their names translated.
+  bool merge_other_shards() {
+    for (auto &shard : this->shards) {
+      {
+        std::unique_lock lock(shard->queue_lock);
+        shard->finished = true;
+      }
+
+      shard->queue_cond.notify_all();
+      shard->worker.join();
+    }
+
+    for (auto &shard : this->shards) {
+      if (!shard->error.empty()) {
+        adaptyst_set_error(this->module_id, shard->error.c_str());
+        return false;
+      }
+    }
+
+    Shard &result = *this->shards[0];
+
+    for (std::size_t i = 1; i < this->shards.size(); i++) {
+      Shard &shard = *this->shards[i];
+      std::vector<uint32_t> name_map(shard.names.size());
+
+      for (uint32_t j = 0; j < shard.names.size(); j++) {
+        name_map[j] = result.names.intern(shard.names.name(j));
+      }
+
+      for (auto &region : shard.region_states) {
+        RegionState &target = result.region_states[region.first];
+
+        for (auto &part : region.second.parts) {
+          target.parts[part.first].tree.merge(part.second.tree, name_map);
+        }
+      }
+
+      shard.region_states.clear();
+    }
+
+    return true;
+  }
+
+  // Summarises the call trees of the processes of every region in
+  // "outputs" into "summaries", pointed to by the outputs. The summaries
+  // of the processes of a region are reduced on all hardware threads.
+  void summarise_processes(std::map<std::string, RegionOutput> &outputs,
+                           const NameTable &names,
+                           std::map<std::string, ProcessSummary> &summaries) {
+    std::vector<uint32_t> name_map(names.size());
+
+    for (uint32_t i = 0; i < names.size(); i++) {
+      name_map[i] = i;
+    }
+
+    unsigned int threads = std::max(std::thread::hardware_concurrency(), 1U);
+
+    for (auto &[name, output] : outputs) {
+      if (output.processes.empty()) {
+        continue;
+      }
+
+      std::vector<ProcessSummary> process_summaries;
+
+      for (auto &process : output.processes) {
+        process_summaries.emplace_back(*process.second);
+      }
+
+      parallel_reduce(process_summaries, threads,
+                      [&](ProcessSummary &target, const ProcessSummary &source) {
+        target.merge(source, name_map);
+      });
+
+      output.summary = &(summaries[name] = std::move(process_summaries[0]));
+    }
+  }
+
+  // Writes regions.json, streaming each call tree to the file, or
+  // a checkpoint if "histograms" is true (see CallTree::write_json()).
+  bool write_json(std::ostream &stream,
+                  const std::map<std::string, RegionOutput> &outputs,
+                  const NameTable &names, bool histograms = false) {
+    stream << '{';
+
+    for (auto it = outputs.begin(); it != outputs.end(); it++) {
+      if (it != outputs.begin()) {
+        stream << ',';
+      }
+
+      write_json_string(stream, it->first);
+      stream << ":{";
+
+      if (this->categories_used && it->second.tree) {
+        this->write_categories(stream, *it->second.tree, names);
+      }
+
+      stream << "\"data\":";
+
+      if (it->second.tree) {
+        it->second.tree->write_json(stream, names, histograms);
+      } else {
+        stream << "{}";
+      }
+
+      if (it->second.tree && it->second.tree->incomplete(CallTree::ROOT)) {
+        stream << ",\"incomplete\":true";
+      }
+
+      if (it->second.defined) {
+        stream << ",\"length\":" << it->second.length;
+      }
+
+      if (this->per_process) {
+        stream << ",\"processes\":{";
+
+        for (auto process = it->second.processes.begin();
+             process != it->second.processes.end(); process++) {
+          if (process != it->second.processes.begin()) {
+            stream << ',';
+          }
+
+          write_json_string(stream, process->first);
+          stream << ':';
+          process->second->write_json(stream, names, histograms);
+        }
+
+        stream << '}';
+      }
+
+      if (it->second.defined) {
+        stream << ",\"start\":" << it->second.start;
+      }
+
+      if (it->second.summary) {
+        stream << ",\"summary\":";
+        it->second.summary->write_json(stream, names);
+      }
+
+      if (this->per_thread) {
+        stream << ",\"threads\":{";
+
+        for (auto thread = it->second.threads.begin();
+             thread != it->second.threads.end(); thread++) {
+          if (thread != it->second.threads.begin()) {
+            stream << ',';
+          }
+
+          write_json_string(stream, thread->first);
+          stream << ':';
+          thread->second->write_json(stream, names, histograms);
+        }
+
+        stream << '}';
+      }
+
+      stream << '}';
+
+      if (!stream) {
+        return false;
+      }
+    }
+
+    stream << '}' << std::endl;
+    return (bool)stream;
+  }
+
+  // Writes timeline.json in the Chrome trace event format from
+  // the timeline files of all shards, with every region shown as
+  // a process and every part as a thread in it. Timestamps are in
+  // microseconds since the start of the workflow.
+  bool write_timeline(std::ostream &stream,
+                      unsigned long long workflow_start_time) {
+    std::map<std::string, int> region_ids;
+    std::map<std::pair<int, std::string>, int> thread_ids;
+    bool first = true;
+
+    auto separate = [&]() {
+      if (!first) {
+        stream << ",\n";
+      }
+
+      first = false;
+    };
+
+    auto write_time = [&](unsigned long long time) {
+      stream << time / 1000 << '.' << (char)('0' + time / 100 % 10)
+             << (char)('0' + time / 10 % 10) << (char)('0' + time % 10);
+    };
+
+    stream << "{\"displayTimeUnit\":\"ns\",\"traceEvents\":[\n";
+
+    for (auto &shard : this->shards) {
+      if (shard->timeline_path.empty()) {
+        continue;
+      }
+
+      const NameTable &names = shard->names;
+      bool success = TimelineWriter::read(shard->timeline_path,
+                                          [&](const TimelineWriter::Record &record) {
+        const std::string &region = names.name(record.region);
+        const std::string &part = names.name(record.part);
+        auto [region_id, new_region] = region_ids.try_emplace(region,
+                                                              region_ids.size() + 1);
+
+        if (new_region) {
+          separate();
+          stream << "{\"ph\":\"M\",\"name\":\"process_name\",\"pid\":"
+                 << region_id->second << ",\"args\":{\"name\":";
+          write_json_string(stream, "Region " + region);
+          stream << "}}";
+        }
+
+        auto [thread_id, new_thread] =
+          thread_ids.try_emplace({ region_id->second, part },
+                                 thread_ids.size() + 1);
+
+        if (new_thread) {
+          separate();
+          stream << "{\"ph\":\"M\",\"name\":\"thread_name\",\"pid\":"
+                 << region_id->second << ",\"tid\":" << thread_id->second
+                 << ",\"args\":{\"name\":";
+          write_json_string(stream, part);
+          stream << "}}";
+        }
+
+        unsigned long long start = record.start > workflow_start_time ?
+          record.start - workflow_start_time : 0;
+
+        separate();
+        stream << "{\"ph\":\"X\",\"name\":";
+        write_json_string(stream, names.name(record.name));
+        stream << ",\"pid\":" << region_id->second << ",\"tid\":"
+               << thread_id->second << ",\"ts\":";
+        write_time(start);
+        stream << ",\"dur\":";
+        write_time(record.end - record.start);
+        stream << ",\"args\":{\"depth\":" << record.depth << "}}";
+      });
+
+      if (!success) {
+        return false;
+      }
+    }
+
+    stream << "\n]}" << std::endl;
+    return (bool)stream;
+  }
+
+  // Writes regions.bin, see TableHeader.
+  bool write_table(std::ostream &stream,
+                   const std::map<std::string, RegionOutput> &outputs,
+                   NameTable &names) {
+    std::vector<TableRegion> regions;
+    uint64_t node_count = 0;
+
+    for (auto &output : outputs) {
+      uint32_t name = names.intern(output.first);
+      uint32_t root = CallTree::NONE;
+
+      if (output.second.tree) {
+        root = node_count;
+        node_count += output.second.tree->size();
+      }
+
+      regions.push_back({ name, root, output.second.length,
+                          output.second.start });
+    }
+
+    TableHeader header;
+    std::memcpy(header.magic, "NVGPUT04", sizeof(header.magic));
+    header.name_count = names.size();
+    header.region_count = regions.size();
+    header.node_count = node_count;
+    header.string_size = 0;
+
+    for (uint32_t i = 0; i < names.size(); i++) {
+      header.string_size += names.name(i).size();
+    }
+
+    stream.write((const char *)&header, sizeof(header));
+
+    uint64_t offset = 0;
+
+    for (uint32_t i = 0; i < names.size(); i++) {
+      NameEntry entry = { offset, names.name(i).size() };
+      stream.write((const char *)&entry, sizeof(entry));
+      offset += entry.size;
+    }
+
+    stream.write((const char *)regions.data(),
+                 regions.size() * sizeof(TableRegion));
 
-  std::string cuda_api_type;
-  amod_t module_id;
-  std::unordered_map<std::string, std::unordered_map<std::string,
-                                                     Region> > regions;
-  std::mutex region_lock;
-  nlohmann::json data;
+    for (auto &region : regions) {
+      if (region.root == CallTree::NONE) {
+        continue;
+      }
+
+      const CallTree *tree = outputs.at(names.name(region.name)).tree;
+
+      for (uint32_t i = 0; i < tree->size(); i++) {
+        CallTree::Transfer transfer = tree->total_transfer(i);
+        TableNode node = { tree->node(i), tree->self_time(i),
+                           tree->percentile(i, 50),
+                           tree->percentile(i, 99),
+                           tree->incomplete(i) ? 1U : 0U,
+                           transfer.bytes, transfer.time };
+
+        for (uint32_t *index : { &node.node.parent, &node.node.first_child,
+                                 &node.node.next_sibling }) {
+          if (*index != CallTree::NONE) {
+            *index += region.root;
+          }
+        }
+
+        stream.write((const char *)&node, sizeof(node));
+      }
+    }
+
+    for (uint32_t i = 0; i < names.size(); i++) {
+      stream.write(names.name(i).data(), names.name(i).size());
+    }
+
+    return (bool)stream;
+  }
+
+  // Sets the start and length of the regions in "outputs", adding
+  // the regions without call trees if "add_missing" is true.
+  bool add_region_times(std::map<std::string, RegionOutput> &outputs,
+                        bool add_missing) {
+    std::unique_lock lock(this->region_lock);
+    for (auto &part_id : this->regions) {
+      for (auto &region : part_id.second) {
+        std::string name = region.first;
+        Region &region_data = region.second;
+
+        if (outputs.find(name) == outputs.end()) {
+          if (!add_missing) {
+            continue;
+          }
+
+          outputs[name] = { false, 0, 0, nullptr, {}, {}, nullptr };
+        }
+
+        unsigned long long start, end;
+        unsigned long long workflow_start_time = adaptyst_get_workflow_start_time(this->module_id);
+
+        if (adaptyst_get_internal_error_code(this->module_id) !=
+            ADAPTYST_OK) {
+          return false;
+        }
+
+        if (!region_data.start_defined) {
+          start = 0;
+        } else {
+          start = region_data.start - workflow_start_time;
+        }
+
+        if (!region_data.end_defined) {
+          end = adaptyst_get_workflow_end_time(this->module_id);
+          if (adaptyst_get_internal_error_code(this->module_id) !=
+              ADAPTYST_OK) {
+            return false;
+          }
+        } else {
+          end = region_data.end - workflow_start_time;
+        }
+
+        outputs[name].defined = true;
+        outputs[name].length = (unsigned long long)(end - start);
+        outputs[name].start = start;
+      }
+    }
+
+    return true;
+  }
+
+  // Rebuilds the index of a part and publishes a new snapshot
+  // containing it. this->region_lock must be held.
+  void publish_regions(const std::string &part_id) {
+    std::vector<RegionIndex::Interval> intervals;
+
+    for (auto &region : this->regions[part_id]) {
+      Region &data = region.second;
+      intervals.push_back({ data.start_defined ? data.start : 0,
+                            data.end_defined ? data.end : (unsigned long long)-1,
+                            region.first });
+    }
+
+    auto snapshot = std::make_shared<RegionSnapshot>(*this->region_snapshot);
+    (*snapshot)[part_id] = std::make_shared<const RegionIndex>(std::move(intervals));
+    this->region_snapshot = snapshot;
+    this->region_version.fetch_add(1, std::memory_order_release);
+  }
+
+  // Waits for the next message from the workflow, with the timeout
+  // doubled after every timeout from MIN_RECEIVE_TIMEOUT up to
+  // MAX_RECEIVE_TIMEOUT. Receiving returns as soon as a message
+  // arrives, so a long timeout only makes an idle module wake up and
+  // check whether the workflow is running less often. Returns false
+  // on an error, and true with "msg" set to null once the workflow
+  // has finished.
+  bool receive_message(const char *&msg) {
+    while (true) {
+      bool received = adaptyst_receive_string_timeout(this->module_id, &msg,
+                                                      this->receive_timeout);
+
+      if (received && msg) {
+        this->receive_timeout = MIN_RECEIVE_TIMEOUT;
+        return true;
+      }
+
+      if (!received &&
+          adaptyst_get_internal_error_code(this->module_id) != ADAPTYST_ERR_TIMEOUT) {
+        adaptyst_set_error(this->module_id, "Error when receiving injection "
+                           "data from the workflow");
+        return false;
+      }
+
+      this->receive_timeouts++;
+      msg = nullptr;
+
+      if (!adaptyst_is_workflow_running(this->module_id)) {
+        return true;
+      }
+
+      this->receive_timeout = std::min(this->receive_timeout * 2,
+                                       MAX_RECEIVE_TIMEOUT);
+    }
+  }
+
+  // Returns a message from the workflow if one is already waiting,
+  // or null otherwise.
+  const char *poll_message() {
+    const char *msg;
+
+    if (!adaptyst_receive_string_timeout(this->module_id, &msg, 0)) {
+      return nullptr;
+    }
+
+    return msg;
+  }
+
+  // Splits a message into lines, since several events may be batched
+  // in one message, and dispatches them to the shards.
+  void handle_message(const char *msg) {
+    adaptyst_log(this->module_id, msg, "General");
+    this->messages_received++;
+
+    std::string_view lines(msg);
+    this->bytes_since_checkpoint += lines.size();
+
+    while (!lines.empty()) {
+      std::string_view::size_type pos = lines.find('\n');
+      this->dispatch_line(lines.substr(0, pos));
+
+      if (pos == std::string_view::npos) {
+        break;
+      }
+
+      lines.remove_prefix(pos + 1);
+    }
+  }
 
 public:
   static NvgpuModule *instance;
 
   NvgpuModule(amod_t module_id,
-              std::string cuda_api_type) {
+              std::string cuda_api_type,
+              std::vector<std::string> cuda_api_include,
+              std::vector<std::string> cuda_api_exclude,
+              std::string wire_protocol,
+              std::string extra_output,
+              std::string timeline,
+              bool per_thread,
+              unsigned int aggregation_threads,
+              bool overhead_correction,
+              std::string queue_policy,
+              unsigned int checkpoint_interval,
+              unsigned int checkpoint_size,
+              bool fast_clock,
+              bool nvtx,
+              unsigned int tree_memory_limit,
+              bool per_process) {
     this->module_id = module_id;
     this->cuda_api_type = cuda_api_type;
-    this->data = nlohmann::json::object();
+    this->cuda_api_include = cuda_api_include;
+    this->cuda_api_exclude = cuda_api_exclude;
+    this->wire_protocol = wire_protocol;
+    this->extra_output = extra_output;
+    this->timeline = timeline;
+    this->per_thread = per_thread;
+    this->per_process = per_process;
+    this->overhead_correction = overhead_correction;
+    this->queue_policy = queue_policy;
+    this->fast_clock = fast_clock;
+    this->fast_clock_used = false;
+    this->nvtx = nvtx;
+    this->categories_used = false;
+    this->checkpoint_interval = checkpoint_interval;
+    this->checkpoint_size = (unsigned long long)checkpoint_size * 1024 * 1024;
+    this->tree_node_limit = tree_memory_limit == 0 ? 0 :
+      CallTree::node_limit((std::size_t)tree_memory_limit * 1024 * 1024);
+    this->checkpoint_count = 0;
+    this->bytes_since_checkpoint = 0;
+    this->messages_received = 0;
+    this->receive_timeouts = 0;
+    this->receive_timeout = MIN_RECEIVE_TIMEOUT;
+    this->injection_reports = 0;
+    this->region_snapshot = std::make_shared<RegionSnapshot>();
+    this->region_version = 0;
+
+    for (unsigned int i = 0; i < aggregation_threads; i++) {
+      this->shards.push_back(std::make_unique<Shard>());
+      this->shards.back()->cached_regions = this->region_snapshot;
+      this->shards.back()->cached_region_version = 0;
+      this->shards.back()->finished = false;
+      this->shards.back()->busy = false;
+      this->shards.back()->clock_drift_max = 0;
+    }
+  }
+
+  ~NvgpuModule() {
+    // Only if process() has failed before stopping the workers.
+    for (auto &shard : this->shards) {
+      if (shard->worker.joinable()) {
+        {
+          std::unique_lock lock(shard->queue_lock);
+          shard->finished = true;
+        }
+
+        shard->queue_cond.notify_all();
+        shard->worker.join();
+      }
+    }
   }
 
   bool process() {
@@ -59,26 +2105,99 @@ public:
 
     const char *msg;
 
-    do {
-      if (!adaptyst_receive_string_timeout(this->module_id, &msg, 1)) {
-        if (adaptyst_get_internal_error_code(this->module_id) == ADAPTYST_ERR_TIMEOUT) {
-          if (!adaptyst_is_workflow_running(this->module_id)) {
-            adaptyst_set_error(this->module_id, "The workflow has finished without sending "
-                               "the required injection data");
-            return false;
-          }
+    if (!this->receive_message(msg)) {
+      return false;
+    } else if (!msg) {
+      adaptyst_set_error(this->module_id, "The workflow has finished without "
+                         "sending the required injection data");
+      return false;
+    }
+
+    // The request is "cuda_api_type" optionally followed by
+    // the protocols and capabilities supported by the injection part.
+    // Only the CUDA API type is sent back if nothing is listed,
+    // otherwise it is followed by the chosen protocol and, if supported
+    // and needed, the API filter.
+    std::string_view request(msg);
+    std::string_view request_type = request.substr(0, request.find(' '));
+
+    if (request_type == "cuda_api_type") {
+      std::string reply = this->cuda_api_type;
+      std::string supported = std::string(request.substr(request_type.size())) +
+        " ";
+      bool filtered = !this->cuda_api_include.empty() ||
+        !this->cuda_api_exclude.empty();
+
+      if (request.size() > request_type.size()) {
+        std::string protocol = "text";
+
+        if (this->wire_protocol == "binary" &&
+            supported.find(" " NVGPU_BINARY_PROTOCOL " ") != std::string::npos) {
+          protocol = NVGPU_BINARY_PROTOCOL;
+        }
+
+        reply += " " + protocol;
+      }
+
+      if (supported.find(" " NVGPU_OVERHEAD_CAPABILITY " ") != std::string::npos) {
+        reply += " " NVGPU_OVERHEAD_CAPABILITY;
+      }
+
+      if (this->queue_policy != "block") {
+        if (supported.find(" " NVGPU_POLICY_CAPABILITY " ") != std::string::npos) {
+          reply += " " NVGPU_POLICY_CAPABILITY " " + this->queue_policy;
         } else {
-          adaptyst_set_error(this->module_id, "Error when receiving injection "
-                             "data from the workflow");
-          return false;
+          adaptyst_print(this->module_id,
+                         "The injection part does not support queue_policy, "
+                         "waiting for the module when its buffers are full",
+                         true, false, "General");
+        }
+      }
+
+      if (this->fast_clock &&
+          supported.find(" " NVGPU_CLOCK_CAPABILITY " ") != std::string::npos) {
+        reply += " " NVGPU_CLOCK_CAPABILITY;
+        this->fast_clock_used = true;
+      }
+
+      if (supported.find(" " NVGPU_TRANSFER_CAPABILITY " ") != std::string::npos) {
+        reply += " " NVGPU_TRANSFER_CAPABILITY;
+      }
+
+      if (supported.find(" " NVGPU_CATEGORY_CAPABILITY " ") != std::string::npos) {
+        reply += " " NVGPU_CATEGORY_CAPABILITY;
+        this->categories_used = true;
+      }
+
+      if (supported.find(" " NVGPU_LAUNCH_CAPABILITY " ") != std::string::npos) {
+        reply += " " NVGPU_LAUNCH_CAPABILITY;
+      }
+
+      if (this->nvtx) {
+        if (supported.find(" " NVGPU_NVTX_CAPABILITY " ") != std::string::npos) {
+          reply += " " NVGPU_NVTX_CAPABILITY;
+        } else {
+          adaptyst_print(this->module_id,
+                         "The injection part does not support nvtx, "
+                         "tracing CUDA calls only", true, false, "General");
         }
       }
-    } while (!msg);
 
-    std::string request(msg);
+      if (filtered) {
+        if (supported.find(" " NVGPU_FILTER_CAPABILITY " ") != std::string::npos) {
+          reply += " " NVGPU_FILTER_CAPABILITY " " +
+            ApiFilter::join_list(this->cuda_api_include) + " " +
+            ApiFilter::join_list(this->cuda_api_exclude);
+        } else {
+          adaptyst_print(this->module_id,
+                         "The injection part does not support "
+                         "cuda_api_include and cuda_api_exclude, tracing all "
+                         "functions selected by cuda_api_type", true, false,
+                         "General");
+        }
+      }
 
-    if (request == "cuda_api_type") {
-      if (!adaptyst_send_string(this->module_id, this->cuda_api_type.c_str())) {
+      if (!adaptyst_send_string(this->module_id, reply.c_str())) {
         adaptyst_set_error(this->module_id, "Could not send injection reply "
                            "to the workflow");
         return false;
@@ -89,206 +2208,224 @@ public:
       return false;
     }
 
-    std::unordered_map<std::string, std::vector<std::pair<std::string, unsigned long long> > > stacks;
+    const char *dir = adaptyst_get_module_dir(this->module_id);
 
-    do {
-      if (!adaptyst_receive_string_timeout(this->module_id, &msg, 1)) {
-        if (adaptyst_get_internal_error_code(this->module_id) == ADAPTYST_ERR_TIMEOUT) {
-          if (!adaptyst_is_workflow_running(this->module_id)) {
-            break;
-          }
-        } else {
-          adaptyst_set_error(this->module_id, "Error when receiving injection "
-                             "data from the workflow");
+    if (!dir) {
+      adaptyst_set_error(this->module_id, "adaptyst_get_module_dir() returned null");
+      return false;
+    }
+
+    this->module_dir = dir;
+
+    if (this->timeline != "none") {
+      for (std::size_t i = 0; i < this->shards.size(); i++) {
+        Shard &shard = *this->shards[i];
+        shard.timeline_path = fs::path(dir) /
+          ("timeline." + std::to_string(i) + ".bin");
+        shard.timeline = std::make_unique<TimelineWriter>();
+
+        if (!shard.timeline->open(shard.timeline_path)) {
+          adaptyst_set_error(this->module_id,
+                             shard.timeline->error().c_str());
           return false;
         }
       }
+    }
 
-      if (!msg) {
-        continue;
+    if (this->shards.size() > 1) {
+      for (auto &shard : this->shards) {
+        shard->worker = std::thread(&NvgpuModule::run_worker, this,
+                                    std::ref(*shard));
       }
+    }
 
-      std::smatch match;
-      std::string msg_str(msg);
+    this->last_checkpoint = std::chrono::steady_clock::now();
 
-      if (!std::regex_match(msg_str,
-                            match,
-                            std::regex("^(-?\\d+) (.+) (enter|exit) (.+)$"))) {
-        adaptyst_print(this->module_id,
-                       ("Invalid message from the injection part, ignoring: " +
-                        msg_str).c_str(), true, false, "General");
-        continue;
+    while (true) {
+      if (!this->receive_message(msg)) {
+        return false;
+      } else if (!msg) {
+        break;
       }
 
-      adaptyst_log(this->module_id, msg, "General");
+      // Everything which has arrived in the meantime is handled before
+      // the batches are handed over to the workers, so that they get
+      // fewer and larger batches when events come in quickly.
+      std::size_t handled = 0;
 
-      std::string timestamp_str = match[1].str();
+      do {
+        this->handle_message(msg);
+      } while (++handled < MAX_MESSAGES_PER_WAKEUP &&
+               (msg = this->poll_message()));
 
-      if (timestamp_str == "-1") {
-        adaptyst_print(this->module_id,
-                       ("Unknown timestamp received from the injection part, ignoring: " +
-                        msg_str).c_str(), true, false, "General");
-        continue;
+      this->send_batches();
+
+      if ((this->checkpoint_interval > 0 &&
+           std::chrono::steady_clock::now() - this->last_checkpoint >=
+           std::chrono::seconds(this->checkpoint_interval)) ||
+          (this->checkpoint_size > 0 &&
+           this->bytes_since_checkpoint >= this->checkpoint_size)) {
+        if (!this->checkpoint()) {
+          return false;
+        }
       }
+    }
 
-      unsigned long long timestamp = std::stoull(timestamp_str);
+    adaptyst_profile_wait(this->module_id);
 
-      std::string part_id = match[2].str();
-      std::vector<std::string> applicable_regions;
+    if (!this->merge_shards()) {
+      return false;
+    }
 
-      {
-        std::unique_lock lock(this->region_lock);
-        if (this->regions.find(part_id) == this->regions.end()) {
-          adaptyst_print(this->module_id,
-                         (part_id + " doesn't seem to have any active regions, ignoring: " +
-                          msg_str).c_str(), true, false, "General");
-          continue;
-        }
+    Shard &result = *this->shards[0];
 
-        for (auto &region : this->regions[part_id]) {
-          Region &data = region.second;
+    // Sorted by name, like the keys of a JSON object.
+    std::map<std::string, RegionOutput> outputs;
 
-          if ((data.start_defined && data.end_defined &&
-               timestamp >= data.start && timestamp <= data.end) ||
-              (data.start_defined && !data.end_defined &&
-               timestamp >= data.start) ||
-              (!data.start_defined && data.end_defined &&
-               timestamp <= data.end) ||
-              (!data.start_defined && !data.end_defined)) {
-            applicable_regions.push_back(region.first);
-          }
+    for (auto &state : result.region_states) {
+      const CallTree *tree = &state.second.tree;
+      std::map<std::string, const CallTree *> threads;
+
+      for (auto &part : state.second.parts) {
+        if (state.second.parts.size() == 1 && !state.second.restored) {
+          tree = &part.second.tree;
+        }
+
+        if (this->per_thread && part.second.tree.size() > 1) {
+          threads[part.first] = &part.second.tree;
         }
       }
 
-      std::string state = match[3].str();
-      std::string func_name = match[4].str();
+      std::map<std::string, const CallTree *> processes;
 
-      for (auto &region_name : applicable_regions) {
-        if (state == "enter") {
-          if (stacks.find(region_name) == stacks.end()) {
-            stacks[region_name] = std::vector<std::pair<std::string, unsigned long long> >();
-          }
+      for (auto &process : state.second.processes) {
+        if (process.second.size() > 1) {
+          processes[process.first] = &process.second;
+        }
+      }
 
-          stacks[region_name].push_back(std::make_pair(func_name, timestamp));
-        } else if (state == "exit") {
-          if (stacks.find(region_name) == stacks.end() ||
-              stacks[region_name].empty() ||
-              stacks[region_name][stacks[region_name].size() - 1].first !=
-                  func_name) {
-            adaptyst_print(this->module_id,
-                           ("Received message from the injection part doesn't correspond to "
-                           "the current stack of region "
-                            "\"" + region_name + "\", ignoring: " + msg_str).c_str(),
-                           true, false, "General");
-            continue;
-          }
+      // A region gets its call tree only once a call has finished
+      // in it.
+      if (tree->size() > 1) {
+        outputs[state.first] = { false, 0, 0, tree, threads, processes,
+                                 nullptr };
+      }
+    }
 
-          auto &cur_stack = stacks[region_name];
+    if (!this->add_region_times(outputs, true)) {
+      return false;
+    }
 
-          unsigned long long length =
-            timestamp - cur_stack[cur_stack.size() - 1].second;
+    double callback_overhead = this->callback_overhead();
 
-          if (!this->data.contains(region_name)) {
-            this->data[region_name] = nlohmann::json::object();
-          }
+    if (this->overhead_correction && callback_overhead > 0) {
+      for (auto &region : result.region_states) {
+        region.second.tree.subtract_overhead(callback_overhead);
 
-          if (!this->data[region_name].contains("data")) {
-            this->data[region_name]["data"] = nlohmann::json::object();
-          }
+        for (auto &part : region.second.parts) {
+          part.second.tree.subtract_overhead(callback_overhead);
+        }
 
-          if (!this->data[region_name]["data"].contains(cur_stack[0].first)) {
-            this->data[region_name]["data"][cur_stack[0].first] = nlohmann::json::object();
-            this->data[region_name]["data"][cur_stack[0].first]["length"] = 0ULL;
-            this->data[region_name]["data"][cur_stack[0].first]["children"] =
-              nlohmann::json::object();
-          }
+        for (auto &process : region.second.processes) {
+          process.second.subtract_overhead(callback_overhead);
+        }
+      }
+    }
 
-          this->data[region_name]["data"][cur_stack[0].first]["length"] =
-            (unsigned long long)this->data[region_name]["data"][cur_stack[0].first]["length"] + length;
+    std::map<std::string, ProcessSummary> summaries;
 
-          nlohmann::json *cur_object = &this->data[region_name]["data"][cur_stack[0].first]["children"];
+    if (this->per_process) {
+      this->summarise_processes(outputs, result.names, summaries);
+    }
 
-          for (int i = 1; i < cur_stack.size(); i++) {
-            if (!cur_object->contains(cur_stack[i].first)) {
-              (*cur_object)[cur_stack[i].first] = nlohmann::json::object();
-              (*cur_object)[cur_stack[i].first]["length"] = 0ULL;
-              (*cur_object)[cur_stack[i].first]["children"] = nlohmann::json::object();
-            }
+    fs::path path = fs::path(dir) / "regions.json";
+    std::ofstream stream(path);
 
-            (*cur_object)[cur_stack[i].first]["length"] =
-              (unsigned long long)(*cur_object)[cur_stack[i].first]["length"] + length;
+    if (!stream) {
+      adaptyst_set_error(this->module_id,
+                         ("Could not open " + path.string()).c_str());
+      return false;
+    }
 
-            cur_object = &(*cur_object)[cur_stack[i].first]["children"];
-          }
+    if (!this->write_json(stream, outputs, result.names)) {
+      adaptyst_set_error(this->module_id,
+                         ("Could not write data to " + path.string()).c_str());
+      return false;
+    }
 
-          cur_stack.pop_back();
-        }
-      }
-    } while (msg);
+    // Everything in the checkpoints is in regions.json now.
+    for (unsigned int i = 0; i < this->checkpoint_count; i++) {
+      fs::remove(this->checkpoint_path(i));
+    }
 
-    adaptyst_profile_wait(this->module_id);
+    if (this->extra_output == "table") {
+      fs::path table_path = fs::path(dir) / "regions.bin";
+      std::ofstream table_stream(table_path, std::ios::binary);
 
-    {
-      std::unique_lock lock(this->region_lock);
-      for (auto &part_id : this->regions) {
-        for (auto &region : part_id.second) {
-          std::string name = region.first;
-          Region &data = region.second;
+      if (!table_stream) {
+        adaptyst_set_error(this->module_id,
+                           ("Could not open " + table_path.string()).c_str());
+        return false;
+      }
 
-          if (!this->data.contains(name)) {
-            this->data[name] = nlohmann::json::object();
-            this->data[name]["data"] = nlohmann::json::object();
-          }
+      if (!this->write_table(table_stream, outputs, result.names)) {
+        adaptyst_set_error(this->module_id,
+                           ("Could not write data to " +
+                            table_path.string()).c_str());
+        return false;
+      }
+    }
 
-          unsigned long long start, end;
-          unsigned long long workflow_start_time = adaptyst_get_workflow_start_time(this->module_id);
+    if (this->timeline != "none") {
+      for (auto &shard : this->shards) {
+        if (shard->timeline && !shard->timeline->close()) {
+          adaptyst_set_error(this->module_id,
+                             shard->timeline->error().c_str());
+          return false;
+        }
+      }
 
-          if (adaptyst_get_internal_error_code(this->module_id) !=
-              ADAPTYST_OK) {
-            return false;
-          }
+      unsigned long long workflow_start_time =
+        adaptyst_get_workflow_start_time(this->module_id);
 
-          if (!data.start_defined) {
-            start = 0;
-          } else {
-            start = data.start - workflow_start_time;
-          }
+      if (adaptyst_get_internal_error_code(this->module_id) != ADAPTYST_OK) {
+        return false;
+      }
 
-          if (!data.end_defined) {
-            end = adaptyst_get_workflow_end_time(this->module_id);
-            if (adaptyst_get_internal_error_code(this->module_id) !=
-                ADAPTYST_OK) {
-              return false;
-            }
-          } else {
-            end = data.end - workflow_start_time;
-          }
+      fs::path timeline_path = fs::path(dir) / "timeline.json";
+      std::ofstream timeline_stream(timeline_path);
 
-          this->data[name]["length"] = (unsigned long long)(end - start);
-          this->data[name]["start"] = start;
-        }
+      if (!timeline_stream) {
+        adaptyst_set_error(this->module_id,
+                           ("Could not open " + timeline_path.string()).c_str());
+        return false;
       }
-    }
 
-    const char *dir = adaptyst_get_module_dir(this->module_id);
+      if (!this->write_timeline(timeline_stream, workflow_start_time)) {
+        adaptyst_set_error(this->module_id,
+                           ("Could not write data to " +
+                            timeline_path.string()).c_str());
+        return false;
+      }
 
-    if (!dir) {
-      adaptyst_set_error(this->module_id, "adaptyst_get_module_dir() returned null");
-      return false;
+      for (auto &shard : this->shards) {
+        fs::remove(shard->timeline_path);
+      }
     }
 
-    fs::path path = fs::path(adaptyst_get_module_dir(this->module_id)) / "regions.json";
-    std::ofstream stream(path);
+    fs::path overhead_path = fs::path(dir) / "overhead.json";
+    std::ofstream overhead_stream(overhead_path);
 
-    if (!stream) {
+    if (!overhead_stream) {
       adaptyst_set_error(this->module_id,
-                         ("Could not open " + path.string()).c_str());
+                         ("Could not open " + overhead_path.string()).c_str());
       return false;
     }
 
-    if (!(stream << this->data.dump() << std::endl)) {
+    if (!this->write_overhead(overhead_stream)) {
       adaptyst_set_error(this->module_id,
-                         ("Could not write data to " + path.string()).c_str());
+                         ("Could not write data to " +
+                          overhead_path.string()).c_str());
       return false;
     }
 
@@ -313,10 +2450,11 @@ public:
     {
       std::unique_lock lock(this->region_lock);
       if (this->regions.find(part_id) == this->regions.end()) {
-        this->regions[part_id] = std::unordered_map<std::string, Region>();
+        this->regions[part_id] = StringMap<Region>();
       }
 
       this->regions[part_id][name] = region;
+      this->publish_regions(part_id);
     }
   }
 
@@ -331,6 +2469,8 @@ public:
       Region &region = this->regions[part_id][name];
       region.end_defined = true;
       region.end = std::stoull(timestamp_str);
+      region.end_received = std::chrono::steady_clock::now();
+      this->publish_regions(part_id);
     }
   }
 };
@@ -349,8 +2489,115 @@ extern "C" {
       return false;
     }
 
+    std::vector<std::string> cuda_api_filters[2];
+    const char *filter_options[] = { "cuda_api_include", "cuda_api_exclude" };
+
+    for (int i = 0; i < 2; i++) {
+      option *filter_opt = adaptyst_get_option(module_id, filter_options[i]);
+      cuda_api_filters[i] =
+        ApiFilter::parse_list(*(const char **)filter_opt->data);
+
+      for (auto &item : cuda_api_filters[i]) {
+        if (!ApiFilter::valid_item(item)) {
+          adaptyst_set_error(module_id, (std::string(filter_options[i]) +
+                                         " contains an invalid item: " +
+                                         item).c_str());
+          return false;
+        }
+      }
+    }
+
+    option *wire_protocol_opt = adaptyst_get_option(module_id, "wire_protocol");
+    std::string wire_protocol(*(const char **)wire_protocol_opt->data);
+
+    if (wire_protocol != "binary" && wire_protocol != "text") {
+      adaptyst_set_error(module_id, "wire_protocol must be one of: "
+                         "\"binary\" or \"text\"");
+      return false;
+    }
+
+    option *extra_output_opt = adaptyst_get_option(module_id, "extra_output");
+    std::string extra_output(*(const char **)extra_output_opt->data);
+
+    if (extra_output != "none" && extra_output != "table") {
+      adaptyst_set_error(module_id, "extra_output must be one of: "
+                         "\"none\" or \"table\"");
+      return false;
+    }
+
+    option *timeline_opt = adaptyst_get_option(module_id, "timeline");
+    std::string timeline(*(const char **)timeline_opt->data);
+
+    if (timeline != "none" && timeline != "chrome") {
+      adaptyst_set_error(module_id, "timeline must be one of: "
+                         "\"none\" or \"chrome\"");
+      return false;
+    }
+
+    option *per_thread_opt = adaptyst_get_option(module_id, "per_thread");
+    bool per_thread = *(bool *)per_thread_opt->data;
+
+    option *aggregation_threads_opt = adaptyst_get_option(module_id,
+                                                          "aggregation_threads");
+    unsigned int aggregation_threads =
+      *(unsigned int *)aggregation_threads_opt->data;
+
+    if (aggregation_threads == 0) {
+      adaptyst_set_error(module_id, "aggregation_threads must be at least 1");
+      return false;
+    }
+
+    option *overhead_correction_opt = adaptyst_get_option(module_id,
+                                                          "overhead_correction");
+    bool overhead_correction = *(bool *)overhead_correction_opt->data;
+
+    option *checkpoint_interval_opt = adaptyst_get_option(module_id,
+                                                          "checkpoint_interval");
+    unsigned int checkpoint_interval =
+      *(unsigned int *)checkpoint_interval_opt->data;
+
+    option *checkpoint_size_opt = adaptyst_get_option(module_id,
+                                                      "checkpoint_size");
+    unsigned int checkpoint_size = *(unsigned int *)checkpoint_size_opt->data;
+
+    option *fast_clock_opt = adaptyst_get_option(module_id, "fast_clock");
+    bool fast_clock = *(bool *)fast_clock_opt->data;
+
+    option *nvtx_opt = adaptyst_get_option(module_id, "nvtx");
+    bool nvtx = *(bool *)nvtx_opt->data;
+
+    option *tree_memory_limit_opt = adaptyst_get_option(module_id,
+                                                        "tree_memory_limit");
+    unsigned int tree_memory_limit =
+      *(unsigned int *)tree_memory_limit_opt->data;
+
+    option *per_process_opt = adaptyst_get_option(module_id, "per_process");
+    bool per_process = *(bool *)per_process_opt->data;
+
+    option *queue_policy_opt = adaptyst_get_option(module_id, "queue_policy");
+    std::string queue_policy(*(const char **)queue_policy_opt->data);
+
+    if (queue_policy != "block" && queue_policy != "drop" &&
+        queue_policy != "sample") {
+      adaptyst_set_error(module_id, "queue_policy must be one of: "
+                         "\"block\", \"drop\", or \"sample\"");
+      return false;
+    }
+
     try {
-      NvgpuModule::instance = new NvgpuModule(module_id, cuda_api_type);
+      NvgpuModule::instance = new NvgpuModule(module_id, cuda_api_type,
+                                              cuda_api_filters[0],
+                                              cuda_api_filters[1],
+                                              wire_protocol, extra_output,
+                                              timeline, per_thread,
+                                              aggregation_threads,
+                                              overhead_correction,
+                                              queue_policy,
+                                              checkpoint_interval,
+                                              checkpoint_size,
+                                              fast_clock, nvtx,
+                                              tree_memory_limit,
+                                              per_process);
     } catch (std::exception &e) {
       adaptyst_set_error(module_id, e.what());
       return false;
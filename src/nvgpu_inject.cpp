@@ -1,20 +1,29 @@
 // SPDX-FileCopyrightText: 2025 CERN
 // SPDX-License-Identifier: GPL-3.0-or-later
 
-// This code contains commented sections using the concurrent
-// queue library from https://github.com/cameron314/concurrentqueue.
-// These are commented out because there is a bug causing a segmentation
-// fault. TODO: investigate this
-
 #include <adaptyst/hw_inject.h>
 #include <cupti.h>
+#include <generated_cuda_runtime_api_meta.h>
+#include <generated_cuda_meta.h>
+#include <cupti_nvtx_cbid.h>
+#include <generated_nvtx_meta.h>
 #include <string>
 #include <iostream>
+#include <algorithm>
 #include <unordered_map>
 #include <memory>
-#include <future>
-#include <sstream>
-//#include <blockingconcurrentqueue.h>
+#include <vector>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <chrono>
+#include <charconv>
+#include "message.hpp"
+#include "event_buffer.hpp"
+#include "api_filter.hpp"
+#include "clock.hpp"
+#include "api_category.hpp"
 
 class NvgpuInjection {
 public:
@@ -24,10 +33,45 @@ public:
     BOTH
   } ApiType;
 
-  NvgpuInjection(amod_t module_id, ApiType cuda_api_type) {
+  // What a thread does when its event buffer is full: waits for
+  // the flusher (BLOCK), loses the event (DROP), or does the same and
+  // also keeps only every SAMPLE_INTERVAL-th call once the buffer is
+  // past HIGH_WATER_MARK (SAMPLE).
+  typedef enum QueuePolicy {
+    BLOCK,
+    DROP,
+    SAMPLE
+  } QueuePolicy;
+
+  NvgpuInjection(amod_t module_id, ApiType cuda_api_type, bool binary,
+                 ApiFilter filter, bool report_overhead, QueuePolicy policy,
+                 bool fast_clock, bool report_transfers,
+                 bool report_categories, bool nvtx, bool report_launches) {
     this->status = ADAPTYST_MODULE_OK;
     this->module_id = module_id;
     this->cuda_api_type = cuda_api_type;
+    this->binary = binary;
+    this->filter = std::move(filter);
+    this->report_overhead = report_overhead;
+    this->policy = policy;
+    this->fast_clock = fast_clock;
+    this->report_transfers = report_transfers;
+    this->report_categories = report_categories;
+    this->nvtx = nvtx;
+    this->report_launches = report_launches;
+    this->bytes_sent = 0;
+    this->send_failures = 0;
+    this->next_symbol = 1;
+    this->subscribed = false;
+    this->active_count = 0;
+    this->flusher_running = false;
+    this->flush_requested = false;
+
+    for (int i = 0; i < FUNCTIONS_DEFINED_SIZE; i++) {
+      this->functions_defined[i] = false;
+      this->functions_classified[i] = false;
+      this->functions_lost[i] = 0;
+    }
 
     CUptiResult result = cuptiSubscribe(&this->handle, NvgpuInjection::callback,
                                         this);
@@ -55,26 +99,60 @@ public:
       }
     }
 
-    // this->messenger = std::async([this]() {
-    //   std::string msg;
-    //   this->messages.wait_dequeue(msg);
+    this->subscribed = true;
+
+    if (!this->filter.empty() && !this->select_callbacks()) {
+      this->status = ADAPTYST_MODULE_ERR;
+      return;
+    }
+
+    // No event can be sent before the first calibration point.
+    if (this->fast_clock) {
+      this->start_clock();
+    }
 
-    //   while (msg != "stop") {
-    //     adaptyst_send_string(this->module_id, msg.c_str());
-    //     this->messages.wait_dequeue(msg);
-    //   }
-    // });
+    if (this->nvtx && this->binary) {
+      this->send("@F" + std::to_string(CUPTI_CB_DOMAIN_NVTX) + " " +
+                 std::to_string(NVTX_RANGE_CBID) + " " NVTX_RANGE_FUNCTION);
+    }
 
-    this->subscribed = true;
+    this->flusher_running = true;
+    this->flusher = std::thread(&NvgpuInjection::flush_loop, this);
   }
 
   ~NvgpuInjection() {
+    std::string loss_report;
+
     if (this->subscribed) {
       cuptiUnsubscribe(this->handle);
+
+      // Function names are looked up before CUPTI is finalised.
+      if (this->policy != BLOCK) {
+        loss_report = this->build_loss_report();
+      }
+
       cuptiFinalize();
     }
 
-    // this->messages.enqueue("stop");
+    // No callbacks can run at this point, so the flusher sends
+    // everything left in the buffers before exiting.
+    if (this->flusher.joinable()) {
+      {
+        std::unique_lock lock(this->flusher_lock);
+        this->flusher_running = false;
+      }
+
+      this->flusher_cond.notify_one();
+      this->flusher.join();
+    }
+
+    if (!loss_report.empty()) {
+      this->send(loss_report);
+    }
+
+    if (this->report_overhead) {
+      this->send_overhead();
+    }
   }
 
   int get_status() {
@@ -82,7 +160,25 @@ public:
   }
 
   int start(std::string part_id) {
-    if (this->active_threads.empty()) {
+    std::unique_lock lock(this->threads_lock);
+
+    if (this->active_count == 0 && !this->filter.empty()) {
+      for (auto &callback : this->callbacks) {
+        CUptiResult result = cuptiEnableCallback(1, this->handle,
+                                                 callback.domain,
+                                                 callback.cbid);
+
+        if (result != CUPTI_SUCCESS) {
+          cuptiEnableDomain(0, this->handle, CUPTI_CB_DOMAIN_RUNTIME_API);
+          cuptiEnableDomain(0, this->handle, CUPTI_CB_DOMAIN_DRIVER_API);
+          adaptyst_set_error(("cuptiEnableCallback() returned " +
+                              std::to_string(result) + " for callback " +
+                              std::to_string(callback.cbid) + " of domain " +
+                              std::to_string(callback.domain)).c_str());
+          return ADAPTYST_MODULE_ERR;
+        }
+      }
+    } else if (this->active_count == 0) {
       CUptiResult result;
 
       if (this->cuda_api_type == RUNTIME || this->cuda_api_type == BOTH) {
@@ -111,96 +207,1206 @@ public:
       }
     }
 
-    if (this->active_threads.find(part_id) == this->active_threads.end()) {
-      this->active_threads[part_id] = 1;
-    } else {
-      this->active_threads[part_id]++;
+    if (this->active_count == 0 && this->nvtx) {
+      for (CUpti_CallbackId cbid : NVTX_CALLBACKS) {
+        CUptiResult result = cuptiEnableCallback(1, this->handle,
+                                                 CUPTI_CB_DOMAIN_NVTX, cbid);
+
+        if (result != CUPTI_SUCCESS) {
+          cuptiEnableDomain(0, this->handle, CUPTI_CB_DOMAIN_RUNTIME_API);
+          cuptiEnableDomain(0, this->handle, CUPTI_CB_DOMAIN_DRIVER_API);
+          cuptiEnableDomain(0, this->handle, CUPTI_CB_DOMAIN_NVTX);
+          adaptyst_set_error(("cuptiEnableCallback() returned " +
+                              std::to_string(result) + " for NVTX callback " +
+                              std::to_string(cbid)).c_str());
+          return ADAPTYST_MODULE_ERR;
+        }
+      }
     }
 
+    this->get_record(part_id)->depth.fetch_add(1, std::memory_order_release);
+    this->active_count++;
+
     return ADAPTYST_MODULE_OK;
   }
 
   int stop(std::string part_id) {
-    this->active_threads[part_id]--;
+    std::unique_lock lock(this->threads_lock);
+    ThreadRecord *record = this->get_record(part_id);
 
-    if (this->active_threads[part_id] == 0) {
-      this->active_threads.erase(part_id);
+    if (record->depth.load(std::memory_order_relaxed) == 0) {
+      return ADAPTYST_MODULE_OK;
     }
 
-    if (this->active_threads.empty()) {
+    record->depth.fetch_sub(1, std::memory_order_release);
+    this->active_count--;
+
+    if (this->active_count == 0) {
       cuptiEnableDomain(0, this->handle, CUPTI_CB_DOMAIN_RUNTIME_API);
       cuptiEnableDomain(0, this->handle, CUPTI_CB_DOMAIN_DRIVER_API);
+
+      if (this->nvtx) {
+        cuptiEnableDomain(0, this->handle, CUPTI_CB_DOMAIN_NVTX);
+      }
+
+      this->request_flush();
     }
 
     return ADAPTYST_MODULE_OK;
   }
 
 private:
+  typedef struct Callback {
+    CUpti_CallbackDomain domain;
+    CUpti_CallbackId cbid;
+  } Callback;
+
+  // Fills this->callbacks with the callbacks of the domains selected
+  // by this->cuda_api_type which pass this->filter. Enabling only them
+  // instead of whole domains spares a callback and an event for every
+  // call of any other function. Returns false if no callback is
+  // selected, which is most likely a mistake in the filter.
+  bool select_callbacks() {
+    auto add_domain = [this](CUpti_CallbackDomain domain,
+                             CUpti_CallbackId size) {
+      // Callback ID 0 is invalid in every domain.
+      for (CUpti_CallbackId cbid = 1; cbid < size; cbid++) {
+        const char *name;
+
+        if (cuptiGetCallbackName(domain, cbid, &name) != CUPTI_SUCCESS ||
+            !name) {
+          continue;
+        }
+
+        if (this->filter.matches(name, api_category(domain, cbid))) {
+          this->callbacks.push_back({ domain, cbid });
+        }
+      }
+    };
+
+    if (this->cuda_api_type == RUNTIME || this->cuda_api_type == BOTH) {
+      add_domain(CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_SIZE);
+    }
+
+    if (this->cuda_api_type == DRIVER || this->cuda_api_type == BOTH) {
+      add_domain(CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_SIZE);
+    }
+
+    if (this->callbacks.empty()) {
+      adaptyst_set_error("cuda_api_include and cuda_api_exclude do not "
+                         "match any CUDA API function");
+      return false;
+    }
+
+    return true;
+  }
+
+  // Profiling state of a thread, shared between the thread itself and
+  // start()/stop(), which may be called from any thread. Records are
+  // never freed while the injection object is alive.
+  typedef struct ThreadRecord {
+    // Number of regions the thread is currently in.
+    std::atomic<unsigned int> depth;
+
+    // Overhead counters of the callbacks made in a region, written
+    // only by the thread itself with add_counter() and read when
+    // the injection is closed. callback_time is estimated from
+    // a sample of callbacks.
+    std::atomic<unsigned long long> callbacks;
+    std::atomic<unsigned long long> traced_callbacks;
+    std::atomic<unsigned long long> callback_time;
+
+    // Events lost because of the queue policy, in total and since
+    // the last "@L" line, with the timestamp of the first of the latter.
+    // Also written only by the thread itself.
+    std::atomic<unsigned long long> lost;
+    std::atomic<unsigned long long> pending_lost;
+    std::atomic<unsigned long long> pending_lost_time;
+  } ThreadRecord;
+
+  // Cheaper than fetch_add(), which is not needed with one writer.
+  static void add_counter(std::atomic<unsigned long long> &counter,
+                          unsigned long long value) {
+    counter.store(counter.load(std::memory_order_relaxed) + value,
+                  std::memory_order_relaxed);
+  }
+
+  // Identity of a thread, cached by the thread on its first callback.
+  typedef struct ThreadState {
+    NvgpuInjection *owner;
+    ThreadRecord *record;
+    EventBuffer *buffer;
+    uint32_t pid;
+    uint32_t tid;
+    std::string part_id;
+
+    // Nesting depth of the calls of the thread, used to skip a whole
+    // call (everything until the exit at skip_depth) when its enter is
+    // not sent. Only tracked with a policy other than BLOCK.
+    int call_depth;
+    bool skipping;
+    int skip_depth;
+    unsigned long long sampled_calls;
+
+    // Names of the NVTX ranges seen by the thread with their IDs in
+    // the binary protocol, and the ranges it is in, innermost last.
+    std::unordered_map<std::string, uint32_t> range_ids;
+    std::vector<const std::pair<const std::string, uint32_t> *> ranges;
+  } ThreadState;
+
+  // Returns the record of a thread, creating it if needed.
+  // this->threads_lock must be held.
+  ThreadRecord *get_record(const std::string &part_id) {
+    auto &record = this->threads[part_id];
+
+    if (!record) {
+      record = std::make_unique<ThreadRecord>();
+      record->depth = 0;
+      record->callbacks = 0;
+      record->traced_callbacks = 0;
+      record->callback_time = 0;
+      record->lost = 0;
+      record->pending_lost = 0;
+      record->pending_lost_time = 0;
+    }
+
+    return record.get();
+  }
+
+  void init_thread_state(ThreadState &state) {
+    state.pid = getpid();
+    state.tid = gettid();
+    state.part_id = std::to_string(state.pid) + "_" +
+      std::to_string(state.tid);
+    state.buffer = nullptr;
+    state.call_depth = 0;
+    state.skipping = false;
+    state.skip_depth = 0;
+    state.sampled_calls = 0;
+
+    {
+      std::unique_lock lock(this->threads_lock);
+      state.record = this->get_record(state.part_id);
+    }
+
+    state.owner = this;
+  }
+
   static void callback(void *userdata, CUpti_CallbackDomain domain,
                        CUpti_CallbackId cbid, const void *cbdata) {
     NvgpuInjection *obj = (NvgpuInjection *)userdata;
+    thread_local ThreadState state = { nullptr, nullptr, nullptr, 0, 0, "",
+                                        0, false, 0, 0, {}, {} };
+
+    if (state.owner != obj) {
+      obj->init_thread_state(state);
+    }
+
+    // Threads outside any region, usually most of them, return
+    // after this single load, without counting the callback.
+    if (state.record->depth.load(std::memory_order_acquire) == 0) {
+      return;
+    }
 
-    std::string part_id = std::to_string(getpid()) + "_" +
-      std::to_string(gettid());
+    ThreadRecord *record = state.record;
+    add_counter(record->callbacks, 1);
+    add_counter(record->traced_callbacks, 1);
 
-    if (obj->active_threads.find(part_id) == obj->active_threads.end()) {
+    // Reading the clock costs about as much as the rest of tracing,
+    // so only every TIMING_INTERVAL-th callback is timed.
+    if (record->traced_callbacks.load(std::memory_order_relaxed) %
+        TIMING_INTERVAL != 1) {
+      obj->trace(state, domain, cbid, cbdata);
+      return;
+    }
+
+    auto start_time = std::chrono::steady_clock::now();
+    obj->trace(state, domain, cbid, cbdata);
+    auto end_time = std::chrono::steady_clock::now();
+
+    add_counter(record->callback_time, TIMING_INTERVAL *
+                std::chrono::duration_cast<std::chrono::nanoseconds>(
+                  end_time - start_time).count());
+  }
+
+  // Sends an event for a callback of a thread in a region.
+  void trace(ThreadState &state, CUpti_CallbackDomain domain,
+             CUpti_CallbackId cbid, const void *cbdata) {
+    if (!state.buffer) {
+      state.buffer = this->create_buffer();
+    }
+
+    if (domain == CUPTI_CB_DOMAIN_NVTX) {
+      this->trace_range(state, cbid, (const CUpti_NvtxData *)cbdata);
       return;
     }
 
     const CUpti_CallbackData *data = (const CUpti_CallbackData *)cbdata;
+    bool enter = data->callbackSite == CUPTI_API_ENTER;
 
-    int error;
-    std::stringstream stream;
-    stream << adaptyst_get_timestamp(&error) << " ";
+    if (this->policy != BLOCK && !this->admit(state, domain, cbid, enter)) {
+      return;
+    }
+
+    ApiCategory category = api_category(domain, cbid);
+    bool is_launch = category == API_LAUNCH;
+
+    if (this->report_categories && category != API_OTHER) {
+      this->define_category(domain, cbid, category, data->functionName);
+    }
+
+    // The "@M" or "@G" line sent before the event, if any. Reused by
+    // every callback of this thread to avoid allocating.
+    thread_local std::string prefix_line;
+    prefix_line.clear();
+
+    TransferDirection direction;
+    unsigned long long bytes;
+    LaunchConfig config;
+
+    if (this->report_transfers && enter &&
+        get_transfer(domain, cbid, data->functionParams, direction, bytes)) {
+      char bytes_str[24];
+      char *bytes_end = std::to_chars(bytes_str, bytes_str + sizeof(bytes_str),
+                                      bytes).ptr;
+      prefix_line = "@M ";
+      prefix_line += state.part_id;
+      prefix_line += ' ';
+      prefix_line += transfer_direction_name(direction);
+      prefix_line += ' ';
+      prefix_line.append(bytes_str, bytes_end);
+    } else if (this->report_launches && enter && is_launch &&
+               get_launch(domain, cbid, data->functionParams, config)) {
+      char config_str[LAUNCH_CONFIG_SIZE];
+      prefix_line = "@G ";
+      prefix_line += state.part_id;
+      prefix_line += ' ';
+      prefix_line.append(config_str, write_launch_config(config, config_str));
+    }
+
+    if (this->binary && this->define_function(domain, cbid, data->functionName)) {
+      BinaryHeader header;
+      header.timestamp = this->timestamp();
+      header.pid = state.pid;
+      header.tid = state.tid;
+      header.site = data->callbackSite == CUPTI_API_ENTER ? 0 : 1;
+      header.domain = domain;
+      header.cbid = cbid;
+      header.symbol = is_launch && data->symbolName ?
+        this->define_symbol(data->symbolName) : 0;
+
+      char record[BINARY_RECORD_LENGTH + 1];
+      encode_binary_header(header, record);
 
-    stream << part_id << " ";
+      if (!this->push(state, std::string_view(record, BINARY_RECORD_LENGTH),
+                      prefix_line)) {
+        this->lose(state, domain, cbid, enter);
+      }
+
+      return;
+    }
+
+    thread_local std::string line;
+    char timestamp[24];
+    char *timestamp_end = std::to_chars(timestamp, timestamp + sizeof(timestamp),
+                                        this->timestamp()).ptr;
+
+    line.assign(timestamp, timestamp_end);
+    line += ' ';
+    line += state.part_id;
+    line += ' ';
 
     if (data->callbackSite == CUPTI_API_ENTER) {
-      stream << "enter ";
+      line += "enter ";
     } else if (data->callbackSite == CUPTI_API_EXIT) {
-      stream << "exit ";
-    }
-
-    stream << data->functionName;
-
-    if (cbid == CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000 ||
-        cbid == CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernelExC_v11060 ||
-        cbid == CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_ptsz_v7000 ||
-        cbid == CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernelExC_ptsz_v11060 ||
-        cbid == CUPTI_RUNTIME_TRACE_CBID_cudaLaunchCooperativeKernel_v9000 ||
-        cbid == CUPTI_RUNTIME_TRACE_CBID_cudaLaunchCooperativeKernel_ptsz_v9000 ||
-        cbid == CUPTI_RUNTIME_TRACE_CBID_cudaLaunchCooperativeKernelMultiDevice_v9000 ||
-        cbid == CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel ||
-        cbid == CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx ||
-        cbid == CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel_ptsz ||
-        cbid == CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx_ptsz ||
-        cbid == CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernel ||
-        cbid == CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernel_ptsz ||
-        cbid == CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernelMultiDevice) {
+      line += "exit ";
+    }
+
+    line += data->functionName;
+
+    if (is_launch) {
       if (data->symbolName) {
-        stream << " " << data->symbolName;
+        line += ' ';
+        line += data->symbolName;
+      }
+    }
+
+    if (!this->push(state, line, prefix_line)) {
+      this->lose(state, domain, cbid, enter);
+    }
+  }
+
+  // Sends an enter event for an NVTX push and an exit event for an NVTX
+  // pop of a thread in a region. Pops without a matching push seen by
+  // the thread, e.g. of ranges pushed before the region, are ignored.
+  void trace_range(ThreadState &state, CUpti_CallbackId cbid,
+                   const CUpti_NvtxData *data) {
+    const char *name;
+    bool enter = get_range(cbid, data->functionParams, name);
+    const std::pair<const std::string, uint32_t> *range;
+
+    if (enter) {
+      range = this->intern_range(state, name ? name : "unnamed");
+      state.ranges.push_back(range);
+    } else if (!state.ranges.empty()) {
+      range = state.ranges.back();
+      state.ranges.pop_back();
+    } else {
+      return;
+    }
+
+    if (this->policy != BLOCK &&
+        !this->admit(state, CUPTI_CB_DOMAIN_NVTX, cbid, enter)) {
+      return;
+    }
+
+    bool pushed;
+
+    if (this->binary) {
+      BinaryHeader header;
+      header.timestamp = this->timestamp();
+      header.pid = state.pid;
+      header.tid = state.tid;
+      header.site = enter ? 0 : 1;
+      header.domain = CUPTI_CB_DOMAIN_NVTX;
+      header.cbid = NVTX_RANGE_CBID;
+      header.symbol = range->second;
+
+      char record[BINARY_RECORD_LENGTH + 1];
+      encode_binary_header(header, record);
+      pushed = this->push(state, std::string_view(record, BINARY_RECORD_LENGTH),
+                          "");
+    } else {
+      thread_local std::string line;
+      char timestamp[24];
+      char *timestamp_end = std::to_chars(timestamp,
+                                          timestamp + sizeof(timestamp),
+                                          this->timestamp()).ptr;
+
+      line.assign(timestamp, timestamp_end);
+      line += ' ';
+      line += state.part_id;
+      line += enter ? " enter " NVTX_RANGE_FUNCTION " " :
+        " exit " NVTX_RANGE_FUNCTION " ";
+      line += range->first;
+      pushed = this->push(state, line, "");
+    }
+
+    if (!pushed) {
+      this->lose(state, CUPTI_CB_DOMAIN_NVTX, cbid, enter);
+    }
+  }
+
+  // Returns the entry of a range name in state.range_ids, adding it
+  // the first time the thread sees the name. Only then are the names
+  // of other threads looked up, and in the binary protocol, the ID of
+  // a new name sent to the module.
+  const std::pair<const std::string, uint32_t> *
+  intern_range(ThreadState &state, const char *name) {
+    // Reused to avoid allocating for names seen before. Events are
+    // single lines, so line breaks in names are replaced.
+    thread_local std::string key;
+    key = name;
+    std::replace(key.begin(), key.end(), '\n', ' ');
+
+    auto found = state.range_ids.find(key);
+
+    if (found != state.range_ids.end()) {
+      return &*found;
+    }
+
+    uint32_t id = this->binary ? this->define_symbol(key.c_str()) : 0;
+    return &*state.range_ids.emplace(key, id).first;
+  }
+
+  // Gets the name of the range pushed by an NVTX callback, or nullptr
+  // if it has no ASCII name. Returns false for pops.
+  static bool get_range(CUpti_CallbackId cbid, const void *params,
+                        const char *&name) {
+    const nvtxEventAttributes_t *attributes = nullptr;
+    name = nullptr;
+
+    switch (cbid) {
+    case CUPTI_CBID_NVTX_nvtxRangePushA:
+      name = params ? ((const nvtxRangePushA_params *)params)->message :
+        nullptr;
+      return true;
+    case CUPTI_CBID_NVTX_nvtxRangePushEx:
+      attributes = params ?
+        ((const nvtxRangePushEx_params *)params)->eventAttrib : nullptr;
+      break;
+    case CUPTI_CBID_NVTX_nvtxDomainRangePushEx:
+      attributes = params ?
+        ((const nvtxDomainRangePushEx_params *)params)->core : nullptr;
+      break;
+    default:
+      return false;
+    }
+
+    if (attributes && attributes->messageType == NVTX_MESSAGE_TYPE_ASCII) {
+      name = attributes->message.ascii;
+    }
+
+    return true;
+  }
+
+  static TransferDirection kind_direction(cudaMemcpyKind kind) {
+    switch (kind) {
+    case cudaMemcpyHostToDevice:
+      return HOST_TO_DEVICE;
+    case cudaMemcpyDeviceToHost:
+      return DEVICE_TO_HOST;
+    case cudaMemcpyDeviceToDevice:
+      return DEVICE_TO_DEVICE;
+    case cudaMemcpyHostToHost:
+      return HOST_TO_HOST;
+    default:
+      return UNKNOWN_DIRECTION;
+    }
+  }
+
+  // Gets the direction and size of the transfer made by a memcpy or
+  // memset call from its parameters. Returns false for other functions,
+  // including the less common memcpy and memset variants (e.g. those
+  // with arrays or 3D copies).
+  static bool get_transfer(CUpti_CallbackDomain domain, CUpti_CallbackId cbid,
+                           const void *params, TransferDirection &direction,
+                           unsigned long long &bytes) {
+    if (!params) {
+      return false;
+    }
+
+    auto set = [&](TransferDirection transfer_direction,
+                   unsigned long long size) {
+      direction = transfer_direction;
+      bytes = size;
+      return true;
+    };
+
+    if (domain == CUPTI_CB_DOMAIN_RUNTIME_API) {
+      switch (cbid) {
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020: {
+        auto p = (const cudaMemcpy_v3020_params *)params;
+        return set(kind_direction(p->kind), p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyAsync_v3020: {
+        auto p = (const cudaMemcpyAsync_v3020_params *)params;
+        return set(kind_direction(p->kind), p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_ptds_v7000: {
+        auto p = (const cudaMemcpy_ptds_v7000_params *)params;
+        return set(kind_direction(p->kind), p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyAsync_ptsz_v7000: {
+        auto p = (const cudaMemcpyAsync_ptsz_v7000_params *)params;
+        return set(kind_direction(p->kind), p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy2D_v3020: {
+        auto p = (const cudaMemcpy2D_v3020_params *)params;
+        return set(kind_direction(p->kind),
+                   (unsigned long long)p->width * p->height);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy2DAsync_v3020: {
+        auto p = (const cudaMemcpy2DAsync_v3020_params *)params;
+        return set(kind_direction(p->kind),
+                   (unsigned long long)p->width * p->height);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyToSymbol_v3020: {
+        auto p = (const cudaMemcpyToSymbol_v3020_params *)params;
+        return set(kind_direction(p->kind), p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyFromSymbol_v3020: {
+        auto p = (const cudaMemcpyFromSymbol_v3020_params *)params;
+        return set(kind_direction(p->kind), p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyToSymbolAsync_v3020: {
+        auto p = (const cudaMemcpyToSymbolAsync_v3020_params *)params;
+        return set(kind_direction(p->kind), p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyFromSymbolAsync_v3020: {
+        auto p = (const cudaMemcpyFromSymbolAsync_v3020_params *)params;
+        return set(kind_direction(p->kind), p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyPeer_v4000: {
+        auto p = (const cudaMemcpyPeer_v4000_params *)params;
+        return set(PEER_TO_PEER, p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyPeerAsync_v4000: {
+        auto p = (const cudaMemcpyPeerAsync_v4000_params *)params;
+        return set(PEER_TO_PEER, p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemset_v3020: {
+        auto p = (const cudaMemset_v3020_params *)params;
+        return set(MEMSET, p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemsetAsync_v3020: {
+        auto p = (const cudaMemsetAsync_v3020_params *)params;
+        return set(MEMSET, p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemset_ptds_v7000: {
+        auto p = (const cudaMemset_ptds_v7000_params *)params;
+        return set(MEMSET, p->count);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaMemsetAsync_ptsz_v7000: {
+        auto p = (const cudaMemsetAsync_ptsz_v7000_params *)params;
+        return set(MEMSET, p->count);
+      }
+      default:
+        return false;
+      }
+    } else if (domain == CUPTI_CB_DOMAIN_DRIVER_API) {
+      switch (cbid) {
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpyHtoD_v2:
+        return set(HOST_TO_DEVICE,
+                   ((const cuMemcpyHtoD_v2_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpyHtoDAsync_v2:
+        return set(HOST_TO_DEVICE,
+                   ((const cuMemcpyHtoDAsync_v2_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpyDtoH_v2:
+        return set(DEVICE_TO_HOST,
+                   ((const cuMemcpyDtoH_v2_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpyDtoHAsync_v2:
+        return set(DEVICE_TO_HOST,
+                   ((const cuMemcpyDtoHAsync_v2_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpyDtoD_v2:
+        return set(DEVICE_TO_DEVICE,
+                   ((const cuMemcpyDtoD_v2_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpyDtoDAsync_v2:
+        return set(DEVICE_TO_DEVICE,
+                   ((const cuMemcpyDtoDAsync_v2_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpy:
+        return set(UNKNOWN_DIRECTION,
+                   ((const cuMemcpy_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpyAsync:
+        return set(UNKNOWN_DIRECTION,
+                   ((const cuMemcpyAsync_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpyPeer:
+        return set(PEER_TO_PEER,
+                   ((const cuMemcpyPeer_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemcpyPeerAsync:
+        return set(PEER_TO_PEER,
+                   ((const cuMemcpyPeerAsync_params *)params)->ByteCount);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemsetD8_v2:
+        return set(MEMSET, ((const cuMemsetD8_v2_params *)params)->N);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemsetD8Async:
+        return set(MEMSET, ((const cuMemsetD8Async_params *)params)->N);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemsetD16_v2:
+        return set(MEMSET, ((const cuMemsetD16_v2_params *)params)->N * 2);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemsetD16Async:
+        return set(MEMSET, ((const cuMemsetD16Async_params *)params)->N * 2);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemsetD32_v2:
+        return set(MEMSET, ((const cuMemsetD32_v2_params *)params)->N * 4);
+      case CUPTI_DRIVER_TRACE_CBID_cuMemsetD32Async:
+        return set(MEMSET, ((const cuMemsetD32Async_params *)params)->N * 4);
+      default:
+        return false;
       }
     }
 
-    adaptyst_send_string(obj->module_id, stream.str().c_str());
-    // obj->messages.enqueue(stream.str());
+    return false;
   }
 
+  // Gets the configuration of a kernel launch from the parameters of
+  // a launch call. Returns false for other functions and for launches
+  // of several kernels at once (the MultiDevice variants).
+  static bool get_launch(CUpti_CallbackDomain domain, CUpti_CallbackId cbid,
+                         const void *params, LaunchConfig &config) {
+    if (!params) {
+      return false;
+    }
+
+    auto set = [&](unsigned int grid_x, unsigned int grid_y,
+                   unsigned int grid_z, unsigned int block_x,
+                   unsigned int block_y, unsigned int block_z,
+                   unsigned long long shared_memory, const void *stream) {
+      config = { { grid_x, grid_y, grid_z }, { block_x, block_y, block_z },
+                 shared_memory, (uintptr_t)stream };
+      return true;
+    };
+
+    // The runtime API takes dim3, the driver API separate dims.
+    auto set_runtime = [&](const dim3 &grid, const dim3 &block,
+                           unsigned long long shared_memory,
+                           const void *stream) {
+      return set(grid.x, grid.y, grid.z, block.x, block.y, block.z,
+                 shared_memory, stream);
+    };
+
+    if (domain == CUPTI_CB_DOMAIN_RUNTIME_API) {
+      switch (cbid) {
+      case CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000: {
+        auto p = (const cudaLaunchKernel_v7000_params *)params;
+        return set_runtime(p->gridDim, p->blockDim, p->sharedMem, p->stream);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_ptsz_v7000: {
+        auto p = (const cudaLaunchKernel_ptsz_v7000_params *)params;
+        return set_runtime(p->gridDim, p->blockDim, p->sharedMem, p->stream);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaLaunchCooperativeKernel_v9000: {
+        auto p = (const cudaLaunchCooperativeKernel_v9000_params *)params;
+        return set_runtime(p->gridDim, p->blockDim, p->sharedMem, p->stream);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaLaunchCooperativeKernel_ptsz_v9000: {
+        auto p = (const cudaLaunchCooperativeKernel_ptsz_v9000_params *)params;
+        return set_runtime(p->gridDim, p->blockDim, p->sharedMem, p->stream);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernelExC_v11060: {
+        auto p = ((const cudaLaunchKernelExC_v11060_params *)params)->config;
+        return p && set_runtime(p->gridDim, p->blockDim, p->dynamicSmemBytes,
+                                p->stream);
+      }
+      case CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernelExC_ptsz_v11060: {
+        auto p =
+          ((const cudaLaunchKernelExC_ptsz_v11060_params *)params)->config;
+        return p && set_runtime(p->gridDim, p->blockDim, p->dynamicSmemBytes,
+                                p->stream);
+      }
+      default:
+        return false;
+      }
+    } else if (domain == CUPTI_CB_DOMAIN_DRIVER_API) {
+      // cuLaunchKernel() and cuLaunchCooperativeKernel() have the same
+      // parameters up to the stream.
+      auto set_driver = [&](auto p) {
+        return set(p->gridDimX, p->gridDimY, p->gridDimZ, p->blockDimX,
+                   p->blockDimY, p->blockDimZ, p->sharedMemBytes, p->hStream);
+      };
+
+      switch (cbid) {
+      case CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel:
+        return set_driver((const cuLaunchKernel_params *)params);
+      case CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel_ptsz:
+        return set_driver((const cuLaunchKernel_ptsz_params *)params);
+      case CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernel:
+        return set_driver((const cuLaunchCooperativeKernel_params *)params);
+      case CUPTI_DRIVER_TRACE_CBID_cuLaunchCooperativeKernel_ptsz:
+        return set_driver(
+          (const cuLaunchCooperativeKernel_ptsz_params *)params);
+      case CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx: {
+        auto p = ((const cuLaunchKernelEx_params *)params)->config;
+        return p && set_driver(p);
+      }
+      case CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx_ptsz: {
+        auto p = ((const cuLaunchKernelEx_ptsz_params *)params)->config;
+        return p && set_driver(p);
+      }
+      default:
+        return false;
+      }
+    }
+
+    return false;
+  }
+
+  // Decides whether an event is sent with the DROP and SAMPLE policies,
+  // which leave out whole calls together with the calls made during
+  // them, so that the module still gets matching enters and exits.
+  bool admit(ThreadState &state, CUpti_CallbackDomain domain,
+             CUpti_CallbackId cbid, bool enter) {
+    int depth = enter ? ++state.call_depth : state.call_depth--;
+
+    // The exit of the skipped call has been missed if a call at
+    // the same depth starts, e.g. because it was outside the region.
+    if (state.skipping && enter && depth <= state.skip_depth) {
+      state.skipping = false;
+    }
+
+    if (state.skipping) {
+      if (!enter && depth == state.skip_depth) {
+        state.skipping = false;
+      }
+
+      this->count_lost(state, domain, cbid);
+      return false;
+    }
+
+    if (enter && this->policy == SAMPLE &&
+        state.buffer->size() >= HIGH_WATER_MARK &&
+        state.sampled_calls++ % SAMPLE_INTERVAL != 0) {
+      this->lose(state, domain, cbid, enter);
+      return false;
+    }
+
+    return true;
+  }
+
+  // Handles an event which is not sent. If it is an enter, the rest
+  // of its call is skipped by admit().
+  void lose(ThreadState &state, CUpti_CallbackDomain domain,
+            CUpti_CallbackId cbid, bool enter) {
+    if (enter) {
+      state.skipping = true;
+      state.skip_depth = state.call_depth;
+    }
+
+    this->count_lost(state, domain, cbid);
+  }
+
+  void count_lost(ThreadState &state, CUpti_CallbackDomain domain,
+                  CUpti_CallbackId cbid) {
+    ThreadRecord *record = state.record;
+
+    if (record->pending_lost.load(std::memory_order_relaxed) == 0) {
+      record->pending_lost_time.store(this->timestamp(),
+                                      std::memory_order_relaxed);
+    }
+
+    add_counter(record->lost, 1);
+    add_counter(record->pending_lost, 1);
+
+    int index = function_index(domain, cbid);
+
+    if (index != -1) {
+      this->functions_lost[index].fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Returns the timestamp of an event, in ticks of this->clock if
+  // the module converts them.
+  unsigned long long timestamp() {
+    if (this->fast_clock) {
+      return this->clock.now();
+    }
+
+    int error;
+    return adaptyst_get_timestamp(&error);
+  }
+
+  static unsigned long long adaptyst_timestamp() {
+    int error;
+    return adaptyst_get_timestamp(&error);
+  }
+
+  // Takes the first calibration point of this->clock and sends it,
+  // with the rate of the clock measured over INITIAL_CALIBRATION.
+  void start_clock() {
+    FastClock::Point first = this->clock.calibrate(adaptyst_timestamp);
+    std::this_thread::sleep_for(INITIAL_CALIBRATION);
+    this->calibration = this->clock.calibrate(adaptyst_timestamp);
+    this->clock_rate = (double)(this->calibration.timestamp - first.timestamp) /
+      (this->calibration.ticks - first.ticks);
+    this->last_calibration = std::chrono::steady_clock::now();
+    this->send(this->calibration_line());
+  }
+
+  // Takes a new calibration point, with the rate of the clock measured
+  // since the previous one, and returns its "@C" line. Run by
+  // the flusher every CALIBRATION_INTERVAL.
+  std::string recalibrate_clock() {
+    FastClock::Point point = this->clock.calibrate(adaptyst_timestamp);
+
+    if (point.ticks > this->calibration.ticks &&
+        point.timestamp > this->calibration.timestamp) {
+      this->clock_rate = (double)(point.timestamp - this->calibration.timestamp) /
+        (point.ticks - this->calibration.ticks);
+    }
+
+    this->calibration = point;
+    this->last_calibration = std::chrono::steady_clock::now();
+    return this->calibration_line();
+  }
+
+  std::string calibration_line() {
+    char rate[32];
+    char *rate_end = std::to_chars(rate, rate + sizeof(rate),
+                                   this->clock_rate).ptr;
+    return "@C " + std::to_string(getpid()) + " " +
+      std::to_string(this->calibration.ticks) + " " +
+      std::to_string(this->calibration.timestamp) + " " +
+      std::string(rate, rate_end);
+  }
+
+  static std::string loss_line(unsigned long long timestamp,
+                               const std::string &part_id,
+                               unsigned long long count) {
+    return "@L " + std::to_string(timestamp) + " " + part_id + " " +
+      std::to_string(count);
+  }
+
+  // Returns the "@L" lines of the losses not reported yet and
+  // the "@A" line, joined with newlines, or an empty string if
+  // nothing has been lost.
+  std::string build_loss_report() {
+    std::string report;
+
+    {
+      std::unique_lock lock(this->threads_lock);
+
+      for (auto &thread : this->threads) {
+        unsigned long long pending =
+          thread.second->pending_lost.load(std::memory_order_relaxed);
+
+        if (pending > 0) {
+          report += loss_line(
+            thread.second->pending_lost_time.load(std::memory_order_relaxed),
+            thread.first, pending) + "\n";
+        }
+      }
+    }
+
+    std::string functions;
+
+    for (int i = 0; i < FUNCTIONS_DEFINED_SIZE; i++) {
+      unsigned long long count =
+        this->functions_lost[i].load(std::memory_order_relaxed);
+
+      if (count == 0) {
+        continue;
+      }
+
+      CUpti_CallbackDomain domain = CUPTI_CB_DOMAIN_RUNTIME_API;
+      CUpti_CallbackId cbid = i;
+
+      if (i >= (int)CUPTI_RUNTIME_TRACE_CBID_SIZE) {
+        domain = CUPTI_CB_DOMAIN_DRIVER_API;
+        cbid = i - (int)CUPTI_RUNTIME_TRACE_CBID_SIZE;
+      }
+
+      const char *name;
+
+      if (cuptiGetCallbackName(domain, cbid, &name) != CUPTI_SUCCESS ||
+          !name) {
+        continue;
+      }
+
+      functions += std::string(" ") + name + "=" + std::to_string(count);
+    }
+
+    if (!functions.empty()) {
+      report += "@A" + functions;
+    } else if (!report.empty()) {
+      report.pop_back();
+    }
+
+    return report;
+  }
+
+  void send(const std::string &message) {
+    if (adaptyst_send_string(this->module_id, message.c_str()) == 0) {
+      this->bytes_sent.fetch_add(message.size() + 1, std::memory_order_relaxed);
+    } else {
+      this->send_failures.fetch_add(1, std::memory_order_relaxed);
+    }
+  }
+
+  // Sends the overhead counters summed over all threads as
+  // "@O <name>=<value> ...". Nothing else can be sent afterwards.
+  void send_overhead() {
+    unsigned long long callbacks = 0;
+    unsigned long long traced_callbacks = 0;
+    unsigned long long callback_time = 0;
+    unsigned long long lost = 0;
+
+    {
+      std::unique_lock lock(this->threads_lock);
+
+      for (auto &thread : this->threads) {
+        callbacks += thread.second->callbacks.load(std::memory_order_relaxed);
+        traced_callbacks +=
+          thread.second->traced_callbacks.load(std::memory_order_relaxed);
+        callback_time +=
+          thread.second->callback_time.load(std::memory_order_relaxed);
+        lost += thread.second->lost.load(std::memory_order_relaxed);
+      }
+    }
+
+    std::string message = "@O callbacks=" + std::to_string(callbacks) +
+      " traced_callbacks=" + std::to_string(traced_callbacks) +
+      " callback_time=" + std::to_string(callback_time) +
+      " lost=" + std::to_string(lost) +
+      " bytes_sent=" + std::to_string(this->bytes_sent.load()) +
+      " send_failures=" + std::to_string(this->send_failures.load());
+    adaptyst_send_string(this->module_id, message.c_str());
+  }
+
+  // Creates an event buffer for the calling thread. This happens on
+  // the first callback in a region, so threads which are never profiled
+  // do not get one.
+  EventBuffer *create_buffer() {
+    std::unique_lock lock(this->buffers_lock);
+    this->buffers.push_back(std::make_unique<EventBuffer>(BUFFER_CAPACITY));
+    return this->buffers.back().get();
+  }
+
+  // Adds an event line to the buffer of the calling thread, preceded
+  // by "before" if it is not empty. If the buffer is full, waits for
+  // the flusher to make space with the BLOCK policy and returns false
+  // otherwise. Losses not reported yet are reported just before
+  // the event.
+  bool push(ThreadState &state, std::string_view line,
+            std::string_view before) {
+    EventBuffer *buffer = state.buffer;
+
+    if (this->policy == BLOCK) {
+      for (std::string_view item : { before, line }) {
+        while (!item.empty() && !buffer->push(item)) {
+          this->request_flush();
+          std::this_thread::yield();
+        }
+      }
+    } else {
+      ThreadRecord *record = state.record;
+      unsigned long long pending =
+        record->pending_lost.load(std::memory_order_relaxed);
+      std::size_t needed = 1 + (pending > 0 ? 1 : 0) + (before.empty() ? 0 : 1);
+
+      // Only the flusher changes the size meanwhile, making it smaller.
+      if (buffer->capacity() - buffer->size() < needed) {
+        this->request_flush();
+        return false;
+      }
+
+      if (pending > 0) {
+        buffer->push(loss_line(
+          record->pending_lost_time.load(std::memory_order_relaxed),
+          state.part_id, pending));
+        record->pending_lost.store(0, std::memory_order_relaxed);
+      }
+
+      if (!before.empty()) {
+        buffer->push(before);
+      }
+
+      buffer->push(line);
+    }
+
+    if (buffer->size() >= buffer->capacity() / 2) {
+      this->request_flush();
+    }
+
+    return true;
+  }
+
+  void request_flush() {
+    if (!this->flush_requested.exchange(true, std::memory_order_acq_rel)) {
+      this->flusher_cond.notify_one();
+    }
+  }
+
+  // Runs in the flusher thread. Lines from every buffer are joined with
+  // newlines and sent in batches of up to BATCH_SIZE bytes, either
+  // every FLUSH_INTERVAL or earlier if a buffer gets half-full.
+  void flush_loop() {
+    std::string batch;
+    batch.reserve(BATCH_SIZE + 1024);
+
+    auto send_batch = [&]() {
+      if (!batch.empty()) {
+        this->send(batch);
+        batch.clear();
+      }
+    };
+
+    auto add_line = [&](std::string_view line) {
+      if (!batch.empty()) {
+        if (batch.size() + line.size() >= BATCH_SIZE) {
+          send_batch();
+        } else {
+          batch += '\n';
+        }
+      }
+
+      batch += line;
+    };
+
+    std::vector<EventBuffer *> snapshot;
+    bool running = true;
+
+    while (running) {
+      {
+        std::unique_lock lock(this->flusher_lock);
+        this->flusher_cond.wait_for(lock, FLUSH_INTERVAL, [this]() {
+          return !this->flusher_running ||
+            this->flush_requested.load(std::memory_order_acquire);
+        });
+
+        running = this->flusher_running;
+      }
+
+      this->flush_requested.store(false, std::memory_order_release);
+
+      // Events drained below may be older than the new point, which
+      // the module handles in the same way as newer ones.
+      if (this->fast_clock && std::chrono::steady_clock::now() -
+          this->last_calibration >= CALIBRATION_INTERVAL) {
+        add_line(this->recalibrate_clock());
+      }
+
+      // Buffers are never removed, so they can be drained without
+      // holding the lock.
+      {
+        std::unique_lock lock(this->buffers_lock);
+        snapshot.clear();
+
+        for (auto &buffer : this->buffers) {
+          snapshot.push_back(buffer.get());
+        }
+      }
+
+      std::size_t drained;
+
+      do {
+        drained = 0;
+
+        for (auto buffer : snapshot) {
+          drained += buffer->drain(add_line);
+        }
+      } while (drained > 0);
+
+      send_batch();
+    }
+  }
+
+  // Sends the name of a function to the module the first time it is
+  // seen in the binary protocol. Returns false if the function cannot
+  // be referred to by a binary event, in which case the text protocol
+  // should be used for it.
+  bool define_function(CUpti_CallbackDomain domain, CUpti_CallbackId cbid,
+                       const char *name) {
+    int index = function_index(domain, cbid);
+
+    if (index == -1) {
+      return false;
+    }
+
+    if (this->functions_defined[index].load(std::memory_order_acquire)) {
+      return true;
+    }
+
+    // The definition must reach the module before any event using it,
+    // so the flag is set only after sending.
+    std::unique_lock lock(this->definition_lock);
+
+    if (!this->functions_defined[index].load(std::memory_order_relaxed)) {
+      std::string definition = "@F" + std::to_string(domain) + " " +
+        std::to_string(cbid) + " " + name;
+      this->send(definition);
+      this->functions_defined[index].store(true, std::memory_order_release);
+    }
+
+    return true;
+  }
+
+  // Sends the category of a function to the module the first time it
+  // is seen. Unlike definitions, categories are used only when
+  // the results are written, so they can arrive after the events.
+  void define_category(CUpti_CallbackDomain domain, CUpti_CallbackId cbid,
+                       ApiCategory category, const char *name) {
+    int index = function_index(domain, cbid);
+
+    if (index == -1 ||
+        this->functions_classified[index].load(std::memory_order_relaxed) ||
+        this->functions_classified[index].exchange(true)) {
+      return;
+    }
+
+    this->send(std::string("@K ") + api_category_name(category) + " " + name);
+  }
+
+  // Returns the index of a function in per-function arrays such as
+  // this->functions_defined, or -1 if it has none.
+  static int function_index(CUpti_CallbackDomain domain,
+                            CUpti_CallbackId cbid) {
+    if (domain == CUPTI_CB_DOMAIN_RUNTIME_API &&
+        cbid < CUPTI_RUNTIME_TRACE_CBID_SIZE) {
+      return cbid;
+    } else if (domain == CUPTI_CB_DOMAIN_DRIVER_API &&
+               cbid < CUPTI_DRIVER_TRACE_CBID_SIZE) {
+      return (int)CUPTI_RUNTIME_TRACE_CBID_SIZE + cbid;
+    }
+
+    return -1;
+  }
+
+  // Returns the ID of a kernel symbol, sending its definition to
+  // the module the first time it is seen.
+  uint32_t define_symbol(const char *symbol) {
+    std::unique_lock lock(this->definition_lock);
+    auto found = this->symbols.find(symbol);
+
+    if (found != this->symbols.end()) {
+      return found->second;
+    }
+
+    uint32_t id = this->next_symbol++;
+    std::string definition = "@S" + std::to_string(getpid()) + " " +
+      std::to_string(id) + " " + symbol;
+    this->send(definition);
+    this->symbols[symbol] = id;
+    return id;
+  }
+
+  static constexpr std::size_t BUFFER_CAPACITY = 4096;
+  static constexpr std::size_t BATCH_SIZE = 64 * 1024;
+  static constexpr std::chrono::milliseconds FLUSH_INTERVAL{10};
+  static constexpr unsigned long long TIMING_INTERVAL = 64;
+  static constexpr std::size_t HIGH_WATER_MARK = BUFFER_CAPACITY * 3 / 4;
+  static constexpr unsigned long long SAMPLE_INTERVAL = 8;
+  static constexpr std::chrono::milliseconds INITIAL_CALIBRATION{2};
+  static constexpr std::chrono::milliseconds CALIBRATION_INTERVAL{100};
+
+  static constexpr CUpti_CallbackId NVTX_CALLBACKS[] = {
+    CUPTI_CBID_NVTX_nvtxRangePushA,
+    CUPTI_CBID_NVTX_nvtxRangePushEx,
+    CUPTI_CBID_NVTX_nvtxRangePop,
+    CUPTI_CBID_NVTX_nvtxDomainRangePushEx,
+    CUPTI_CBID_NVTX_nvtxDomainRangePop
+  };
+
+  static const int FUNCTIONS_DEFINED_SIZE =
+    (int)CUPTI_RUNTIME_TRACE_CBID_SIZE + (int)CUPTI_DRIVER_TRACE_CBID_SIZE;
+
   CUpti_SubscriberHandle handle;
   bool subscribed;
+  bool binary;
+  ApiFilter filter;
+  std::vector<Callback> callbacks;
+  bool report_overhead;
+  QueuePolicy policy;
+  bool report_transfers;
+  bool report_categories;
+  bool nvtx;
+  bool report_launches;
+
+  // Whether events are timestamped with this->clock. The calibration
+  // state is used only by the flusher after the constructor.
+  bool fast_clock;
+  FastClock clock;
+  FastClock::Point calibration;
+  double clock_rate;
+  std::chrono::steady_clock::time_point last_calibration;
+  std::atomic<unsigned long long> bytes_sent;
+  std::atomic<unsigned long long> send_failures;
+  std::atomic<bool> functions_defined[FUNCTIONS_DEFINED_SIZE];
+  std::atomic<bool> functions_classified[FUNCTIONS_DEFINED_SIZE];
+  std::atomic<unsigned long long> functions_lost[FUNCTIONS_DEFINED_SIZE];
+  std::unordered_map<std::string, uint32_t> symbols;
+  uint32_t next_symbol;
+  std::mutex definition_lock;
   int status;
-  std::future<void> messenger;
-  // moodycamel::BlockingConcurrentQueue<std::string> messages;
+  std::vector<std::unique_ptr<EventBuffer> > buffers;
+  std::mutex buffers_lock;
+  std::thread flusher;
+  bool flusher_running;
+  std::mutex flusher_lock;
+  std::condition_variable flusher_cond;
+  std::atomic<bool> flush_requested;
   amod_t module_id;
   ApiType cuda_api_type;
-  std::unordered_map<std::string, unsigned int> active_threads;
+  std::unordered_map<std::string, std::unique_ptr<ThreadRecord> > threads;
+  unsigned int active_count;
+  std::mutex threads_lock;
 };
 
 static std::unordered_map<amod_t, std::unique_ptr<NvgpuInjection> > injections;
 
 extern "C" {
   int adaptyst_init(amod_t module_id) {
-    std::string request = "cuda_api_type";
+    std::string request = "cuda_api_type text " NVGPU_BINARY_PROTOCOL
+      " " NVGPU_FILTER_CAPABILITY " " NVGPU_OVERHEAD_CAPABILITY
+      " " NVGPU_POLICY_CAPABILITY " " NVGPU_CLOCK_CAPABILITY
+      " " NVGPU_TRANSFER_CAPABILITY " " NVGPU_CATEGORY_CAPABILITY
+      " " NVGPU_NVTX_CAPABILITY " " NVGPU_LAUNCH_CAPABILITY;
     if (adaptyst_send_string_nl(module_id, request.c_str()) != 0) {
       adaptyst_set_error_nl("Could not send \"cuda_api_type\" injection request "
                             "to Adaptyst");
@@ -214,15 +1420,70 @@ extern "C" {
       return ADAPTYST_MODULE_ERR;
     }
 
+    // The reply is the CUDA API type, optionally followed by
+    // the chosen protocol ("text" if there is none) and the capabilities
+    // used by the module with their arguments.
     std::string reply(msg);
+    std::vector<std::string> tokens;
+
+    for (std::string::size_type start = 0; start <= reply.size();) {
+      std::string::size_type end = reply.find(' ', start);
+
+      if (end == std::string::npos) {
+        end = reply.size();
+      }
+
+      tokens.push_back(reply.substr(start, end - start));
+      start = end + 1;
+    }
+
+    std::string type_str = tokens[0];
+    std::string protocol = tokens.size() > 1 ? tokens[1] : "text";
+    ApiFilter filter;
+    bool report_overhead = false;
+    NvgpuInjection::QueuePolicy policy = NvgpuInjection::BLOCK;
+    bool fast_clock = false;
+    bool report_transfers = false;
+    bool report_categories = false;
+    bool nvtx = false;
+    bool report_launches = false;
+
+    for (std::size_t i = 2; i < tokens.size(); i++) {
+      if (tokens[i] == NVGPU_FILTER_CAPABILITY && i + 2 < tokens.size()) {
+        filter = ApiFilter(ApiFilter::parse_list(tokens[i + 1]),
+                           ApiFilter::parse_list(tokens[i + 2]));
+        i += 2;
+      } else if (tokens[i] == NVGPU_OVERHEAD_CAPABILITY) {
+        report_overhead = true;
+      } else if (tokens[i] == NVGPU_POLICY_CAPABILITY && i + 1 < tokens.size() &&
+                 (tokens[i + 1] == "drop" || tokens[i + 1] == "sample")) {
+        policy = tokens[i + 1] == "drop" ? NvgpuInjection::DROP :
+          NvgpuInjection::SAMPLE;
+        i++;
+      } else if (tokens[i] == NVGPU_CLOCK_CAPABILITY) {
+        fast_clock = true;
+      } else if (tokens[i] == NVGPU_TRANSFER_CAPABILITY) {
+        report_transfers = true;
+      } else if (tokens[i] == NVGPU_CATEGORY_CAPABILITY) {
+        report_categories = true;
+      } else if (tokens[i] == NVGPU_NVTX_CAPABILITY) {
+        nvtx = true;
+      } else if (tokens[i] == NVGPU_LAUNCH_CAPABILITY) {
+        report_launches = true;
+      } else {
+        adaptyst_set_error_nl(("Invalid reply to \"cuda_api_type\" received "
+                               "from Adaptyst: " + reply).c_str());
+        return ADAPTYST_MODULE_ERR;
+      }
+    }
 
     NvgpuInjection::ApiType type;
 
-    if (reply == "runtime") {
+    if (type_str == "runtime") {
       type = NvgpuInjection::RUNTIME;
-    } else if (reply == "driver") {
+    } else if (type_str == "driver") {
       type = NvgpuInjection::DRIVER;
-    } else if (reply == "both") {
+    } else if (type_str == "both") {
       type = NvgpuInjection::BOTH;
     } else {
       adaptyst_set_error_nl(("Invalid reply to \"cuda_api_type\" received "
@@ -230,8 +1491,17 @@ extern "C" {
       return ADAPTYST_MODULE_ERR;
     }
 
+    if (protocol != "text" && protocol != NVGPU_BINARY_PROTOCOL) {
+      adaptyst_set_error_nl(("Invalid protocol in the reply to \"cuda_api_type\" "
+                             "received from Adaptyst: " + reply).c_str());
+      return ADAPTYST_MODULE_ERR;
+    }
+
     try {
-      injections[module_id] = std::make_unique<NvgpuInjection>(module_id, type);
+      injections[module_id] = std::make_unique<NvgpuInjection>(
+          module_id, type, protocol == NVGPU_BINARY_PROTOCOL,
+          std::move(filter), report_overhead, policy, fast_clock,
+          report_transfers, report_categories, nvtx, report_launches);
       return injections[module_id]->get_status();
     } catch (std::exception &e) {
       adaptyst_set_error_nl(e.what());
@@ -260,6 +1530,7 @@ extern "C" {
   }
 
   void adaptyst_close(amod_t module_id) {
-
+    // Unsubscribes from CUPTI and sends any buffered events.
+    injections.erase(module_id);
   }
 }
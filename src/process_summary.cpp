@@ -0,0 +1,165 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "process_summary.hpp"
+
+ProcessSummary::ProcessSummary() {
+  this->nodes.push_back({ NONE, NONE, NONE, NONE, 0, 0, 0, 0 });
+  this->process_count = 0;
+}
+
+ProcessSummary::ProcessSummary(const CallTree &tree) : ProcessSummary() {
+  this->process_count = 1;
+
+  // Parents come before their children in the arena of a call tree,
+  // so node i of the tree becomes node index[i] here in one pass.
+  std::vector<uint32_t> index(tree.size(), NONE);
+  index[CallTree::ROOT] = ROOT;
+
+  for (uint32_t i = 1; i < tree.size(); i++) {
+    const CallTree::Node &node = tree.node(i);
+    index[i] = this->child(index[node.parent], node.name);
+    add(this->nodes[index[i]], 1, node.length, node.length, node.length);
+  }
+}
+
+uint32_t ProcessSummary::child(uint32_t parent, uint32_t name) {
+  auto found = this->children.find(child_key(parent, name));
+
+  if (found != this->children.end()) {
+    return found->second;
+  }
+
+  uint32_t index = this->nodes.size();
+  this->nodes.push_back({ name, parent, NONE, this->nodes[parent].first_child,
+                          0, 0, 0, 0 });
+  this->nodes[parent].first_child = index;
+  this->children.emplace(child_key(parent, name), index);
+  return index;
+}
+
+void ProcessSummary::add(Node &target, unsigned long long processes,
+                         unsigned long long min, unsigned long long max,
+                         unsigned long long total) {
+  if (processes == 0) {
+    return;
+  }
+
+  if (target.processes == 0 || min < target.min) {
+    target.min = min;
+  }
+
+  if (max > target.max) {
+    target.max = max;
+  }
+
+  target.processes += processes;
+  target.total += total;
+}
+
+void ProcessSummary::merge(const ProcessSummary &other,
+                           const std::vector<uint32_t> &names) {
+  std::vector<uint32_t> index(other.nodes.size(), NONE);
+  index[ROOT] = ROOT;
+
+  for (uint32_t i = 1; i < other.nodes.size(); i++) {
+    const Node &source = other.nodes[i];
+    index[i] = this->child(index[source.parent], names[source.name]);
+    add(this->nodes[index[i]], source.processes, source.min, source.max,
+        source.total);
+  }
+
+  this->process_count += other.process_count;
+}
+
+void ProcessSummary::merge_json(const nlohmann::json &json,
+                                NameTable &names) {
+  // Pairs of a "children" object and the node they belong to here.
+  std::vector<std::pair<const nlohmann::json *, uint32_t> > pending;
+  pending.push_back({ &json.at("data"), ROOT });
+
+  while (!pending.empty()) {
+    auto [children, parent] = pending.back();
+    pending.pop_back();
+
+    for (auto &[name, source] : children->items()) {
+      uint32_t index = this->child(parent, names.intern(name));
+      add(this->nodes[index], source.at("processes"), source.at("min"),
+          source.at("max"), source.at("total"));
+      pending.push_back({ &source.at("children"), index });
+    }
+  }
+
+  this->process_count += json.at("processes").get<unsigned long long>();
+}
+
+std::vector<uint32_t> ProcessSummary::sorted_children(const NameTable &names,
+                                                      uint32_t parent) const {
+  std::vector<uint32_t> result;
+
+  for (uint32_t i = this->nodes[parent].first_child; i != NONE;
+       i = this->nodes[i].next_sibling) {
+    result.push_back(i);
+  }
+
+  std::sort(result.begin(), result.end(), [&](uint32_t a, uint32_t b) {
+    return names.name(this->nodes[a].name) < names.name(this->nodes[b].name);
+  });
+
+  return result;
+}
+
+void ProcessSummary::write_json(std::ostream &stream,
+                                const NameTable &names) const {
+  // The walk is iterative as in CallTree::write_json().
+  typedef struct Level {
+    std::vector<uint32_t> children;
+    std::size_t next;
+  } Level;
+
+  std::vector<Level> levels;
+  levels.push_back({ this->sorted_children(names, ROOT), 0 });
+  stream << "{\"data\":{";
+
+  while (!levels.empty()) {
+    Level &level = levels.back();
+
+    if (level.next == level.children.size()) {
+      levels.pop_back();
+      stream << '}';
+
+      if (!levels.empty()) {
+        Level &parent = levels.back();
+        const Node &node = this->nodes[parent.children[parent.next - 1]];
+
+        // Processes not making the calls of the path count as 0.
+        unsigned long long min = node.processes < this->process_count ?
+          0 : node.min;
+        double mean = this->process_count == 0 ? 0 :
+          (double)node.total / this->process_count;
+        double imbalance = mean == 0 ? 0 : node.max / mean - 1;
+
+        stream << ",\"imbalance\":" << nlohmann::json(imbalance).dump()
+               << ",\"max\":" << node.max
+               << ",\"mean\":" << (unsigned long long)mean
+               << ",\"min\":" << min
+               << ",\"processes\":" << node.processes
+               << ",\"total\":" << node.total << '}';
+      }
+
+      continue;
+    }
+
+    uint32_t index = level.children[level.next++];
+
+    if (level.next > 1) {
+      stream << ',';
+    }
+
+    write_json_string(stream, names.name(this->nodes[index].name));
+    stream << ":{\"children\":{";
+    levels.push_back({ this->sorted_children(names, index), 0 });
+  }
+
+  stream << ",\"processes\":" << this->process_count << '}';
+}
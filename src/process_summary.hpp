@@ -0,0 +1,137 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_PROCESS_SUMMARY_HPP
+#define NVGPU_PROCESS_SUMMARY_HPP
+
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include <ostream>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <nlohmann/json.hpp>
+#include "call_tree.hpp"
+
+// Statistics of the call paths of a region across processes: for
+// every path in the call tree of any process, the minimum, maximum,
+// and total of its length over the processes making it, from which
+// the statistics over all processes are written. Summaries of
+// disjoint sets of processes can be merged in any order, so they are
+// reduced pairwise (see parallel_reduce()).
+class ProcessSummary {
+public:
+  static constexpr uint32_t NONE = CallTree::NONE;
+  static constexpr uint32_t ROOT = CallTree::ROOT;
+
+  typedef struct Node {
+    uint32_t name;
+    uint32_t parent;
+    uint32_t first_child;
+    uint32_t next_sibling;
+
+    // Number of processes making the calls of this path.
+    unsigned long long processes;
+    unsigned long long min;
+    unsigned long long max;
+    unsigned long long total;
+  } Node;
+
+  // Summary of no processes.
+  ProcessSummary();
+
+  // Summary of a single process with the call tree "tree".
+  explicit ProcessSummary(const CallTree &tree);
+
+  // Adds the processes of "other" to this summary, with names[i] being
+  // the name in this summary of name i of "other".
+  void merge(const ProcessSummary &other, const std::vector<uint32_t> &names);
+
+  // Number of processes summarised, including those not making any
+  // call.
+  unsigned long long processes() const {
+    return this->process_count;
+  }
+
+  const Node &node(uint32_t index) const {
+    return this->nodes[index];
+  }
+
+  std::size_t size() const {
+    return this->nodes.size();
+  }
+
+  // Writes the "summary" object of a region in regions.json:
+  // "processes" with the number of processes, and "data" with
+  // the call paths as nested objects mapping names to objects with
+  // "children", "imbalance", "max", "mean", "min", "processes", and
+  // "total". "processes" of a path is the number of processes making
+  // its calls, while the statistics are over all processes summarised,
+  // the others counting as 0: "min" is then 0 and "mean" is the total
+  // over all of them. The imbalance is max / mean - 1, i.e. how much
+  // longer the slowest process has spent in the path than an average
+  // one. The output is the same as of nlohmann::json::dump().
+  void write_json(std::ostream &stream, const NameTable &names) const;
+
+  // Adds the processes of a summary written by write_json() to this
+  // one, interning its names in "names". Throws
+  // nlohmann::json::exception if "json" is not such a summary.
+  void merge_json(const nlohmann::json &json, NameTable &names);
+
+private:
+  uint32_t child(uint32_t parent, uint32_t name);
+
+  // Adds the statistics of one node to another.
+  static void add(Node &target, unsigned long long processes,
+                  unsigned long long min, unsigned long long max,
+                  unsigned long long total);
+
+  std::vector<uint32_t> sorted_children(const NameTable &names,
+                                        uint32_t parent) const;
+
+  static uint64_t child_key(uint32_t parent, uint32_t name) {
+    return ((uint64_t)parent << 32) | name;
+  }
+
+  std::vector<Node> nodes;
+  std::unordered_map<uint64_t, uint32_t> children;
+  unsigned long long process_count;
+};
+
+// Merges all items into the first one by calling merge(a, b) for
+// pairs of items, in rounds in which the items merged in the previous
+// round are merged pairwise, so that n items take log2(n) rounds of up
+// to n / 2 independent merges. The merges of a round run on up to
+// "threads" threads. The other items are left in an unspecified state.
+template<typename T, typename Merge>
+void parallel_reduce(std::vector<T> &items, unsigned int threads,
+                     Merge merge) {
+  for (std::size_t step = 1; step < items.size(); step *= 2) {
+    // Item i absorbs item i + step for every i divisible by 2 * step.
+    std::size_t pairs = (items.size() + step - 1) / (2 * step);
+    std::atomic<std::size_t> next = 0;
+
+    auto work = [&]() {
+      for (std::size_t pair = next++; pair < pairs; pair = next++) {
+        std::size_t index = pair * 2 * step;
+        merge(items[index], items[index + step]);
+        items[index + step] = T();
+      }
+    };
+
+    std::vector<std::thread> workers;
+
+    for (std::size_t i = 1; i < std::min<std::size_t>(threads, pairs); i++) {
+      workers.emplace_back(work);
+    }
+
+    work();
+
+    for (auto &worker : workers) {
+      worker.join();
+    }
+  }
+}
+
+#endif
@@ -0,0 +1,143 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_REGION_INDEX_HPP
+#define NVGPU_REGION_INDEX_HPP
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+// Immutable index of the regions of a part, answering which regions
+// contain a given timestamp in O(log n + k) time.
+//
+// This is an implicit interval tree: intervals are sorted by their
+// start and the array itself is treated as a balanced binary search
+// tree, where an element at index i whose lowest k bits are set is
+// a node at level k. Every node additionally stores the maximum end
+// of its subtree, so subtrees that end before the timestamp are
+// skipped. The layout is the one of cgranges by Heng Li.
+class RegionIndex {
+public:
+  // A closed interval [start, end]. Use 0 and (unsigned long long)-1
+  // for undefined bounds.
+  typedef struct Interval {
+    unsigned long long start;
+    unsigned long long end;
+    std::string name;
+  } Interval;
+
+  RegionIndex(std::vector<Interval> intervals) {
+    this->intervals = std::move(intervals);
+    std::sort(this->intervals.begin(), this->intervals.end(),
+              [](const Interval &a, const Interval &b) {
+                return a.start < b.start;
+              });
+
+    this->max_end.resize(this->intervals.size());
+    this->max_level = this->build();
+  }
+
+  // Calls "callback" with the name of every interval
+  // containing "timestamp".
+  template<typename F>
+  void stab(unsigned long long timestamp, F callback) const {
+    long long n = this->intervals.size();
+
+    if (n == 0) {
+      return;
+    }
+
+    typedef struct StackItem {
+      int level;
+      long long index;
+      bool left_done;
+    } StackItem;
+
+    StackItem stack[64];
+    int size = 0;
+    stack[size++] = { this->max_level, (1LL << this->max_level) - 1, false };
+
+    while (size > 0) {
+      StackItem item = stack[--size];
+
+      if (item.level <= 3) {
+        // Small subtrees are scanned linearly.
+        long long first = item.index >> item.level << item.level;
+        long long last = std::min(first + (1LL << (item.level + 1)) - 1, n);
+
+        for (long long i = first;
+             i < last && this->intervals[i].start <= timestamp; i++) {
+          if (timestamp <= this->intervals[i].end) {
+            callback(this->intervals[i].name);
+          }
+        }
+      } else if (!item.left_done) {
+        long long left = item.index - (1LL << (item.level - 1));
+        stack[size++] = { item.level, item.index, true };
+
+        if (left >= n || this->max_end[left] >= timestamp) {
+          stack[size++] = { item.level - 1, left, false };
+        }
+      } else if (item.index < n &&
+                 this->intervals[item.index].start <= timestamp) {
+        if (timestamp <= this->intervals[item.index].end) {
+          callback(this->intervals[item.index].name);
+        }
+
+        stack[size++] = { item.level - 1,
+                          item.index + (1LL << (item.level - 1)), false };
+      }
+    }
+  }
+
+  std::size_t size() const {
+    return this->intervals.size();
+  }
+
+private:
+  // Computes this->max_end and returns the level of the root.
+  int build() {
+    long long n = this->intervals.size();
+
+    if (n == 0) {
+      return 0;
+    }
+
+    long long last_index = 0;
+    unsigned long long last = 0;
+
+    for (long long i = 0; i < n; i += 2) {
+      last_index = i;
+      last = this->max_end[i] = this->intervals[i].end;
+    }
+
+    int level;
+
+    for (level = 1; (1LL << level) <= n; level++) {
+      long long half = 1LL << (level - 1);
+      long long step = half << 2;
+
+      for (long long i = (half << 1) - 1; i < n; i += step) {
+        unsigned long long left = this->max_end[i - half];
+        unsigned long long right = i + half < n ? this->max_end[i + half] : last;
+        this->max_end[i] = std::max({ this->intervals[i].end, left, right });
+      }
+
+      last_index = (last_index >> level & 1) ? last_index - half :
+        last_index + half;
+
+      if (last_index < n && this->max_end[last_index] > last) {
+        last = this->max_end[last_index];
+      }
+    }
+
+    return level - 1;
+  }
+
+  std::vector<Interval> intervals;
+  std::vector<unsigned long long> max_end;
+  int max_level;
+};
+
+#endif
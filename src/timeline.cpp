@@ -0,0 +1,119 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include "timeline.hpp"
+#include <fstream>
+#include <vector>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+TimelineWriter::TimelineWriter() {
+  this->fd = -1;
+  this->written = 0;
+  this->window_offset = 0;
+  this->window = nullptr;
+  this->position = nullptr;
+  this->window_end = nullptr;
+}
+
+TimelineWriter::~TimelineWriter() {
+  this->close();
+}
+
+bool TimelineWriter::open(const std::filesystem::path &path) {
+  this->fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+  this->written = 0;
+
+  if (this->fd == -1) {
+    return this->fail("Could not open " + path.string());
+  }
+
+  return true;
+}
+
+bool TimelineWriter::map_next() {
+  if (this->fd == -1) {
+    return this->fail("The timeline file is not open");
+  }
+
+  // The window is full when a new one is needed. If the new one could
+  // not be mapped, the next call tries again at the same offset.
+  if (this->window) {
+    munmap(this->window, WINDOW_SIZE);
+    this->written = this->window_offset + WINDOW_SIZE;
+    this->window = nullptr;
+  }
+
+  std::size_t offset = this->written;
+
+  if (ftruncate(this->fd, offset + WINDOW_SIZE) != 0) {
+    return this->fail("Could not extend the timeline file");
+  }
+
+  void *window = mmap(nullptr, WINDOW_SIZE, PROT_READ | PROT_WRITE,
+                      MAP_SHARED, this->fd, offset);
+
+  if (window == MAP_FAILED) {
+    return this->fail("Could not map the timeline file");
+  }
+
+  this->window_offset = offset;
+  this->window = (Record *)window;
+  this->position = this->window;
+  this->window_end = this->window + WINDOW_SIZE / sizeof(Record);
+  return true;
+}
+
+bool TimelineWriter::close() {
+  if (this->fd == -1) {
+    return true;
+  }
+
+  bool success = true;
+  std::size_t size = this->written;
+
+  if (this->window) {
+    size = this->window_offset +
+      (this->position - this->window) * sizeof(Record);
+    munmap(this->window, WINDOW_SIZE);
+    this->window = nullptr;
+  }
+
+  if (ftruncate(this->fd, size) != 0) {
+    success = this->fail("Could not truncate the timeline file");
+  }
+
+  ::close(this->fd);
+  this->fd = -1;
+  return success;
+}
+
+bool TimelineWriter::fail(const std::string &message) {
+  this->error_message = message + ": " + std::strerror(errno);
+  return false;
+}
+
+bool TimelineWriter::read(const std::filesystem::path &path,
+                          std::function<void(const Record &)> callback) {
+  std::ifstream stream(path, std::ios::binary);
+
+  if (!stream) {
+    return false;
+  }
+
+  std::vector<Record> chunk(4096);
+
+  while (stream) {
+    stream.read((char *)chunk.data(), chunk.size() * sizeof(Record));
+    std::size_t count = stream.gcount() / sizeof(Record);
+
+    for (std::size_t i = 0; i < count; i++) {
+      callback(chunk[i]);
+    }
+  }
+
+  return stream.eof();
+}
@@ -0,0 +1,84 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_TIMELINE_HPP
+#define NVGPU_TIMELINE_HPP
+
+#include <string>
+#include <cstdint>
+#include <cstddef>
+#include <ostream>
+#include <functional>
+#include <filesystem>
+
+// Append-only file of finished calls, written through a memory-mapped
+// window which moves forward as the file grows. Only the current
+// window is mapped, so the memory used does not depend on the length
+// of the trace.
+class TimelineWriter {
+public:
+  typedef struct Record {
+    uint64_t start;
+    uint64_t end;
+
+    // Name IDs of the part (thread), the region, and the function
+    // with its kernel symbol if there is one.
+    uint32_t part;
+    uint32_t region;
+    uint32_t name;
+
+    // Depth of the call in the stack of the part, 0 being
+    // the outermost call.
+    uint32_t depth;
+  } Record;
+
+  TimelineWriter();
+  ~TimelineWriter();
+
+  // Creates the file, replacing any existing one. Returns false on
+  // error, with the reason in error().
+  bool open(const std::filesystem::path &path);
+
+  // Returns false on error, with the reason in error().
+  bool append(const Record &record) {
+    if (this->position == this->window_end && !this->map_next()) {
+      return false;
+    }
+
+    *this->position++ = record;
+    return true;
+  }
+
+  // Unmaps the window and truncates the file to the records written,
+  // which after a failed append() are those written before it.
+  bool close();
+
+  const std::string &error() const {
+    return this->error_message;
+  }
+
+  // Calls "callback" with every record of a file written by
+  // TimelineWriter, reading it in fixed-size chunks. Returns false if
+  // the file cannot be read.
+  static bool read(const std::filesystem::path &path,
+                   std::function<void(const Record &)> callback);
+
+private:
+  static constexpr std::size_t WINDOW_SIZE = 8 * 1024 * 1024;
+
+  bool map_next();
+  bool fail(const std::string &message);
+
+  int fd;
+
+  // Bytes of the file filled with records in the windows already
+  // unmapped.
+  std::size_t written;
+  std::size_t window_offset;
+  Record *window;
+  Record *position;
+  Record *window_end;
+  std::string error_message;
+};
+
+#endif
@@ -0,0 +1,158 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include "inject_host.hpp"
+
+namespace {
+  std::mutex lock;
+  std::vector<std::string> sent_strings;
+  std::string request_string;
+  std::string reply_string = "runtime";
+  std::string received;
+  std::string last_error;
+  inject_host::Sender sender;
+  inject_host::Receiver receiver;
+  inject_host::Clock timestamp_clock;
+  std::atomic<bool> failing{false};
+
+  int send(const char *message) {
+    if (failing.load(std::memory_order_relaxed)) {
+      return ADAPTYST_MODULE_ERR;
+    }
+
+    // Read without the lock, the transport is set before the injection
+    // part starts.
+    if (sender) {
+      return sender(message) ? ADAPTYST_MODULE_OK : ADAPTYST_MODULE_ERR;
+    }
+
+    std::unique_lock guard(lock);
+    sent_strings.emplace_back(message);
+    return ADAPTYST_MODULE_OK;
+  }
+}
+
+extern "C" {
+  void adaptyst_set_error(const char *error) {
+    std::unique_lock guard(lock);
+    last_error = error;
+  }
+
+  void adaptyst_set_error_nl(const char *error) {
+    adaptyst_set_error(error);
+  }
+
+  int adaptyst_send_string(amod_t module_id, const char *message) {
+    return send(message);
+  }
+
+  int adaptyst_send_string_nl(amod_t module_id, const char *message) {
+    {
+      std::unique_lock guard(lock);
+      request_string = message;
+    }
+
+    return sender ? send(message) : ADAPTYST_MODULE_OK;
+  }
+
+  int adaptyst_receive_string_nl(amod_t module_id, const char **message) {
+    if (receiver) {
+      if (!receiver(received)) {
+        return ADAPTYST_MODULE_ERR;
+      }
+    } else {
+      std::unique_lock guard(lock);
+      received = reply_string;
+    }
+
+    *message = received.c_str();
+    return ADAPTYST_MODULE_OK;
+  }
+
+  unsigned long long adaptyst_get_timestamp(int *error) {
+    if (error) {
+      *error = ADAPTYST_MODULE_OK;
+    }
+
+    return timestamp_clock ? timestamp_clock() :
+      inject_host::steady_timestamp();
+  }
+}
+
+namespace inject_host {
+  void set_reply(std::string reply) {
+    std::unique_lock guard(lock);
+    reply_string = std::move(reply);
+  }
+
+  void set_transport(Sender new_sender, Receiver new_receiver) {
+    std::unique_lock guard(lock);
+    sender = std::move(new_sender);
+    receiver = std::move(new_receiver);
+  }
+
+  void set_clock(Clock new_clock) {
+    std::unique_lock guard(lock);
+    timestamp_clock = std::move(new_clock);
+  }
+
+  void fail_sends(bool fail) {
+    failing.store(fail);
+  }
+
+  std::vector<std::string> sent() {
+    std::unique_lock guard(lock);
+    return sent_strings;
+  }
+
+  std::vector<std::string> sent_lines() {
+    std::vector<std::string> lines;
+
+    for (auto &message : sent()) {
+      std::string::size_type start = 0;
+
+      while (true) {
+        std::string::size_type end = message.find('\n', start);
+        lines.push_back(message.substr(start, end - start));
+
+        if (end == std::string::npos) {
+          break;
+        }
+
+        start = end + 1;
+      }
+    }
+
+    return lines;
+  }
+
+  std::string request() {
+    std::unique_lock guard(lock);
+    return request_string;
+  }
+
+  std::string error() {
+    std::unique_lock guard(lock);
+    return last_error;
+  }
+
+  unsigned long long steady_timestamp() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(
+      std::chrono::steady_clock::now().time_since_epoch()).count();
+  }
+
+  void reset() {
+    std::unique_lock guard(lock);
+    sent_strings.clear();
+    request_string.clear();
+    reply_string = "runtime";
+    last_error.clear();
+    sender = nullptr;
+    receiver = nullptr;
+    timestamp_clock = nullptr;
+    failing.store(false);
+  }
+}
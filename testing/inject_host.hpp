@@ -0,0 +1,59 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Fake Adaptyst for the injection part: implements the functions of
+// <adaptyst/hw_inject.h> used by it, recording what it sends and
+// answering its "cuda_api_type" request with a given reply, unless
+// a transport to a real module is set.
+
+#ifndef NVGPU_TESTING_INJECT_HOST_HPP
+#define NVGPU_TESTING_INJECT_HOST_HPP
+
+#include <adaptyst/hw_inject.h>
+#include <string>
+#include <string_view>
+#include <vector>
+#include <functional>
+
+namespace inject_host {
+  // Called with every string sent by the injection part, from
+  // the sending thread. Returns false if sending has failed.
+  typedef std::function<bool(std::string_view)> Sender;
+
+  // Called when the injection part waits for a string from the module.
+  // Returns false if receiving has failed.
+  typedef std::function<bool(std::string &)> Receiver;
+
+  // Source of adaptyst_get_timestamp().
+  typedef std::function<unsigned long long()> Clock;
+
+  // Sets the reply to the "cuda_api_type" request, used without
+  // a transport.
+  void set_reply(std::string reply);
+
+  // Sends and receives through functions instead of recording.
+  void set_transport(Sender sender, Receiver receiver);
+  void set_clock(Clock clock);
+
+  // Makes every send fail from now on.
+  void fail_sends(bool fail);
+
+  // Strings sent with adaptyst_send_string(), in the order they have
+  // been sent, and the same split into lines.
+  std::vector<std::string> sent();
+  std::vector<std::string> sent_lines();
+
+  // The request sent by adaptyst_init().
+  std::string request();
+
+  // The last error set by the injection part, or an empty string.
+  std::string error();
+
+  // Default adaptyst_get_timestamp(): the steady clock in nanoseconds.
+  unsigned long long steady_timestamp();
+
+  // Forgets everything, including the reply, transport, and clock.
+  void reset();
+}
+
+#endif
@@ -0,0 +1,302 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <map>
+#include <deque>
+#include <mutex>
+#include <condition_variable>
+#include <chrono>
+#include <sstream>
+#include "module_host.hpp"
+
+extern "C" {
+  bool adaptyst_module_init(amod_t module_id);
+  bool adaptyst_module_process(amod_t module_id, ir workflow);
+  void adaptyst_module_close(amod_t module_id);
+  bool adaptyst_region_start(amod_t module_id, const char *name,
+                             const char *part_id, const char *timestamp_str);
+  bool adaptyst_region_end(amod_t module_id, const char *name,
+                           const char *part_id, const char *timestamp_str);
+}
+
+namespace {
+  // Value of an option, pointed to by its "data" in the way
+  // the module reads it.
+  typedef struct Value {
+    std::string string;
+    const char *c_str;
+    bool boolean;
+    unsigned int number;
+    option opt;
+  } Value;
+
+  const amod_t MODULE_ID{};
+
+  std::mutex lock;
+  std::condition_variable queue_cond;
+  std::deque<std::string> queue;
+  bool finished = false;
+  std::size_t queue_limit = 0;
+
+  // The message being handled by the module, which must stay valid
+  // until the next one is received.
+  std::string current;
+
+  std::map<std::string, Value> options;
+  std::string module_dir = ".";
+  unsigned long long workflow_start = 0;
+  unsigned long long workflow_end = 0;
+  int error_code = ADAPTYST_OK;
+  std::vector<std::string> sent_strings;
+  std::vector<std::string> printed_strings;
+  std::string last_error;
+  std::function<void(const std::string &)> reply_sink;
+
+  Value &value(const std::string &name) {
+    Value &result = options[name];
+    result.opt = {};
+    return result;
+  }
+
+  void set_defaults() {
+    module_host::set_option("cuda_api_type", "runtime");
+    module_host::set_option("cuda_api_include", "");
+    module_host::set_option("cuda_api_exclude", "");
+    module_host::set_option("wire_protocol", "binary");
+    module_host::set_option("extra_output", "none");
+    module_host::set_option("timeline", "none");
+    module_host::set_option("queue_policy", "block");
+    module_host::set_option("per_thread", false);
+    module_host::set_option("per_process", false);
+    module_host::set_option("overhead_correction", false);
+    module_host::set_option("fast_clock", false);
+    module_host::set_option("nvtx", false);
+    module_host::set_option("aggregation_threads", 1U);
+    module_host::set_option("checkpoint_interval", 0U);
+    module_host::set_option("checkpoint_size", 0U);
+    module_host::set_option("tree_memory_limit", 0U);
+  }
+
+  const bool defaults_set = (set_defaults(), true);
+
+  // Handles a control line, returning false if "message" is not one.
+  bool control(const std::string &message) {
+    if (message.size() < 2 || message[0] != '!' ||
+        (message[1] != 'R' && message[1] != 'E')) {
+      return false;
+    }
+
+    std::istringstream stream(message.substr(2));
+    std::string name, part_id, timestamp;
+    stream >> name >> part_id >> timestamp;
+
+    if (message[1] == 'R') {
+      adaptyst_region_start(MODULE_ID, name.c_str(), part_id.c_str(),
+                            timestamp.c_str());
+    } else {
+      adaptyst_region_end(MODULE_ID, name.c_str(), part_id.c_str(),
+                          timestamp.c_str());
+    }
+
+    return true;
+  }
+}
+
+extern "C" {
+  void adaptyst_profile_notify(amod_t module_id) { }
+  void adaptyst_profile_wait(amod_t module_id) { }
+
+  bool adaptyst_receive_string_timeout(amod_t module_id, const char **msg,
+                                       long timeout) {
+    while (true) {
+      std::unique_lock guard(lock);
+      queue_cond.wait_for(guard, std::chrono::milliseconds(timeout), []() {
+        return !queue.empty() || finished;
+      });
+
+      if (queue.empty()) {
+        error_code = ADAPTYST_ERR_TIMEOUT;
+        *msg = nullptr;
+        return false;
+      }
+
+      current = std::move(queue.front());
+      queue.pop_front();
+      error_code = ADAPTYST_OK;
+      queue_cond.notify_all();
+      guard.unlock();
+
+      if (control(current)) {
+        continue;
+      }
+
+      *msg = current.c_str();
+      return true;
+    }
+  }
+
+  int adaptyst_get_internal_error_code(amod_t module_id) {
+    std::unique_lock guard(lock);
+    return error_code;
+  }
+
+  bool adaptyst_is_workflow_running(amod_t module_id) {
+    std::unique_lock guard(lock);
+    return !finished || !queue.empty();
+  }
+
+  void adaptyst_set_error(amod_t module_id, const char *error) {
+    std::unique_lock guard(lock);
+    last_error = error;
+  }
+
+  bool adaptyst_send_string(amod_t module_id, const char *message) {
+    if (reply_sink) {
+      reply_sink(message);
+      return true;
+    }
+
+    std::unique_lock guard(lock);
+    sent_strings.emplace_back(message);
+    return true;
+  }
+
+  void adaptyst_print(amod_t module_id, const char *message, bool warning,
+                      bool error, const char *type) {
+    std::unique_lock guard(lock);
+    printed_strings.emplace_back(message);
+  }
+
+  void adaptyst_log(amod_t module_id, const char *message, const char *type) { }
+
+  unsigned long long adaptyst_get_workflow_start_time(amod_t module_id) {
+    std::unique_lock guard(lock);
+    error_code = ADAPTYST_OK;
+    return workflow_start;
+  }
+
+  unsigned long long adaptyst_get_workflow_end_time(amod_t module_id) {
+    std::unique_lock guard(lock);
+    error_code = ADAPTYST_OK;
+    return workflow_end;
+  }
+
+  const char *adaptyst_get_module_dir(amod_t module_id) {
+    return module_dir.c_str();
+  }
+
+  option *adaptyst_get_option(amod_t module_id, const char *name) {
+    auto found = options.find(name);
+    return found == options.end() ? nullptr : &found->second.opt;
+  }
+
+  bool adaptyst_set_will_profile(amod_t module_id, bool will_profile) {
+    return true;
+  }
+}
+
+namespace module_host {
+  void set_option(const std::string &name, const std::string &option_value) {
+    Value &result = value(name);
+    result.string = option_value;
+    result.c_str = result.string.c_str();
+    result.opt.data = &result.c_str;
+  }
+
+  void set_option(const std::string &name, const char *option_value) {
+    set_option(name, std::string(option_value));
+  }
+
+  void set_option(const std::string &name, bool option_value) {
+    Value &result = value(name);
+    result.boolean = option_value;
+    result.opt.data = &result.boolean;
+  }
+
+  void set_option(const std::string &name, unsigned int option_value) {
+    Value &result = value(name);
+    result.number = option_value;
+    result.opt.data = &result.number;
+  }
+
+  void set_module_dir(const std::string &dir) {
+    module_dir = dir;
+  }
+
+  void set_workflow_times(unsigned long long start, unsigned long long end) {
+    std::unique_lock guard(lock);
+    workflow_start = start;
+    workflow_end = end;
+  }
+
+  void push(std::string message) {
+    {
+      std::unique_lock guard(lock);
+      queue_cond.wait(guard, []() {
+        return queue_limit == 0 || queue.size() < queue_limit;
+      });
+      queue.push_back(std::move(message));
+    }
+
+    queue_cond.notify_all();
+  }
+
+  void set_queue_limit(std::size_t limit) {
+    std::unique_lock guard(lock);
+    queue_limit = limit;
+  }
+
+  void set_reply_sink(std::function<void(const std::string &)> sink) {
+    reply_sink = std::move(sink);
+  }
+
+  void finish() {
+    {
+      std::unique_lock guard(lock);
+      finished = true;
+    }
+
+    queue_cond.notify_all();
+  }
+
+  bool run() {
+    bool success = adaptyst_module_init(MODULE_ID) &&
+      adaptyst_module_process(MODULE_ID, ir{});
+    adaptyst_module_close(MODULE_ID);
+    return success;
+  }
+
+  std::vector<std::string> sent() {
+    std::unique_lock guard(lock);
+    return sent_strings;
+  }
+
+  std::vector<std::string> printed() {
+    std::unique_lock guard(lock);
+    return printed_strings;
+  }
+
+  std::string error() {
+    std::unique_lock guard(lock);
+    return last_error;
+  }
+
+  void reset() {
+    {
+      std::unique_lock guard(lock);
+      queue.clear();
+      finished = false;
+      queue_limit = 0;
+      workflow_start = 0;
+      workflow_end = 0;
+      error_code = ADAPTYST_OK;
+      sent_strings.clear();
+      printed_strings.clear();
+      last_error.clear();
+    }
+
+    reply_sink = nullptr;
+    options.clear();
+    set_defaults();
+  }
+}
@@ -0,0 +1,60 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Fake Adaptyst for the module: implements the functions of
+// <adaptyst/hw.h> used by it and runs it on a queue of messages, as if
+// they came from the injection part of a workflow.
+//
+// Besides injection messages, the queue takes control lines which are
+// handled by the host itself at the point they are received:
+// "!R <region> <part ID> <timestamp>" starts a region and
+// "!E <region> <part ID> <timestamp>" ends it.
+
+#ifndef NVGPU_TESTING_MODULE_HOST_HPP
+#define NVGPU_TESTING_MODULE_HOST_HPP
+
+#include <adaptyst/hw.h>
+#include <string>
+#include <vector>
+#include <functional>
+
+namespace module_host {
+  void set_option(const std::string &name, const std::string &value);
+  void set_option(const std::string &name, const char *value);
+  void set_option(const std::string &name, bool value);
+  void set_option(const std::string &name, unsigned int value);
+
+  // Directory where the module writes its output.
+  void set_module_dir(const std::string &dir);
+  void set_workflow_times(unsigned long long start, unsigned long long end);
+
+  // Makes push() wait while the queue holds "limit" messages, like
+  // a full socket would, or not at all if "limit" is 0 (the default).
+  void set_queue_limit(std::size_t limit);
+
+  // Called with every string sent by the module, e.g. the reply to
+  // the "cuda_api_type" request, instead of recording it.
+  void set_reply_sink(std::function<void(const std::string &)> sink);
+
+  // Adds a message to the queue, which may be done while the module
+  // runs. finish() marks the end of the workflow, after which
+  // the module writes its output once the queue is empty.
+  void push(std::string message);
+  void finish();
+
+  // Initialises the module, runs it until the workflow finishes and
+  // the queue is empty, and closes it. Returns false if initialisation
+  // or processing has failed, with the reason in error().
+  bool run();
+
+  // Strings sent by the module and printed by it.
+  std::vector<std::string> sent();
+  std::vector<std::string> printed();
+  std::string error();
+
+  // Restores the default options and forgets everything else. The module
+  // directory is kept.
+  void reset();
+}
+
+#endif
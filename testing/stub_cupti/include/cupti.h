@@ -0,0 +1,86 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// The part of the CUPTI callback API used by the injection part, for
+// the tests and benchmarks. Callbacks are fired by hand with
+// the functions of stub_cupti.hpp instead of by CUDA.
+
+#ifndef STUB_CUPTI_H
+#define STUB_CUPTI_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+typedef enum {
+  CUPTI_SUCCESS = 0,
+  CUPTI_ERROR_INVALID_PARAMETER = 1,
+  CUPTI_ERROR_NOT_INITIALIZED = 15,
+  CUPTI_ERROR_MULTIPLE_SUBSCRIBERS_NOT_SUPPORTED = 39
+} CUptiResult;
+
+typedef enum {
+  CUPTI_CB_DOMAIN_INVALID = 0,
+  CUPTI_CB_DOMAIN_DRIVER_API = 1,
+  CUPTI_CB_DOMAIN_RUNTIME_API = 2,
+  CUPTI_CB_DOMAIN_RESOURCE = 3,
+  CUPTI_CB_DOMAIN_SYNCHRONIZE = 4,
+  CUPTI_CB_DOMAIN_NVTX = 5,
+  CUPTI_CB_DOMAIN_SIZE
+} CUpti_CallbackDomain;
+
+typedef enum {
+  CUPTI_API_ENTER = 0,
+  CUPTI_API_EXIT = 1
+} CUpti_ApiCallbackSite;
+
+typedef uint32_t CUpti_CallbackId;
+typedef struct CUpti_Subscriber_st *CUpti_SubscriberHandle;
+typedef void (*CUpti_CallbackFunc)(void *userdata,
+                                   CUpti_CallbackDomain domain,
+                                   CUpti_CallbackId cbid,
+                                   const void *cbdata);
+
+typedef struct {
+  CUpti_ApiCallbackSite callbackSite;
+  const char *functionName;
+  const void *functionParams;
+  void *functionReturnValue;
+  const char *symbolName;
+  void *context;
+  uint32_t contextUid;
+  uint64_t *correlationData;
+  uint32_t correlationId;
+} CUpti_CallbackData;
+
+typedef struct {
+  const char *functionName;
+  const void *functionParams;
+  const void *functionReturnValue;
+} CUpti_NvtxData;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+CUptiResult cuptiSubscribe(CUpti_SubscriberHandle *subscriber,
+                           CUpti_CallbackFunc callback, void *userdata);
+CUptiResult cuptiUnsubscribe(CUpti_SubscriberHandle subscriber);
+CUptiResult cuptiFinalize(void);
+CUptiResult cuptiEnableDomain(uint32_t enable,
+                              CUpti_SubscriberHandle subscriber,
+                              CUpti_CallbackDomain domain);
+CUptiResult cuptiEnableCallback(uint32_t enable,
+                                CUpti_SubscriberHandle subscriber,
+                                CUpti_CallbackDomain domain,
+                                CUpti_CallbackId cbid);
+CUptiResult cuptiGetCallbackName(CUpti_CallbackDomain domain,
+                                 uint32_t cbid, const char **name);
+
+#ifdef __cplusplus
+}
+#endif
+
+#include "cupti_runtime_cbid.h"
+#include "cupti_driver_cbid.h"
+
+#endif
@@ -0,0 +1,121 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Callback IDs of the CUDA driver API functions known to the module,
+// for the tests. They need not be the IDs used by CUPTI.
+
+#ifndef STUB_CUPTI_DRIVER_CBID_H
+#define STUB_CUPTI_DRIVER_CBID_H
+
+#define STUB_CUPTI_DRIVER_CALLBACKS(X) \
+  X(cuMemAlloc, 38) \
+  X(cuMemcpyHtoD, 40) \
+  X(cuMemcpyHtoD_v2, 276) \
+  X(cuMemcpyHtoDAsync_v2, 277) \
+  X(cuMemcpyDtoH_v2, 278) \
+  X(cuMemcpyDtoHAsync_v2, 279) \
+  X(cuMemcpyDtoD_v2, 280) \
+  X(cuMemcpyDtoDAsync_v2, 281) \
+  X(cuMemsetD8_v2, 290) \
+  X(cuMemsetD16_v2, 291) \
+  X(cuMemsetD32_v2, 292) \
+  X(cuLaunchKernel, 307) \
+  X(cuMemcpy, 308) \
+  X(cuMemcpyAsync, 309) \
+  X(cuMemcpyPeer, 310) \
+  X(cuMemcpyPeerAsync, 311) \
+  X(cuMemsetD8Async, 312) \
+  X(cuMemsetD16Async, 313) \
+  X(cuMemsetD32Async, 314) \
+  X(cuLaunchKernel_ptsz, 442) \
+  X(cuLaunchCooperativeKernel, 500) \
+  X(cuLaunchCooperativeKernel_ptsz, 501) \
+  X(cuLaunchCooperativeKernelMultiDevice, 502) \
+  X(cuCtxSynchronize, 600) \
+  X(cuEventCreate, 601) \
+  X(cuEventDestroy_v2, 602) \
+  X(cuEventQuery, 603) \
+  X(cuEventRecord, 604) \
+  X(cuEventSynchronize, 605) \
+  X(cuGraphLaunch, 606) \
+  X(cuMemAllocAsync, 607) \
+  X(cuMemAllocHost_v2, 608) \
+  X(cuMemAllocManaged, 609) \
+  X(cuMemAlloc_v2, 610) \
+  X(cuMemFreeAsync, 611) \
+  X(cuMemFreeHost, 612) \
+  X(cuMemFree_v2, 613) \
+  X(cuStreamCreate, 614) \
+  X(cuStreamDestroy_v2, 615) \
+  X(cuStreamQuery, 616) \
+  X(cuStreamSynchronize, 617) \
+  X(cuStreamWaitEvent, 618) \
+  X(cuLaunchKernelEx, 652) \
+  X(cuLaunchKernelEx_ptsz, 653) \
+  X(cuMemcpy2D_v2, 700) \
+  X(cuMemcpy2DUnaligned_v2, 701) \
+  X(cuMemcpy2DAsync_v2, 702) \
+  X(cuMemcpy3D_v2, 703) \
+  X(cuMemcpy3DAsync_v2, 704) \
+  X(cuMemcpy3DPeer, 705) \
+  X(cuMemcpy3DPeerAsync, 706) \
+  X(cuMemcpyHtoA_v2, 707) \
+  X(cuMemcpyAtoH_v2, 708) \
+  X(cuMemcpyHtoAAsync_v2, 709) \
+  X(cuMemcpyAtoHAsync_v2, 710) \
+  X(cuMemcpyDtoA_v2, 711) \
+  X(cuMemcpyAtoD_v2, 712) \
+  X(cuMemcpyAtoA_v2, 713) \
+  X(cuMemcpy_ptds, 714) \
+  X(cuMemcpyAsync_ptsz, 715) \
+  X(cuMemcpyHtoD_v2_ptds, 716) \
+  X(cuMemcpyDtoH_v2_ptds, 717) \
+  X(cuMemcpyDtoD_v2_ptds, 718) \
+  X(cuMemcpyHtoDAsync_v2_ptsz, 719) \
+  X(cuMemcpyDtoHAsync_v2_ptsz, 720) \
+  X(cuMemcpyDtoDAsync_v2_ptsz, 721) \
+  X(cuMemcpyPeer_ptds, 722) \
+  X(cuMemcpyPeerAsync_ptsz, 723) \
+  X(cuMemcpy2D_v2_ptds, 724) \
+  X(cuMemcpy2DUnaligned_v2_ptds, 725) \
+  X(cuMemcpy2DAsync_v2_ptsz, 726) \
+  X(cuMemcpy3D_v2_ptds, 727) \
+  X(cuMemcpy3DAsync_v2_ptsz, 728) \
+  X(cuMemcpy3DPeer_ptds, 729) \
+  X(cuMemcpy3DPeerAsync_ptsz, 730) \
+  X(cuMemcpyHtoA_v2_ptds, 731) \
+  X(cuMemcpyAtoH_v2_ptds, 732) \
+  X(cuMemcpyHtoAAsync_v2_ptsz, 733) \
+  X(cuMemcpyAtoHAsync_v2_ptsz, 734) \
+  X(cuMemcpyDtoA_v2_ptds, 735) \
+  X(cuMemcpyAtoD_v2_ptds, 736) \
+  X(cuMemcpyAtoA_v2_ptds, 737) \
+  X(cuMemsetD2D8_v2, 738) \
+  X(cuMemsetD2D16_v2, 739) \
+  X(cuMemsetD2D32_v2, 740) \
+  X(cuMemsetD2D8Async, 741) \
+  X(cuMemsetD2D16Async, 742) \
+  X(cuMemsetD2D32Async, 743) \
+  X(cuMemsetD8_v2_ptds, 744) \
+  X(cuMemsetD16_v2_ptds, 745) \
+  X(cuMemsetD32_v2_ptds, 746) \
+  X(cuMemsetD2D8_v2_ptds, 747) \
+  X(cuMemsetD2D16_v2_ptds, 748) \
+  X(cuMemsetD2D32_v2_ptds, 749) \
+  X(cuMemsetD8Async_ptsz, 750) \
+  X(cuMemsetD16Async_ptsz, 751) \
+  X(cuMemsetD32Async_ptsz, 752) \
+  X(cuMemsetD2D8Async_ptsz, 753) \
+  X(cuMemsetD2D16Async_ptsz, 754) \
+  X(cuMemsetD2D32Async_ptsz, 755)
+
+typedef enum {
+  CUPTI_DRIVER_TRACE_CBID_INVALID = 0,
+#define STUB_CUPTI_ENTRY(name, id) CUPTI_DRIVER_TRACE_CBID_##name = id,
+  STUB_CUPTI_DRIVER_CALLBACKS(STUB_CUPTI_ENTRY)
+#undef STUB_CUPTI_ENTRY
+  CUPTI_DRIVER_TRACE_CBID_SIZE = 800,
+  CUPTI_DRIVER_TRACE_CBID_FORCE_INT = 0x7fffffff
+} CUpti_driver_api_trace_cbid;
+
+#endif
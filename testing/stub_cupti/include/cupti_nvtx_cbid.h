@@ -0,0 +1,26 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Callback IDs of the NVTX functions traced by the module for the tests.
+
+#ifndef STUB_CUPTI_NVTX_CBID_H
+#define STUB_CUPTI_NVTX_CBID_H
+
+#define STUB_CUPTI_NVTX_CALLBACKS(X) \
+  X(nvtxRangePushA, 17) \
+  X(nvtxRangePushW, 18) \
+  X(nvtxRangePushEx, 19) \
+  X(nvtxRangePop, 20) \
+  X(nvtxDomainRangePushEx, 48) \
+  X(nvtxDomainRangePop, 49)
+
+typedef enum {
+  CUPTI_CBID_NVTX_INVALID = 0,
+#define STUB_CUPTI_ENTRY(name, id) CUPTI_CBID_NVTX_##name = id,
+  STUB_CUPTI_NVTX_CALLBACKS(STUB_CUPTI_ENTRY)
+#undef STUB_CUPTI_ENTRY
+  CUPTI_CBID_NVTX_SIZE = 64,
+  CUPTI_CBID_NVTX_FORCE_INT = 0x7fffffff
+} CUpti_nvtx_api_trace_cbid;
+
+#endif
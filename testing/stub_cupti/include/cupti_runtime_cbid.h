@@ -0,0 +1,116 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Callback IDs of the CUDA runtime API functions known to the module,
+// for the tests. They need not be the IDs used by CUPTI.
+
+#ifndef STUB_CUPTI_RUNTIME_CBID_H
+#define STUB_CUPTI_RUNTIME_CBID_H
+
+#define STUB_CUPTI_RUNTIME_CALLBACKS(X) \
+  X(cudaGetDevice_v3020, 17) \
+  X(cudaMalloc_v3020, 20) \
+  X(cudaFree_v3020, 27) \
+  X(cudaMemcpy_v3020, 31) \
+  X(cudaMemcpy2D_v3020, 32) \
+  X(cudaMemcpyToSymbol_v3020, 37) \
+  X(cudaMemcpyFromSymbol_v3020, 38) \
+  X(cudaMemcpyAsync_v3020, 41) \
+  X(cudaMemcpy2DAsync_v3020, 43) \
+  X(cudaMemcpyToSymbolAsync_v3020, 46) \
+  X(cudaMemcpyFromSymbolAsync_v3020, 47) \
+  X(cudaMemset_v3020, 48) \
+  X(cudaMemsetAsync_v3020, 51) \
+  X(cudaMemcpyPeer_v4000, 161) \
+  X(cudaMemcpyPeerAsync_v4000, 162) \
+  X(cudaDeviceSynchronize_v3020, 165) \
+  X(cudaLaunchKernel_v7000, 211) \
+  X(cudaLaunchKernel_ptsz_v7000, 214) \
+  X(cudaMemcpy_ptds_v7000, 217) \
+  X(cudaMemset_ptds_v7000, 228) \
+  X(cudaMemcpyAsync_ptsz_v7000, 237) \
+  X(cudaMemsetAsync_ptsz_v7000, 245) \
+  X(cudaLaunchCooperativeKernel_v9000, 269) \
+  X(cudaLaunchCooperativeKernel_ptsz_v9000, 270) \
+  X(cudaLaunchCooperativeKernelMultiDevice_v9000, 271) \
+  X(cudaEventCreateWithFlags_v3020, 300) \
+  X(cudaEventCreate_v3020, 301) \
+  X(cudaEventDestroy_v3020, 302) \
+  X(cudaEventElapsedTime_v3020, 303) \
+  X(cudaEventQuery_v3020, 304) \
+  X(cudaEventRecord_v3020, 305) \
+  X(cudaEventSynchronize_v3020, 306) \
+  X(cudaFreeAsync_v11020, 307) \
+  X(cudaFreeHost_v3020, 308) \
+  X(cudaGraphLaunch_ptsz_v10000, 309) \
+  X(cudaGraphLaunch_v10000, 310) \
+  X(cudaHostAlloc_v3020, 311) \
+  X(cudaMallocAsync_v11020, 312) \
+  X(cudaMallocHost_v3020, 313) \
+  X(cudaMallocManaged_v6000, 314) \
+  X(cudaMallocPitch_v3020, 315) \
+  X(cudaStreamCreateWithFlags_v5000, 316) \
+  X(cudaStreamCreateWithPriority_v5050, 317) \
+  X(cudaStreamCreate_v3020, 318) \
+  X(cudaStreamDestroy_v5050, 319) \
+  X(cudaStreamQuery_v3020, 320) \
+  X(cudaStreamSynchronize_ptsz_v7000, 321) \
+  X(cudaStreamSynchronize_v3020, 322) \
+  X(cudaStreamWaitEvent_ptsz_v7000, 323) \
+  X(cudaStreamWaitEvent_v3020, 324) \
+  X(cudaThreadSynchronize_v3020, 325) \
+  X(cudaMemcpy3D_v3020, 326) \
+  X(cudaMemcpy3DAsync_v3020, 327) \
+  X(cudaMemcpy3DPeer_v4000, 328) \
+  X(cudaMemcpy3DPeerAsync_v4000, 329) \
+  X(cudaMemcpyToArray_v3020, 330) \
+  X(cudaMemcpyFromArray_v3020, 331) \
+  X(cudaMemcpyArrayToArray_v3020, 332) \
+  X(cudaMemcpyToArrayAsync_v3020, 333) \
+  X(cudaMemcpyFromArrayAsync_v3020, 334) \
+  X(cudaMemcpy2DToArray_v3020, 335) \
+  X(cudaMemcpy2DFromArray_v3020, 336) \
+  X(cudaMemcpy2DArrayToArray_v3020, 337) \
+  X(cudaMemcpy2DToArrayAsync_v3020, 338) \
+  X(cudaMemcpy2DFromArrayAsync_v3020, 339) \
+  X(cudaMemcpy2D_ptds_v7000, 340) \
+  X(cudaMemcpy2DAsync_ptsz_v7000, 341) \
+  X(cudaMemcpy3D_ptds_v7000, 342) \
+  X(cudaMemcpy3DAsync_ptsz_v7000, 343) \
+  X(cudaMemcpy3DPeer_ptds_v7000, 344) \
+  X(cudaMemcpy3DPeerAsync_ptsz_v7000, 345) \
+  X(cudaMemcpyToSymbol_ptds_v7000, 346) \
+  X(cudaMemcpyFromSymbol_ptds_v7000, 347) \
+  X(cudaMemcpyToSymbolAsync_ptsz_v7000, 348) \
+  X(cudaMemcpyFromSymbolAsync_ptsz_v7000, 349) \
+  X(cudaMemcpyToArray_ptds_v7000, 350) \
+  X(cudaMemcpyFromArray_ptds_v7000, 351) \
+  X(cudaMemcpyArrayToArray_ptds_v7000, 352) \
+  X(cudaMemcpyToArrayAsync_ptsz_v7000, 353) \
+  X(cudaMemcpyFromArrayAsync_ptsz_v7000, 354) \
+  X(cudaMemcpy2DToArray_ptds_v7000, 355) \
+  X(cudaMemcpy2DFromArray_ptds_v7000, 356) \
+  X(cudaMemcpy2DArrayToArray_ptds_v7000, 357) \
+  X(cudaMemcpy2DToArrayAsync_ptsz_v7000, 358) \
+  X(cudaMemcpy2DFromArrayAsync_ptsz_v7000, 359) \
+  X(cudaMemset2D_v3020, 360) \
+  X(cudaMemset2DAsync_v3020, 361) \
+  X(cudaMemset3D_v3020, 362) \
+  X(cudaMemset3DAsync_v3020, 363) \
+  X(cudaMemset2D_ptds_v7000, 364) \
+  X(cudaMemset2DAsync_ptsz_v7000, 365) \
+  X(cudaMemset3D_ptds_v7000, 366) \
+  X(cudaMemset3DAsync_ptsz_v7000, 367) \
+  X(cudaLaunchKernelExC_v11060, 430) \
+  X(cudaLaunchKernelExC_ptsz_v11060, 431)
+
+typedef enum {
+  CUPTI_RUNTIME_TRACE_CBID_INVALID = 0,
+#define STUB_CUPTI_ENTRY(name, id) CUPTI_RUNTIME_TRACE_CBID_##name = id,
+  STUB_CUPTI_RUNTIME_CALLBACKS(STUB_CUPTI_ENTRY)
+#undef STUB_CUPTI_ENTRY
+  CUPTI_RUNTIME_TRACE_CBID_SIZE = 500,
+  CUPTI_RUNTIME_TRACE_CBID_FORCE_INT = 0x7fffffff
+} CUpti_runtime_api_trace_cbid;
+
+#endif
@@ -0,0 +1,100 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Parameters of the CUDA driver API functions whose arguments are read
+// by the injection part, for the tests. Only the fields it reads are
+// guaranteed to match CUDA.
+
+#ifndef STUB_GENERATED_CUDA_META_H
+#define STUB_GENERATED_CUDA_META_H
+
+#include <stddef.h>
+
+typedef unsigned long long CUdeviceptr;
+typedef struct CUfunc_st *CUfunction;
+typedef struct CUstream_st *CUstream;
+
+typedef struct CUlaunchAttribute_st {
+  int id;
+  char value[60];
+} CUlaunchAttribute;
+
+typedef struct CUlaunchConfig_st {
+  unsigned int gridDimX;
+  unsigned int gridDimY;
+  unsigned int gridDimZ;
+  unsigned int blockDimX;
+  unsigned int blockDimY;
+  unsigned int blockDimZ;
+  unsigned int sharedMemBytes;
+  CUstream hStream;
+  CUlaunchAttribute *attrs;
+  unsigned int numAttrs;
+} CUlaunchConfig;
+
+#define STUB_CU_MEMCPY_PARAMS(name)             \
+  typedef struct name##_params_st {             \
+    CUdeviceptr dst;                            \
+    const void *src;                            \
+    size_t ByteCount;                           \
+    CUstream hStream;                           \
+  } name##_params;
+
+STUB_CU_MEMCPY_PARAMS(cuMemcpyHtoD_v2)
+STUB_CU_MEMCPY_PARAMS(cuMemcpyHtoDAsync_v2)
+STUB_CU_MEMCPY_PARAMS(cuMemcpyDtoH_v2)
+STUB_CU_MEMCPY_PARAMS(cuMemcpyDtoHAsync_v2)
+STUB_CU_MEMCPY_PARAMS(cuMemcpyDtoD_v2)
+STUB_CU_MEMCPY_PARAMS(cuMemcpyDtoDAsync_v2)
+STUB_CU_MEMCPY_PARAMS(cuMemcpy)
+STUB_CU_MEMCPY_PARAMS(cuMemcpyAsync)
+STUB_CU_MEMCPY_PARAMS(cuMemcpyPeer)
+STUB_CU_MEMCPY_PARAMS(cuMemcpyPeerAsync)
+
+#define STUB_CU_MEMSET_PARAMS(name)             \
+  typedef struct name##_params_st {             \
+    CUdeviceptr dstDevice;                      \
+    unsigned int value;                         \
+    size_t N;                                   \
+    CUstream hStream;                           \
+  } name##_params;
+
+STUB_CU_MEMSET_PARAMS(cuMemsetD8_v2)
+STUB_CU_MEMSET_PARAMS(cuMemsetD8Async)
+STUB_CU_MEMSET_PARAMS(cuMemsetD16_v2)
+STUB_CU_MEMSET_PARAMS(cuMemsetD16Async)
+STUB_CU_MEMSET_PARAMS(cuMemsetD32_v2)
+STUB_CU_MEMSET_PARAMS(cuMemsetD32Async)
+
+#define STUB_CU_LAUNCH_PARAMS(name)             \
+  typedef struct name##_params_st {             \
+    CUfunction f;                               \
+    unsigned int gridDimX;                      \
+    unsigned int gridDimY;                      \
+    unsigned int gridDimZ;                      \
+    unsigned int blockDimX;                     \
+    unsigned int blockDimY;                     \
+    unsigned int blockDimZ;                     \
+    unsigned int sharedMemBytes;                \
+    CUstream hStream;                           \
+    void **kernelParams;                        \
+    void **extra;                               \
+  } name##_params;
+
+STUB_CU_LAUNCH_PARAMS(cuLaunchKernel)
+STUB_CU_LAUNCH_PARAMS(cuLaunchKernel_ptsz)
+STUB_CU_LAUNCH_PARAMS(cuLaunchCooperativeKernel)
+STUB_CU_LAUNCH_PARAMS(cuLaunchCooperativeKernel_ptsz)
+
+#define STUB_CU_LAUNCH_EX_PARAMS(name)          \
+  typedef struct name##_params_st {             \
+    const CUlaunchConfig *config;               \
+    CUfunction f;                               \
+    void **kernelParams;                        \
+    void **extra;                               \
+  } name##_params;
+
+STUB_CU_LAUNCH_EX_PARAMS(cuLaunchKernelEx)
+STUB_CU_LAUNCH_EX_PARAMS(cuLaunchKernelEx_ptsz)
+
+#endif
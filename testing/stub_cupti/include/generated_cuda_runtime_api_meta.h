@@ -0,0 +1,136 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Parameters of the CUDA runtime API functions whose arguments are read
+// by the injection part, for the tests. Only the fields it reads are
+// guaranteed to match CUDA.
+
+#ifndef STUB_GENERATED_CUDA_RUNTIME_API_META_H
+#define STUB_GENERATED_CUDA_RUNTIME_API_META_H
+
+#include <stddef.h>
+
+enum cudaMemcpyKind {
+  cudaMemcpyHostToHost = 0,
+  cudaMemcpyHostToDevice = 1,
+  cudaMemcpyDeviceToHost = 2,
+  cudaMemcpyDeviceToDevice = 3,
+  cudaMemcpyDefault = 4
+};
+
+typedef struct CUstream_st *cudaStream_t;
+
+struct dim3 {
+  unsigned int x, y, z;
+};
+
+typedef struct cudaLaunchAttribute_st {
+  int id;
+  char value[60];
+} cudaLaunchAttribute;
+
+typedef struct cudaLaunchConfig_st {
+  dim3 gridDim;
+  dim3 blockDim;
+  size_t dynamicSmemBytes;
+  cudaStream_t stream;
+  cudaLaunchAttribute *attrs;
+  unsigned int numAttrs;
+} cudaLaunchConfig_t;
+
+#define STUB_MEMCPY_PARAMS(name)                \
+  typedef struct name##_params_st {             \
+    void *dst;                                  \
+    const void *src;                            \
+    size_t count;                               \
+    enum cudaMemcpyKind kind;                   \
+    cudaStream_t stream;                        \
+  } name##_params;
+
+STUB_MEMCPY_PARAMS(cudaMemcpy_v3020)
+STUB_MEMCPY_PARAMS(cudaMemcpyAsync_v3020)
+STUB_MEMCPY_PARAMS(cudaMemcpy_ptds_v7000)
+STUB_MEMCPY_PARAMS(cudaMemcpyAsync_ptsz_v7000)
+
+#define STUB_MEMCPY_2D_PARAMS(name)             \
+  typedef struct name##_params_st {             \
+    void *dst;                                  \
+    size_t dpitch;                              \
+    const void *src;                            \
+    size_t spitch;                              \
+    size_t width;                               \
+    size_t height;                              \
+    enum cudaMemcpyKind kind;                   \
+    cudaStream_t stream;                        \
+  } name##_params;
+
+STUB_MEMCPY_2D_PARAMS(cudaMemcpy2D_v3020)
+STUB_MEMCPY_2D_PARAMS(cudaMemcpy2DAsync_v3020)
+
+#define STUB_MEMCPY_SYMBOL_PARAMS(name)         \
+  typedef struct name##_params_st {             \
+    const void *symbol;                         \
+    const void *src;                            \
+    size_t count;                               \
+    size_t offset;                              \
+    enum cudaMemcpyKind kind;                   \
+    cudaStream_t stream;                        \
+  } name##_params;
+
+STUB_MEMCPY_SYMBOL_PARAMS(cudaMemcpyToSymbol_v3020)
+STUB_MEMCPY_SYMBOL_PARAMS(cudaMemcpyFromSymbol_v3020)
+STUB_MEMCPY_SYMBOL_PARAMS(cudaMemcpyToSymbolAsync_v3020)
+STUB_MEMCPY_SYMBOL_PARAMS(cudaMemcpyFromSymbolAsync_v3020)
+
+#define STUB_MEMCPY_PEER_PARAMS(name)           \
+  typedef struct name##_params_st {             \
+    void *dst;                                  \
+    int dstDevice;                              \
+    const void *src;                            \
+    int srcDevice;                              \
+    size_t count;                               \
+    cudaStream_t stream;                        \
+  } name##_params;
+
+STUB_MEMCPY_PEER_PARAMS(cudaMemcpyPeer_v4000)
+STUB_MEMCPY_PEER_PARAMS(cudaMemcpyPeerAsync_v4000)
+
+#define STUB_MEMSET_PARAMS(name)                \
+  typedef struct name##_params_st {             \
+    void *devPtr;                               \
+    int value;                                  \
+    size_t count;                               \
+    cudaStream_t stream;                        \
+  } name##_params;
+
+STUB_MEMSET_PARAMS(cudaMemset_v3020)
+STUB_MEMSET_PARAMS(cudaMemsetAsync_v3020)
+STUB_MEMSET_PARAMS(cudaMemset_ptds_v7000)
+STUB_MEMSET_PARAMS(cudaMemsetAsync_ptsz_v7000)
+
+#define STUB_LAUNCH_PARAMS(name)                \
+  typedef struct name##_params_st {             \
+    const void *func;                           \
+    dim3 gridDim;                               \
+    dim3 blockDim;                              \
+    void **args;                                \
+    size_t sharedMem;                           \
+    cudaStream_t stream;                        \
+  } name##_params;
+
+STUB_LAUNCH_PARAMS(cudaLaunchKernel_v7000)
+STUB_LAUNCH_PARAMS(cudaLaunchKernel_ptsz_v7000)
+STUB_LAUNCH_PARAMS(cudaLaunchCooperativeKernel_v9000)
+STUB_LAUNCH_PARAMS(cudaLaunchCooperativeKernel_ptsz_v9000)
+
+#define STUB_LAUNCH_EX_PARAMS(name)             \
+  typedef struct name##_params_st {             \
+    const cudaLaunchConfig_t *config;           \
+    const void *func;                           \
+    void **args;                                \
+  } name##_params;
+
+STUB_LAUNCH_EX_PARAMS(cudaLaunchKernelExC_v11060)
+STUB_LAUNCH_EX_PARAMS(cudaLaunchKernelExC_ptsz_v11060)
+
+#endif
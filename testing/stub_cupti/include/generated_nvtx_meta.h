@@ -0,0 +1,60 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Parameters of the NVTX functions traced by the injection part, for
+// the tests. Only the fields it reads are guaranteed to match NVTX.
+
+#ifndef STUB_GENERATED_NVTX_META_H
+#define STUB_GENERATED_NVTX_META_H
+
+#include <stdint.h>
+#include <wchar.h>
+
+typedef enum {
+  NVTX_MESSAGE_UNKNOWN = 0,
+  NVTX_MESSAGE_TYPE_ASCII = 1,
+  NVTX_MESSAGE_TYPE_UNICODE = 2,
+  NVTX_MESSAGE_TYPE_REGISTERED = 3
+} nvtxMessageType_t;
+
+typedef union {
+  const char *ascii;
+  const wchar_t *unicode;
+  void *registered;
+} nvtxMessageValue_t;
+
+typedef struct {
+  uint16_t version;
+  uint16_t size;
+  uint32_t category;
+  int32_t colorType;
+  uint32_t color;
+  int32_t payloadType;
+  int32_t reserved0;
+  union {
+    uint64_t ullValue;
+  } payload;
+  int32_t messageType;
+  nvtxMessageValue_t message;
+} nvtxEventAttributes_t;
+
+typedef struct nvtxDomainRegistration_st *nvtxDomainHandle_t;
+
+typedef struct nvtxRangePushA_params_st {
+  const char *message;
+} nvtxRangePushA_params;
+
+typedef struct nvtxRangePushEx_params_st {
+  const nvtxEventAttributes_t *eventAttrib;
+} nvtxRangePushEx_params;
+
+typedef struct nvtxDomainRangePushEx_params_st {
+  nvtxDomainHandle_t domain;
+  const nvtxEventAttributes_t *core;
+} nvtxDomainRangePushEx_params;
+
+typedef struct nvtxDomainRangePop_params_st {
+  nvtxDomainHandle_t domain;
+} nvtxDomainRangePop_params;
+
+#endif
@@ -0,0 +1,250 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <cupti.h>
+#include <cupti_nvtx_cbid.h>
+#include <string>
+#include <atomic>
+#include <mutex>
+#include <array>
+#include "stub_cupti.hpp"
+
+namespace {
+  // Larger than the number of callback IDs of every domain.
+  constexpr std::size_t MAX_CBID = 1024;
+
+  typedef struct Names {
+    std::array<std::array<std::string, MAX_CBID>, CUPTI_CB_DOMAIN_SIZE>
+    callbacks;
+    std::array<std::array<std::string, MAX_CBID>, CUPTI_CB_DOMAIN_SIZE>
+    functions;
+  } Names;
+
+  const Names &names() {
+    static const Names names = []() {
+      Names result;
+
+      auto add = [&](CUpti_CallbackDomain domain, CUpti_CallbackId cbid,
+                     std::string name) {
+        std::string function = name;
+        std::string::size_type pos = function.rfind("_v");
+
+        if (pos != std::string::npos && pos + 2 < function.size() &&
+            function.find_first_not_of("0123456789", pos + 2) ==
+            std::string::npos) {
+          function.resize(pos);
+        }
+
+        result.callbacks[domain][cbid] = name;
+        result.functions[domain][cbid] = function;
+      };
+
+#define STUB_CUPTI_RUNTIME_NAME(name, id)                               \
+      add(CUPTI_CB_DOMAIN_RUNTIME_API, id, #name);
+#define STUB_CUPTI_DRIVER_NAME(name, id)                                \
+      add(CUPTI_CB_DOMAIN_DRIVER_API, id, #name);
+#define STUB_CUPTI_NVTX_NAME(name, id)          \
+      add(CUPTI_CB_DOMAIN_NVTX, id, #name);
+
+      STUB_CUPTI_RUNTIME_CALLBACKS(STUB_CUPTI_RUNTIME_NAME)
+      STUB_CUPTI_DRIVER_CALLBACKS(STUB_CUPTI_DRIVER_NAME)
+      STUB_CUPTI_NVTX_CALLBACKS(STUB_CUPTI_NVTX_NAME)
+
+#undef STUB_CUPTI_RUNTIME_NAME
+#undef STUB_CUPTI_DRIVER_NAME
+#undef STUB_CUPTI_NVTX_NAME
+
+      return result;
+    }();
+
+    return names;
+  }
+
+  // Read by every fired call, so kept lock-free.
+  std::atomic<CUpti_CallbackFunc> subscriber_callback{nullptr};
+  std::atomic<void *> subscriber_userdata{nullptr};
+  std::atomic<bool> enabled_callbacks[CUPTI_CB_DOMAIN_SIZE][MAX_CBID];
+
+  std::mutex calls_lock;
+  std::vector<stub_cupti::EnableCall> calls;
+
+  // Any non-null handle will do, there is one subscriber at most.
+  CUpti_SubscriberHandle const HANDLE =
+    (CUpti_SubscriberHandle)&subscriber_callback;
+
+  bool valid(CUpti_CallbackDomain domain, CUpti_CallbackId cbid) {
+    return domain > CUPTI_CB_DOMAIN_INVALID && domain < CUPTI_CB_DOMAIN_SIZE &&
+      cbid < MAX_CBID;
+  }
+
+  void record(bool whole_domain, uint32_t enable, CUpti_CallbackDomain domain,
+              CUpti_CallbackId cbid) {
+    std::unique_lock lock(calls_lock);
+    calls.push_back({ whole_domain, enable != 0, domain, cbid });
+  }
+
+  bool fire(CUpti_CallbackDomain domain, CUpti_CallbackId cbid,
+            const void *cbdata) {
+    CUpti_CallbackFunc callback =
+      subscriber_callback.load(std::memory_order_acquire);
+
+    if (!callback || !valid(domain, cbid) ||
+        !enabled_callbacks[domain][cbid].load(std::memory_order_relaxed)) {
+      return false;
+    }
+
+    callback(subscriber_userdata.load(std::memory_order_relaxed), domain, cbid,
+             cbdata);
+    return true;
+  }
+}
+
+extern "C" {
+  CUptiResult cuptiSubscribe(CUpti_SubscriberHandle *subscriber,
+                             CUpti_CallbackFunc callback, void *userdata) {
+    if (!subscriber || !callback) {
+      return CUPTI_ERROR_INVALID_PARAMETER;
+    } else if (subscriber_callback.load()) {
+      return CUPTI_ERROR_MULTIPLE_SUBSCRIBERS_NOT_SUPPORTED;
+    }
+
+    subscriber_userdata.store(userdata);
+    subscriber_callback.store(callback, std::memory_order_release);
+    *subscriber = HANDLE;
+    return CUPTI_SUCCESS;
+  }
+
+  CUptiResult cuptiUnsubscribe(CUpti_SubscriberHandle subscriber) {
+    if (subscriber != HANDLE || !subscriber_callback.load()) {
+      return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    subscriber_callback.store(nullptr, std::memory_order_release);
+    subscriber_userdata.store(nullptr);
+
+    for (auto &domain : enabled_callbacks) {
+      for (auto &callback : domain) {
+        callback.store(false, std::memory_order_relaxed);
+      }
+    }
+
+    return CUPTI_SUCCESS;
+  }
+
+  CUptiResult cuptiFinalize(void) {
+    return CUPTI_SUCCESS;
+  }
+
+  CUptiResult cuptiEnableDomain(uint32_t enable,
+                                CUpti_SubscriberHandle subscriber,
+                                CUpti_CallbackDomain domain) {
+    if (subscriber != HANDLE || !valid(domain, 0)) {
+      return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    record(true, enable, domain, 0);
+
+    for (auto &callback : enabled_callbacks[domain]) {
+      callback.store(enable != 0, std::memory_order_relaxed);
+    }
+
+    return CUPTI_SUCCESS;
+  }
+
+  CUptiResult cuptiEnableCallback(uint32_t enable,
+                                  CUpti_SubscriberHandle subscriber,
+                                  CUpti_CallbackDomain domain,
+                                  CUpti_CallbackId cbid) {
+    if (subscriber != HANDLE || !valid(domain, cbid) ||
+        names().callbacks[domain][cbid].empty()) {
+      return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    record(false, enable, domain, cbid);
+    enabled_callbacks[domain][cbid].store(enable != 0,
+                                          std::memory_order_relaxed);
+    return CUPTI_SUCCESS;
+  }
+
+  CUptiResult cuptiGetCallbackName(CUpti_CallbackDomain domain,
+                                   uint32_t cbid, const char **name) {
+    const char *result = stub_cupti::callback_name(domain, cbid);
+
+    if (!name || !result) {
+      return CUPTI_ERROR_INVALID_PARAMETER;
+    }
+
+    *name = result;
+    return CUPTI_SUCCESS;
+  }
+}
+
+namespace stub_cupti {
+  bool subscribed() {
+    return subscriber_callback.load() != nullptr;
+  }
+
+  bool enabled(CUpti_CallbackDomain domain, CUpti_CallbackId cbid) {
+    return valid(domain, cbid) && enabled_callbacks[domain][cbid].load();
+  }
+
+  std::vector<EnableCall> enable_calls() {
+    std::unique_lock lock(calls_lock);
+    return calls;
+  }
+
+  void clear_enable_calls() {
+    std::unique_lock lock(calls_lock);
+    calls.clear();
+  }
+
+  const char *callback_name(CUpti_CallbackDomain domain,
+                            CUpti_CallbackId cbid) {
+    if (!valid(domain, cbid) || names().callbacks[domain][cbid].empty()) {
+      return nullptr;
+    }
+
+    return names().callbacks[domain][cbid].c_str();
+  }
+
+  const char *function_name(CUpti_CallbackDomain domain,
+                            CUpti_CallbackId cbid) {
+    if (!valid(domain, cbid) || names().functions[domain][cbid].empty()) {
+      return nullptr;
+    }
+
+    return names().functions[domain][cbid].c_str();
+  }
+
+  bool api_call(CUpti_CallbackDomain domain, CUpti_CallbackId cbid,
+                CUpti_ApiCallbackSite site, const void *params,
+                const char *symbol) {
+    CUpti_CallbackData data = {};
+    data.callbackSite = site;
+    data.functionName = function_name(domain, cbid);
+    data.functionParams = params;
+    data.symbolName = symbol;
+    return fire(domain, cbid, &data);
+  }
+
+  bool nvtx_call(CUpti_CallbackId cbid, const void *params) {
+    CUpti_NvtxData data = {};
+    data.functionName = function_name(CUPTI_CB_DOMAIN_NVTX, cbid);
+    data.functionParams = params;
+    return fire(CUPTI_CB_DOMAIN_NVTX, cbid, &data);
+  }
+
+  void reset() {
+    subscriber_callback.store(nullptr);
+    subscriber_userdata.store(nullptr);
+
+    for (auto &domain : enabled_callbacks) {
+      for (auto &callback : domain) {
+        callback.store(false);
+      }
+    }
+
+    std::unique_lock lock(calls_lock);
+    calls.clear();
+  }
+}
@@ -0,0 +1,56 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Control of the stub CUPTI library: the callbacks enabled by
+// the injection part can be inspected, and API calls are simulated by
+// firing the subscribed callback in the same way as CUPTI would.
+
+#ifndef STUB_CUPTI_HPP
+#define STUB_CUPTI_HPP
+
+#include <cupti.h>
+#include <vector>
+
+namespace stub_cupti {
+  // A call of cuptiEnableDomain() (with "cbid" being 0) or
+  // cuptiEnableCallback().
+  typedef struct EnableCall {
+    bool whole_domain;
+    bool enable;
+    CUpti_CallbackDomain domain;
+    CUpti_CallbackId cbid;
+  } EnableCall;
+
+  bool subscribed();
+  bool enabled(CUpti_CallbackDomain domain, CUpti_CallbackId cbid);
+
+  // Returns the enable calls made since the last reset() or
+  // clear_enable_calls().
+  std::vector<EnableCall> enable_calls();
+  void clear_enable_calls();
+
+  // Name of a callback as returned by cuptiGetCallbackName(), e.g.
+  // "cudaMemcpy_v3020", or nullptr if it is unknown.
+  const char *callback_name(CUpti_CallbackDomain domain,
+                            CUpti_CallbackId cbid);
+
+  // Name of the function of a callback as given to the callback, i.e.
+  // without the version suffix, e.g. "cudaMemcpy".
+  const char *function_name(CUpti_CallbackDomain domain,
+                            CUpti_CallbackId cbid);
+
+  // Fires the enter or exit callback of a runtime or driver API call
+  // in the calling thread if the callback is enabled. Returns whether
+  // the callback has been called.
+  bool api_call(CUpti_CallbackDomain domain, CUpti_CallbackId cbid,
+                CUpti_ApiCallbackSite site, const void *params = nullptr,
+                const char *symbol = nullptr);
+
+  // The same for an NVTX call, which has only one callback.
+  bool nvtx_call(CUpti_CallbackId cbid, const void *params);
+
+  // Forgets the subscriber, the enabled callbacks, and the calls.
+  void reset();
+}
+
+#endif
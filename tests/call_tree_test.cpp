@@ -0,0 +1,493 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of CallTree on synthetic trees: the regions.json output
+// streamed by write_json() against nlohmann::json::dump(),
+// the percentiles of call lengths, and what pruning keeps.
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <sstream>
+#include <tuple>
+#include <nlohmann/json.hpp>
+#include "call_tree.hpp"
+#include "check.hpp"
+
+// Names needing escapes, non-ASCII characters, and names sorting
+// differently as bytes and as characters.
+static const char *NAMES[] = {
+  "cudaLaunchKernel kernel<float>(float*, int)", "cudaMemcpy",
+  "cuMemcpyHtoD_v2", "B", "a", "quote\" and back\\slash",
+  "tab\tnew\nline", "\x01\x1f control", "\xc3\xbcnic\xc3\xb6" "de",
+  "path/with~tilde", ""
+};
+
+static const char *CONFIGS[] = {
+  "4,1,1 128,1,1 0 0", "32,2,1 256,1,1 1024 7f3a2c001e0", "1,1,1 1,1,1 0 2a"
+};
+
+static void test_names() {
+  NameTable names;
+  uint32_t a = names.intern("cudaMemcpy");
+  uint32_t b = names.intern(std::string("cudaLaunchKernel"));
+  uint32_t id;
+
+  CHECK(a != b);
+  CHECK_EQUAL(names.intern(std::string_view("cudaMemcpy")), a);
+  CHECK_EQUAL(names.name(b), "cudaLaunchKernel");
+  CHECK_EQUAL(names.size(), 2);
+  CHECK(names.find("cudaMemcpy", id) && id == a);
+  CHECK(!names.find("cudaFree", id));
+}
+
+static std::string write_json(const CallTree &tree, const NameTable &names) {
+  std::ostringstream stream;
+  tree.write_json(stream, names);
+  return stream.str();
+}
+
+// Adds random calls to a tree and to a nlohmann::json object in
+// the regions.json format, with the object addressed by paths, and
+// marks some nodes incomplete. Keys
+// are in the order of nlohmann::json objects, i.e. sorted by bytes.
+static void test_write_json() {
+  for (unsigned int seed = 1; seed <= 20; seed++) {
+    std::mt19937_64 random(seed);
+    NameTable names;
+    CallTree tree;
+    nlohmann::json expected = nlohmann::json::object();
+
+    // Pointer to the object of every node and of its children, and
+    // the lengths of the calls of every node.
+    std::vector<nlohmann::json::json_pointer> nodes = {
+      nlohmann::json::json_pointer()
+    };
+    std::vector<nlohmann::json::json_pointer> children = {
+      nlohmann::json::json_pointer()
+    };
+    std::vector<std::vector<unsigned long long>> calls(1);
+
+    while (tree.size() < 300) {
+      uint32_t parent = random() % tree.size();
+      const char *name = NAMES[random() % (sizeof(NAMES) / sizeof(NAMES[0]))];
+      std::size_t size = tree.size();
+      uint32_t index = tree.child(parent, names.intern(name));
+      nlohmann::json::json_pointer node = children[parent] / name;
+
+      if (index == size) {
+        CHECK(!expected.contains(node));
+        nodes.push_back(node);
+        children.push_back(node / "children");
+        calls.emplace_back();
+        expected[node]["length"] = 0;
+        expected[node]["children"] = nlohmann::json::object();
+      }
+
+      CHECK_EQUAL(tree.child(parent, names.intern(name)), index);
+      CHECK_EQUAL(tree.node(index).parent, parent);
+
+      // E.g. calls on the stack of a thread which has lost events.
+      if (random() % 8 == 0) {
+        tree.mark_incomplete(index);
+        expected[node]["incomplete"] = true;
+      }
+
+      // Some nodes have no finished calls, e.g. of calls cut off at
+      // the end of a region.
+      for (unsigned long long i = random() % 4; i > 0; i--) {
+        unsigned long long length = 1 + random() % (1ULL << (random() % 40));
+        tree.add_call(index, length);
+        tree.node(index).length += length;
+        calls[index].push_back(length);
+        expected[node]["length"] =
+          expected[node]["length"].get<unsigned long long>() + length;
+      }
+    }
+
+    std::vector<unsigned long long> times(tree.size(), 0);
+    std::vector<unsigned long long> children_times(tree.size(), 0);
+
+    for (uint32_t i = 1; i < tree.size(); i++) {
+      for (unsigned long long length : calls[i]) {
+        times[i] += length;
+      }
+
+      children_times[tree.node(i).parent] += times[i];
+    }
+
+    for (uint32_t i = 1; i < tree.size(); i++) {
+      unsigned long long min = 0, max = 0;
+
+      if (!calls[i].empty()) {
+        min = *std::min_element(calls[i].begin(), calls[i].end());
+        max = *std::max_element(calls[i].begin(), calls[i].end());
+      }
+
+      expected[nodes[i]]["stats"] = {
+        { "count", calls[i].size() }, { "max", max }, { "min", min },
+        { "p50", tree.percentile(i, 50) }, { "p99", tree.percentile(i, 99) },
+        { "self", times[i] > children_times[i] ?
+          times[i] - children_times[i] : 0 },
+        { "time", times[i] }
+      };
+    }
+
+    if (!CHECK_EQUAL(write_json(tree, names), expected.dump())) {
+      return;
+    }
+  }
+
+  CHECK_EQUAL(write_json(CallTree(), NameTable()), "{}");
+}
+
+// The walk is iterative, so a call path much deeper than any real one
+// is written as well.
+static void test_write_json_deep() {
+  NameTable names;
+  CallTree tree;
+  nlohmann::json expected = nlohmann::json::object();
+  nlohmann::json *children = &expected;
+  uint32_t index = CallTree::ROOT;
+
+  for (int i = 0; i < 2000; i++) {
+    const char *name = i % 2 == 0 ? "cudaLaunchKernel" : "cuLaunchKernel";
+    unsigned long long length = 2000 - i;
+    index = tree.child(index, names.intern(name));
+    tree.add_call(index, length);
+    tree.node(index).length = length;
+
+    nlohmann::json &node = (*children)[name];
+    node["length"] = length;
+    node["stats"] = {
+      { "count", 1 }, { "max", length }, { "min", length },
+      { "p50", length }, { "p99", length },
+      { "self", i == 1999 ? length : 1 }, { "time", length }
+    };
+    node["children"] = nlohmann::json::object();
+    children = &node["children"];
+  }
+
+  CHECK_EQUAL(write_json(tree, names), expected.dump());
+}
+
+// Launches are counted per configuration, also after merging trees
+// with other name IDs and reading a written tree back.
+static void test_launches() {
+  NameTable names;
+  CallTree tree;
+  uint32_t launch = tree.child(CallTree::ROOT,
+                               names.intern("cudaLaunchKernel k()"));
+  tree.add_call(launch, 10);
+  tree.add_launch(launch, names.intern(CONFIGS[0]), 10);
+  tree.add_call(launch, 30);
+  tree.add_launch(launch, names.intern(CONFIGS[1]), 30);
+  tree.node(launch).length = 40;
+
+  NameTable other_names;
+  CallTree other;
+  uint32_t config = other_names.intern(CONFIGS[0]);
+  uint32_t other_launch = other.child(
+    CallTree::ROOT, other_names.intern("cudaLaunchKernel k()"));
+  other.add_call(other_launch, 50);
+  other.add_launch(other_launch, config, 50);
+  other.node(other_launch).length = 50;
+
+  std::vector<uint32_t> mapping;
+
+  for (uint32_t i = 0; i < other_names.size(); i++) {
+    mapping.push_back(names.intern(other_names.name(i)));
+  }
+
+  tree.merge(other, mapping);
+
+  std::string expected =
+    "{\"cudaLaunchKernel k()\":{\"children\":{},\"launches\":{"
+    "\"32,2,1 256,1,1 1024 7f3a2c001e0\":{\"count\":1,\"max\":30,"
+    "\"time\":30},\"4,1,1 128,1,1 0 0\":{\"count\":2,\"max\":50,"
+    "\"time\":60}},\"length\":90,\"stats\":";
+  std::string written = write_json(tree, names);
+
+  if (!CHECK_EQUAL(written.substr(0, expected.size()), expected)) {
+    return;
+  }
+
+  std::ostringstream stream;
+  tree.write_json(stream, names, true);
+
+  NameTable read_names;
+  CallTree read;
+  read.merge_json(nlohmann::json::parse(stream.str()), read_names);
+  CHECK_EQUAL(write_json(read, read_names), written);
+}
+
+// Percentiles are within 1/8 of the exact ones, and a node with
+// a single call gives its length exactly.
+static void test_percentiles() {
+  std::mt19937_64 random(7);
+  std::lognormal_distribution<double> distribution(10, 2);
+
+  for (int sample = 0; sample < 20; sample++) {
+    CallTree tree;
+    uint32_t index = tree.child(CallTree::ROOT, 0);
+    std::vector<unsigned long long> lengths;
+
+    for (int i = 0; i < 1000; i++) {
+      lengths.push_back(1 + (unsigned long long)distribution(random));
+      tree.add_call(index, lengths.back());
+    }
+
+    std::sort(lengths.begin(), lengths.end());
+
+    for (double percent : { 1.0, 50.0, 90.0, 99.0, 100.0 }) {
+      std::size_t rank = std::max<std::size_t>(
+        1, (std::size_t)(percent / 100 * lengths.size()));
+      double exact = lengths[rank - 1];
+      CHECK_NEAR(tree.percentile(index, percent), exact, exact / 8);
+    }
+  }
+
+  CallTree tree;
+  uint32_t index = tree.child(CallTree::ROOT, 0);
+  tree.add_call(index, 123457);
+  CHECK_EQUAL(tree.percentile(index, 50), 123457);
+}
+
+// A call of A made 3 calls of B, which made 4 calls of C. Every call
+// of C adds 2 callbacks to B, and those of B and C add 2 each to A.
+// Lengths stay the sums of the corrected times below them, and a time
+// smaller than its overhead becomes 0.
+static void test_subtract_overhead() {
+  CallTree tree;
+  uint32_t a = tree.child(CallTree::ROOT, 0);
+  uint32_t b = tree.child(a, 1);
+  uint32_t c = tree.child(b, 2);
+  uint32_t d = tree.child(CallTree::ROOT, 3);
+  uint32_t e = tree.child(d, 4);
+
+  for (auto [index, count, time] : { std::tuple(a, 1, 1000),
+                                     std::tuple(b, 3, 300),
+                                     std::tuple(c, 4, 40),
+                                     std::tuple(d, 1, 20),
+                                     std::tuple(e, 2, 10) }) {
+    for (int i = 0; i < count; i++) {
+      tree.add_call(index, time / count);
+    }
+  }
+
+  tree.node(a).length = 1340;
+  tree.node(b).length = 340;
+  tree.node(c).length = 40;
+  tree.node(d).length = 30;
+  tree.node(e).length = 10;
+  tree.subtract_overhead(5);
+
+  CHECK_EQUAL(tree.node(a).time, 1000 - 2 * 5 * 7);
+  CHECK_EQUAL(tree.node(b).time, 300 - 2 * 5 * 4);
+  CHECK_EQUAL(tree.node(c).time, 40);
+  CHECK_EQUAL(tree.node(a).length, 930 + 260 + 40);
+  CHECK_EQUAL(tree.node(b).length, 260 + 40);
+  CHECK_EQUAL(tree.node(c).length, 40);
+  CHECK_EQUAL(tree.node(d).time, 0);
+  CHECK_EQUAL(tree.node(d).length, 10);
+  CHECK_EQUAL(tree.node(e).time, 10);
+
+  // Counts and per-call statistics are not corrected.
+  CHECK_EQUAL(tree.node(b).count, 3);
+  CHECK_EQUAL(tree.node(b).min, 100);
+  CHECK_EQUAL(tree.node(b).max, 100);
+}
+
+// Totals of the children of a node, which pruning keeps: the calls of
+// folded children are in "[other]", while calls made during them only
+// count in their time. Transfers and launches are kept from all nodes
+// below.
+typedef struct Totals {
+  unsigned long long count;
+  unsigned long long time;
+  unsigned long long length;
+  unsigned long long transfer_bytes;
+  unsigned long long launch_count;
+} Totals;
+
+static void add_transfers_and_launches(const CallTree &tree, uint32_t index,
+                                       Totals &totals) {
+  totals.transfer_bytes += tree.total_transfer(index).bytes;
+
+  if (auto launches = tree.node_launches(index)) {
+    for (const CallTree::Launch &launch : *launches) {
+      totals.launch_count += launch.count;
+    }
+  }
+
+  for (uint32_t i = tree.node(index).first_child; i != CallTree::NONE;
+       i = tree.node(i).next_sibling) {
+    add_transfers_and_launches(tree, i, totals);
+  }
+}
+
+static Totals children_totals(const CallTree &tree, uint32_t index) {
+  Totals totals = { 0, 0, 0, 0, 0 };
+
+  for (uint32_t i = tree.node(index).first_child; i != CallTree::NONE;
+       i = tree.node(i).next_sibling) {
+    totals.count += tree.node(i).count;
+    totals.time += tree.node(i).time;
+    totals.length += tree.node(i).length;
+    add_transfers_and_launches(tree, i, totals);
+  }
+
+  return totals;
+}
+
+// Makes a call with random calls nested in it, each under a name out
+// of "names" distinct ones, some of them launches of one of "configs".
+// Returns the length of the call.
+static unsigned long long nested_call(CallTree &tree, uint32_t parent,
+                                      uint32_t name, unsigned int depth,
+                                      std::mt19937_64 &random,
+                                      const std::vector<uint32_t> &configs) {
+  uint32_t index = tree.child(parent, name);
+  unsigned long long length = 1 + random() % 1000;
+
+  if (depth > 0) {
+    for (unsigned long long i = random() % 4; i > 0; i--) {
+      length += nested_call(tree, index, random() % 2000, depth - 1, random,
+                            configs);
+    }
+  }
+
+  tree.add_call(index, length);
+  tree.node(index).length += length;
+
+  if (random() % 8 == 0) {
+    tree.add_transfer(index, random() % TRANSFER_DIRECTIONS, random() % 4096,
+                      length);
+  } else if (random() % 8 == 0) {
+    tree.add_launch(index, configs[random() % configs.size()], length);
+  }
+
+  return length;
+}
+
+// Every pruning keeps the length and statistics of every kept node and
+// the totals of its children, with the calls of the removed ones in
+// "[other]" nodes.
+static void test_prune_conservation() {
+  NameTable names;
+
+  for (int i = 0; i < 2000; i++) {
+    names.intern("function_" + std::to_string(i));
+  }
+
+  uint32_t other = names.intern(CallTree::OTHER_NAME);
+  std::vector<uint32_t> configs = { names.intern(CONFIGS[0]),
+                                    names.intern(CONFIGS[1]) };
+  std::mt19937_64 random(7);
+  CallTree tree;
+  tree.set_node_limit(300);
+  unsigned int prunings = 0;
+
+  for (int call = 0; call < 5000; call++) {
+    nested_call(tree, CallTree::ROOT, random() % 50, 3, random, configs);
+
+    if (!tree.over_limit()) {
+      continue;
+    }
+
+    CallTree before = tree;
+    std::vector<uint32_t> new_index = tree.prune(other, {});
+    prunings++;
+
+    CHECK(tree.size() <= 300 / 2 + 1);
+    CHECK_EQUAL(new_index.size(), before.size());
+    CHECK_EQUAL(new_index[CallTree::ROOT], CallTree::ROOT);
+
+    for (uint32_t i = 0; i < before.size(); i++) {
+      uint32_t j = new_index[i];
+
+      if (j == CallTree::NONE) {
+        continue;
+      }
+
+      const CallTree::Node &old_node = before.node(i);
+      const CallTree::Node &new_node = tree.node(j);
+      Totals old_totals = children_totals(before, i);
+      Totals new_totals = children_totals(tree, j);
+
+      // A kept "[other]" node takes the calls folded next to it.
+      if (old_node.name == other) {
+        CHECK(new_node.count >= old_node.count);
+        continue;
+      }
+
+      if (!CHECK_EQUAL(new_node.name, old_node.name) ||
+          !CHECK_EQUAL(new_node.length, old_node.length) ||
+          !CHECK_EQUAL(new_node.count, old_node.count) ||
+          !CHECK_EQUAL(new_node.time, old_node.time) ||
+          !CHECK_EQUAL(new_node.min, old_node.min) ||
+          !CHECK_EQUAL(new_node.max, old_node.max) ||
+          !CHECK_EQUAL(new_totals.count, old_totals.count) ||
+          !CHECK_EQUAL(new_totals.time, old_totals.time) ||
+          !CHECK_EQUAL(new_totals.length, old_totals.length) ||
+          !CHECK_EQUAL(new_totals.transfer_bytes,
+                       old_totals.transfer_bytes) ||
+          !CHECK_EQUAL(new_totals.launch_count, old_totals.launch_count)) {
+        return;
+      }
+    }
+  }
+
+  CHECK(prunings > 10);
+}
+
+// A call path taking more than about 1 / (limit / 2) of the time is
+// never folded, however many distinct light paths there are.
+static void test_prune_heavy_path() {
+  NameTable names;
+  uint32_t other = names.intern(CallTree::OTHER_NAME);
+  uint32_t heavy = names.intern("heavy");
+  CallTree tree;
+  tree.set_node_limit(100);
+  unsigned long long heavy_count = 0;
+
+  for (int i = 0; i < 100000; i++) {
+    uint32_t name = i % 10 == 0 ? heavy :
+      names.intern("light_" + std::to_string(i));
+    uint32_t index = tree.child(CallTree::ROOT, name);
+    unsigned long long length = name == heavy ? 1000 : 10;
+    tree.add_call(index, length);
+    tree.node(index).length += length;
+    heavy_count += name == heavy;
+
+    if (tree.over_limit()) {
+      tree.prune(other, {});
+    }
+  }
+
+  bool found = false;
+
+  for (uint32_t i = tree.node(CallTree::ROOT).first_child;
+       i != CallTree::NONE; i = tree.node(i).next_sibling) {
+    if (tree.node(i).name == heavy) {
+      found = true;
+      CHECK_EQUAL(tree.node(i).count, heavy_count);
+    }
+  }
+
+  CHECK(found);
+  CHECK_EQUAL(children_totals(tree, CallTree::ROOT).count, 100000);
+}
+
+int main() {
+  test_names();
+  test_write_json();
+  test_write_json_deep();
+  test_launches();
+  test_percentiles();
+  test_subtract_overhead();
+  test_prune_conservation();
+  test_prune_heavy_path();
+  return nvgpu_test::report();
+}
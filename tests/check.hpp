@@ -0,0 +1,79 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Minimal checks for the tests: a failed check is printed and
+// counted, and the test exits with report() so that CTest sees it.
+
+#ifndef NVGPU_TESTS_CHECK_HPP
+#define NVGPU_TESTS_CHECK_HPP
+
+#include <iostream>
+#include <cmath>
+#include <utility>
+#include <type_traits>
+
+namespace nvgpu_test {
+  inline int failures = 0;
+
+  inline bool check(bool passed, const char *expression, const char *file,
+                    int line) {
+    if (!passed) {
+      std::cerr << file << ":" << line << ": check failed: " << expression
+                << std::endl;
+      failures++;
+    }
+
+    return passed;
+  }
+
+  // Integer types std::cmp_equal() accepts, i.e. not bool and
+  // the character types.
+  template<typename T>
+  inline constexpr bool is_integer = std::is_integral_v<T> &&
+    !std::is_same_v<T, bool> && !std::is_same_v<T, char> &&
+    !std::is_same_v<T, wchar_t> && !std::is_same_v<T, char8_t> &&
+    !std::is_same_v<T, char16_t> && !std::is_same_v<T, char32_t>;
+
+  // Integers are compared by value whatever their signedness, e.g.
+  // -1 is not equal to SIZE_MAX.
+  template<typename A, typename B>
+  bool equal(const A &a, const B &b) {
+    if constexpr (is_integer<A> && is_integer<B>) {
+      return std::cmp_equal(a, b);
+    } else {
+      return a == b;
+    }
+  }
+
+  template<typename A, typename B>
+  bool check_equal(const A &a, const B &b, const char *expression,
+                   const char *file, int line) {
+    if (!equal(a, b)) {
+      std::cerr << file << ":" << line << ": check failed: " << expression
+                << " (" << a << " != " << b << ")" << std::endl;
+      failures++;
+      return false;
+    }
+
+    return true;
+  }
+
+  inline int report() {
+    if (failures > 0) {
+      std::cerr << failures << " check(s) failed" << std::endl;
+      return 1;
+    }
+
+    return 0;
+  }
+}
+
+#define CHECK(condition) \
+  nvgpu_test::check((condition), #condition, __FILE__, __LINE__)
+#define CHECK_EQUAL(a, b) \
+  nvgpu_test::check_equal((a), (b), #a " == " #b, __FILE__, __LINE__)
+#define CHECK_NEAR(a, b, tolerance) \
+  nvgpu_test::check(std::abs((double)(a) - (double)(b)) <= (tolerance), \
+                    #a " ~ " #b, __FILE__, __LINE__)
+
+#endif
@@ -0,0 +1,292 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of checkpoints: the module runs on the fake Adaptyst of
+// module_host in a child process, which is killed in the middle of
+// profiling in one of the tests, and its checkpoint files are compared
+// with regions.json of a run without checkpoints.
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <fstream>
+#include <functional>
+#include <filesystem>
+#include <csignal>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <nlohmann/json.hpp>
+#include "module_host.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+static const std::string PART_ID = "100_1";
+
+// A region needs to have ended this long ago (CHECKPOINT_DELAY) and
+// the previous checkpoint to be this long ago (checkpoint_interval)
+// for the region to be written to a checkpoint.
+static const std::chrono::milliseconds CHECKPOINT_WAIT{1200};
+
+// Starts the module in a child process writing to "dir", with
+// the messages pushed by "feed" from another thread, which must call
+// module_host::finish() for the module to finish. The child exits
+// with 0 if the module has succeeded and no check has failed in it.
+static pid_t start_module(const fs::path &dir,
+                          unsigned int checkpoint_interval,
+                          const std::function<void()> &feed) {
+  pid_t pid = fork();
+
+  if (pid != 0) {
+    return pid;
+  }
+
+  // Only the checks failed in the child count in its exit status.
+  nvgpu_test::failures = 0;
+  module_host::set_module_dir(dir.string());
+  module_host::set_option("wire_protocol", "text");
+  module_host::set_option("checkpoint_interval", checkpoint_interval);
+  module_host::set_workflow_times(0, 1000000000);
+
+  std::thread feeder([&]() {
+    module_host::push("cuda_api_type text");
+    feed();
+  });
+
+  bool success = module_host::run();
+  feeder.join();
+  _exit(success && nvgpu_test::failures == 0 ? 0 : 1);
+}
+
+static bool wait_for_file(const fs::path &path) {
+  for (int i = 0; i < 1000; i++) {
+    if (fs::exists(path)) {
+      return true;
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  return false;
+}
+
+// Waits for the module to print a message containing "text".
+static bool wait_for_print(const std::string &text) {
+  for (int i = 0; i < 1000; i++) {
+    for (auto &message : module_host::printed()) {
+      if (message.find(text) != std::string::npos) {
+        return true;
+      }
+    }
+
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+  }
+
+  return false;
+}
+
+static bool wait_module(pid_t pid) {
+  int status;
+  return waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+    WEXITSTATUS(status) == 0;
+}
+
+// Pushes a region of calls with nested calls, starting at "start".
+static void push_region(const std::string &name, unsigned long long start,
+                        int calls) {
+  module_host::push("!R " + name + " " + PART_ID + " " +
+                    std::to_string(start));
+  unsigned long long time = start;
+
+  auto event = [&](const std::string &state, const std::string &function) {
+    time += 10;
+    module_host::push(std::to_string(time) + " " + PART_ID + " " + state +
+                      " " + function);
+  };
+
+  for (int i = 0; i < calls; i++) {
+    std::string outer = i % 3 == 0 ? "cudaMemcpy" : "cudaLaunchKernel k" +
+      std::to_string(i % 5);
+    event("enter", outer);
+
+    if (i % 2 == 0) {
+      event("enter", "cuLaunchKernel");
+      time += i;
+      event("exit", "cuLaunchKernel");
+    }
+
+    event("exit", outer);
+  }
+
+  module_host::push("!E " + name + " " + PART_ID + " " +
+                    std::to_string(time + 10));
+}
+
+static nlohmann::json read_json(const fs::path &path) {
+  std::ifstream stream(path);
+
+  try {
+    return nlohmann::json::parse(stream);
+  } catch (nlohmann::json::exception &e) {
+    CHECK(false);
+    std::cerr << path << ": " << e.what() << std::endl;
+    return nlohmann::json();
+  }
+}
+
+// Removes the histograms which checkpoints have in addition to
+// regions.json.
+static void strip_histograms(nlohmann::json &json) {
+  if (!json.is_object()) {
+    return;
+  }
+
+  json.erase("histogram");
+
+  for (auto &[key, value] : json.items()) {
+    strip_histograms(value);
+  }
+}
+
+static fs::path make_dir(const std::string &name) {
+  fs::path dir = fs::temp_directory_path() /
+    ("nvgpu_checkpoint_test_" + std::to_string(getpid()) + "_" + name);
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+  return dir;
+}
+
+// regions.json of a run without checkpoints.
+static nlohmann::json reference(const std::function<void()> &feed) {
+  fs::path dir = make_dir("reference");
+  pid_t pid = start_module(dir, 0, feed);
+  CHECK(wait_module(pid));
+  nlohmann::json result = read_json(dir / "regions.json");
+  fs::remove_all(dir);
+  return result;
+}
+
+// The module is killed while a region is open after a checkpoint of
+// the closed ones, which are all in the checkpoint as they would be
+// in regions.json.
+static void test_crash() {
+  nlohmann::json expected = reference([]() {
+    push_region("a", 1000, 300);
+    push_region("b", 100000, 200);
+    module_host::finish();
+  });
+
+  fs::path dir = make_dir("crash");
+  pid_t pid = start_module(dir, 1, []() {
+    push_region("a", 1000, 300);
+    push_region("b", 100000, 200);
+    std::this_thread::sleep_for(CHECKPOINT_WAIT);
+
+    // Region "c" never ends, and its events keep the module busy until
+    // it is killed.
+    module_host::push("!R c " + PART_ID + " 200000");
+
+    for (unsigned long long time = 200010;; time += 20) {
+      module_host::push(std::to_string(time) + " " + PART_ID +
+                        " enter cudaDeviceSynchronize");
+      module_host::push(std::to_string(time + 10) + " " + PART_ID +
+                        " exit cudaDeviceSynchronize");
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+  });
+
+  bool written = CHECK(wait_for_file(dir / "checkpoint.0.json"));
+  kill(pid, SIGKILL);
+  waitpid(pid, nullptr, 0);
+
+  if (written) {
+    nlohmann::json checkpoint = read_json(dir / "checkpoint.0.json");
+    strip_histograms(checkpoint);
+    CHECK_EQUAL(checkpoint.size(), 2);
+    CHECK_EQUAL(checkpoint["a"], expected["a"]);
+    CHECK_EQUAL(checkpoint["b"], expected["b"]);
+    CHECK(!checkpoint.contains("c"));
+  }
+
+  // Checkpoints are renamed into place once complete.
+  CHECK(!fs::exists(dir / "checkpoint.0.json.tmp"));
+  CHECK(!fs::exists(dir / "regions.json"));
+  fs::remove_all(dir);
+}
+
+// Regions read back from checkpoints are in regions.json as if there
+// were no checkpoints, and the checkpoint files are removed once it
+// is written.
+static void test_restore() {
+  fs::path dir = make_dir("restore");
+  auto feed = [&](bool wait) {
+    push_region("a", 1000, 300);
+    push_region("b", 100000, 200);
+
+    if (wait) {
+      std::this_thread::sleep_for(CHECKPOINT_WAIT);
+    }
+
+    push_region("c", 200000, 100);
+
+    // The checkpoint is written while the events of "c" are handled.
+    if (wait) {
+      CHECK(wait_for_file(dir / "checkpoint.0.json"));
+    }
+
+    push_region("b", 300000, 100);
+    module_host::finish();
+  };
+
+  nlohmann::json expected = reference([&]() { feed(false); });
+  CHECK(wait_module(start_module(dir, 1, [&]() { feed(true); })));
+
+  CHECK_EQUAL(read_json(dir / "regions.json"), expected);
+  CHECK(!fs::exists(dir / "checkpoint.0.json"));
+  CHECK(!fs::exists(dir / "checkpoint.1.json"));
+  fs::remove_all(dir);
+}
+
+// If a checkpoint cannot be written or renamed into place, its regions
+// stay in memory and end up in regions.json.
+static void test_failed_checkpoint() {
+  auto feed = [](bool wait) {
+    push_region("a", 1000, 300);
+
+    if (wait) {
+      std::this_thread::sleep_for(CHECKPOINT_WAIT);
+    }
+
+    push_region("b", 100000, 200);
+
+    if (wait) {
+      CHECK(wait_for_print("keeping regions in memory"));
+    }
+
+    module_host::finish();
+  };
+
+  nlohmann::json expected = reference([&]() { feed(false); });
+
+  for (const char *blocked : { "checkpoint.0.json.tmp",
+                               "checkpoint.0.json" }) {
+    fs::path dir = make_dir("failed");
+
+    // A directory in the way makes opening or renaming fail.
+    fs::create_directories(dir / blocked / "file");
+
+    CHECK(wait_module(start_module(dir, 1, [&]() { feed(true); })));
+    CHECK_EQUAL(read_json(dir / "regions.json"), expected);
+    CHECK(fs::is_directory(dir / blocked));
+    fs::remove_all(dir);
+  }
+}
+
+int main() {
+  test_crash();
+  test_restore();
+  test_failed_checkpoint();
+  return nvgpu_test::report();
+}
@@ -0,0 +1,245 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of the comparison done by nvgpu-diff on synthetic profiles.
+
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <unistd.h>
+#include "profile_diff.hpp"
+#include "check.hpp"
+
+// regions.json with region "r" holding "a" (with child "b") and "c",
+// skipping nodes with a length of 0. The keys the reader must skip
+// are there too.
+static std::string profile(unsigned long long a, unsigned long long b,
+                           unsigned long long c) {
+  std::string data;
+
+  if (a != 0) {
+    data += "\"a\":{\"length\":" + std::to_string(a) +
+      ",\"count\":3,\"histogram\":[1,2,{\"length\":5}],\"children\":{";
+
+    if (b != 0) {
+      data += "\"b\":{\"length\":" + std::to_string(b) +
+        ",\"time\":0.5,\"children\":{}}";
+    }
+
+    data += "}}";
+  }
+
+  if (c != 0) {
+    data += std::string(data.empty() ? "" : ",") + "\"c\":{\"length\":" +
+      std::to_string(c) + ",\"children\":{}}";
+  }
+
+  return "{\"r\":{\"processes\":{\"1\":{\"length\":99}},\"data\":{" +
+    data + "},\"summary\":{\"length\":7}}}";
+}
+
+static std::vector<PathTable> read_all(const std::vector<std::string> &jsons) {
+  std::vector<PathTable> tables(jsons.size());
+
+  for (std::size_t i = 0; i < jsons.size(); i++) {
+    std::string error;
+    CHECK(parse_profile(jsons[i], tables[i], error));
+    CHECK_EQUAL(error, "");
+  }
+
+  return tables;
+}
+
+static std::string path_name(const Diff &diff, const Change &change) {
+  std::string result;
+
+  for (auto name : diff.paths.names_of(change.path)) {
+    result += (result.empty() ? "" : " > ") + std::string(name);
+  }
+
+  return result;
+}
+
+static const Change *find(const Diff &diff, const std::string &path) {
+  for (auto &change : diff.changes) {
+    if (path_name(diff, change) == path) {
+      return &change;
+    }
+  }
+
+  return nullptr;
+}
+
+static void test_read() {
+  PathTable table;
+  std::string error;
+  CHECK(parse_profile(profile(100, 40, 10), table, error));
+
+  // Root, "r", "a", "b" and "c": nothing of "processes" or "summary".
+  CHECK_EQUAL(table.paths.size(), 5U);
+
+  for (uint32_t i = 1; i < table.paths.size(); i++) {
+    std::string name = table.names.name(table.paths[i].name);
+
+    if (name == "r") {
+      // The top-level calls only.
+      CHECK_EQUAL(table.paths[i].length, 110ULL);
+    } else if (name == "a") {
+      CHECK_EQUAL(table.paths[i].length, 100ULL);
+    } else if (name == "b") {
+      CHECK_EQUAL(table.paths[i].length, 40ULL);
+    } else {
+      CHECK_EQUAL(name, "c");
+      CHECK_EQUAL(table.paths[i].length, 10ULL);
+    }
+  }
+
+  PathTable broken;
+  CHECK(!parse_profile("{\"r\":{\"data\":{\"a\":", broken, error));
+  CHECK(!error.empty());
+}
+
+static void test_matched() {
+  auto tables = read_all({ profile(100, 40, 10), profile(100, 40, 10) });
+  Diff diff = compare_profiles(tables, 1, { 0, 3, 0 });
+
+  CHECK_EQUAL(diff.paths.paths.size(), 5U);
+  CHECK(diff.changes.empty());
+  CHECK_EQUAL(diff.regressions, 0U);
+  CHECK_EQUAL(diff.improvements, 0U);
+  CHECK_EQUAL(diff.over_budget, 0U);
+}
+
+static void test_added_removed() {
+  // "b" is removed and "c" is added, with "a" unchanged apart from its
+  // child.
+  auto tables = read_all({ profile(100, 40, 0), profile(100, 0, 25) });
+  Diff diff = compare_profiles(tables, 1, { -1, 3, 0 });
+
+  // Paths of both sides are aligned: root, "r", "a", "b" and "c".
+  CHECK_EQUAL(diff.paths.paths.size(), 5U);
+  CHECK_EQUAL(diff.changes.size(), 3U);
+  CHECK_EQUAL(diff.regressions, 2U);
+  CHECK_EQUAL(diff.improvements, 1U);
+  CHECK(find(diff, "r > a") == nullptr);
+
+  const Change *removed = find(diff, "r > a > b");
+  const Change *added = find(diff, "r > c");
+  const Change *region = find(diff, "r");
+
+  if (CHECK(removed && added && region)) {
+    CHECK_EQUAL(removed->baseline, 40.0);
+    CHECK_EQUAL(removed->candidate, 0.0);
+    CHECK_EQUAL(added->baseline, 0.0);
+    CHECK_EQUAL(added->candidate, 25.0);
+    CHECK_EQUAL(region->baseline, 100.0);
+    CHECK_EQUAL(region->candidate, 125.0);
+  }
+
+  // Largest first.
+  CHECK_EQUAL(path_name(diff, diff.changes[0]), "r > a > b");
+}
+
+static void test_thresholds() {
+  // 5 runs per side with about 1% of noise and "b" being 30% slower.
+  std::vector<std::string> jsons;
+  unsigned long long jitter[] = { 0, 3, 6, 2, 4 };
+
+  for (int i = 0; i < 5; i++) {
+    jsons.push_back(profile(1000 + jitter[i], 500 + jitter[i], 300));
+  }
+
+  for (int i = 0; i < 5; i++) {
+    jsons.push_back(profile(1150 + jitter[4 - i], 650 + jitter[4 - i],
+                            300 + jitter[i]));
+  }
+
+  auto tables = read_all(jsons);
+  Diff diff = compare_profiles(tables, 5, { 10, 3, 0 });
+
+  // "b", "a" and "r" are slower, but the noise of "c" is not reported.
+  CHECK_EQUAL(diff.regressions, 3U);
+  CHECK_EQUAL(diff.improvements, 0U);
+  CHECK(find(diff, "r > c") == nullptr);
+
+  const Change *b = find(diff, "r > a > b");
+
+  if (CHECK(b != nullptr)) {
+    CHECK_NEAR(b->baseline, 503, 1e-9);
+    CHECK_NEAR(b->candidate, 653, 1e-9);
+    CHECK(b->noise > 0 && b->noise < 150);
+  }
+
+  // +30% of "b" and +15% of "a" are over 10%, +~11% of "r" too.
+  CHECK_EQUAL(diff.over_budget, 3U);
+
+  tables = read_all(jsons);
+  diff = compare_profiles(tables, 5, { 20, 3, 0 });
+  CHECK_EQUAL(diff.over_budget, 1U);
+
+  tables = read_all(jsons);
+  diff = compare_profiles(tables, 5, { 50, 3, 0 });
+  CHECK_EQUAL(diff.over_budget, 0U);
+
+  // A change smaller than the minimum is not reported.
+  tables = read_all(jsons);
+  diff = compare_profiles(tables, 5, { -1, 3, 151 });
+  CHECK_EQUAL(diff.changes.size(), 1U);
+  CHECK(find(diff, "r") != nullptr);
+
+  // Neither is a change hidden in the noise.
+  tables = read_all(jsons);
+  diff = compare_profiles(tables, 5, { -1, 1000, 0 });
+  CHECK(diff.changes.empty());
+
+  // Without a sigma threshold, "c" is reported as well.
+  tables = read_all(jsons);
+  diff = compare_profiles(tables, 5, { -1, 0, 0 });
+  CHECK_EQUAL(diff.changes.size(), 4U);
+}
+
+static void test_file() {
+  // Larger than one chunk, so that nodes cross chunk boundaries.
+  std::string json = "{\"r\":{\"data\":{";
+
+  for (int i = 0; json.size() < 3 << 20; i++) {
+    json += (i == 0 ? "\"" : ",\"") + std::to_string(i) +
+      "\":{\"length\":" + std::to_string(i) + ",\"children\":{}}";
+  }
+
+  json += "}}}";
+
+  char path[] = "/tmp/nvgpu_diff_testXXXXXX";
+  int fd = mkstemp(path);
+
+  if (!CHECK(fd != -1)) {
+    return;
+  }
+
+  CHECK_EQUAL(write(fd, json.data(), json.size()), (ssize_t)json.size());
+  close(fd);
+
+  PathTable from_file, from_string;
+  std::string error;
+  CHECK(read_profile(path, from_file, error));
+  CHECK(parse_profile(json, from_string, error));
+  unlink(path);
+
+  if (CHECK_EQUAL(from_file.paths.size(), from_string.paths.size())) {
+    for (std::size_t i = 0; i < from_file.paths.size(); i++) {
+      CHECK_EQUAL(from_file.paths[i].length, from_string.paths[i].length);
+    }
+  }
+
+  CHECK(!read_profile(path, from_file, error));
+  CHECK(error.find("Could not open") == 0);
+}
+
+int main() {
+  test_read();
+  test_matched();
+  test_added_removed();
+  test_thresholds();
+  test_file();
+  return nvgpu_test::report();
+}
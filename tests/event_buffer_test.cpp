@@ -0,0 +1,73 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of the ring buffer between a profiled thread and the flusher.
+
+#include <string>
+#include <thread>
+#include "event_buffer.hpp"
+#include "check.hpp"
+
+// Lines pushed to a small buffer while it is drained by another thread
+// come out once each and in order, with the buffer wrapping around
+// many times.
+static void test_concurrent() {
+  constexpr int LINES = 200000;
+
+  EventBuffer buffer(8);
+  std::thread producer([&]() {
+    for (int i = 0; i < LINES; i++) {
+      std::string line = std::to_string(i);
+
+      while (!buffer.push(line)) {
+        std::this_thread::yield();
+      }
+    }
+  });
+
+  int next = 0;
+  bool ordered = true;
+
+  while (next < LINES) {
+    std::size_t drained = buffer.drain([&](std::string_view line) {
+      ordered = ordered && line == std::to_string(next);
+      next++;
+    });
+
+    if (drained == 0) {
+      std::this_thread::yield();
+    }
+  }
+
+  producer.join();
+
+  CHECK(ordered);
+  CHECK_EQUAL(next, LINES);
+  CHECK_EQUAL(buffer.size(), 0);
+}
+
+// A full buffer refuses lines until it is drained.
+static void test_full() {
+  EventBuffer buffer(4);
+
+  for (int i = 0; i < 4; i++) {
+    CHECK(buffer.push("line " + std::to_string(i)));
+  }
+
+  CHECK(!buffer.push("line 4"));
+  CHECK_EQUAL(buffer.size(), 4);
+
+  std::string drained;
+  CHECK_EQUAL(buffer.drain([&](std::string_view line) {
+    drained += line;
+    drained += ';';
+  }), 4);
+  CHECK_EQUAL(drained, "line 0;line 1;line 2;line 3;");
+  CHECK(buffer.push("line 4"));
+}
+
+int main() {
+  test_concurrent();
+  test_full();
+  return nvgpu_test::report();
+}
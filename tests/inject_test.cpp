@@ -0,0 +1,983 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of the injection part running on the stub CUPTI library, with
+// the strings it sends recorded by the fake Adaptyst of inject_host.
+
+#include <adaptyst/hw_inject.h>
+#include <cupti.h>
+#include <generated_cuda_runtime_api_meta.h>
+#include <generated_cuda_meta.h>
+#include <generated_nvtx_meta.h>
+#include <cupti_nvtx_cbid.h>
+#include <string>
+#include <vector>
+#include <thread>
+#include <functional>
+#include <mutex>
+#include <atomic>
+#include <sstream>
+#include <algorithm>
+#include <chrono>
+#include <unistd.h>
+#include "inject_host.hpp"
+#include "stub_cupti.hpp"
+#include "api_filter.hpp"
+#include "api_category.hpp"
+#include "message.hpp"
+#include "clock.hpp"
+#include "check.hpp"
+
+extern "C" {
+  int adaptyst_init(amod_t module_id);
+  int adaptyst_region_start(amod_t module_id, const char *part_id,
+                            const char *name, const char *timestamp_str);
+  int adaptyst_region_end(amod_t module_id, const char *part_id,
+                          const char *name, const char *timestamp_str);
+  void adaptyst_close(amod_t module_id);
+}
+
+static const amod_t MODULE_ID{};
+
+static std::string this_part_id() {
+  return std::to_string(getpid()) + "_" + std::to_string(gettid());
+}
+
+// Runs the injection part with a "cuda_api_type" reply, making
+// the calls in a region of a new thread (the thread state of
+// the injection part belongs to one instance of it), and returns
+// the lines sent until it is closed.
+static std::vector<std::string> trace(
+  const std::string &reply,
+  const std::function<void(const std::string &)> &calls) {
+  inject_host::reset();
+  stub_cupti::reset();
+  inject_host::set_reply(reply);
+
+  if (!CHECK_EQUAL(adaptyst_init(MODULE_ID), ADAPTYST_MODULE_OK)) {
+    std::cerr << inject_host::error() << std::endl;
+    adaptyst_close(MODULE_ID);
+    return {};
+  }
+
+  std::thread thread([&]() {
+    std::string part_id = this_part_id();
+    CHECK_EQUAL(adaptyst_region_start(MODULE_ID, part_id.c_str(), "region",
+                                      "0"), ADAPTYST_MODULE_OK);
+    calls(part_id);
+    CHECK_EQUAL(adaptyst_region_end(MODULE_ID, part_id.c_str(), "region",
+                                    "0"), ADAPTYST_MODULE_OK);
+  });
+
+  thread.join();
+  adaptyst_close(MODULE_ID);
+  return inject_host::sent_lines();
+}
+
+static void call(CUpti_CallbackDomain domain, CUpti_CallbackId cbid,
+                 const void *params, const char *symbol = nullptr) {
+  CHECK(stub_cupti::api_call(domain, cbid, CUPTI_API_ENTER, params, symbol));
+  CHECK(stub_cupti::api_call(domain, cbid, CUPTI_API_EXIT, params, symbol));
+}
+
+static std::vector<std::string> with_prefix(
+  const std::vector<std::string> &lines, const std::string &prefix) {
+  std::vector<std::string> result;
+
+  for (auto &line : lines) {
+    if (line.starts_with(prefix)) {
+      result.push_back(line);
+    }
+  }
+
+  return result;
+}
+
+// Returns the events of a part in "lines", without their timestamps.
+static std::vector<std::string> events(const std::vector<std::string> &lines,
+                                       const std::string &part_id) {
+  std::vector<std::string> result;
+  std::string infix = " " + part_id + " ";
+
+  for (auto &line : lines) {
+    std::string::size_type pos = line.find(infix);
+
+    if (!line.starts_with("@") && pos != std::string::npos) {
+      result.push_back(line.substr(pos + infix.size()));
+    }
+  }
+
+  return result;
+}
+
+// Returns the line after the first one equal to "line", or an empty
+// string if there is none.
+static std::string line_after(const std::vector<std::string> &lines,
+                              const std::string &line) {
+  for (std::size_t i = 0; i + 1 < lines.size(); i++) {
+    if (lines[i] == line) {
+      return lines[i + 1];
+    }
+  }
+
+  return "";
+}
+
+static bool is_event(const std::string &line, const std::string &part_id,
+                     const std::string &event) {
+  std::string suffix = " " + part_id + " " + event;
+  return line.size() > suffix.size() && line.ends_with(suffix);
+}
+
+// A category in a filter matches exactly the functions api_category()
+// puts in it, e.g. not cudaGraphLaunch for "launch" although its name
+// has "Launch" in it.
+static void test_filter_categories() {
+  for (int category = 0; category < API_CATEGORIES; category++) {
+    ApiFilter filter({ api_category_name(category) }, {});
+
+    for (CUpti_CallbackDomain domain : { CUPTI_CB_DOMAIN_RUNTIME_API,
+                                         CUPTI_CB_DOMAIN_DRIVER_API }) {
+      CUpti_CallbackId size = domain == CUPTI_CB_DOMAIN_RUNTIME_API ?
+        (CUpti_CallbackId)CUPTI_RUNTIME_TRACE_CBID_SIZE :
+        (CUpti_CallbackId)CUPTI_DRIVER_TRACE_CBID_SIZE;
+
+      for (CUpti_CallbackId cbid = 1; cbid < size; cbid++) {
+        const char *name = stub_cupti::callback_name(domain, cbid);
+        ApiCategory expected = api_category(domain, cbid);
+
+        if (name && !CHECK_EQUAL(filter.matches(name, expected),
+                                 expected == category)) {
+          std::cerr << api_category_name(category) << ": " << name
+                    << std::endl;
+        }
+      }
+    }
+  }
+
+  CHECK_EQUAL(api_category(CUPTI_CB_DOMAIN_RUNTIME_API,
+                           CUPTI_RUNTIME_TRACE_CBID_cudaGraphLaunch_v10000),
+              API_GRAPH_LAUNCH);
+  CHECK_EQUAL(api_category(CUPTI_CB_DOMAIN_RUNTIME_API,
+                           CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy3D_v3020),
+              API_MEMCPY);
+  CHECK_EQUAL(api_category(CUPTI_CB_DOMAIN_DRIVER_API,
+                           CUPTI_DRIVER_TRACE_CBID_cuMemsetD2D8Async_ptsz),
+              API_MEMSET);
+
+  // Function names are still matched with and without suffixes.
+  ApiFilter filter({ "cuMemcpyHtoD" }, { "memset" });
+  CHECK(filter.matches("cuMemcpyHtoD_v2_ptds", API_MEMCPY));
+  CHECK(!filter.matches("cuMemcpyDtoH_v2", API_MEMCPY));
+  CHECK(!ApiFilter({}, { "memset" }).matches("cuMemsetD8_v2", API_MEMSET));
+}
+
+// With a filter, only the callbacks of the functions passing it are
+// enabled, one by one instead of whole domains, so other calls never
+// reach the injection part.
+static void test_filter() {
+  std::string part_id;
+  std::vector<stub_cupti::EnableCall> enables;
+
+  auto lines = trace("runtime text " NVGPU_FILTER_CAPABILITY
+                     " memcpy,cudaLaunchKernel cudaMemcpyAsync",
+                     [&](const std::string &id) {
+    part_id = id;
+    enables = stub_cupti::enable_calls();
+
+    CHECK(stub_cupti::enabled(CUPTI_CB_DOMAIN_RUNTIME_API,
+                              CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020));
+    CHECK(stub_cupti::enabled(CUPTI_CB_DOMAIN_RUNTIME_API,
+                              CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy2D_v3020));
+    CHECK(stub_cupti::enabled(
+            CUPTI_CB_DOMAIN_RUNTIME_API,
+            CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_ptsz_v7000));
+    CHECK(!stub_cupti::enabled(
+            CUPTI_CB_DOMAIN_RUNTIME_API,
+            CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyAsync_ptsz_v7000));
+    CHECK(!stub_cupti::enabled(CUPTI_CB_DOMAIN_RUNTIME_API,
+                               CUPTI_RUNTIME_TRACE_CBID_cudaFree_v3020));
+    CHECK(!stub_cupti::enabled(CUPTI_CB_DOMAIN_DRIVER_API,
+                               CUPTI_DRIVER_TRACE_CBID_cuMemcpy));
+
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020, nullptr);
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, nullptr, "k()");
+
+    CHECK(!stub_cupti::api_call(CUPTI_CB_DOMAIN_RUNTIME_API,
+                                CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyAsync_v3020,
+                                CUPTI_API_ENTER));
+    CHECK(!stub_cupti::api_call(CUPTI_CB_DOMAIN_RUNTIME_API,
+                                CUPTI_RUNTIME_TRACE_CBID_cudaFree_v3020,
+                                CUPTI_API_ENTER));
+  });
+
+  // Every enabled callback passes the filter.
+  ApiFilter filter({ "memcpy", "cudaLaunchKernel" }, { "cudaMemcpyAsync" });
+  std::size_t enabled = 0;
+
+  for (auto &enable : enables) {
+    CHECK(!enable.whole_domain);
+    CHECK(enable.enable);
+    CHECK_EQUAL(enable.domain, CUPTI_CB_DOMAIN_RUNTIME_API);
+
+    const char *name = stub_cupti::callback_name(enable.domain, enable.cbid);
+
+    if (CHECK(name)) {
+      CHECK(filter.matches(name, api_category(enable.domain, enable.cbid)));
+      enabled++;
+    }
+  }
+
+  // The memcpy category has 44 runtime functions without
+  // cudaMemcpyAsync, and cudaLaunchKernel has 2 callbacks.
+  CHECK_EQUAL(enabled, 46);
+
+  std::vector<std::string> expected = {
+    "enter cudaMemcpy", "exit cudaMemcpy",
+    "enter cudaLaunchKernel k()", "exit cudaLaunchKernel k()"
+  };
+
+  CHECK(events(lines, part_id) == expected);
+
+  // A filter matching nothing is refused.
+  inject_host::reset();
+  stub_cupti::reset();
+  inject_host::set_reply("runtime text " NVGPU_FILTER_CAPABILITY
+                         " cudaNothing -");
+  CHECK_EQUAL(adaptyst_init(MODULE_ID), ADAPTYST_MODULE_ERR);
+  CHECK(!inject_host::error().empty());
+  adaptyst_close(MODULE_ID);
+}
+
+// The "@M" line comes right before the enter event of every memcpy and
+// memset call with the direction and size of the transfer.
+static void test_transfers() {
+  std::string part_id;
+
+  auto lines = trace("both text " NVGPU_TRANSFER_CAPABILITY,
+                     [&](const std::string &id) {
+    part_id = id;
+
+    cudaMemcpy_v3020_params memcpy = {
+      nullptr, nullptr, 1024, cudaMemcpyHostToDevice, nullptr
+    };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020, &memcpy);
+
+    cudaMemcpyAsync_v3020_params memcpy_default = {
+      nullptr, nullptr, 3, cudaMemcpyDefault, nullptr
+    };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyAsync_v3020, &memcpy_default);
+
+    cudaMemcpy2D_v3020_params memcpy_2d = {
+      nullptr, 64, nullptr, 64, 16, 8, cudaMemcpyDeviceToHost, nullptr
+    };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy2D_v3020, &memcpy_2d);
+
+    cudaMemcpyPeer_v4000_params memcpy_peer = {
+      nullptr, 1, nullptr, 0, 64, nullptr
+    };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaMemcpyPeer_v4000, &memcpy_peer);
+
+    cudaMemset_v3020_params memset = { nullptr, 0, 32, nullptr };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaMemset_v3020, &memset);
+
+    cuMemcpyDtoD_v2_params cu_memcpy = { 0, nullptr, 256, nullptr };
+    call(CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuMemcpyDtoD_v2,
+         &cu_memcpy);
+
+    cuMemsetD32_v2_params cu_memset = { 0, 0, 10, nullptr };
+    call(CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuMemsetD32_v2,
+         &cu_memset);
+
+    // No parameters and no transfer to report.
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020, nullptr);
+    call(CUPTI_CB_DOMAIN_RUNTIME_API, CUPTI_RUNTIME_TRACE_CBID_cudaFree_v3020,
+         nullptr);
+  });
+
+  struct {
+    std::string transfer;
+    std::string event;
+  } expected[] = {
+    { "HtoD 1024", "enter cudaMemcpy" },
+    { "default 3", "enter cudaMemcpyAsync" },
+    { "DtoH 128", "enter cudaMemcpy2D" },
+    { "PtoP 64", "enter cudaMemcpyPeer" },
+    { "memset 32", "enter cudaMemset" },
+    { "DtoD 256", "enter cuMemcpyDtoD" },
+    { "memset 40", "enter cuMemsetD32" }
+  };
+
+  CHECK_EQUAL(with_prefix(lines, "@M").size(), 7);
+
+  for (auto &transfer : expected) {
+    std::string line = "@M " + part_id + " " + transfer.transfer;
+    CHECK(is_event(line_after(lines, line), part_id, transfer.event));
+  }
+
+  CHECK_EQUAL(events(lines, part_id).size(), 18);
+
+  CHECK_EQUAL(with_prefix(trace("runtime text", [](const std::string &) {
+    cudaMemset_v3020_params memset = { nullptr, 0, 32, nullptr };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaMemset_v3020, &memset);
+  }), "@M").size(), 0);
+}
+
+// The "@K" line is sent once for every function in a category, in
+// both domains, before its first event, and never for functions of no
+// category or without the category1 capability.
+static void test_categories() {
+  std::string part_id;
+
+  auto lines = trace("both text " NVGPU_CATEGORY_CAPABILITY,
+                     [&](const std::string &id) {
+    part_id = id;
+
+    for (int i = 0; i < 2; i++) {
+      call(CUPTI_CB_DOMAIN_RUNTIME_API,
+           CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, nullptr);
+      call(CUPTI_CB_DOMAIN_DRIVER_API,
+           CUPTI_DRIVER_TRACE_CBID_cuMemcpyDtoD_v2, nullptr);
+      call(CUPTI_CB_DOMAIN_RUNTIME_API,
+           CUPTI_RUNTIME_TRACE_CBID_cudaDeviceSynchronize_v3020, nullptr);
+      call(CUPTI_CB_DOMAIN_RUNTIME_API,
+           CUPTI_RUNTIME_TRACE_CBID_cudaMalloc_v3020, nullptr);
+      call(CUPTI_CB_DOMAIN_RUNTIME_API,
+           CUPTI_RUNTIME_TRACE_CBID_cudaGetDevice_v3020, nullptr);
+    }
+  });
+
+  CHECK(with_prefix(lines, "@K") ==
+        std::vector<std::string>({ "@K launch cudaLaunchKernel",
+                                   "@K memcpy cuMemcpyDtoD",
+                                   "@K sync cudaDeviceSynchronize",
+                                   "@K alloc cudaMalloc" }));
+
+  // Categories are sent at once rather than buffered with the events.
+  for (std::string function : { "cudaLaunchKernel", "cuMemcpyDtoD" }) {
+    auto category = std::find_if(lines.begin(), lines.end(),
+                                 [&](const std::string &line) {
+      return line.starts_with("@K ") && line.ends_with(" " + function);
+    });
+    auto event = std::find_if(lines.begin(), lines.end(),
+                              [&](const std::string &line) {
+      return is_event(line, part_id, "enter " + function);
+    });
+    CHECK(event != lines.end() && category < event);
+  }
+
+  CHECK_EQUAL(events(lines, part_id).size(), 20);
+
+  CHECK_EQUAL(with_prefix(trace("runtime text", [](const std::string &) {
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaDeviceSynchronize_v3020, nullptr);
+  }), "@K").size(), 0);
+}
+
+// NVTX ranges are sent as calls of NVTX_RANGE_FUNCTION with the range
+// name as the symbol, in the order in which the thread pushes and pops
+// them.
+static void test_nvtx() {
+  std::string part_id;
+
+  auto lines = trace("runtime text " NVGPU_NVTX_CAPABILITY,
+                     [&](const std::string &id) {
+    part_id = id;
+
+    CHECK(stub_cupti::enabled(CUPTI_CB_DOMAIN_NVTX,
+                              CUPTI_CBID_NVTX_nvtxRangePushA));
+    CHECK(stub_cupti::enabled(CUPTI_CB_DOMAIN_NVTX,
+                              CUPTI_CBID_NVTX_nvtxRangePop));
+
+    // Pops of ranges pushed before the region are ignored.
+    CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePop, nullptr));
+
+    nvtxRangePushA_params outer = { "outer" };
+    CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePushA, &outer));
+
+    nvtxEventAttributes_t attributes = {};
+    attributes.messageType = NVTX_MESSAGE_TYPE_ASCII;
+    attributes.message.ascii = "inner\nrange";
+    nvtxRangePushEx_params inner = { &attributes };
+    CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePushEx, &inner));
+
+    CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePop, nullptr));
+    CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePop, nullptr));
+
+    nvtxRangePushA_params unnamed = { nullptr };
+    CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePushA, &unnamed));
+    CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePop, nullptr));
+  });
+
+  std::vector<std::string> expected = {
+    "enter " NVTX_RANGE_FUNCTION " outer",
+    "enter " NVTX_RANGE_FUNCTION " inner range",
+    "exit " NVTX_RANGE_FUNCTION " inner range",
+    "exit " NVTX_RANGE_FUNCTION " outer",
+    "enter " NVTX_RANGE_FUNCTION " unnamed",
+    "exit " NVTX_RANGE_FUNCTION " unnamed"
+  };
+
+  CHECK(events(lines, part_id) == expected);
+}
+
+// In the binary protocol, range names are defined once per process
+// with "@S" and NVTX_RANGE_FUNCTION once with "@F".
+static void test_nvtx_binary() {
+  std::string part_id;
+
+  auto lines = trace("runtime " NVGPU_BINARY_PROTOCOL " "
+                     NVGPU_NVTX_CAPABILITY, [&](const std::string &id) {
+    part_id = id;
+
+    nvtxRangePushA_params outer = { "outer" };
+    nvtxRangePushA_params inner = { "inner" };
+
+    for (int i = 0; i < 2; i++) {
+      CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePushA, &outer));
+      CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePushA, &inner));
+      CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePop, nullptr));
+      CHECK(stub_cupti::nvtx_call(CUPTI_CBID_NVTX_nvtxRangePop, nullptr));
+    }
+  });
+
+  std::string prefix = "@S" + std::to_string(getpid()) + " ";
+  CHECK_EQUAL(with_prefix(lines, "@F").size(), 1);
+  CHECK_EQUAL(with_prefix(lines, "@S").size(), 2);
+  CHECK_EQUAL(with_prefix(lines, prefix).size(), 2);
+
+  MessageDecoder decoder;
+  Message message;
+  std::vector<std::string> decoded;
+
+  for (auto &line : lines) {
+    if (line.starts_with("@F") || line.starts_with("@S")) {
+      CHECK_EQUAL(decoder.decode(line, message), MessageDecoder::DEFINITION);
+    } else if (!line.starts_with("@") && !line.empty() &&
+               CHECK_EQUAL(decoder.decode(line, message),
+                           MessageDecoder::EVENT)) {
+      CHECK_EQUAL(message.part_id, part_id);
+      decoded.push_back(std::string(message.state == Message::ENTER ?
+                                    "enter " : "exit ") +
+                        std::string(message.func_name));
+    }
+  }
+
+  std::vector<std::string> expected;
+
+  for (int i = 0; i < 2; i++) {
+    expected.insert(expected.end(), {
+        "enter " NVTX_RANGE_FUNCTION " outer",
+        "enter " NVTX_RANGE_FUNCTION " inner",
+        "exit " NVTX_RANGE_FUNCTION " inner",
+        "exit " NVTX_RANGE_FUNCTION " outer"
+      });
+  }
+
+  CHECK(decoded == expected);
+}
+
+// Returns the value of counter "name" in an "@O" line of "lines", or
+// -1 if there is no such counter.
+static long long counter(const std::vector<std::string> &lines,
+                         const std::string &name) {
+  for (auto &line : lines) {
+    if (!line.starts_with("@O")) {
+      continue;
+    }
+
+    std::string::size_type pos = line.find(" " + name + "=");
+
+    if (pos != std::string::npos) {
+      return std::stoll(line.substr(pos + name.size() + 2));
+    }
+  }
+
+  return -1;
+}
+
+// The "@G" line comes right before the enter event of every launch
+// and has the configuration of the runtime or driver API parameters.
+static void test_launch_config() {
+  cudaLaunchConfig_t runtime_config = {
+    { 16, 1, 1 }, { 64, 4, 1 }, 512, (cudaStream_t)0x2a, nullptr, 0
+  };
+  CUlaunchConfig driver_config = {
+    1, 2, 3, 32, 4, 1, 1024, (CUstream)0xabc, nullptr, 0
+  };
+  std::string part_id;
+
+  auto lines = trace("both text " NVGPU_LAUNCH_CAPABILITY,
+                     [&](const std::string &id) {
+    part_id = id;
+
+    cudaLaunchKernel_v7000_params launch = {
+      nullptr, { 4, 2, 1 }, { 128, 1, 1 }, nullptr, 256, (cudaStream_t)0x7f
+    };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, &launch,
+         "kernel(int)");
+
+    cudaLaunchKernelExC_v11060_params launch_ex = {
+      &runtime_config, nullptr, nullptr
+    };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernelExC_v11060, &launch_ex,
+         "kernel_ex(int)");
+
+    cuLaunchKernel_params cu_launch = {
+      nullptr, 8, 1, 1, 64, 2, 1, 0, nullptr, nullptr, nullptr
+    };
+    call(CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuLaunchKernel,
+         &cu_launch, "cu_kernel(int)");
+
+    cuLaunchKernelEx_params cu_launch_ex = {
+      &driver_config, nullptr, nullptr, nullptr
+    };
+    call(CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx,
+         &cu_launch_ex, "cu_kernel_ex(int)");
+
+    // No configuration to report.
+    cuLaunchKernelEx_params no_config = { nullptr, nullptr, nullptr,
+                                          nullptr };
+    call(CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuLaunchKernelEx,
+         &no_config, "cu_kernel_ex(int)");
+
+    cudaMemset_v3020_params memset = { nullptr, 0, 64, nullptr };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaMemset_v3020, &memset);
+  });
+
+  struct {
+    std::string config;
+    std::string event;
+  } expected[] = {
+    { "4,2,1 128,1,1 256 7f", "enter cudaLaunchKernel kernel(int)" },
+    { "16,1,1 64,4,1 512 2a", "enter cudaLaunchKernelExC kernel_ex(int)" },
+    { "8,1,1 64,2,1 0 0", "enter cuLaunchKernel cu_kernel(int)" },
+    { "1,2,3 32,4,1 1024 abc", "enter cuLaunchKernelEx cu_kernel_ex(int)" }
+  };
+
+  CHECK_EQUAL(with_prefix(lines, "@G").size(), 4);
+
+  for (auto &launch : expected) {
+    std::string line = "@G " + part_id + " " + launch.config;
+    CHECK(valid_launch_config(launch.config));
+    CHECK(is_event(line_after(lines, line), part_id, launch.event));
+  }
+
+  CHECK_EQUAL(with_prefix(trace("runtime text", [](const std::string &) {
+    cudaLaunchKernel_v7000_params launch = {
+      nullptr, { 1, 1, 1 }, { 1, 1, 1 }, nullptr, 0, nullptr
+    };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, &launch, "k()");
+  }), "@G").size(), 0);
+}
+
+// In the binary protocol, the "@G" line comes before the record of
+// the launch, whose symbol is defined for the process.
+static void test_launch_config_binary() {
+  std::string part_id;
+  auto lines = trace("runtime " NVGPU_BINARY_PROTOCOL " "
+                     NVGPU_LAUNCH_CAPABILITY, [&](const std::string &id) {
+    part_id = id;
+
+    cudaLaunchKernel_v7000_params launch = {
+      nullptr, { 4, 2, 1 }, { 128, 1, 1 }, nullptr, 0, nullptr
+    };
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, &launch,
+         "kernel(int)");
+  });
+
+  CHECK_EQUAL(with_prefix(lines, "@S").size(), 1);
+  CHECK_EQUAL(with_prefix(lines, "@S" + std::to_string(getpid()) +
+                          " ").size(), 1);
+
+  MessageDecoder decoder;
+  Message message;
+  std::string record = line_after(lines,
+                                 "@G " + part_id + " 4,2,1 128,1,1 0 0");
+
+  for (auto &line : lines) {
+    if (line.starts_with("@F") || line.starts_with("@S")) {
+      CHECK_EQUAL(decoder.decode(line, message), MessageDecoder::DEFINITION);
+    }
+  }
+
+  if (CHECK_EQUAL(decoder.decode(record, message), MessageDecoder::EVENT)) {
+    CHECK_EQUAL(message.part_id, part_id);
+    CHECK_EQUAL(message.state, Message::ENTER);
+    CHECK_EQUAL(message.func_name, "cudaLaunchKernel kernel(int)");
+  }
+}
+
+// Once the module has acknowledged the overhead capability, closing
+// the injection part sends its counters: the callbacks made in
+// a region, not those of threads outside any, and the bytes of
+// everything sent before.
+static void test_overhead() {
+  auto lines = trace("runtime text " NVGPU_OVERHEAD_CAPABILITY,
+                     [&](const std::string &id) {
+    for (int i = 0; i < 3; i++) {
+      call(CUPTI_CB_DOMAIN_RUNTIME_API,
+           CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, nullptr, "k()");
+    }
+
+    // Outside any region.
+    std::thread other([]() {
+      call(CUPTI_CB_DOMAIN_RUNTIME_API,
+           CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020, nullptr);
+    });
+
+    other.join();
+  });
+
+  unsigned long long bytes = 0;
+
+  for (auto &message : inject_host::sent()) {
+    if (!message.starts_with("@O")) {
+      bytes += message.size() + 1;
+    }
+  }
+
+  CHECK(lines.back().starts_with("@O"));
+  CHECK_EQUAL(counter(lines, "callbacks"), 6);
+  CHECK_EQUAL(counter(lines, "traced_callbacks"), 6);
+  CHECK(counter(lines, "callback_time") >= 0);
+  CHECK_EQUAL(counter(lines, "bytes_sent"), bytes);
+  CHECK_EQUAL(counter(lines, "send_failures"), 0);
+
+  // Older modules never see the line.
+  lines = trace("runtime text", [&](const std::string &id) {
+    call(CUPTI_CB_DOMAIN_RUNTIME_API,
+         CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, nullptr, "k()");
+  });
+
+  CHECK_EQUAL(counter(lines, "callbacks"), -1);
+}
+
+// Many threads make calls at once while the module reads batches more
+// slowly than they are made, so their buffers fill up. With the BLOCK
+// policy, every event of every thread still arrives exactly once and
+// in order.
+static void test_many_threads() {
+  constexpr int THREADS = 16;
+  constexpr int CALLS = 4000;
+
+  std::mutex lock;
+  std::vector<std::string> messages;
+
+  inject_host::reset();
+  stub_cupti::reset();
+  inject_host::set_transport([&](std::string_view message) {
+    std::this_thread::sleep_for(std::chrono::milliseconds(2));
+    std::unique_lock guard(lock);
+    messages.emplace_back(message);
+    return true;
+  }, [](std::string &reply) {
+    reply = "runtime text";
+    return true;
+  });
+
+  if (!CHECK_EQUAL(adaptyst_init(MODULE_ID), ADAPTYST_MODULE_OK)) {
+    adaptyst_close(MODULE_ID);
+    return;
+  }
+
+  std::vector<std::string> part_ids(THREADS);
+  std::vector<std::thread> threads;
+
+  for (int i = 0; i < THREADS; i++) {
+    threads.emplace_back([&, i]() {
+      std::string part_id = this_part_id();
+      part_ids[i] = part_id;
+      CHECK_EQUAL(adaptyst_region_start(MODULE_ID, part_id.c_str(), "region",
+                                        "0"), ADAPTYST_MODULE_OK);
+
+      for (int j = 0; j < CALLS; j++) {
+        std::string symbol = "k" + std::to_string(j);
+        call(CUPTI_CB_DOMAIN_RUNTIME_API,
+             CUPTI_RUNTIME_TRACE_CBID_cudaLaunchKernel_v7000, nullptr,
+             symbol.c_str());
+      }
+
+      CHECK_EQUAL(adaptyst_region_end(MODULE_ID, part_id.c_str(), "region",
+                                      "0"), ADAPTYST_MODULE_OK);
+    });
+  }
+
+  for (auto &thread : threads) {
+    thread.join();
+  }
+
+  adaptyst_close(MODULE_ID);
+
+  std::vector<std::string> lines;
+
+  for (auto &message : messages) {
+    std::string::size_type start = 0;
+
+    while (start <= message.size()) {
+      std::string::size_type end = message.find('\n', start);
+      lines.push_back(message.substr(start, end - start));
+      start = end == std::string::npos ? message.size() + 1 : end + 1;
+    }
+  }
+
+  std::vector<std::string> expected;
+
+  for (int j = 0; j < CALLS; j++) {
+    std::string symbol = " k" + std::to_string(j);
+    expected.push_back("enter cudaLaunchKernel" + symbol);
+    expected.push_back("exit cudaLaunchKernel" + symbol);
+  }
+
+  for (auto &part_id : part_ids) {
+    CHECK(events(lines, part_id) == expected);
+  }
+
+  CHECK_EQUAL(with_prefix(lines, "@L").size(), 0);
+}
+
+// The module reads nothing until a thread has made all its calls, so
+// its buffer fills up. With the DROP and SAMPLE policies, the thread
+// is never held up and every event is either sent or counted as lost:
+// the "@L" lines of the thread and the "@A" line add up to the events
+// left out, and the events sent are whole calls.
+static void test_slow_consumer(const std::string &policy) {
+  constexpr int CALLS = 10000;
+
+  std::mutex lock;
+  std::vector<std::string> messages;
+  std::atomic<bool> blocked{false};
+
+  inject_host::reset();
+  stub_cupti::reset();
+  inject_host::set_transport([&](std::string_view message) {
+    while (blocked.load()) {
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    std::unique_lock guard(lock);
+    messages.emplace_back(message);
+    return true;
+  }, [&](std::string &reply) {
+    reply = "both text " NVGPU_POLICY_CAPABILITY " " + policy;
+    return true;
+  });
+
+  if (!CHECK_EQUAL(adaptyst_init(MODULE_ID), ADAPTYST_MODULE_OK)) {
+    adaptyst_close(MODULE_ID);
+    return;
+  }
+
+  blocked = true;
+  std::string part_id;
+
+  std::thread thread([&]() {
+    part_id = this_part_id();
+    CHECK_EQUAL(adaptyst_region_start(MODULE_ID, part_id.c_str(), "region",
+                                      "0"), ADAPTYST_MODULE_OK);
+
+    for (int i = 0; i < CALLS; i++) {
+      CHECK(stub_cupti::api_call(CUPTI_CB_DOMAIN_RUNTIME_API,
+                                 CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020,
+                                 CUPTI_API_ENTER));
+      call(CUPTI_CB_DOMAIN_DRIVER_API, CUPTI_DRIVER_TRACE_CBID_cuMemcpy,
+           nullptr);
+      CHECK(stub_cupti::api_call(CUPTI_CB_DOMAIN_RUNTIME_API,
+                                 CUPTI_RUNTIME_TRACE_CBID_cudaMemcpy_v3020,
+                                 CUPTI_API_EXIT));
+    }
+
+    CHECK_EQUAL(adaptyst_region_end(MODULE_ID, part_id.c_str(), "region",
+                                    "0"), ADAPTYST_MODULE_OK);
+  });
+
+  thread.join();
+  blocked = false;
+  adaptyst_close(MODULE_ID);
+
+  std::vector<std::string> lines;
+
+  for (auto &message : messages) {
+    std::istringstream stream(message);
+    std::string line;
+
+    while (std::getline(stream, line)) {
+      lines.push_back(line);
+    }
+  }
+
+  unsigned long long sent = 0;
+  unsigned long long lost = 0;
+  unsigned long long lost_functions = 0;
+  bool sent_after_loss = false;
+  bool nested = true;
+  std::vector<std::string> stack;
+
+  for (auto &line : lines) {
+    std::istringstream stream(line);
+    std::string first, part, state, function;
+    stream >> first;
+
+    if (first == "@L") {
+      unsigned long long count;
+      stream >> first >> part >> count;
+      CHECK_EQUAL(part, part_id);
+      lost += count;
+    } else if (first == "@A") {
+      std::string item;
+
+      while (stream >> item) {
+        std::string name = item.substr(0, item.find('='));
+        CHECK(name == "cudaMemcpy_v3020" || name == "cuMemcpy");
+        lost_functions += std::stoull(item.substr(item.find('=') + 1));
+      }
+    } else if (stream >> part >> state >> function && part == part_id) {
+      sent++;
+      sent_after_loss = sent_after_loss || lost > 0;
+
+      if (state == "enter") {
+        stack.push_back(function);
+      } else {
+        nested = nested && !stack.empty() && stack.back() == function;
+
+        if (!stack.empty()) {
+          stack.pop_back();
+        }
+      }
+    }
+  }
+
+  CHECK(lost > 0);
+  CHECK_EQUAL(sent + lost, 4ULL * CALLS);
+  CHECK_EQUAL(lost_functions, lost);
+  CHECK(nested);
+  CHECK(stack.empty());
+
+  // Only sampling lets calls through while the buffer is past its high
+  // water mark, reporting the calls left out before them.
+  CHECK_EQUAL(sent_after_loss, policy == "sample");
+}
+
+// Largest difference allowed between an event timestamp converted from
+// fast clock ticks and the Adaptyst clock at the time of the event.
+// Most of it is the error of the rate measured over the first 2 ms,
+// which adds up until the clock is calibrated again.
+static const unsigned long long CLOCK_ERROR_BOUND = 20000;
+
+// Events timestamped with the fast clock, converted back with
+// the calibration points sent before them as the module does, are
+// within CLOCK_ERROR_BOUND of adaptyst_get_timestamp() read around
+// the call. The Adaptyst clock runs 0.05% faster than the fast clock
+// and calls are made for longer than the calibration interval, so
+// the rate and the recalibration are both needed.
+static void test_fast_clock() {
+  constexpr int CALLS = 250;
+
+  auto adaptyst_clock = []() {
+    return 5000000000ULL +
+      (unsigned long long)(inject_host::steady_timestamp() * 1.0005);
+  };
+
+  inject_host::reset();
+  stub_cupti::reset();
+  inject_host::set_reply("runtime text " NVGPU_CLOCK_CAPABILITY);
+  inject_host::set_clock(adaptyst_clock);
+
+  if (!CHECK_EQUAL(adaptyst_init(MODULE_ID), ADAPTYST_MODULE_OK)) {
+    adaptyst_close(MODULE_ID);
+    return;
+  }
+
+  std::string part_id;
+  std::vector<std::pair<unsigned long long, unsigned long long> > bounds;
+
+  std::thread thread([&]() {
+    part_id = this_part_id();
+    CHECK_EQUAL(adaptyst_region_start(MODULE_ID, part_id.c_str(), "region",
+                                      "0"), ADAPTYST_MODULE_OK);
+
+    for (int i = 0; i < CALLS; i++) {
+      unsigned long long before = adaptyst_clock();
+      call(CUPTI_CB_DOMAIN_RUNTIME_API,
+           CUPTI_RUNTIME_TRACE_CBID_cudaDeviceSynchronize_v3020, nullptr);
+      bounds.emplace_back(before, adaptyst_clock());
+      std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+
+    CHECK_EQUAL(adaptyst_region_end(MODULE_ID, part_id.c_str(), "region",
+                                    "0"), ADAPTYST_MODULE_OK);
+  });
+
+  thread.join();
+  adaptyst_close(MODULE_ID);
+
+  ClockConversion conversion;
+  std::size_t calibrations = 0;
+  std::size_t events = 0;
+  unsigned long long max_error = 0;
+
+  for (auto &line : inject_host::sent_lines()) {
+    std::istringstream stream(line);
+    std::string first, part;
+    stream >> first >> part;
+
+    if (first == "@C") {
+      FastClock::Point point;
+      double rate;
+
+      if (CHECK((bool)(stream >> point.ticks >> point.timestamp >> rate))) {
+        CHECK_EQUAL(part, std::to_string(getpid()));
+        conversion.set(point, rate);
+        calibrations++;
+      }
+    } else if (part == part_id && CHECK(calibrations > 0) &&
+               CHECK(events / 2 < bounds.size())) {
+      unsigned long long timestamp = conversion.convert(std::stoull(first));
+      auto [before, after] = bounds[events++ / 2];
+
+      if (timestamp < before) {
+        max_error = std::max(max_error, before - timestamp);
+      } else if (timestamp > after) {
+        max_error = std::max(max_error, timestamp - after);
+      }
+    }
+  }
+
+  CHECK_EQUAL(events, 2 * CALLS);
+  CHECK(calibrations >= 2);
+
+  if (!CHECK(max_error <= CLOCK_ERROR_BOUND)) {
+    std::cerr << "Largest clock error: " << max_error << " ns" << std::endl;
+  }
+}
+
+int main() {
+  test_filter();
+  test_filter_categories();
+  test_transfers();
+  test_categories();
+  test_nvtx();
+  test_nvtx_binary();
+  test_launch_config();
+  test_launch_config_binary();
+  test_overhead();
+  test_many_threads();
+  test_slow_consumer("drop");
+  test_slow_consumer("sample");
+  test_fast_clock();
+  return nvgpu_test::report();
+}
@@ -0,0 +1,169 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of decoding lines of the injection part in the text and
+// the binary protocol, with several processes sending to one module.
+
+#include <string>
+#include "message.hpp"
+#include "check.hpp"
+
+static std::string binary_event(unsigned long long timestamp, uint32_t pid,
+                                uint32_t tid, bool enter, uint8_t domain,
+                                uint16_t cbid, uint32_t symbol) {
+  BinaryHeader header = { timestamp, pid, tid, (uint8_t)(enter ? 0 : 1),
+                          domain, cbid, symbol };
+  char record[BINARY_RECORD_LENGTH + 1];
+  encode_binary_header(header, record);
+  return record;
+}
+
+// Decodes "line", which must be an event, into strings outliving
+// the next call to decode().
+static bool decode_event(MessageDecoder &decoder, const std::string &line,
+                         std::string &part_id, std::string &func_name,
+                         Message &message) {
+  if (!CHECK_EQUAL(decoder.decode(line, message), MessageDecoder::EVENT)) {
+    return false;
+  }
+
+  part_id = message.part_id;
+  func_name = message.func_name;
+  return true;
+}
+
+static void test_header() {
+  BinaryHeader header = { 123456789012345ULL, 4000000000U, 7, 1, 2, 0xabcd,
+                          0x12345678 };
+  char record[BINARY_RECORD_LENGTH + 1];
+  encode_binary_header(header, record);
+
+  BinaryHeader decoded;
+  CHECK(decode_binary_header(record, decoded));
+  CHECK_EQUAL(decoded.timestamp, header.timestamp);
+  CHECK_EQUAL(decoded.pid, header.pid);
+  CHECK_EQUAL(decoded.tid, header.tid);
+  CHECK_EQUAL((int)decoded.site, (int)header.site);
+  CHECK_EQUAL((int)decoded.domain, (int)header.domain);
+  CHECK_EQUAL(decoded.cbid, header.cbid);
+  CHECK_EQUAL(decoded.symbol, header.symbol);
+
+  record[5] = '!';
+  CHECK(!decode_binary_header(record, decoded));
+}
+
+// Two processes both number their first symbol 1, and their events
+// must decode to the same messages as in the text protocol.
+static void test_two_processes() {
+  MessageDecoder decoder;
+  Message message;
+
+  for (const char *definition : { "@F1 211 cudaLaunchKernel",
+                                  "@S100 1 kernel_a(int)",
+                                  "@S200 1 kernel_b(float*)",
+                                  "@S200 2 kernel_a(int)" }) {
+    CHECK_EQUAL(decoder.decode(definition, message),
+                MessageDecoder::DEFINITION);
+  }
+
+  struct {
+    std::string binary;
+    std::string text;
+  } events[] = {
+    { binary_event(10, 100, 7, true, 1, 211, 1),
+      "10 100_7 enter cudaLaunchKernel kernel_a(int)" },
+    { binary_event(11, 200, 8, true, 1, 211, 1),
+      "11 200_8 enter cudaLaunchKernel kernel_b(float*)" },
+    { binary_event(12, 200, 8, false, 1, 211, 1),
+      "12 200_8 exit cudaLaunchKernel kernel_b(float*)" },
+    { binary_event(13, 200, 8, true, 1, 211, 2),
+      "13 200_8 enter cudaLaunchKernel kernel_a(int)" },
+    { binary_event(14, 100, 7, false, 1, 211, 1),
+      "14 100_7 exit cudaLaunchKernel kernel_a(int)" },
+    { binary_event(BINARY_UNKNOWN_TIMESTAMP, 200, 9, true, 1, 211, 0),
+      "-1 200_9 enter cudaLaunchKernel" }
+  };
+
+  for (auto &event : events) {
+    std::string binary_part, binary_name, text_part, text_name;
+    Message binary, text;
+
+    if (!decode_event(decoder, event.binary, binary_part, binary_name,
+                      binary) ||
+        !decode_event(decoder, event.text, text_part, text_name, text)) {
+      continue;
+    }
+
+    CHECK_EQUAL(binary_part, text_part);
+    CHECK_EQUAL(binary_name, text_name);
+    CHECK_EQUAL(binary.timestamp_known, text.timestamp_known);
+    CHECK_EQUAL(binary.timestamp, text.timestamp);
+    CHECK_EQUAL(binary.state, text.state);
+  }
+
+  // Symbol 2 is defined by process 200 only.
+  CHECK_EQUAL(decoder.decode(binary_event(15, 100, 7, true, 1, 211, 2),
+                             message), MessageDecoder::INVALID);
+  CHECK_EQUAL(decoder.decode(binary_event(15, 300, 7, true, 1, 211, 1),
+                             message), MessageDecoder::INVALID);
+}
+
+// Full names built before a definition changes must not be used
+// afterwards, e.g. when a PID is reused by another process.
+static void test_redefinition() {
+  MessageDecoder decoder;
+  Message message;
+  std::string part_id, func_name;
+
+  decoder.decode("@F1 211 cudaLaunchKernel", message);
+  decoder.decode("@S100 1 old_kernel", message);
+
+  if (decode_event(decoder, binary_event(1, 100, 1, true, 1, 211, 1),
+                   part_id, func_name, message)) {
+    CHECK_EQUAL(func_name, "cudaLaunchKernel old_kernel");
+  }
+
+  decoder.decode("@S100 1 new_kernel", message);
+
+  if (decode_event(decoder, binary_event(2, 100, 1, true, 1, 211, 1),
+                   part_id, func_name, message)) {
+    CHECK_EQUAL(func_name, "cudaLaunchKernel new_kernel");
+  }
+
+  decoder.decode("@F1 211 cudaLaunchKernel_ptsz", message);
+
+  if (decode_event(decoder, binary_event(3, 100, 1, true, 1, 211, 1),
+                   part_id, func_name, message)) {
+    CHECK_EQUAL(func_name, "cudaLaunchKernel_ptsz new_kernel");
+  }
+
+  if (decode_event(decoder, binary_event(4, 100, 1, true, 1, 211, 0),
+                   part_id, func_name, message)) {
+    CHECK_EQUAL(func_name, "cudaLaunchKernel_ptsz");
+  }
+}
+
+static void test_invalid_definitions() {
+  MessageDecoder decoder;
+  Message message;
+
+  // A symbol must be defined with the PID of its process.
+  CHECK_EQUAL(decoder.decode("@S1 kernel", message),
+              MessageDecoder::INVALID);
+  CHECK_EQUAL(decoder.decode("@S100 0 kernel", message),
+              MessageDecoder::INVALID);
+  CHECK_EQUAL(decoder.decode("@S100 x kernel", message),
+              MessageDecoder::INVALID);
+  CHECK_EQUAL(decoder.decode("@F256 1 function", message),
+              MessageDecoder::INVALID);
+  CHECK_EQUAL(decoder.decode("@X1 2 name", message),
+              MessageDecoder::INVALID);
+}
+
+int main() {
+  test_header();
+  test_two_processes();
+  test_redefinition();
+  test_invalid_definitions();
+  return nvgpu_test::report();
+}
@@ -0,0 +1,189 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of ProcessSummary on random call trees of processes against
+// statistics computed from the trees directly, and of
+// parallel_reduce().
+
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <numeric>
+#include <algorithm>
+#include <sstream>
+#include <nlohmann/json.hpp>
+#include "process_summary.hpp"
+#include "check.hpp"
+
+static const char *NAMES[] = {
+  "cudaLaunchKernel kernel(float*, int)", "cudaMemcpy", "cuMemcpyHtoD",
+  "cudaDeviceSynchronize", "[other]"
+};
+
+// Lengths of every call path, given by its names, over the processes
+// making its calls.
+typedef std::map<std::vector<std::string>, std::vector<unsigned long long> >
+Lengths;
+
+// Makes the call tree of a process with random call paths, so that
+// only some processes make the calls of a path.
+static CallTree process_tree(std::mt19937_64 &random, NameTable &names,
+                             Lengths &lengths) {
+  CallTree tree;
+  std::map<uint32_t, std::vector<std::string> > paths = { { 0, {} } };
+
+  for (int i = random() % 20; i > 0; i--) {
+    uint32_t parent = random() % tree.size();
+    std::string name = NAMES[random() % (sizeof(NAMES) / sizeof(NAMES[0]))];
+    std::size_t size = tree.size();
+    uint32_t index = tree.child(parent, names.intern(name));
+
+    if (index == size) {
+      paths[index] = paths[parent];
+      paths[index].push_back(name);
+    }
+  }
+
+  // Lengths are set once all nodes exist, with every node as long as
+  // its own calls and those below it.
+  for (uint32_t i = tree.size() - 1; i > 0; i--) {
+    tree.node(i).length += 1 + random() % 100000;
+    tree.node(tree.node(i).parent).length += tree.node(i).length;
+  }
+
+  for (uint32_t i = 1; i < tree.size(); i++) {
+    lengths[paths[i]].push_back(tree.node(i).length);
+  }
+
+  return tree;
+}
+
+static std::string write_json(const ProcessSummary &summary,
+                              const NameTable &names) {
+  std::ostringstream stream;
+  summary.write_json(stream, names);
+  return stream.str();
+}
+
+// The summary as written by write_json(), computed from "lengths".
+static std::string expected_json(const Lengths &lengths,
+                                 unsigned long long processes) {
+  nlohmann::json data = nlohmann::json::object();
+
+  for (auto &[path, values] : lengths) {
+    nlohmann::json *node = &data;
+
+    for (std::size_t i = 0; i < path.size(); i++) {
+      node = &(*node)[path[i]];
+
+      if (i + 1 < path.size()) {
+        node = &(*node)["children"];
+      }
+    }
+
+    unsigned long long total = std::accumulate(values.begin(), values.end(),
+                                               0ULL);
+    unsigned long long max = *std::max_element(values.begin(), values.end());
+
+    // The processes not making the calls of the path count as 0.
+    unsigned long long min = values.size() < processes ? 0 :
+      *std::min_element(values.begin(), values.end());
+    double mean = (double)total / processes;
+
+    if (!node->contains("children")) {
+      (*node)["children"] = nlohmann::json::object();
+    }
+
+    (*node)["imbalance"] = max / mean - 1;
+    (*node)["max"] = max;
+    (*node)["mean"] = (unsigned long long)mean;
+    (*node)["min"] = min;
+    (*node)["processes"] = values.size();
+    (*node)["total"] = total;
+  }
+
+  return nlohmann::json({ { "data", data },
+                          { "processes", processes } }).dump();
+}
+
+// Summaries of single processes merged pairwise on any number of
+// threads, or read back from their JSON, give the statistics of every
+// call path over all processes, with those not making its calls
+// counting as 0.
+static void test_summary() {
+  for (unsigned int seed = 1; seed <= 10; seed++) {
+    std::mt19937_64 random(seed);
+    NameTable names;
+    Lengths lengths;
+    std::vector<CallTree> trees;
+    unsigned long long processes = 1 + random() % 40;
+
+    for (unsigned long long i = 0; i < processes; i++) {
+      trees.push_back(process_tree(random, names, lengths));
+    }
+
+    std::string expected = expected_json(lengths, processes);
+    std::vector<uint32_t> same_names(names.size());
+    std::iota(same_names.begin(), same_names.end(), 0);
+
+    for (unsigned int threads : { 1, 4 }) {
+      std::vector<ProcessSummary> summaries;
+
+      for (auto &tree : trees) {
+        summaries.emplace_back(tree);
+      }
+
+      parallel_reduce(summaries, threads, [&](ProcessSummary &a,
+                                              const ProcessSummary &b) {
+        a.merge(b, same_names);
+      });
+
+      if (!CHECK_EQUAL(write_json(summaries[0], names), expected)) {
+        return;
+      }
+    }
+
+    // A summary of part of the processes read back from JSON into one
+    // of the others.
+    ProcessSummary first, second;
+
+    for (unsigned long long i = 0; i < processes; i++) {
+      (i % 2 == 0 ? first : second).merge(ProcessSummary(trees[i]),
+                                          same_names);
+    }
+
+    first.merge_json(nlohmann::json::parse(write_json(second, names)),
+                     names);
+    CHECK_EQUAL(first.processes(), processes);
+    CHECK_EQUAL(write_json(first, names), expected);
+  }
+
+  CHECK_EQUAL(write_json(ProcessSummary(), NameTable()),
+              "{\"data\":{},\"processes\":0}");
+}
+
+// Every item is merged into the first one exactly once, whatever
+// the number of items and threads.
+static void test_parallel_reduce() {
+  for (unsigned int threads : { 1, 3, 8 }) {
+    for (unsigned long long count = 0; count <= 33; count++) {
+      std::vector<unsigned long long> items(count);
+      std::iota(items.begin(), items.end(), 1);
+      parallel_reduce(items, threads, [](unsigned long long &a,
+                                         unsigned long long b) {
+        a += b;
+      });
+
+      if (count > 0) {
+        CHECK_EQUAL(items[0], count * (count + 1) / 2);
+      }
+    }
+  }
+}
+
+int main() {
+  test_summary();
+  test_parallel_reduce();
+  return nvgpu_test::report();
+}
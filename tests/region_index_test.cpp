@@ -0,0 +1,132 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of RegionIndex against a linear scan of its intervals.
+
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include "region_index.hpp"
+#include "check.hpp"
+
+static std::vector<std::string> stab(const RegionIndex &index,
+                                     unsigned long long timestamp) {
+  std::vector<std::string> names;
+  index.stab(timestamp, [&](const std::string &name) {
+    names.push_back(name);
+  });
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+static std::vector<std::string> scan(
+  const std::vector<RegionIndex::Interval> &intervals,
+  unsigned long long timestamp) {
+  std::vector<std::string> names;
+
+  for (auto &interval : intervals) {
+    if (interval.start <= timestamp && timestamp <= interval.end) {
+      names.push_back(interval.name);
+    }
+  }
+
+  std::sort(names.begin(), names.end());
+  return names;
+}
+
+// Random intervals of every count up to 130 and around larger powers
+// of two, as the shape of the implicit tree depends on it. Intervals
+// are short or long, nested or overlapping, may share their start, and
+// some have undefined bounds. Timestamps are random and at every bound.
+static void test_random() {
+  std::mt19937_64 random(1);
+  std::size_t mismatches = 0;
+
+  std::vector<std::size_t> counts;
+
+  for (std::size_t n = 0; n <= 130; n++) {
+    counts.push_back(n);
+  }
+
+  counts.insert(counts.end(), { 255, 256, 257, 511, 512, 513, 1000 });
+
+  for (std::size_t n : counts) {
+    std::vector<RegionIndex::Interval> intervals;
+
+    for (std::size_t i = 0; i < n; i++) {
+      unsigned long long start = random() % 10000;
+      unsigned long long length = random() % 4 == 0 ? random() % 5000 :
+        random() % 50;
+
+      if (i > 0 && random() % 8 == 0) {
+        start = intervals[random() % i].start;
+      }
+
+      RegionIndex::Interval interval = { start, start + length,
+                                         "r" + std::to_string(i) };
+
+      if (random() % 16 == 0) {
+        interval.start = 0;
+      } else if (random() % 16 == 0) {
+        interval.end = (unsigned long long)-1;
+      }
+
+      intervals.push_back(interval);
+    }
+
+    RegionIndex index(intervals);
+    CHECK_EQUAL(index.size(), n);
+
+    std::vector<unsigned long long> timestamps = {
+      0, 10000, 20000, (unsigned long long)-1
+    };
+
+    for (auto &interval : intervals) {
+      timestamps.push_back(interval.start);
+      timestamps.push_back(interval.end);
+
+      if (interval.start > 0) {
+        timestamps.push_back(interval.start - 1);
+      }
+
+      if (interval.end != (unsigned long long)-1) {
+        timestamps.push_back(interval.end + 1);
+      }
+    }
+
+    for (int i = 0; i < 200; i++) {
+      timestamps.push_back(random() % 16000);
+    }
+
+    for (unsigned long long timestamp : timestamps) {
+      if (stab(index, timestamp) != scan(intervals, timestamp)) {
+        mismatches++;
+      }
+    }
+  }
+
+  CHECK_EQUAL(mismatches, 0);
+}
+
+// Every interval containing the timestamp is found once, however many
+// there are.
+static void test_all_overlapping() {
+  std::vector<RegionIndex::Interval> intervals;
+
+  for (int i = 0; i < 1000; i++) {
+    intervals.push_back({ (unsigned long long)i, 2000ULL - i,
+                          "r" + std::to_string(i) });
+  }
+
+  RegionIndex index(intervals);
+  CHECK_EQUAL(stab(index, 1000).size(), 1000);
+  CHECK_EQUAL(stab(index, 500).size(), 501);
+  CHECK(stab(index, 2001).empty());
+}
+
+int main() {
+  test_random();
+  test_all_overlapping();
+  return nvgpu_test::report();
+}
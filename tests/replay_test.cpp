@@ -0,0 +1,746 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of the aggregation of threads running in the same region at
+// once: their events are interleaved line by line, as the flusher of
+// the injection part sends them, and replayed into the module running
+// on the fake Adaptyst of module_host in a child process.
+
+#include <string>
+#include <vector>
+#include <map>
+#include <random>
+#include <algorithm>
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <filesystem>
+#include <thread>
+#include <chrono>
+#include <unistd.h>
+#include <sys/wait.h>
+#include <nlohmann/json.hpp>
+#include "module_host.hpp"
+#include "message.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+// Count and time of the calls of every call path, with names joined
+// by "/".
+typedef struct Calls {
+  unsigned long long count = 0;
+  unsigned long long time = 0;
+
+  bool operator==(const Calls &other) const {
+    return this->count == other.count && this->time == other.time;
+  }
+} Calls;
+
+typedef std::map<std::string, Calls> Paths;
+
+static std::ostream &operator<<(std::ostream &stream, const Paths &paths) {
+  for (auto &[path, calls] : paths) {
+    stream << path << ": " << calls.count << " " << calls.time << "; ";
+  }
+
+  return stream;
+}
+
+typedef struct Event {
+  bool enter;
+  std::string function;
+} Event;
+
+typedef struct Trace {
+  // Injection messages and control lines in the order to push them.
+  std::vector<std::string> messages;
+
+  // Expected calls of the region and of every part.
+  Paths region;
+  std::map<std::string, Paths> parts;
+} Trace;
+
+// Appends the events of a call and of random calls nested in it.
+static void random_call(std::mt19937 &random, int depth,
+                        std::vector<Event> &events) {
+  static const char *functions[] = {
+    "cudaLaunchKernel k0", "cudaLaunchKernel k1", "cudaMemcpy",
+    "cuLaunchKernel", "cudaDeviceSynchronize"
+  };
+
+  std::string function = functions[random() % 5];
+  events.push_back({ true, function });
+
+  if (depth < 3) {
+    int nested = random() % 3;
+
+    for (int i = 0; i < nested; i++) {
+      random_call(random, depth + 1, events);
+    }
+  }
+
+  events.push_back({ false, function });
+}
+
+// Makes "calls" top-level calls in every part, with the next event
+// always taken from a random part and timestamped by a clock common to
+// all parts. Lines are sent in batches of random size mixing parts.
+static Trace interleaved_trace(const std::vector<std::string> &part_ids,
+                               int calls, unsigned int seed) {
+  std::mt19937 random(seed);
+  std::vector<std::vector<Event> > events(part_ids.size());
+  std::vector<std::size_t> next(part_ids.size(), 0);
+  std::vector<std::vector<std::pair<std::string, unsigned long long> > >
+    stacks(part_ids.size());
+  Trace trace;
+
+  for (std::size_t i = 0; i < part_ids.size(); i++) {
+    for (int j = 0; j < calls; j++) {
+      random_call(random, 0, events[i]);
+    }
+
+    trace.messages.push_back("!R region " + part_ids[i] + " 1000");
+  }
+
+  unsigned long long time = 1000;
+  std::size_t remaining = part_ids.size();
+  std::string batch;
+  std::size_t batch_lines = 0;
+
+  while (remaining > 0) {
+    std::size_t part = random() % part_ids.size();
+
+    if (next[part] == events[part].size()) {
+      continue;
+    }
+
+    Event &event = events[part][next[part]++];
+    auto &stack = stacks[part];
+    time += 1 + random() % 20;
+
+    if (event.enter) {
+      std::string parent = stack.empty() ? "" : stack.back().first + "/";
+      stack.emplace_back(parent + event.function, time);
+    } else {
+      for (Paths *paths : { &trace.region, &trace.parts[part_ids[part]] }) {
+        Calls &calls = (*paths)[stack.back().first];
+        calls.count++;
+        calls.time += time - stack.back().second;
+      }
+
+      stack.pop_back();
+    }
+
+    if (!batch.empty()) {
+      batch += '\n';
+    }
+
+    batch += std::to_string(time) + " " + part_ids[part] +
+      (event.enter ? " enter " : " exit ") + event.function;
+
+    if (++batch_lines >= 1 + random() % 64) {
+      trace.messages.push_back(std::move(batch));
+      batch.clear();
+      batch_lines = 0;
+    }
+
+    if (next[part] == events[part].size()) {
+      remaining--;
+    }
+  }
+
+  if (!batch.empty()) {
+    trace.messages.push_back(std::move(batch));
+  }
+
+  for (auto &part_id : part_ids) {
+    trace.messages.push_back("!E region " + part_id + " " +
+                             std::to_string(time + 10));
+  }
+
+  return trace;
+}
+
+// Flattens a call tree of regions.json into "paths".
+static void flatten(const nlohmann::json &tree, const std::string &prefix,
+                    Paths &paths) {
+  for (auto &[name, node] : tree.items()) {
+    std::string path = prefix.empty() ? name : prefix + "/" + name;
+    paths[path] = { node.at("stats").at("count").get<unsigned long long>(),
+                    node.at("stats").at("time").get<unsigned long long>() };
+    flatten(node.at("children"), path, paths);
+  }
+}
+
+static Paths paths_of(const nlohmann::json &tree) {
+  Paths paths;
+  flatten(tree, "", paths);
+  return paths;
+}
+
+static nlohmann::json read_json(const fs::path &path) {
+  std::ifstream stream(path);
+
+  try {
+    return nlohmann::json::parse(stream);
+  } catch (nlohmann::json::exception &e) {
+    CHECK(false);
+    std::cerr << path << ": " << e.what() << std::endl;
+    return nlohmann::json();
+  }
+}
+
+typedef struct Replay {
+  unsigned int workers = 1;
+
+  // Whether the second half of the messages arrives only after
+  // the module has waited for a while, with the workflow still
+  // running.
+  bool pause = false;
+
+  bool overhead_correction = false;
+
+  // Whether the module is asked for the categories of functions.
+  bool categories = false;
+
+  bool per_process = false;
+
+  // Set to the contents of timeline.json, recorded only if it is not
+  // null, and of overhead.json.
+  nlohmann::json *timeline = nullptr;
+  nlohmann::json *overhead = nullptr;
+} Replay;
+
+// Runs the module on the messages of "trace" in a child process and
+// returns regions.json. The child fails if the module prints anything,
+// e.g. about an event not corresponding to the stack of its thread.
+static nlohmann::json replay(const Trace &trace, const Replay &options) {
+  fs::path dir = fs::temp_directory_path() /
+    ("nvgpu_replay_test_" + std::to_string(getpid()));
+  fs::remove_all(dir);
+  fs::create_directories(dir);
+
+  pid_t pid = fork();
+
+  if (pid == 0) {
+    module_host::set_module_dir(dir.string());
+    module_host::set_option("wire_protocol", "text");
+    module_host::set_option("per_thread", true);
+    module_host::set_option("per_process", options.per_process);
+    module_host::set_option("aggregation_threads", options.workers);
+    module_host::set_option("timeline",
+                            options.timeline ? "chrome" : "none");
+    module_host::set_option("overhead_correction",
+                            options.overhead_correction);
+    module_host::set_workflow_times(0, 1000000000);
+    module_host::push(options.categories ?
+                      "cuda_api_type text " NVGPU_CATEGORY_CAPABILITY :
+                      "cuda_api_type text");
+
+    std::size_t half = options.pause ? trace.messages.size() / 2 :
+      trace.messages.size();
+
+    for (std::size_t i = 0; i < half; i++) {
+      module_host::push(trace.messages[i]);
+    }
+
+    std::thread rest([&]() {
+      if (options.pause) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(100));
+      }
+
+      for (std::size_t i = half; i < trace.messages.size(); i++) {
+        module_host::push(trace.messages[i]);
+      }
+
+      module_host::finish();
+    });
+
+    bool success = module_host::run();
+    rest.join();
+
+    for (auto &message : module_host::printed()) {
+      std::cerr << message << std::endl;
+    }
+
+    _exit(success && module_host::printed().empty() ? 0 : 1);
+  }
+
+  int status;
+  CHECK(waitpid(pid, &status, 0) == pid && WIFEXITED(status) &&
+        WEXITSTATUS(status) == 0);
+
+  nlohmann::json result = read_json(dir / "regions.json");
+
+  if (options.timeline) {
+    *options.timeline = read_json(dir / "timeline.json");
+
+    for (auto &entry : fs::directory_iterator(dir)) {
+      CHECK(entry.path().extension() != ".bin");
+    }
+  }
+
+  if (options.overhead) {
+    *options.overhead = read_json(dir / "overhead.json");
+  }
+
+  fs::remove_all(dir);
+  return result;
+}
+
+// Threads of two processes make calls in the same region at once. No
+// event is dropped: the tree of the region has every call of every
+// thread, and the tree of every thread has exactly its own calls,
+// whichever number of aggregation threads handles them.
+static void test_interleaved() {
+  std::vector<std::string> part_ids;
+
+  for (int i = 1; i <= 8; i++) {
+    part_ids.push_back(std::to_string(i <= 4 ? 100 : 200) + "_" +
+                       std::to_string(i));
+  }
+
+  Trace trace = interleaved_trace(part_ids, 500, 1);
+
+  for (unsigned int workers : { 1U, 4U }) {
+    nlohmann::json regions = replay(trace, { .workers = workers });
+
+    if (!CHECK(regions.contains("region"))) {
+      continue;
+    }
+
+    const nlohmann::json &region = regions["region"];
+    CHECK_EQUAL(paths_of(region["data"]), trace.region);
+    CHECK(!region.contains("incomplete"));
+
+    if (CHECK(region.contains("threads"))) {
+      CHECK_EQUAL(region["threads"].size(), part_ids.size());
+
+      for (auto &part_id : part_ids) {
+        CHECK_EQUAL(paths_of(region["threads"][part_id]),
+                    trace.parts[part_id]);
+      }
+    }
+  }
+}
+
+// Events lost by a thread ("@L") make its region and the calls on its
+// stack at that point incomplete, but not the calls which have already
+// finished. Exits of calls whose enters have been lost are expected
+// then, so nothing is printed about them.
+static void test_losses() {
+  Trace trace;
+  auto events = [&](unsigned long long time, const std::string &part_id,
+                    const std::string &events) {
+    std::istringstream stream(events);
+    std::string state, function;
+    std::string message;
+
+    while (stream >> state >> function) {
+      time += 10;
+      message += (message.empty() ? "" : "\n") + std::to_string(time) + " " +
+        part_id + " " + state + " " + function;
+    }
+
+    trace.messages.push_back(message);
+  };
+
+  trace.messages.push_back("!R region 100_1 1000");
+  trace.messages.push_back("!R region 100_2 1000");
+  events(1000, "100_1", "enter cudaMemcpy enter cuMemcpy exit cuMemcpy "
+         "enter cudaDeviceSynchronize");
+  events(1000, "100_2", "enter cudaMemcpy exit cudaMemcpy");
+
+  // cudaDeviceSynchronize has lost a call of cuCtxSynchronize and
+  // the enter of a call of cuMemcpy, whose exit is then ignored.
+  trace.messages.push_back("@L 1050 100_1 3");
+  events(1100, "100_1", "exit cuMemcpy exit cudaDeviceSynchronize "
+         "exit cudaMemcpy enter cudaFree exit cudaFree");
+  trace.messages.push_back("@A cuCtxSynchronize=2 cuMemcpy=1");
+  trace.messages.push_back("!E region 100_1 2000");
+  trace.messages.push_back("!E region 100_2 2000");
+
+  nlohmann::json overhead;
+  nlohmann::json regions = replay(trace, { .overhead = &overhead });
+
+  if (!CHECK(regions.contains("region"))) {
+    return;
+  }
+
+  const nlohmann::json &region = regions["region"];
+  const nlohmann::json &memcpy = region["data"]["cudaMemcpy"];
+  const nlohmann::json &sync = memcpy["children"]["cudaDeviceSynchronize"];
+  CHECK_EQUAL(region.value("incomplete", false), true);
+  CHECK_EQUAL(memcpy.value("incomplete", false), true);
+  CHECK_EQUAL(sync.value("incomplete", false), true);
+  CHECK(!memcpy["children"]["cuMemcpy"].contains("incomplete"));
+  CHECK(!region["data"]["cudaFree"].contains("incomplete"));
+  CHECK_EQUAL(memcpy["stats"]["count"], 2);
+  CHECK_EQUAL(sync["stats"]["count"], 1);
+
+  // The thread which has lost nothing has a complete tree.
+  CHECK(!region["threads"]["100_2"].contains("incomplete"));
+  CHECK(!region["threads"]["100_2"]["cudaMemcpy"].contains("incomplete"));
+
+  CHECK_EQUAL(overhead["lost"]["threads"],
+              nlohmann::json({ { "100_1", 3 } }));
+  CHECK_EQUAL(overhead["lost"]["functions"],
+              nlohmann::json({ { "cuCtxSynchronize", 2 }, { "cuMemcpy", 1 } }));
+}
+
+// The module keeps waiting for messages while the workflow runs, even
+// if none arrives for longer than its receive timeout. The timeout
+// grows while it waits, so a pause of 100 ms takes a few timeouts
+// rather than one per millisecond.
+static void test_pause() {
+  Trace trace = interleaved_trace({ "100_1", "100_2" }, 200, 2);
+  nlohmann::json overhead;
+  nlohmann::json regions = replay(trace, { .pause = true,
+                                           .overhead = &overhead });
+
+  if (CHECK(regions.contains("region"))) {
+    CHECK_EQUAL(paths_of(regions["region"]["data"]), trace.region);
+  }
+
+  CHECK(overhead["module"]["receive_timeouts"].get<unsigned long long>() <
+        20);
+}
+
+// Every call is in timeline.json, on the thread of its part and with
+// its depth in the stack of the part.
+static void test_timeline() {
+  std::vector<std::string> part_ids = { "100_1", "100_2", "200_3" };
+  Trace trace = interleaved_trace(part_ids, 300, 3);
+
+  for (unsigned int workers : { 1U, 3U }) {
+    nlohmann::json timeline;
+    replay(trace, { .workers = workers, .timeline = &timeline });
+
+    if (!CHECK(timeline.contains("traceEvents"))) {
+      continue;
+    }
+
+    // Part IDs by thread ID, and the calls of every thread in the order
+    // of their starts.
+    std::map<int, std::string> threads;
+    std::map<int, std::vector<const nlohmann::json *> > calls;
+
+    for (auto &event : timeline["traceEvents"]) {
+      if (event["ph"] == "M" && event["name"] == "thread_name") {
+        threads[event["tid"].get<int>()] = event["args"]["name"];
+      } else if (event["ph"] == "X") {
+        calls[event["tid"].get<int>()].push_back(&event);
+      }
+    }
+
+    CHECK_EQUAL(threads.size(), part_ids.size());
+    std::map<std::string, Paths> parts;
+
+    for (auto &[tid, events] : calls) {
+      std::sort(events.begin(), events.end(), [](auto *a, auto *b) {
+        return (*a)["ts"].template get<double>() <
+          (*b)["ts"].template get<double>();
+      });
+
+      std::vector<std::string> stack;
+      Paths &paths = parts[threads[tid]];
+
+      for (auto *event : events) {
+        std::size_t depth = (*event)["args"]["depth"].get<std::size_t>();
+
+        if (!CHECK(depth <= stack.size())) {
+          break;
+        }
+
+        stack.resize(depth);
+        stack.push_back((stack.empty() ? "" : stack.back() + "/") +
+                        (*event)["name"].get<std::string>());
+
+        Calls &path_calls = paths[stack.back()];
+        path_calls.count++;
+        path_calls.time += std::llround((*event)["dur"].get<double>() * 1000);
+      }
+    }
+
+    for (auto &part_id : part_ids) {
+      CHECK_EQUAL(parts[part_id], trace.parts[part_id]);
+    }
+  }
+}
+
+// With overhead correction, two callbacks' worth of the time per call
+// reported by the injection part are taken away from a call path for
+// every call made inside it. overhead.json has the counters of both
+// sides.
+static void test_overhead() {
+  Trace trace = interleaved_trace({ "100_1", "100_2" }, 200, 4);
+  trace.messages.push_back("@O callbacks=5000 traced_callbacks=1000 "
+                           "callback_time=3000 bytes_sent=10 "
+                           "send_failures=0");
+
+  auto corrected = [](const Paths &paths) {
+    Paths result = paths;
+
+    for (auto &[path, calls] : result) {
+      unsigned long long nested = 0;
+
+      for (auto &[other, other_calls] : paths) {
+        if (other.starts_with(path + "/")) {
+          nested += other_calls.count;
+        }
+      }
+
+      calls.time = calls.time > 6 * nested ? calls.time - 6 * nested : 0;
+    }
+
+    return result;
+  };
+
+  nlohmann::json overhead;
+  nlohmann::json regions = replay(trace, { .overhead_correction = true,
+                                           .overhead = &overhead });
+
+  if (CHECK(regions.contains("region"))) {
+    CHECK_EQUAL(paths_of(regions["region"]["data"]),
+                corrected(trace.region));
+
+    for (auto &[part_id, paths] : trace.parts) {
+      CHECK_EQUAL(paths_of(regions["region"]["threads"][part_id]),
+                  corrected(paths));
+    }
+  }
+
+  unsigned long long events = 0;
+
+  for (auto &[path, calls] : trace.region) {
+    events += 2 * calls.count;
+  }
+
+  CHECK_EQUAL(overhead["module"]["events"], events);
+  CHECK_EQUAL(overhead["module"]["invalid"], 0);
+  CHECK_EQUAL(overhead["module"]["no_active_region"], 0);
+  CHECK_EQUAL(overhead["module"]["stack_mismatch"], 0);
+  CHECK_EQUAL(overhead["injection"]["callbacks"], 5000);
+  CHECK_EQUAL(overhead["injection"]["traced_callbacks"], 1000);
+  CHECK_EQUAL(overhead["injection"]["reports"], 1);
+  CHECK_EQUAL(overhead["callback_overhead"], 3.0);
+  CHECK_EQUAL(overhead["corrected"], true);
+
+  // Without correction, the trees are left as they are.
+  regions = replay(trace, { .overhead = &overhead });
+
+  if (CHECK(regions.contains("region"))) {
+    CHECK_EQUAL(paths_of(regions["region"]["data"]), trace.region);
+  }
+
+  CHECK_EQUAL(overhead["corrected"], false);
+}
+
+// The categories of the calls made directly in a region are totals of
+// its top-level nodes by function, with nested calls and functions of
+// no category, here cuLaunchKernel, left out or under "other".
+// Categories can arrive after the events of their functions.
+static void test_categories() {
+  Trace trace = interleaved_trace({ "100_1", "100_2" }, 100, 5);
+  trace.messages.insert(trace.messages.end() - 2, {
+    "@K launch cudaLaunchKernel", "@K memcpy cudaMemcpy",
+    "@K sync cudaDeviceSynchronize"
+  });
+
+  std::map<std::string, Calls> expected;
+
+  for (auto &[path, calls] : trace.region) {
+    if (path.find('/') != std::string::npos) {
+      continue;
+    }
+
+    std::string function = path.substr(0, path.find(' '));
+    std::string category = function == "cudaLaunchKernel" ? "launch" :
+      function == "cudaMemcpy" ? "memcpy" :
+      function == "cudaDeviceSynchronize" ? "sync" : "other";
+    expected[category].count += calls.count;
+    expected[category].time += calls.time;
+  }
+
+  nlohmann::json regions = replay(trace, { .categories = true });
+
+  if (!CHECK(regions.contains("region"))) {
+    return;
+  }
+
+  const nlohmann::json &categories = regions["region"]["categories"];
+  CHECK_EQUAL(categories.size(), expected.size());
+
+  for (auto &[category, calls] : expected) {
+    CHECK_EQUAL(categories[category]["count"], calls.count);
+    CHECK_EQUAL(categories[category]["time"], calls.time);
+  }
+
+  CHECK_EQUAL(paths_of(regions["region"]["data"]), trace.region);
+
+  // Without the capability, the lines are not expected and regions have
+  // no categories.
+  regions = replay(trace, {});
+
+  if (CHECK(regions.contains("region"))) {
+    CHECK(!regions["region"].contains("categories"));
+  }
+}
+
+// NVTX ranges are nodes of the call tree with the calls made in them
+// as children, and are looked through by the categories, as they are
+// not calls themselves.
+static void test_nvtx_categories() {
+  Trace trace;
+  trace.messages = {
+    "!R region 100_1 1000",
+    "@K memcpy cudaMemcpy\n@K sync cudaDeviceSynchronize",
+    "1010 100_1 enter [nvtx] outer\n"
+    "1020 100_1 enter cudaMemcpy\n"
+    "1030 100_1 enter cuMemcpy\n"
+    "1040 100_1 exit cuMemcpy\n"
+    "1050 100_1 exit cudaMemcpy\n"
+    "1060 100_1 enter [nvtx] inner\n"
+    "1070 100_1 enter cudaDeviceSynchronize\n"
+    "1100 100_1 exit cudaDeviceSynchronize\n"
+    "1110 100_1 exit [nvtx] inner\n"
+    "1120 100_1 exit [nvtx] outer\n"
+    "1130 100_1 enter cudaMemcpy\n"
+    "1150 100_1 exit cudaMemcpy",
+    "!E region 100_1 2000"
+  };
+
+  nlohmann::json regions = replay(trace, { .categories = true });
+
+  if (!CHECK(regions.contains("region"))) {
+    return;
+  }
+
+  const nlohmann::json &outer = regions["region"]["data"]["[nvtx] outer"];
+  CHECK_EQUAL(outer["stats"]["count"], 1);
+  CHECK_EQUAL(outer["children"]["cudaMemcpy"]["stats"]["count"], 1);
+  CHECK_EQUAL(outer["children"]["[nvtx] inner"]["children"]
+              ["cudaDeviceSynchronize"]["stats"]["time"], 30);
+  CHECK_EQUAL(regions["region"]["categories"], nlohmann::json({
+    { "memcpy", { { "count", 2 }, { "time", 50 } } },
+    { "sync", { { "count", 1 }, { "time", 30 } } }
+  }));
+}
+
+// Launches with "@G" lines before them are counted per configuration
+// under their node, whichever part and aggregation thread handles
+// them, and those without one are not.
+static void test_launches() {
+  Trace trace;
+  trace.messages = { "!R region 100_1 1000", "!R region 200_2 1000" };
+
+  for (const char *part_id : { "100_1", "200_2" }) {
+    std::string part = part_id;
+    trace.messages.push_back(
+      "@G " + part + " 4,1,1 128,1,1 0 0\n"
+      "1010 " + part + " enter cudaLaunchKernel k()\n"
+      "1020 " + part + " exit cudaLaunchKernel k()\n"
+      "@G " + part + " 32,2,1 256,1,1 1024 7f3a2c001e0\n"
+      "1030 " + part + " enter cudaLaunchKernel k()\n"
+      "1060 " + part + " exit cudaLaunchKernel k()\n"
+      "@G " + part + " 4,1,1 128,1,1 0 0\n"
+      "1070 " + part + " enter cudaLaunchKernel k()\n"
+      "1110 " + part + " exit cudaLaunchKernel k()\n"
+      "1120 " + part + " enter cudaLaunchKernel k()\n"
+      "1130 " + part + " exit cudaLaunchKernel k()");
+  }
+
+  trace.messages.push_back("!E region 100_1 2000");
+  trace.messages.push_back("!E region 200_2 2000");
+
+  for (unsigned int workers : { 1, 2 }) {
+    nlohmann::json regions = replay(trace, { .workers = workers });
+
+    if (!CHECK(regions.contains("region"))) {
+      return;
+    }
+
+    const nlohmann::json &node =
+      regions["region"]["data"]["cudaLaunchKernel k()"];
+    CHECK_EQUAL(node["stats"]["count"], 8);
+    CHECK_EQUAL(node["launches"], nlohmann::json({
+      { "4,1,1 128,1,1 0 0", { { "count", 4 }, { "max", 40 },
+                                { "time", 100 } } },
+      { "32,2,1 256,1,1 1024 7f3a2c001e0", { { "count", 2 },
+                                             { "max", 30 },
+                                             { "time", 60 } } }
+    }));
+  }
+}
+
+// With per_process, every process has the call tree of its parts, and
+// the summary has the total length of every top-level call path over
+// the processes.
+static void test_per_process() {
+  std::vector<std::string> part_ids = { "100_1", "100_2", "200_3" };
+  Trace trace = interleaved_trace(part_ids, 200, 6);
+  nlohmann::json regions = replay(trace, { .workers = 2,
+                                           .per_process = true });
+
+  if (!CHECK(regions.contains("region"))) {
+    return;
+  }
+
+  const nlohmann::json &region = regions["region"];
+  std::map<std::string, Paths> processes;
+
+  for (auto &[part_id, paths] : trace.parts) {
+    Paths &process = processes[part_id.substr(0, part_id.find('_'))];
+
+    for (auto &[path, calls] : paths) {
+      process[path].count += calls.count;
+      process[path].time += calls.time;
+    }
+  }
+
+  CHECK_EQUAL(region["processes"].size(), 2);
+
+  for (auto &[pid, paths] : processes) {
+    CHECK_EQUAL(paths_of(region["processes"][pid]), paths);
+  }
+
+  const nlohmann::json &summary = region["summary"];
+  CHECK_EQUAL(summary["processes"], 2);
+
+  for (auto &[name, node] : summary["data"].items()) {
+    unsigned long long total = 0;
+    unsigned long long count = 0;
+
+    for (auto &[pid, tree] : region["processes"].items()) {
+      if (tree.contains(name)) {
+        total += tree[name]["length"].get<unsigned long long>();
+        count++;
+      }
+    }
+
+    CHECK_EQUAL(node["total"], total);
+    CHECK_EQUAL(node["processes"], count);
+  }
+
+  // Without per_process, regions have neither.
+  regions = replay(trace, {});
+
+  if (CHECK(regions.contains("region"))) {
+    CHECK(!regions["region"].contains("processes"));
+    CHECK(!regions["region"].contains("summary"));
+  }
+}
+
+int main() {
+  test_interleaved();
+  test_losses();
+  test_pause();
+  test_timeline();
+  test_overhead();
+  test_categories();
+  test_nvtx_categories();
+  test_launches();
+  test_per_process();
+  return nvgpu_test::report();
+}
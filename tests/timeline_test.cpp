@@ -0,0 +1,145 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests of the timeline file written through a moving memory-mapped
+// window.
+
+#include <vector>
+#include <filesystem>
+#include <csignal>
+#include <unistd.h>
+#include <sys/resource.h>
+#include "timeline.hpp"
+#include "check.hpp"
+
+namespace fs = std::filesystem;
+
+static TimelineWriter::Record make_record(uint32_t i) {
+  return { 1000ULL * i, 1000ULL * i + 500, i % 7, i % 3, i, i % 5 };
+}
+
+// Records spanning several windows are read back in order, and
+// the file is truncated to them.
+static void test_round_trip() {
+  fs::path path = fs::temp_directory_path() /
+    ("nvgpu_timeline_test_" + std::to_string(getpid()) + ".bin");
+
+  // 2.5 windows of 8 MiB.
+  constexpr uint32_t RECORDS = 5 * 8 * 1024 * 1024 / 2 /
+    sizeof(TimelineWriter::Record);
+
+  {
+    TimelineWriter writer;
+
+    if (!CHECK(writer.open(path))) {
+      return;
+    }
+
+    for (uint32_t i = 0; i < RECORDS; i++) {
+      if (!CHECK(writer.append(make_record(i)))) {
+        std::cerr << writer.error() << std::endl;
+        return;
+      }
+    }
+
+    CHECK(writer.close());
+  }
+
+  CHECK_EQUAL(fs::file_size(path), RECORDS * sizeof(TimelineWriter::Record));
+
+  uint32_t count = 0;
+  bool same = true;
+
+  CHECK(TimelineWriter::read(path, [&](const TimelineWriter::Record &record) {
+    TimelineWriter::Record expected = make_record(count++);
+    same = same && record.start == expected.start &&
+      record.end == expected.end && record.part == expected.part &&
+      record.region == expected.region && record.name == expected.name &&
+      record.depth == expected.depth;
+  }));
+
+  CHECK_EQUAL(count, RECORDS);
+  CHECK(same);
+  fs::remove(path);
+}
+
+// A file with no records is empty.
+static void test_empty() {
+  fs::path path = fs::temp_directory_path() /
+    ("nvgpu_timeline_test_" + std::to_string(getpid()) + ".bin");
+
+  {
+    TimelineWriter writer;
+    CHECK(writer.open(path));
+  }
+
+  CHECK_EQUAL(fs::file_size(path), 0);
+
+  unsigned int count = 0;
+  CHECK(TimelineWriter::read(path, [&](const TimelineWriter::Record &) {
+    count++;
+  }));
+  CHECK_EQUAL(count, 0);
+  fs::remove(path);
+}
+
+// When the file cannot grow past the first window, append() fails
+// and close() keeps the records of that window.
+static void test_grow_failure() {
+  fs::path path = fs::temp_directory_path() /
+    ("nvgpu_timeline_test_" + std::to_string(getpid()) + ".bin");
+  constexpr uint32_t WINDOW_RECORDS = 8 * 1024 * 1024 /
+    sizeof(TimelineWriter::Record);
+
+  // The file may take 1.5 windows, so extending it fails with EFBIG
+  // instead of killing the process.
+  rlimit old_limit;
+  getrlimit(RLIMIT_FSIZE, &old_limit);
+  rlimit limit = { 12 * 1024 * 1024, old_limit.rlim_max };
+  auto old_handler = std::signal(SIGXFSZ, SIG_IGN);
+
+  if (!CHECK(setrlimit(RLIMIT_FSIZE, &limit) == 0)) {
+    std::signal(SIGXFSZ, old_handler);
+    return;
+  }
+
+  {
+    TimelineWriter writer;
+
+    if (CHECK(writer.open(path))) {
+      for (uint32_t i = 0; i < WINDOW_RECORDS; i++) {
+        if (!CHECK(writer.append(make_record(i)))) {
+          break;
+        }
+      }
+
+      CHECK(!writer.append(make_record(WINDOW_RECORDS)));
+      CHECK(!writer.append(make_record(WINDOW_RECORDS)));
+      CHECK(writer.close());
+    }
+  }
+
+  setrlimit(RLIMIT_FSIZE, &old_limit);
+  std::signal(SIGXFSZ, old_handler);
+
+  CHECK_EQUAL(fs::file_size(path),
+              WINDOW_RECORDS * sizeof(TimelineWriter::Record));
+
+  uint32_t count = 0;
+  bool same = true;
+
+  CHECK(TimelineWriter::read(path, [&](const TimelineWriter::Record &record) {
+    same = same && record.start == make_record(count++).start;
+  }));
+
+  CHECK_EQUAL(count, WINDOW_RECORDS);
+  CHECK(same);
+  fs::remove(path);
+}
+
+int main() {
+  test_round_trip();
+  test_empty();
+  test_grow_failure();
+  return nvgpu_test::report();
+}
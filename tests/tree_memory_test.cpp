@@ -0,0 +1,162 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Tests that a call tree with a node limit from CallTree::node_limit()
+// stays within its memory budget on an adversarial trace, where every
+// kernel launch has a different symbol, and measures the memory taken
+// by the names of such a trace in a shard, which the budget does not
+// cover. The heap is measured by replacing the global operator new and
+// delete.
+
+#include <string>
+#include <vector>
+#include <atomic>
+#include <new>
+#include <cstdlib>
+#include <malloc.h>
+#include "call_tree.hpp"
+#include "message.hpp"
+#include "check.hpp"
+
+static std::atomic<long long> allocated{0};
+static std::atomic<long long> peak{0};
+
+void *operator new(std::size_t size) {
+  void *ptr = std::malloc(size == 0 ? 1 : size);
+
+  if (!ptr) {
+    throw std::bad_alloc();
+  }
+
+  long long current = allocated += malloc_usable_size(ptr);
+  long long previous = peak.load();
+
+  while (current > previous && !peak.compare_exchange_weak(previous,
+                                                           current)) {
+  }
+
+  return ptr;
+}
+
+void operator delete(void *ptr) noexcept {
+  if (ptr) {
+    allocated -= malloc_usable_size(ptr);
+    std::free(ptr);
+  }
+}
+
+void operator delete(void *ptr, std::size_t size) noexcept {
+  operator delete(ptr);
+}
+
+static const unsigned int SYMBOLS = 1000000;
+
+// Launches every symbol once, as a runtime call with a driver call
+// inside it, pruning as the module does. Returns the peak heap taken
+// by the tree.
+static long long launch_all(const std::vector<uint32_t> &symbols,
+                            uint32_t launch, uint32_t other,
+                            std::size_t memory) {
+  long long start = allocated.load();
+  peak = start;
+
+  {
+    CallTree tree;
+    tree.set_node_limit(CallTree::node_limit(memory));
+
+    for (unsigned int i = 0; i < SYMBOLS; i++) {
+      uint32_t runtime = tree.child(CallTree::ROOT, launch);
+      uint32_t driver = tree.child(runtime, symbols[i]);
+      tree.add_call(driver, 10 + i % 100);
+      tree.node(driver).length += 10 + i % 100;
+      tree.add_call(runtime, 20 + i % 100);
+      tree.node(runtime).length += 20 + i % 100;
+
+      if (tree.over_limit()) {
+        // The calls are done, so nothing is pinned.
+        tree.prune(other, {});
+      }
+    }
+
+    uint32_t runtime = tree.child(CallTree::ROOT, launch);
+    unsigned long long count = 0;
+
+    for (uint32_t i = tree.node(runtime).first_child; i != CallTree::NONE;
+         i = tree.node(i).next_sibling) {
+      count += tree.node(i).count;
+    }
+
+    CHECK_EQUAL(tree.node(runtime).count, SYMBOLS);
+    CHECK_EQUAL(count, SYMBOLS);
+    CHECK(tree.size() <= CallTree::node_limit(memory) + 1);
+  }
+
+  return peak - start;
+}
+
+// Defines every symbol and decodes a binary launch of it as a shard
+// does, interning the names of the events in "names". Returns the heap
+// taken by the names in the decoder and in "names".
+static long long intern_names(MessageDecoder &decoder, NameTable &names,
+                              std::vector<uint32_t> &symbols) {
+  long long start = allocated.load();
+  Message message;
+  char record[BINARY_RECORD_LENGTH + 1];
+  CHECK_EQUAL(decoder.decode("@F2 211 cuLaunchKernel", message),
+              MessageDecoder::DEFINITION);
+
+  for (unsigned int i = 0; i < SYMBOLS; i++) {
+    std::string definition = "@S1 " + std::to_string(i + 1) + " kernel_" +
+      std::to_string(i) + "(float*, int)";
+    encode_binary_header({ 1000, 1, 1, 0, 2, 211, i + 1 }, record);
+
+    if (!CHECK_EQUAL(decoder.decode(definition, message),
+                     MessageDecoder::DEFINITION) ||
+        !CHECK_EQUAL(decoder.decode(std::string_view(record,
+                                                     BINARY_RECORD_LENGTH),
+                                    message), MessageDecoder::EVENT)) {
+      break;
+    }
+
+    symbols.push_back(names.intern(message.func_name));
+  }
+
+  return allocated.load() - start;
+}
+
+int main() {
+  MessageDecoder decoder;
+  NameTable names;
+  std::vector<uint32_t> symbols;
+  symbols.reserve(SYMBOLS);
+
+  // Names are shared by all trees of a shard and kept for the whole
+  // session, so they are not part of the budget of a tree.
+  long long names_used = intern_names(decoder, names, symbols);
+  uint32_t launch = names.intern("cudaLaunchKernel");
+  uint32_t other = names.intern(CallTree::OTHER_NAME);
+
+  // About 0.5 KiB per kernel, as documented for tree_memory_limit.
+  if (!CHECK(names_used <= (long long)SYMBOLS * 640)) {
+    std::cerr << "Names: " << names_used << " bytes used" << std::endl;
+  }
+
+  for (std::size_t mib : { 1, 16 }) {
+    std::size_t memory = mib * 1024 * 1024;
+    long long used = launch_all(symbols, launch, other, memory);
+
+    if (!CHECK(used <= (long long)memory)) {
+      std::cerr << mib << " MiB: " << used << " bytes used" << std::endl;
+    }
+
+    // The budget is not so loose that it wastes most of the memory.
+    CHECK(used >= (long long)memory / 2);
+
+    std::cout << mib << " MiB limit, " << SYMBOLS << " kernels: "
+              << used << " bytes of tree, " << names_used
+              << " bytes of names, " << used + names_used
+              << " bytes in total" << std::endl;
+  }
+
+  return nvgpu_test::report();
+}
@@ -0,0 +1,166 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Compares the regions.json files of baseline and candidate runs of
+// the module, aligning their call trees by path (region name followed
+// by the names of the nodes), and reports the nodes whose mean length
+// has changed by more than the noise between repeated runs. Exits
+// with 1 if a node has got slower by more than the budget.
+//
+// Files are read in fixed-size chunks and parsed with a SAX handler
+// which keeps only the length of every node of "data", so the memory
+// used depends on the number of call paths rather than the size of
+// the files. Files are read in parallel.
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <iomanip>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include "profile_diff.hpp"
+
+static void usage(const char *program) {
+  std::cerr << "Usage: " << program << " [-t <percent>] [-s <sigmas>] "
+            << "[-m <ns>] [-k <count>] [-j <threads>] "
+            << "<baseline>... -- <candidate>..." << std::endl
+            << "       " << program << " [options] <baseline> <candidate>"
+            << std::endl
+            << "Compares regions.json files of the nvgpu module by call "
+            << "path, with every side being the mean of one or more runs."
+            << std::endl
+            << "  -t  exit with 1 if a path gets slower by more than "
+            << "<percent> (default: no budget)" << std::endl
+            << "  -s  report changes larger than <sigmas> standard "
+            << "deviations of the noise between repeated runs (default: 3)"
+            << std::endl
+            << "  -m  report changes of at least <ns> nanoseconds only "
+            << "(default: 0)" << std::endl
+            << "  -k  print the <count> largest changes, 0 for all "
+            << "(default: 20)" << std::endl
+            << "  -j  read files on <threads> threads (default: all "
+            << "hardware threads)" << std::endl;
+}
+
+int main(int argc, char **argv) {
+  double budget = -1;
+  double sigmas = 3;
+  double min_change = 0;
+  std::size_t top = 20;
+  unsigned int threads = std::max(std::thread::hardware_concurrency(), 1U);
+  std::vector<std::string> inputs;
+  std::size_t baseline_count = 0;
+
+  for (int i = 1; i < argc; i++) {
+    std::string arg = argv[i];
+
+    if (arg == "--") {
+      baseline_count = inputs.size();
+    } else if (arg.size() == 2 && arg[0] == '-' && i + 1 < argc &&
+               std::strchr("tsmkj", arg[1])) {
+      double value = std::atof(argv[++i]);
+
+      switch (arg[1]) {
+      case 't': budget = value; break;
+      case 's': sigmas = value; break;
+      case 'm': min_change = value; break;
+      case 'k': top = value; break;
+      case 'j': threads = std::max(value, 1.0); break;
+      }
+    } else if (arg[0] == '-') {
+      usage(argv[0]);
+      return 2;
+    } else {
+      inputs.push_back(arg);
+    }
+  }
+
+  if (baseline_count == 0 && inputs.size() == 2) {
+    baseline_count = 1;
+  }
+
+  if (baseline_count == 0 || baseline_count == inputs.size()) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  threads = std::min<std::size_t>(threads, inputs.size());
+
+  std::vector<PathTable> tables(inputs.size());
+  std::vector<std::string> errors(inputs.size());
+  std::atomic<std::size_t> next = 0;
+
+  auto work = [&]() {
+    for (std::size_t i = next++; i < inputs.size(); i = next++) {
+      read_profile(inputs[i], tables[i], errors[i]);
+    }
+  };
+
+  std::vector<std::thread> workers;
+
+  for (unsigned int i = 1; i < threads; i++) {
+    workers.emplace_back(work);
+  }
+
+  work();
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  for (auto &error : errors) {
+    if (!error.empty()) {
+      std::cerr << error << std::endl;
+      return 2;
+    }
+  }
+  Diff diff = compare_profiles(tables, baseline_count,
+                               { budget, sigmas, min_change });
+
+  if (top != 0 && diff.changes.size() > top) {
+    diff.changes.resize(top);
+  }
+
+  std::cout << "change\tpercent\tbaseline\tcandidate\tnoise\tpath"
+            << std::endl << std::fixed;
+
+  for (auto &change : diff.changes) {
+    std::vector<std::string_view> names = diff.paths.names_of(change.path);
+
+    std::cout << std::setprecision(0) << std::showpos
+              << change.candidate - change.baseline << '\t'
+              << std::setprecision(1);
+
+    if (change.baseline == 0) {
+      std::cout << "new";
+    } else {
+      std::cout << (change.candidate - change.baseline) / change.baseline * 100
+                << '%';
+    }
+
+    std::cout << std::noshowpos << std::setprecision(0) << '\t'
+              << change.baseline << '\t' << change.candidate << '\t'
+              << change.noise << '\t';
+
+    for (std::size_t j = 0; j < names.size(); j++) {
+      std::cout << (j == 0 ? "" : " > ") << names[j];
+    }
+
+    std::cout << std::endl;
+  }
+
+  std::cerr << diff.paths.paths.size() - 1 << " paths compared, "
+            << diff.regressions << " slower, " << diff.improvements
+            << " faster";
+
+  if (budget >= 0) {
+    std::cerr << ", " << diff.over_budget << " over the budget of "
+              << budget << '%';
+  }
+
+  std::cerr << std::endl;
+  return diff.over_budget > 0 ? 1 : 0;
+}
@@ -0,0 +1,289 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+// Merges regions.json files written by the module, e.g. on different
+// nodes of a cluster, into one: the call trees and categories of every
+// region are added up and the process summaries are combined, with
+// a file without "summary" counted as a single process. "processes"
+// and "threads" are not written, as they would grow with the number
+// of files.
+//
+// Files are read by a pool of threads, each of which merges the files
+// it has read into its own profile, and the profiles of the threads
+// are then merged pairwise in parallel (see parallel_reduce()).
+
+#include <string>
+#include <vector>
+#include <map>
+#include <fstream>
+#include <iostream>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <nlohmann/json.hpp>
+#include "call_tree.hpp"
+#include "process_summary.hpp"
+
+typedef struct Category {
+  unsigned long long count;
+  unsigned long long time;
+} Category;
+
+typedef struct Region {
+  CallTree tree;
+  ProcessSummary summary;
+  std::map<std::string, Category> categories;
+
+  // Whether start and end are set.
+  bool defined;
+  unsigned long long start;
+  unsigned long long end;
+} Region;
+
+// Everything read from some of the files, with names in its own table
+// so that profiles can be built without sharing anything.
+typedef struct Profile {
+  NameTable names;
+  std::map<std::string, Region> regions;
+} Profile;
+
+static void merge_times(Region &target, bool defined, unsigned long long start,
+                        unsigned long long end) {
+  if (!defined) {
+    return;
+  }
+
+  if (!target.defined || start < target.start) {
+    target.start = start;
+  }
+
+  if (!target.defined || end > target.end) {
+    target.end = end;
+  }
+
+  target.defined = true;
+}
+
+// Adds the regions of a regions.json file to a profile. Throws
+// nlohmann::json::exception if the file is not in this format.
+static void read_profile(const nlohmann::json &json, Profile &profile) {
+  for (auto &[name, source] : json.items()) {
+    Region &region = profile.regions[name];
+    CallTree tree;
+    tree.merge_json(source.at("data"), profile.names);
+
+    if (source.value("incomplete", false)) {
+      tree.mark_incomplete(CallTree::ROOT);
+    }
+
+    std::vector<uint32_t> name_map(profile.names.size());
+
+    for (uint32_t i = 0; i < profile.names.size(); i++) {
+      name_map[i] = i;
+    }
+
+    region.tree.merge(tree, name_map);
+
+    if (source.contains("summary")) {
+      region.summary.merge_json(source["summary"], profile.names);
+    } else {
+      region.summary.merge(ProcessSummary(tree), name_map);
+    }
+
+    if (source.contains("categories")) {
+      for (auto &[category, stats] : source["categories"].items()) {
+        region.categories[category].count +=
+          stats.at("count").get<unsigned long long>();
+        region.categories[category].time +=
+          stats.at("time").get<unsigned long long>();
+      }
+    }
+
+    if (source.contains("start")) {
+      unsigned long long start = source["start"];
+      merge_times(region, true, start,
+                  start + source.at("length").get<unsigned long long>());
+    }
+  }
+}
+
+// Parser callback dropping "processes" and "threads" of the regions
+// while a file is parsed, as most of a file can be in them.
+static bool skip_unmerged(int depth, nlohmann::json::parse_event_t event,
+                          nlohmann::json &parsed) {
+  return event != nlohmann::json::parse_event_t::key || depth != 2 ||
+    (parsed != "processes" && parsed != "threads");
+}
+
+// Adds "source" to "target", leaving "source" unchanged.
+static void merge_profiles(Profile &target, const Profile &source) {
+  std::vector<uint32_t> name_map(source.names.size());
+
+  for (uint32_t i = 0; i < source.names.size(); i++) {
+    name_map[i] = target.names.intern(source.names.name(i));
+  }
+
+  for (auto &[name, region] : source.regions) {
+    Region &target_region = target.regions[name];
+    target_region.tree.merge(region.tree, name_map);
+    target_region.summary.merge(region.summary, name_map);
+
+    for (auto &[category, stats] : region.categories) {
+      target_region.categories[category].count += stats.count;
+      target_region.categories[category].time += stats.time;
+    }
+
+    merge_times(target_region, region.defined, region.start, region.end);
+  }
+}
+
+// Writes a profile in the regions.json format, in the same way as
+// nlohmann::json::dump().
+static bool write_profile(std::ostream &stream, const Profile &profile) {
+  stream << '{';
+
+  for (auto it = profile.regions.begin(); it != profile.regions.end(); it++) {
+    const Region &region = it->second;
+
+    if (it != profile.regions.begin()) {
+      stream << ',';
+    }
+
+    write_json_string(stream, it->first);
+    stream << ":{";
+
+    if (!region.categories.empty()) {
+      stream << "\"categories\":{";
+
+      for (auto category = region.categories.begin();
+           category != region.categories.end(); category++) {
+        if (category != region.categories.begin()) {
+          stream << ',';
+        }
+
+        write_json_string(stream, category->first);
+        stream << ":{\"count\":" << category->second.count << ",\"time\":"
+               << category->second.time << '}';
+      }
+
+      stream << "},";
+    }
+
+    stream << "\"data\":";
+    region.tree.write_json(stream, profile.names);
+
+    if (region.tree.incomplete(CallTree::ROOT)) {
+      stream << ",\"incomplete\":true";
+    }
+
+    if (region.defined) {
+      stream << ",\"length\":" << region.end - region.start
+             << ",\"start\":" << region.start;
+    }
+
+    stream << ",\"summary\":";
+    region.summary.write_json(stream, profile.names);
+    stream << '}';
+
+    if (!stream) {
+      return false;
+    }
+  }
+
+  stream << '}' << std::endl;
+  return (bool)stream;
+}
+
+static void usage(const char *program) {
+  std::cerr << "Usage: " << program << " [-j <threads>] [-o <output>] "
+            << "<regions.json>..." << std::endl
+            << "Merges regions.json files of the nvgpu module, writing "
+            << "the result to <output> (default: standard output) and "
+            << "using <threads> threads (default: all hardware threads)."
+            << std::endl;
+}
+
+int main(int argc, char **argv) {
+  unsigned int threads = std::max(std::thread::hardware_concurrency(), 1U);
+  std::string output;
+  std::vector<std::string> inputs;
+
+  for (int i = 1; i < argc; i++) {
+    if (!std::strcmp(argv[i], "-j") && i + 1 < argc) {
+      threads = std::max(std::atoi(argv[++i]), 1);
+    } else if (!std::strcmp(argv[i], "-o") && i + 1 < argc) {
+      output = argv[++i];
+    } else if (argv[i][0] == '-') {
+      usage(argv[0]);
+      return 2;
+    } else {
+      inputs.push_back(argv[i]);
+    }
+  }
+
+  if (inputs.empty()) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  threads = std::min<std::size_t>(threads, inputs.size());
+
+  std::vector<Profile> profiles(threads);
+  std::vector<std::string> errors(threads);
+  std::atomic<std::size_t> next = 0;
+
+  auto work = [&](unsigned int thread) {
+    for (std::size_t i = next++; i < inputs.size() && errors[thread].empty();
+         i = next++) {
+      std::ifstream stream(inputs[i]);
+
+      if (!stream) {
+        errors[thread] = "Could not open " + inputs[i];
+        break;
+      }
+
+      try {
+        read_profile(nlohmann::json::parse(stream, skip_unmerged),
+                     profiles[thread]);
+      } catch (nlohmann::json::exception &e) {
+        errors[thread] = "Could not read " + inputs[i] + ": " + e.what();
+      }
+    }
+  };
+
+  std::vector<std::thread> workers;
+
+  for (unsigned int i = 1; i < threads; i++) {
+    workers.emplace_back(work, i);
+  }
+
+  work(0);
+
+  for (auto &worker : workers) {
+    worker.join();
+  }
+
+  for (auto &error : errors) {
+    if (!error.empty()) {
+      std::cerr << error << std::endl;
+      return 1;
+    }
+  }
+
+  parallel_reduce(profiles, threads, merge_profiles);
+
+  if (output.empty()) {
+    return write_profile(std::cout, profiles[0]) ? 0 : 1;
+  }
+
+  std::ofstream stream(output);
+
+  if (!stream || !write_profile(stream, profiles[0])) {
+    std::cerr << "Could not write " << output << std::endl;
+    return 1;
+  }
+
+  return 0;
+}
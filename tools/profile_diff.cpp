@@ -0,0 +1,387 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#include <algorithm>
+#include <iterator>
+#include <cmath>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <nlohmann/json.hpp>
+#include "profile_diff.hpp"
+
+PathTable::PathTable() {
+  this->paths.push_back({ NONE, NONE, 0 });
+}
+
+uint32_t PathTable::child(uint32_t parent, std::string_view name) {
+  uint32_t name_id = this->names.intern(name);
+  uint64_t key = ((uint64_t)parent << 32) | name_id;
+  auto found = this->children.find(key);
+
+  if (found != this->children.end()) {
+    return found->second;
+  }
+
+  uint32_t index = this->paths.size();
+  this->paths.push_back({ name_id, parent, 0 });
+  this->children.emplace(key, index);
+  return index;
+}
+
+std::vector<std::string_view> PathTable::names_of(uint32_t path) const {
+  std::vector<std::string_view> result;
+
+  for (uint32_t i = path; i != 0; i = this->paths[i].parent) {
+    result.push_back(this->names.name(this->paths[i].name));
+  }
+
+  std::reverse(result.begin(), result.end());
+  return result;
+}
+
+// SAX handler filling a PathTable from a regions.json file. Everything
+// but the names and lengths of the nodes of "data" is skipped.
+class ProfileReader : public nlohmann::json_sax<nlohmann::json> {
+public:
+  ProfileReader(PathTable &table) : table(table) {
+    this->next = { SKIP, PathTable::NONE };
+    this->length_of = PathTable::NONE;
+  }
+
+  bool null() override {
+    return this->value();
+  }
+
+  bool boolean(bool) override {
+    return this->value();
+  }
+
+  bool number_integer(number_integer_t value) override {
+    return value < 0 ? this->value() :
+      this->number_unsigned((number_unsigned_t)value);
+  }
+
+  bool number_unsigned(number_unsigned_t value) override {
+    if (this->length_of != PathTable::NONE) {
+      this->table.paths[this->length_of].length = value;
+    }
+
+    return this->value();
+  }
+
+  bool number_float(number_float_t, const string_t &) override {
+    return this->value();
+  }
+
+  bool string(string_t &) override {
+    return this->value();
+  }
+
+  bool binary(binary_t &) override {
+    return this->value();
+  }
+
+  bool start_object(std::size_t) override {
+    this->frames.push_back(this->frames.empty() ? Frame{ TOP, 0 } : this->next);
+    this->next = { SKIP, PathTable::NONE };
+    return true;
+  }
+
+  bool key(string_t &key) override {
+    const Frame &frame = this->frames.back();
+    this->next = { SKIP, PathTable::NONE };
+    this->length_of = PathTable::NONE;
+
+    switch (frame.kind) {
+    case TOP:
+      this->next = { REGION, this->table.child(0, key) };
+      break;
+
+    case REGION:
+      if (key == "data") {
+        this->next = { CHILDREN, frame.path };
+      }
+      break;
+
+    case CHILDREN:
+      this->next = { NODE, this->table.child(frame.path, key) };
+      break;
+
+    case NODE:
+      if (key == "children") {
+        this->next = { CHILDREN, frame.path };
+      } else if (key == "length") {
+        this->length_of = frame.path;
+      }
+      break;
+
+    case SKIP:
+      break;
+    }
+
+    return true;
+  }
+
+  bool end_object() override {
+    this->frames.pop_back();
+    return true;
+  }
+
+  bool start_array(std::size_t) override {
+    this->frames.push_back({ SKIP, PathTable::NONE });
+    this->length_of = PathTable::NONE;
+    return true;
+  }
+
+  bool end_array() override {
+    this->frames.pop_back();
+    return true;
+  }
+
+  bool parse_error(std::size_t, const std::string &,
+                   const nlohmann::detail::exception &e) override {
+    this->error = e.what();
+    return false;
+  }
+
+  std::string error;
+
+private:
+  enum Kind { TOP, REGION, CHILDREN, NODE, SKIP };
+
+  typedef struct Frame {
+    Kind kind;
+    uint32_t path;
+  } Frame;
+
+  bool value() {
+    this->length_of = PathTable::NONE;
+    return true;
+  }
+
+  PathTable &table;
+  std::vector<Frame> frames;
+
+  // What the object after the last key is.
+  Frame next;
+
+  // Path whose length is the next value, or PathTable::NONE.
+  uint32_t length_of;
+};
+
+// Input iterator over the bytes of a file, which is read in chunks of
+// CHUNK_SIZE bytes as the iterator moves. An iterator without a file
+// is the end iterator.
+class ChunkIterator {
+public:
+  using iterator_category = std::input_iterator_tag;
+  using value_type = char;
+  using difference_type = std::ptrdiff_t;
+  using pointer = const char *;
+  using reference = const char &;
+
+  typedef struct File {
+    int fd;
+    std::vector<char> buffer;
+    const char *position;
+    const char *end;
+
+    // errno of a failed read, or 0.
+    int error;
+  } File;
+
+  static constexpr std::size_t CHUNK_SIZE = 1 << 20;
+
+  ChunkIterator() : file(nullptr) { }
+
+  explicit ChunkIterator(File &file) : file(&file) {
+    file.buffer.resize(CHUNK_SIZE);
+    file.error = 0;
+    this->fill();
+  }
+
+  const char &operator*() const {
+    return *this->file->position;
+  }
+
+  ChunkIterator &operator++() {
+    if (++this->file->position == this->file->end) {
+      this->fill();
+    }
+
+    return *this;
+  }
+
+  bool operator==(const ChunkIterator &other) const {
+    return this->at_end() == other.at_end();
+  }
+
+private:
+  bool at_end() const {
+    return !this->file || this->file->position == this->file->end;
+  }
+
+  void fill() {
+    ssize_t size;
+
+    do {
+      size = read(this->file->fd, this->file->buffer.data(), CHUNK_SIZE);
+    } while (size == -1 && errno == EINTR);
+
+    if (size == -1) {
+      this->file->error = errno;
+      size = 0;
+    }
+
+    this->file->position = this->file->buffer.data();
+    this->file->end = this->file->position + size;
+  }
+
+  File *file;
+};
+
+// Adds the lengths of the top-level calls of every region to the
+// length of the region.
+static void sum_regions(PathTable &table) {
+  for (auto &node : table.paths) {
+    if (node.parent != PathTable::NONE && node.parent != 0 &&
+        table.paths[node.parent].parent == 0) {
+      table.paths[node.parent].length += node.length;
+    }
+  }
+}
+
+bool read_profile(const std::string &path, PathTable &table,
+                  std::string &error) {
+  ChunkIterator::File file;
+  file.fd = open(path.c_str(), O_RDONLY);
+
+  if (file.fd == -1) {
+    error = "Could not open " + path + ": " + std::strerror(errno);
+    return false;
+  }
+
+  ProfileReader reader(table);
+  bool success = nlohmann::json::sax_parse(ChunkIterator(file),
+                                           ChunkIterator(), &reader);
+  close(file.fd);
+
+  if (file.error != 0) {
+    error = "Could not read " + path + ": " + std::strerror(file.error);
+    return false;
+  } else if (!success) {
+    error = "Could not read " + path + ": " + reader.error;
+    return false;
+  }
+
+  sum_regions(table);
+  return true;
+}
+
+bool parse_profile(std::string_view json, PathTable &table,
+                   std::string &error) {
+  ProfileReader reader(table);
+
+  if (!nlohmann::json::sax_parse(json.begin(), json.end(), &reader)) {
+    error = reader.error;
+    return false;
+  }
+
+  sum_regions(table);
+  return true;
+}
+
+// Mean and sample variance of the length of a path over some runs,
+// with runs not having the path counted as 0.
+typedef struct Sample {
+  double mean;
+  double variance;
+} Sample;
+
+static Sample sample(const std::vector<std::vector<unsigned long long> > &lengths,
+                     std::size_t first, std::size_t last, uint32_t path) {
+  double sum = 0;
+
+  for (std::size_t i = first; i < last; i++) {
+    sum += path < lengths[i].size() ? lengths[i][path] : 0;
+  }
+
+  double mean = sum / (last - first);
+  double squares = 0;
+
+  for (std::size_t i = first; i < last; i++) {
+    double length = path < lengths[i].size() ? lengths[i][path] : 0;
+    squares += (length - mean) * (length - mean);
+  }
+
+  return { mean, last - first < 2 ? 0 : squares / (last - first - 1) };
+}
+
+Diff compare_profiles(std::vector<PathTable> &tables,
+                      std::size_t baseline_count,
+                      const DiffOptions &options) {
+  Diff diff;
+  diff.regressions = 0;
+  diff.improvements = 0;
+  diff.over_budget = 0;
+
+  // Length of path j in run i is lengths[i][j] (or 0 past the end).
+  PathTable &paths = diff.paths;
+  std::vector<std::vector<unsigned long long> > lengths(tables.size());
+
+  for (std::size_t i = 0; i < tables.size(); i++) {
+    std::vector<uint32_t> index(tables[i].paths.size());
+    index[0] = 0;
+
+    for (uint32_t j = 1; j < tables[i].paths.size(); j++) {
+      const PathTable::Path &path = tables[i].paths[j];
+      index[j] = paths.child(index[path.parent],
+                             tables[i].names.name(path.name));
+
+      if (index[j] >= lengths[i].size()) {
+        lengths[i].resize(index[j] + 1);
+      }
+
+      lengths[i][index[j]] = path.length;
+    }
+
+    tables[i] = PathTable();
+  }
+
+  for (uint32_t i = 1; i < paths.paths.size(); i++) {
+    Sample baseline = sample(lengths, 0, baseline_count, i);
+    Sample candidate = sample(lengths, baseline_count, tables.size(), i);
+    double noise = options.sigmas *
+      std::sqrt(baseline.variance / baseline_count +
+                candidate.variance / (tables.size() - baseline_count));
+    double change = candidate.mean - baseline.mean;
+
+    if (std::abs(change) <= noise || std::abs(change) < options.min_change ||
+        change == 0) {
+      continue;
+    }
+
+    diff.changes.push_back({ i, baseline.mean, candidate.mean, noise });
+
+    if (change > 0) {
+      diff.regressions++;
+
+      if (options.budget >= 0 &&
+          change > baseline.mean * options.budget / 100) {
+        diff.over_budget++;
+      }
+    } else {
+      diff.improvements++;
+    }
+  }
+
+  std::sort(diff.changes.begin(), diff.changes.end(),
+            [](const Change &a, const Change &b) {
+    return std::abs(a.candidate - a.baseline) >
+      std::abs(b.candidate - b.baseline);
+  });
+
+  return diff;
+}
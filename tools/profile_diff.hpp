@@ -0,0 +1,89 @@
+// SPDX-FileCopyrightText: 2025 CERN
+// SPDX-License-Identifier: GPL-3.0-or-later
+
+#ifndef NVGPU_PROFILE_DIFF_HPP
+#define NVGPU_PROFILE_DIFF_HPP
+
+#include <string>
+#include <string_view>
+#include <vector>
+#include <unordered_map>
+#include <cstdint>
+#include "call_tree.hpp"
+
+// Call paths with their lengths, with regions as the children of
+// the root (index 0) and the length of a region being the total
+// length of its top-level calls.
+class PathTable {
+public:
+  static constexpr uint32_t NONE = (uint32_t)-1;
+
+  typedef struct Path {
+    uint32_t name;
+    uint32_t parent;
+    unsigned long long length;
+  } Path;
+
+  PathTable();
+  uint32_t child(uint32_t parent, std::string_view name);
+
+  // Names of the nodes from the region of "path" down to "path".
+  std::vector<std::string_view> names_of(uint32_t path) const;
+
+  NameTable names;
+  std::vector<Path> paths;
+
+private:
+  std::unordered_map<uint64_t, uint32_t> children;
+};
+
+// Reads a regions.json file into "table". Returns false on error, with
+// the reason in "error".
+bool read_profile(const std::string &path, PathTable &table,
+                  std::string &error);
+
+// Same as read_profile(), but from a string holding the whole file.
+bool parse_profile(std::string_view json, PathTable &table,
+                   std::string &error);
+
+typedef struct DiffOptions {
+  // Budget in percent, or a negative number for no budget.
+  double budget;
+
+  // Changes must be larger than this many standard errors of the
+  // difference of the means.
+  double sigmas;
+
+  // Changes must be at least this many nanoseconds.
+  double min_change;
+} DiffOptions;
+
+typedef struct Change {
+  uint32_t path;
+  double baseline;
+  double candidate;
+
+  // Change below which it cannot be told apart from noise.
+  double noise;
+} Change;
+
+typedef struct Diff {
+  // Paths of all runs, which "changes" refer to.
+  PathTable paths;
+
+  // Changes sorted from the largest to the smallest in absolute terms.
+  std::vector<Change> changes;
+
+  std::size_t regressions;
+  std::size_t improvements;
+  std::size_t over_budget;
+} Diff;
+
+// Compares the runs of tables[0, baseline_count) against the rest,
+// with a path missing from a run counted as 0. The tables are
+// emptied along the way.
+Diff compare_profiles(std::vector<PathTable> &tables,
+                      std::size_t baseline_count,
+                      const DiffOptions &options);
+
+#endif